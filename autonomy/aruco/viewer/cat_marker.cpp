@@ -1,5 +1,6 @@
 /**
- Repeatedly dump the data in the marker.bin file.
+ Repeatedly dump the camera location, from the viewer's shared memory
+ (or from a marker.bin file, if you give its path).
 */
 #include <fstream>
 #include <iostream>
@@ -7,14 +8,14 @@
 #include "location_binary.h"
 
 int main(int argc,char *argv[]) {
-	const char *path="marker.bin";
+	const char *path=NULL; // NULL means shared memory
 	bool always=false;
-	if (argc>1) path=argv[1];
+	if (argc>1 && 0!=strcmp(argv[1],"-")) path=argv[1]; // "-" for shared memory
 	if (argc>2) always=true;
 	location_reader reader;
 	while (true) {
 		location_binary bin;
-		if (reader.updated(path,bin)) {
+		if (path?reader.updated(path,bin):reader.updated(bin)) {
 			if (always || bin.valid) 
 			printf("Marker %d: Camera %.3f %.3f %.3f meters, heading %.1f degrees, %d vidcap\n",
 				bin.marker_ID, bin.x,bin.y,bin.z,bin.angle,bin.vidcap_count
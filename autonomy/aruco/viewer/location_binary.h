@@ -33,12 +33,127 @@ public:
 };
 
 /**
-  Reads binary location file
+  Shared-memory block holding the latest location.
+  The writer bumps seq to odd before changing bin, and back to
+  even afterwards (a seqlock), so readers never block the writer
+  and can detect and retry a torn read.
+*/
+#include <string.h>
+#include <atomic>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h> /* for O_* flags */
+#include <sys/mman.h> /* for shm_open and mmap */
+#include <sys/stat.h> /* for fstat */
+#include <unistd.h> /* for ftruncate and close */
+#define LOCATION_SHARED_OK 1
+#endif
+
+#define LOCATION_SHARED_NAME "/aurora_marker" /* default shared memory name */
+#define LOCATION_SHARED_MAGIC "AUMARK1"
+
+struct location_shared_block {
+	std::atomic<uint64_t> magic; // LOCATION_SHARED_MAGIC once the writer has set up the block
+	uint32_t bytes; // sizeof(location_binary), to detect mismatched builds
+	std::atomic<uint32_t> seq; // odd while the writer is changing bin
+	location_binary bin;
+};
+
+/* LOCATION_SHARED_MAGIC as the 64-bit value stored in the block */
+inline uint64_t location_shared_magic(void) {
+	uint64_t m=0;
+	memcpy(&m,LOCATION_SHARED_MAGIC,sizeof(m));
+	return m;
+}
+
+/* Map the shared memory block with this name, or return NULL.
+   If create is true, makes the block (writer side). */
+inline location_shared_block *location_shared_map(const char *name,bool create) {
+#ifdef LOCATION_SHARED_OK
+	int fd=shm_open(name,create?(O_RDWR|O_CREAT):O_RDWR,0666);
+	if (fd<0) return NULL;
+	if (create && ftruncate(fd,sizeof(location_shared_block))!=0) {
+		close(fd);
+		return NULL;
+	}
+	struct stat st;
+	if (!create && (fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(location_shared_block))) {
+		close(fd); // writer hasn't sized it yet
+		return NULL;
+	}
+	void *p=mmap(0,sizeof(location_shared_block),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd); // mapping stays valid
+	if (p==MAP_FAILED) return NULL;
+	location_shared_block *blk=(location_shared_block *)p;
+	if (create) {
+		// A crashed writer can leave seq odd, which would stall readers
+		//  forever: restart it, and only then mark the block ready.
+		blk->magic.store(0,std::memory_order_relaxed);
+		blk->bytes=sizeof(location_binary);
+		blk->seq.store(0,std::memory_order_relaxed);
+		blk->magic.store(location_shared_magic(),std::memory_order_release);
+	}
+	else if (blk->magic.load(std::memory_order_acquire)!=location_shared_magic()
+		|| blk->bytes!=sizeof(location_binary))
+	{ // writer hasn't set it up yet (or is a different build)
+		munmap(p,sizeof(location_shared_block));
+		return NULL;
+	}
+	return blk;
+#else
+	return NULL;
+#endif
+}
+
+/**
+  Publishes locations to shared memory, with no system calls per update.
+*/
+class location_publisher {
+	location_shared_block *blk;
+public:
+	location_publisher(const char *name=LOCATION_SHARED_NAME) {
+		blk=location_shared_map(name,true);
+		if (blk==NULL) printf("Error creating shared memory location %s\n",name);
+	}
+	bool ok(void) const { return blk!=NULL; }
+
+	void publish(const location_binary &bin) {
+		if (!blk) return;
+		uint32_t s=blk->seq.load(std::memory_order_relaxed);
+		blk->seq.store(s+1,std::memory_order_relaxed); // odd: write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy((void *)&blk->bin,&bin,sizeof(bin));
+		blk->seq.store(s+2,std::memory_order_release); // even: done
+	}
+};
+
+/**
+  Reads the latest location, from shared memory or a binary file.
 */
 class location_reader {
 	location_binary bin;
+	location_shared_block *blk;
+	const char *shared_name;
 public:
-	location_reader() {bin.count=0;}
+	location_reader(const char *shared_name_=LOCATION_SHARED_NAME)
+		:blk(NULL), shared_name(shared_name_) {bin.count=0;}
+	
+	/** Return true if the shared memory location has been updated. */
+	bool updated(location_binary &bin_out) {
+		if (blk==NULL) { // writer may not have started yet
+			blk=location_shared_map(shared_name,false);
+			if (blk==NULL) return false;
+		}
+		location_binary bin_new;
+		for (int tries=0;;tries++) {
+			if (tries>=100) return false; // writer stuck mid-update?
+			uint32_t s0=blk->seq.load(std::memory_order_acquire);
+			if (s0&1) continue; // write in progress
+			memcpy(&bin_new,(const void *)&blk->bin,sizeof(bin_new));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (blk->seq.load(std::memory_order_relaxed)==s0) break; // consistent
+		}
+		return changed(bin_new,bin_out);
+	}
 	
 	/** Return true if the file at this path has been updated. */
 	bool updated(const char *bin_path,location_binary &bin_out) {
@@ -48,9 +163,15 @@ public:
 		} 
 		location_binary bin_new;
 		if (fread(&bin_new,sizeof(bin_new),1,fbin)<=0) { // atomic(?) file read
+			fclose(fbin);
 			return false;
 		}
 		fclose(fbin);
+		return changed(bin_new,bin_out);
+	}
+
+private:
+	bool changed(const location_binary &bin_new,location_binary &bin_out) {
 		if (bin_new.count!=bin.count) {
 			bin=bin_new;
 			bin_out=bin;
@@ -61,4 +182,3 @@ public:
 };
 
 #endif
-
@@ -2,8 +2,10 @@
 Dr. Lawlor's modified ArUco marker detector:
 	- Finds marker 16 in the webcam image
 	- Reconstructs the camera's location relative to the marker
-	- Writes the camera location and orientation to "marker.bin"
+	- Publishes the camera location and orientation to shared memory
+	  (and optionally "marker.bin", with -file)
 	- Periodically saves an image to vidcap.jpg and vidcaps/<date>.jpg
+	  (with -vidcap N), from a separate low-priority thread
 
 
 ArUco example Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
@@ -149,6 +151,77 @@ extern "C" void perror(const char *str) {
 }
 
 #include "location_binary.h"
+#include "../../realsense/beacon_pipeline.h" /* for stale_queue */
+#include <thread>
+#include <sys/stat.h> /* for mkdir */
+#ifdef __linux__
+#include <sys/resource.h> /* for setpriority */
+#include <sys/syscall.h> /* for gettid */
+#endif
+
+
+/**
+  Writes annotated camera images to disk on its own thread,
+  so the detection loop never waits on JPEG encoding or the disk.
+  If the disk falls behind, older images are dropped.
+*/
+class image_dump_thread {
+	stale_queue<cv::Mat> images;
+	std::atomic<bool> quit;
+	std::thread thread;
+public:
+	std::atomic<uint32_t> count; // images written so far
+	
+	image_dump_thread() :images(1), quit(false), count(0) {
+		mkdir("vidcaps",0777); // fails harmlessly if it exists
+		thread=std::thread(&image_dump_thread::run,this);
+	}
+	~image_dump_thread() {
+		quit=true;
+		thread.join();
+	}
+	
+	// Queue this image to be written (the caller must not modify it afterwards)
+	void dump(const cv::Mat &img) { images.push(img); }
+
+private:
+	void run(void) {
+#ifdef __linux__
+		setpriority(PRIO_PROCESS,syscall(SYS_gettid),19); // lowest priority thread
+#endif
+		std::vector<int> params;
+		params.push_back(CV_IMWRITE_JPEG_QUALITY);
+		params.push_back(30); // <- low quality, save disk space and network bandwidth
+		std::vector<unsigned char> jpeg;
+		cv::Mat img;
+		while (!quit) {
+			if (!images.pop(img)) continue;
+			cv::imencode(".jpg",img,jpeg,params); // encode once, write twice
+			
+			if (write_file("vidcap_next.jpg",jpeg))
+				rename("vidcap_next.jpg","vidcap.jpg"); // atomic file replace
+			
+			// Telemetry log, named like date '+%F__%H_%M_%S__%N'
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME,&ts);
+			struct tm t;
+			localtime_r(&ts.tv_sec,&t);
+			char name[100];
+			size_t len=strftime(name,sizeof(name),"vidcaps/%F__%H_%M_%S__",&t);
+			snprintf(name+len,sizeof(name)-len,"%09ld.jpg",(long)ts.tv_nsec);
+			write_file(name,jpeg);
+			count++;
+		}
+	}
+	
+	static bool write_file(const char *name,const std::vector<unsigned char> &data) {
+		FILE *f=fopen(name,"wb");
+		if (f==NULL) return false;
+		bool ok=data.size()==fwrite(&data[0],1,data.size(),f);
+		if (fclose(f)!=0) ok=false;
+		return ok;
+	}
+};
 
 
 /**
@@ -395,6 +468,8 @@ int main(int argc,char **argv)
 	pair<double,double> AvrgTime(0,0) ;//determines the average time required for detection
 	int skipCount=1; // only process frames ==0 mod this
 	int skipPhase=0;
+	int vidcapCount=0; // save a vidcap every this many processed frames (0 for never)
+	bool writeFile=false; // also write marker.bin, for old readers
 
 	int wid=640, ht=480;
 	const char *dictionary="TAG25h9";
@@ -406,6 +481,8 @@ int main(int argc,char **argv)
 		else if (0==strcmp(argv[argi],"-sz")) sscanf(argv[++argi],"%dx%d",&wid,&ht);
 		else if (0==strcmp(argv[argi],"-skip")) sscanf(argv[++argi],"%d",&skipCount);
 		else if (0==strcmp(argv[argi],"-min")) sscanf(argv[++argi],"%f",&minSize);
+		else if (0==strcmp(argv[argi],"-vidcap")) sscanf(argv[++argi],"%d",&vidcapCount);
+		else if (0==strcmp(argv[argi],"-file")) writeFile=true;
 		else printf("Unrecognized argument %s\n",argv[argi]);
 	}
 
@@ -450,7 +527,9 @@ int main(int argc,char **argv)
 	signal(SIGINT,quit_signal_handler); // listen for ctrl-C
 #endif
 	unsigned int framecount=0;
-	uint32_t vidcap_count=0;
+	location_publisher publisher;
+	image_dump_thread *dumper=0;
+	if (vidcapCount>0) dumper=new image_dump_thread;
 
 	//capture until press ESC or until the end of the video
 	while (vidcap.grab()) {
@@ -503,23 +582,27 @@ int main(int argc,char **argv)
 			refine_parallax(bin);
 		}
 
-		// Dump to disk		
+		// Publish to shared memory
 		static uint32_t bin_count=0;
 		bin.count=bin_count++;
-		bin.vidcap_count=vidcap_count;
-		FILE *fbin=fopen("marker.bin","rb+"); // "r" mode avoids file truncation
-		if (fbin==NULL) { // file doesn't exist (yet)
-			fbin=fopen("marker.bin","w"); // create the file
-			if (fbin==NULL) { // 
-				printf("Error creating marker.bin output file (disk full?  permissions?)");
-				exit(1);
-			}
-		} 
-		fwrite(&bin,sizeof(bin),1,fbin); // atomic(?) file write
-		fclose(fbin);
+		bin.vidcap_count=dumper?dumper->count.load():0;
+		publisher.publish(bin);
+		
+		if (writeFile) { // Dump to disk
+			FILE *fbin=fopen("marker.bin","rb+"); // "r" mode avoids file truncation
+			if (fbin==NULL) { // file doesn't exist (yet)
+				fbin=fopen("marker.bin","w"); // create the file
+				if (fbin==NULL) { // 
+					printf("Error creating marker.bin output file (disk full?  permissions?)");
+					exit(1);
+				}
+			} 
+			fwrite(&bin,sizeof(bin),1,fbin); // atomic(?) file write
+			fclose(fbin);
+		}
 
 		bool vidcap=false;
-		// if ((framecount++%32) == 0) vidcap=true;
+		if (dumper && (framecount++%vidcapCount) == 0) vidcap=true;
 		if (showGUI || vidcap) {
 			//print marker info and draw the markers in image
 			TheInputImage.copyTo(TheInputImageCopy);
@@ -545,15 +628,12 @@ int main(int argc,char **argv)
 				}
 			}
 
-			if (vidcap) { // write to disk
-				std::vector<int> params;
-				params.push_back(CV_IMWRITE_JPEG_QUALITY);
-				params.push_back(30); // <- low quality, save disk space and network bandwidth
-				cv::imwrite("vidcap_next.jpg",TheInputImageCopy,params); // dump JPEG
-				int ignore;
-				ignore=system("mv -f vidcap_next.jpg vidcap.jpg"); // atomic(?) file replace
-				ignore=system("cp vidcap.jpg vidcaps/`date '+%F__%H_%M_%S__%N'`.jpg"); // telemetry log
-				vidcap_count++;
+			if (vidcap) { // hand off to be written to disk
+				if (showGUI) dumper->dump(TheInputImageCopy.clone());
+				else {
+					dumper->dump(TheInputImageCopy);
+					TheInputImageCopy=Mat(); // dumper owns that image now
+				}
 			}
 		}
 		if (showGUI) {
@@ -10,6 +10,8 @@
 #include <cmath>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "gridnav/gridnav_RMC.h"
 
@@ -37,6 +39,7 @@
 // New vive localization
 #include "osl/transform.h"
 #include "osl/file_ipc.h"
+#include "bitgrid_RMC.h" /* kinect obstacle grids */
 
 
 #include "aurora/simulator.h"
@@ -48,6 +51,10 @@ using osl::quadric;
 bool show_GUI=true;
 bool simulate_only=false; // --sim flag
 bool should_plan_paths=true; // --noplan flag
+bool plan_lattice=false; // --lattice flag: plan with arc motion primitives
+long plan_budget_us=5000; // --plan_budget flag: microseconds of planner-thread search per path update (0: plan to completion on the control thread)
+bool plan_fields=true; // --nofields flag: don't follow cost-to-go fields to fixed targets
+const char *nav_cache_file="gridnav_cache.bin"; // --nocache flag: always rebuild the navigator at startup
 bool driver_test=false; // --driver_test, path planning testing
 
 bool nodrive=false; // --nodrive flag (for testing indoors)
@@ -119,6 +126,115 @@ public:
 };
 
 
+/**
+  Runs the anytime path planner on its own thread, so a long search
+  (or carrying a big one over as the robot moves) never holds up the
+  control loop.  The control loop posts where it is and where it's
+  going each update, and drives the newest path found.
+*/
+class robot_plan_thread {
+public:
+  typedef rmc_navigator::navigator_t::map_ptr map_ptr;
+  typedef rmc_navigator::navigator_t::drive_t drive_t;
+  
+  // The newest path planned
+  class result_t {
+  public:
+    rmc_navigator::fposition target; // target this path leads to
+    bool valid=false; // path reaches the target
+    bool exhausted=false; // no path: the search ran out of options
+    size_t searched=0; // cells expanded since the search started
+    double epsilon=0.0; // heuristic weight of the search
+    double bound=0.0; // path cost is within this factor of the best path
+    std::deque<rmc_navigator::searchposition> path; // steps from the start posted
+  };
+  
+  robot_plan_thread() :quit(false), pending(false), have_result(false)
+  {
+    worker=std::thread(&robot_plan_thread::run,this);
+  }
+  ~robot_plan_thread() { stop(); }
+  
+  // Stop planning and join the thread (safe to call twice)
+  void stop() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      quit=true;
+      wake.notify_one();
+    }
+    if (worker.joinable()) worker.join();
+  }
+  
+  // Plan from start to target on this map, for about budget_us each round.
+  //   Replaces any earlier request.  (control thread)
+  void request(const map_ptr &map,const rmc_navigator::fposition &start,const rmc_navigator::fposition &target,
+    const drive_t &last_drive,bool lattice,long budget_us)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    req.map=map; req.start=start; req.target=target;
+    req.last_drive=last_drive; req.lattice=lattice; req.budget_us=budget_us;
+    pending=true;
+    wake.notify_one();
+  }
+  
+  // Copy out the newest result, if it's for this target.  (control thread)
+  //   The path may start a few updates back, where the robot was when it was posted.
+  bool get(const rmc_navigator::fposition &target,result_t &r) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!have_result || !(rmc_navigator::navigator_t::gridposition(result.target)==rmc_navigator::navigator_t::gridposition(target)))
+      return false;
+    r=result;
+    return true;
+  }
+  
+private:
+  class request_t {
+  public:
+    map_ptr map;
+    rmc_navigator::fposition start, target;
+    drive_t last_drive;
+    bool lattice=false;
+    long budget_us=0;
+  };
+  
+  rmc_navigator::anytime_planner anytime; // keeps its search between rounds (planner thread only)
+  
+  std::mutex lock; // protects everything below
+  std::condition_variable wake;
+  bool quit;
+  bool pending; // req hasn't been started yet
+  request_t req;
+  bool have_result;
+  result_t result;
+  std::thread worker;
+  
+  // Planner thread: plan the newest request, publish, repeat
+  void run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!quit) {
+      if (!pending) { wake.wait(guard); continue; }
+      request_t r=req;
+      pending=false;
+      guard.unlock();
+      
+      anytime.options=rmc_navigator::navigator_t::planner_options(r.lattice);
+      result_t out;
+      out.target=r.target;
+      out.valid=anytime.plan(r.map,r.start,r.target,r.last_drive,r.budget_us);
+      out.exhausted=anytime.exhausted() || anytime.path.empty();
+      out.searched=anytime.searched_total;
+      out.epsilon=anytime.epsilon;
+      out.bound=anytime.bound;
+      out.path=anytime.path;
+      
+      guard.lock();
+      std::swap(result,out);
+      have_result=true;
+    }
+  }
+};
+
+
 /**
  This is the autonomous path planning object.
 */
@@ -133,11 +249,28 @@ public:
   std::deque<planned_path_t> planned_path;
   rmc_navigator::navigator_t::drive_t last_drive;
   int replan_counter;
+  robot_plan_thread planner; // anytime search, off the control thread
+  rmc_navigator::goal_fields fields; // cost-to-go for the targets we keep driving to
+
+  // Bump this when the startup obstacles below change, to rebuild the navigator cache
+  enum {startup_obstacles_version=1};
 
   robot_autodriver()
+    :navigator(nav_cache_file,startup_obstacles_version),
+     fields(navigator.navigator)
   {
     flush();
+    if (navigator.cached) ROBOT_LOG(log_info,logsys_path,"Navigator loaded from cache %s",nav_cache_file);
+    else mark_startup_obstacles();
 
+    // Start computing the cost fields for our fixed targets
+    fields.add_goal(rmc_navigator::fposition(mine_target_loc.x,mine_target_loc.y,mine_target_angle));
+    fields.add_goal(rmc_navigator::fposition(dump_target_loc.x,dump_target_loc.y,dump_target_angle));
+    fields.add_goal(rmc_navigator::fposition(dump_align_loc.x,dump_align_loc.y,dump_target_angle));
+  }
+
+  // Mark the fixed field obstacles, and save the navigator cache for next time
+  void mark_startup_obstacles() {
     // Add obstacles around the scoring trough
     for (int x=field_x_trough_start;x<=field_x_trough_end;x+=navigator_res)
     for (int y=field_y_trough_start;y<=field_y_trough_end;y+=navigator_res)
@@ -163,12 +296,20 @@ public:
     }
 
     compute_proximity();
+
+    if (nav_cache_file && !navigator.save_cache())
+      ROBOT_LOG(log_warning,logsys_path,"Can't write navigator cache %s",nav_cache_file);
   }
 
   // Mark this field location as an obstacle of this height
   //  (you MUST call compute_proximity after marking obstacles)
   inline void mark_obstacle(int x,int y,int ht) { navigator.mark_obstacle(x,y,ht); }
 
+  // Mark a batch of field obstacles, and update proximity around them
+  //  (no compute_proximity needed afterwards)
+  inline void mark_obstacles(const std::vector<rmc_navigator::navigator_t::obstacle_mark> &list)
+    { navigator.mark_obstacles(list); }
+
   // Recompute proximity costs (after marking obstacles)
   void compute_proximity() {
     // Recompute proximity costs after marking obstacles
@@ -180,15 +321,16 @@ public:
   void debug_dump(const char *filename="debug_nav.txt") {
     // Debug dump obstacles, field, etc.
     std::ofstream navdebug(filename);
+    rmc_navigator::navigator_t::map_ptr map=navigator.navigator.get_map();
     navdebug<<"Raw obstacles:\n";
-    navigator.navigator.obstacles.print(navdebug,10);
+    map->obstacles.print(navdebug,10);
 
     for (int angle=0;angle<=20;angle+=10) {
       navdebug<<"\n\nAngle "<<angle<<" expanded obstacles:\n";
-      navigator.navigator.slice[angle].obstacle.print(navdebug,10);
+      map->slice[angle].obstacle.print(navdebug,10);
 
       navdebug<<"Proximity:\n";
-      navigator.navigator.slice[angle].proximity.print(navdebug,1);
+      map->slice[angle].proximity.print(navdebug,1);
     }
   }
 
@@ -224,14 +366,48 @@ public:
       rmc_navigator::fposition ftarget(target.x,target.y,target_angle);
       debug.target=ftarget;
 
-      rmc_navigator::planner plan(navigator.navigator,fstart,ftarget,last_drive,false);
+      std::deque<rmc_navigator::searchposition> path;
+      bool plan_valid=false, plan_exhausted=true, plan_anytime=false, plan_waiting=false;
+      size_t plan_searched=0;
+      robot_plan_thread::result_t planned;
+      rmc_navigator::navigator_t::field_ptr field;
+      if (plan_fields) field=fields.get(ftarget); // only our fixed targets have fields
+      if (field && field->map==navigator.navigator.get_map() && field->descend(fstart,last_drive,path))
+      { // up-to-date cost field: just walk downhill
+        plan_valid=true;
+        ROBOT_LOG(log_debug,logsys_path,"Path planning followed cost field: %d steps",(int)path.size());
+      }
+      else if (plan_budget_us>0) { // anytime search: newest path from the planner thread
+        planner.request(navigator.navigator.get_map(),fstart,ftarget,last_drive,plan_lattice,plan_budget_us);
+        if (planner.get(ftarget,planned)) {
+          plan_anytime=true;
+          plan_valid=planned.valid;
+          plan_exhausted=planned.exhausted;
+          plan_searched=planned.searched;
+          path.swap(planned.path);
+        }
+        else plan_waiting=true; // nothing planned for this target yet
+      }
+      else {
+        rmc_navigator::planner plan(navigator.navigator,fstart,ftarget,last_drive,false,
+          rmc_navigator::navigator_t::planner_options(plan_lattice));
+        plan_valid=plan.valid;
+        plan_searched=plan.searched;
+        path.swap(plan.path);
+      }
+      if (plan_waiting) { // hold still: last_drive was for the old target
+        ROBOT_LOG(log_debug,logsys_path,"Path planning started for new target, holding still for planner thread");
+        forward=turn=0.0;
+        return true;
+      }
       int steps=0;
-      for (const rmc_navigator::searchposition &p : plan.path)
+      for (const rmc_navigator::searchposition &p : path)
       {
         planned_path.push_back(p);
         if (steps<replan_length)
         {
-          p.print();
+          ROBOT_LOG(log_debug,logsys_path," Drive %.1f turn %.1f at %.0f,%.0f@%.0f cost %.3f estimate %.3f",
+            p.drive.forward,p.drive.turn,p.pos.v.x,p.pos.v.y,p.pos.get_degrees(),p.cost,p.estimate);
         }
         if (steps<robot_autonomy_state::max_path_len)
         {
@@ -242,13 +418,20 @@ public:
         steps++;
       }
 
-      printf("Planned path from %.0f,%.0f@%.0f to target %.0f,%.0f@%.0f: %d steps\n",
+      ROBOT_LOG(log_info,logsys_path,"Planned path from %.0f,%.0f@%.0f to target %.0f,%.0f@%.0f: %d steps",
           cur.x,cur.y,cur_angle,
           target.x,target.y,target_angle, steps);
-      if (!plan.valid) {
-        printf("Path planning FAILED: searched %zd cells\n",plan.searched);
+      if (!plan_valid && plan_exhausted) {
+        ROBOT_LOG(log_warning,logsys_path,"Path planning FAILED: searched %zd cells",plan_searched);
         return false;
       }
+      if (!plan_valid) {
+        ROBOT_LOG(log_warning,logsys_path,"Path planning out of time: searched %zd cells, driving partial path",plan_searched);
+      }
+      else if (plan_anytime) {
+        ROBOT_LOG(log_debug,logsys_path,"Path planning epsilon %.1f: cost within %.2fx of best, searched %zd cells",
+          planned.epsilon,planned.bound,plan_searched);
+      }
     }
     int pathslots=plan_averaging;
     for (int slot=0;slot<plan_averaging;slot++) {
@@ -273,7 +456,7 @@ public:
     {
       cycle_count+=2;
       if (cycle_count>5) {
-        printf("Path planning CYCLE DETECTED, counter %d, keeping last drive\n",
+        ROBOT_LOG(log_warning,logsys_path,"Path planning CYCLE DETECTED, counter %d, keeping last drive",
           cycle_count);
         cycle_count=0;
 
@@ -284,7 +467,7 @@ public:
         //turn=last_drive.turn;
       }
     }
-    printf("Path planning forward %.1f, turn %.1f\n",forward,turn);
+    ROBOT_LOG(log_debug,logsys_path,"Path planning forward %.1f, turn %.1f",forward,turn);
 
     // Update last_drive for next time
     if (planned_path.size()>0) last_drive=planned_path[0].drive;
@@ -293,17 +476,42 @@ public:
   }
 
   // Draw a planned path onscreen
-  void draw_path() {
-    glBegin(GL_LINE_STRIP);
+  static void draw_path(const std::deque<planned_path_t> &planned_path) {
+    static gl_vertex_batch batch(true);
+    batch.clear();
+    batch.begin(GL_LINE_STRIP);
     for (const rmc_navigator::searchposition &p : planned_path) {
-      glColor3f(0.5f+0.5f*p.drive.forward,0.5f+0.5f*p.drive.turn,0.0f);
-      glVertex2fv(p.pos.v);
+      batch.color(0.5f+0.5f*p.drive.forward,0.5f+0.5f*p.drive.turn,0.0f);
+      batch.vertex(p.pos.v);
     }
+    batch.draw();
     glColor3f(1.0f,1.0f,1.0f);
-    glEnd();
   }
 };
 
+/**
+ Everything the GUI needs to draw one frame.  The control loop
+ copies these out after each update, so the GUI can draw at its
+ own rate without touching live robot state.
+*/
+class robot_display_snapshot {
+public:
+  robot_base robot;
+  robot_localization loc; // merged robot location
+  robot_autonomy_state autonomy;
+  bool driving; // autonomous drive is running: show obstacles and path
+  
+  // Navigation grids only get copied when they change:
+  unsigned int grid_version; // incremented when the grids below change
+  rmc_navigator::navigator_t::grid2D<int> obstacles;
+  rmc_navigator::navigator_t::grid2D<int> proximity; // at the robot's angle
+  int proximity_angle; // navigator angle slice of proximity
+  std::deque<robot_autodriver::planned_path_t> path;
+  std::vector<std::string> text; // lines from robotPrintln
+  
+  robot_display_snapshot() :robot(), driving(false), grid_version(0), proximity_angle(-1) {}
+};
+
 /**
   Re-points the realsense
 */
@@ -395,6 +603,97 @@ beacon_pointing_thread_t::beacon_pointing_thread_t()
 beacon_pointing_thread_t *beacon_pointing_thread=0;
 
 
+/**
+  Runs a beacon panorama scan: starts it, then polls for results,
+  so the beacon's network round trips never hold up the control loop.
+*/
+class beacon_scan_thread_t {
+public:
+  beacon_scan_thread_t() :active(false), started(false), generation(0), angle(0), have_status(false)
+  {
+    new std::thread(&beacon_scan_thread_t::run,this);
+  }
+  
+  // Begin a fresh panorama centered on this angle (control thread)
+  void start(int angle_) {
+    std::lock_guard<std::mutex> guard(lock);
+    active=true; started=false; generation++; angle=angle_;
+    obstacles.clear(); have_status=false;
+    wake.notify_one();
+  }
+  
+  // Stop polling the beacon (control thread)
+  void stop(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    active=false; generation++;
+    wake.notify_one();
+  }
+  
+  // Move out any obstacles reported since the last call.
+  //   Returns true and fills status once the beacon has reported on this scan.
+  bool take(std::vector<aurora_detected_obstacle> &new_obstacles,aurora_panorama_status &status_out) {
+    std::lock_guard<std::mutex> guard(lock);
+    new_obstacles.swap(obstacles);
+    obstacles.clear();
+    status_out=status;
+    return have_status;
+  }
+  
+private:
+  enum {reply_timeout_ms=2000}; // give up on a beacon reply after this long
+  
+  std::mutex lock; // protects everything below
+  std::condition_variable wake;
+  bool active; // scanning: keep polling
+  bool started; // beacon accepted our panorama command
+  unsigned int generation; // bumped at each start/stop, to drop stale replies
+  int angle; // panorama center
+  bool have_status;
+  aurora_panorama_status status; // latest report
+  std::vector<aurora_detected_obstacle> obstacles; // not yet taken
+  
+  void run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      if (!active) { wake.wait(guard); continue; }
+      unsigned int gen=generation;
+      bool starting=!started;
+      int scan_angle=angle;
+      guard.unlock();
+      
+      std::vector<unsigned char> reply;
+      bool replied=send_aurora_beacon_command(
+        starting?aurora_beacon_command_panorama:aurora_beacon_command_results,
+        reply,scan_angle,reply_timeout_ms);
+      aurora_panorama_status s;
+      std::vector<aurora_detected_obstacle> seen;
+      bool parsed=replied && parse_aurora_panorama_reply(reply,s,seen);
+      
+      guard.lock();
+      if (gen!=generation) continue; // restarted or stopped meanwhile
+      double delay=0.5; // seconds until next poll
+      if (!parsed) {
+        ROBOT_LOG(log_warning,logsys_beacon,"Bad panorama reply from beacon (%d bytes)",(int)reply.size());
+        if (starting) delay=2.0; // don't hammer a beacon that isn't listening
+      }
+      else if (s.sectors_total<=0) { // beacon has no scan going (or rebooted): start over
+        ROBOT_LOG(log_warning,logsys_beacon,"Beacon has no panorama running, restarting it");
+        started=false;
+        delay=2.0;
+      }
+      else {
+        started=true;
+        status=s; have_status=true;
+        obstacles.insert(obstacles.end(),seen.begin(),seen.end());
+      }
+      wake.wait_for(guard,std::chrono::duration<double>(delay),
+        [&]{ return gen!=generation; });
+    }
+  }
+};
+beacon_scan_thread_t *beacon_scan_thread=0;
+
+
 /**
  This class represents everything the back end knows about the robot.
 */
@@ -440,11 +739,53 @@ public:
       pose_net=new pose_subscriber();
     }
     beacon_pointing_thread=new beacon_pointing_thread_t;
+    beacon_scan_thread=new beacon_scan_thread_t;
   }
 
-  // Do robot work.
+  // Do robot work, and publish a snapshot for the GUI (if asked).
   void update(void);
   
+  // Copy out the latest snapshot of robot state, for drawing.
+  //   The navigation grids are only copied if they've changed.
+  void get_snapshot(robot_display_snapshot &s) {
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    s.robot=snapshot.robot;
+    s.loc=snapshot.loc;
+    s.autonomy=snapshot.autonomy;
+    s.driving=snapshot.driving;
+    if (s.grid_version!=snapshot.grid_version) {
+      s.grid_version=snapshot.grid_version;
+      s.obstacles=snapshot.obstacles;
+      s.proximity=snapshot.proximity;
+      s.proximity_angle=snapshot.proximity_angle;
+    }
+    s.path=snapshot.path;
+    s.text=snapshot.text;
+  }
+  
+  // Hand over the GUI's keyboard state (GUI thread), for the next update.
+  void set_keys(const toggle_t keys) {
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    memcpy(gui_keys,keys,sizeof(gui_keys));
+  }
+  
+  // Draw this snapshot with OpenGL (GUI thread only)
+  void draw(const robot_display_snapshot &s) {
+    for (const std::string &line : s.text)
+      robotPrint(robotPrintf_x,robotPrintf_y,line.c_str());
+    
+    // Show real and simulated robots
+    robot_display(s.loc);
+    robot_display_autonomy(s.autonomy);
+    
+    if (s.driving) {
+      gl_draw_grids(s);
+      robot_autodriver::draw_path(s.path);
+    }
+  }
+  
+  bool publish_snapshots=false; // set to have update keep a GUI snapshot
+  
   
   void point_beacon(int target) {
     if (simulate_only) {
@@ -459,27 +800,39 @@ public:
 
 private:
 
-  /* Use OpenGL to draw this robot navigation grid object */
-  template <class grid_t>
-  void gl_draw_grid(grid_t grid)
+  // Latest state for the GUI (and keys from it), guarded by snapshot_lock
+  std::mutex snapshot_lock;
+  robot_display_snapshot snapshot;
+  toggle_t gui_keys={0}; // oglKeyMap as of the last GUI frame
+  std::vector<std::string> update_text; // robotPrintln lines from this update
+  bool update_driving; // autonomous_drive ran during this update
+  bool update_path_OK; // path planning worked during this update
+  unsigned int snapshot_nav_version=0; // navigator version in snapshot grids
+  
+  // Do the actual robot work
+  void update_control(void);
+
+  /* Use OpenGL to draw the snapshot's navigation grids.
+     The textures are only re-uploaded when the grids change. */
+  void gl_draw_grids(const robot_display_snapshot &s)
   {
-    glPointSize(4.0f);
-    glBegin(GL_POINTS);
-    for (int y=0;y<rmc_navigator::GRIDY;y++)
-    for (int x=0;x<rmc_navigator::GRIDX;x++)
-    {
-      int height=grid.at(x,y);
-      if (height>0) {
-        if (height>50) glColor3f(0.0f,1.0f,1.0f); // cyan trough / walls
-        else if (height<15) glColor3f(1.0f,0.5f,1.0f); // purple very short
-        else if (height<20) glColor3f(1.0f,0.0f,0.0f); // red short-ish
-        else  glColor3f(1.0f,1.0f,1.0f); // white tall
-        glVertex2f(
-          rmc_navigator::GRIDSIZE*x,
-          rmc_navigator::GRIDSIZE*y);
-      }
-    }
-    glEnd();
+    static gl_grid_texture proximity, obstacles;
+    proximity.update(s.proximity,rmc_navigator::GRIDX,rmc_navigator::GRIDY,
+      s.grid_version,[](int prox,unsigned char *rgba) {
+        rgba[0]=255; rgba[1]=128; rgba[2]=0; // orange haze near obstacles
+        rgba[3]=std::min(prox*24,160);
+      });
+    obstacles.update(s.obstacles,rmc_navigator::GRIDX,rmc_navigator::GRIDY,
+      s.grid_version,[](int height,unsigned char *rgba) {
+        rgba[0]=rgba[1]=rgba[2]=255; rgba[3]=255;
+        if (height<=0) rgba[3]=0; // empty
+        else if (height>50) rgba[0]=0; // cyan trough / walls
+        else if (height<15) rgba[1]=128; // purple very short
+        else if (height<20) rgba[1]=rgba[2]=0; // red short-ish
+        // else white tall
+      });
+    proximity.draw(rmc_navigator::GRIDSIZE);
+    obstacles.draw(rmc_navigator::GRIDSIZE);
   }
 
   // Autonomy support:
@@ -495,6 +848,23 @@ private:
 
   robot_state_t last_state;
 
+  // Beacon panorama progress during state_scan_obstacles
+  bool scan_started=false; // panorama handed to beacon_scan_thread
+  std::vector<aurora_detected_obstacle> scan_obstacles; // everything seen this scan
+
+  // Clear the progress kept by this state, before (re)entering it
+  void reset_state_data(robot_state_t new_state)
+  {
+    if (new_state==state_scan_obstacles) { // start a fresh panorama
+      scan_started=false;
+      scan_obstacles.clear();
+    }
+    else if (scan_started) { // leaving the scan: stop polling the beacon
+      beacon_scan_thread->stop();
+      scan_started=false;
+    }
+  }
+
   // Enter a new state (semi)autonomously
   void enter_state(robot_state_t new_state)
   {
@@ -502,6 +872,7 @@ private:
     autodriver.flush();
 
     if (new_state==state_setup_raise) { autonomy_start_time=cur_time; }
+    reset_state_data(new_state);
     // if(!(robot.autonomous)) { new_state=state_drive; }
 
     // Log state timings to dedicate state timing file:
@@ -615,7 +986,7 @@ private:
     vec2 cur(locator.merged.x,locator.merged.y); // robot location
     float cur_angle=locator.merged.angle; 
 
-    gl_draw_grid(autodriver.navigator.navigator.obstacles);
+    update_driving=true; // GUI shows obstacles and path
 
     if (!simulate_only && fmod(cur_time,3.0)<2.0) {
       return false; // periodic stop (for safety, and for re-localization)
@@ -632,11 +1003,11 @@ private:
     double forward=0.0; // forward-backward
     double turn=0.0; // left-right
     if (should_plan_paths)
-    { //<- fixme: move path planning to dedicated thread, to avoid blocking
+    { // anytime path planning runs on autodriver.planner's thread; cost fields on goal_fields'
       path_planning_OK=autodriver.autodrive(
         cur,cur_angle,target,target_angle,
         forward,turn, telemetry.autonomy);
-      if (path_planning_OK) autodriver.draw_path();
+      update_path_OK=path_planning_OK;
     }
     if (!path_planning_OK)
     {
@@ -648,7 +1019,7 @@ private:
 
       turn=orient.x*should.y-orient.y*should.x; // cross product (sin of angle)
       forward=-dot(orient,should); // dot product (like distance)
-      printf("Path planning FAILURE: manual greedy mode %.0f,%.0f\n", forward,turn);
+      ROBOT_LOG(log_warning,logsys_path,"Path planning FAILURE: manual greedy mode %.0f,%.0f", forward,turn);
     }
     set_drive_powers(forward,turn);
 
@@ -782,30 +1153,35 @@ void robot_manager_t::autonomous_state()
   //state_scan_obstacles: Scan for obstacles
   else if (robot.state==state_scan_obstacles)
   {
-    int scan_angle=45;
-    if (time_in_state<10.0) { // line up the beacon correctly
-      point_beacon(scan_angle);
+    int scan_angle=45; // center of panorama
+    
+    // Beacon sweeps several angles, and hands back obstacles as each one finishes.
+    //   beacon_scan_thread does the talking, so we never wait on the network here.
+    if (!scan_started) {
+      beacon_scan_thread->start(scan_angle);
+      scan_started=true;
     }
-    else 
-    { // really do the scan (blocking)
-      std::vector<aurora_detected_obstacle> seen_obstacles;
-      send_aurora_beacon_command('T',seen_obstacles,scan_angle);
-      
-      static std::vector<aurora_detected_obstacle> all_obstacles;
-      
-      // Upload obstacles to autodrive
-      for (aurora_detected_obstacle &o : seen_obstacles)
+    
+    aurora_panorama_status status;
+    std::vector<aurora_detected_obstacle> seen_obstacles;
+    bool reported=beacon_scan_thread->take(seen_obstacles,status);
+    // Upload obstacles to autodrive, as one batch
+    std::vector<rmc_navigator::navigator_t::obstacle_mark> marks;
+    for (aurora_detected_obstacle &o : seen_obstacles)
+    {
+      if (o.y<field_y_mine_zone+50) // ignore obstacles way into mining zone
       {
-        if (o.y<field_y_mine_zone+50) // ignore obstacles way into mining zone
-        {
-          all_obstacles.push_back(o);
-          autodriver.mark_obstacle(o.x,o.y,o.height);
-        }
+        scan_obstacles.push_back(o);
+        marks.push_back(rmc_navigator::navigator_t::obstacle_mark(o.x,o.y,o.height));
       }
-      telemetry.autonomy.obstacle_len=vector_copy_limited(
-        telemetry.autonomy.obstacles, all_obstacles,
-        robot_autonomy_state::max_obstacle_len);
-      autodriver.compute_proximity();
+    }
+    telemetry.autonomy.obstacle_len=vector_copy_limited(
+      telemetry.autonomy.obstacles, scan_obstacles,
+      robot_autonomy_state::max_obstacle_len);
+    if (marks.size()>0) autodriver.mark_obstacles(marks);
+    
+    if ((reported && status.sectors_total>0 && status.sectors_done>=status.sectors_total) || time_in_state>60.0) 
+    { // scan finished (or the beacon is lost)
       if (robot.autonomous) enter_state(state_drive_to_mine);
       else enter_state(state_drive);
     }
@@ -972,18 +1348,57 @@ robot_manager_t *robot_manager;
 unsigned int video_texture_ID=0;
 
 void robot_manager_t::update(void) {
-  cur_time=0.001*glutGet(GLUT_ELAPSED_TIME);
+  update_text.clear();
+  update_driving=update_path_OK=false;
+  robotPrint_capture=&update_text; // GUI draws these lines later
+  
+  update_control();
+  
+  robotPrint_capture=0;
+  if (publish_snapshots) {
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    snapshot.robot=robot;
+    snapshot.loc=locator.merged;
+    snapshot.autonomy=telemetry.autonomy;
+    snapshot.driving=update_driving;
+    if (update_driving) {
+      rmc_navigator::navigator_t::map_ptr map=autodriver.navigator.navigator.get_map();
+      rmc_navigator::fposition heading(0,0,locator.merged.angle);
+      int angle=rmc_navigator::navigator_t::gridposition(heading).a;
+      if (map->version!=snapshot_nav_version || angle!=snapshot.proximity_angle)
+      { // grids changed: copy them out
+        snapshot_nav_version=map->version;
+        snapshot.grid_version++;
+        snapshot.obstacles=map->obstacles;
+        snapshot.proximity=map->slice[angle].proximity;
+        snapshot.proximity_angle=angle;
+      }
+      if (update_path_OK) snapshot.path=autodriver.planned_path;
+      else snapshot.path.clear();
+    }
+    snapshot.text.swap(update_text);
+  }
+}
+
+void robot_manager_t::update_control(void) {
+  cur_time=robotTime();
 
 #if 1 /* enable for backend UI: dangerous, but useful for autonomy testing w/o frontend */
-  // Keyboard control
-  ui.update(oglKeyMap,robot);
+  // Keyboard control, with the keys the GUI thread handed us
+  toggle_t keys;
+  {
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    memcpy(keys,gui_keys,sizeof(keys));
+  }
+  ui.update(keys,robot);
 
   // Click to set state:
-  if (robotState_requested<state_last) {
-    robot.state=robotState_requested;
+  robot_state_t requested=robotState_requested.exchange(state_last); // clear UI request
+  if (requested<state_last) {
+    reset_state_data(requested);
+    robot.state=requested;
     robotPrintln("Entering new state %s (%d) by backend UI request",
       state_to_string(robot.state),robot.state);
-    robotState_requested=state_last; // clear UI request
   }
 #endif
 
@@ -1000,7 +1415,7 @@ void robot_manager_t::update(void) {
         loc.angle=0; //<- don't re-recompute relative angle
         loc.angle=loc.deg_from_dir(vec2(markers.pose.fwd.x,markers.pose.fwd.y));
         float conf=markers.pose.confidence;
-        printf("Computed robot angle: %.0f deg (conf %.2f)\n",loc.angle,conf);
+        ROBOT_LOG(log_debug,logsys_beacon,"Computed robot angle: %.0f deg (conf %.2f)",loc.angle,conf);
         loc.confidence=conf;
         blend(locator.merged,loc,conf);
         blend(sim.loc,loc,conf);
@@ -1009,10 +1424,13 @@ void robot_manager_t::update(void) {
     // robot_display_markers(markers);
   }
 
-// Show real and simulated robots
-  robot_display(locator.merged);
-
-	robot_display_autonomy(telemetry.autonomy);
+  // Mark obstacles the kinect sees (too tall to straddle), once per published frame
+  static bitgrid kinect_obstacles;
+  static file_ipc_link<bitgrid> kinect_obstacle_link("obstacle.grid");
+  if (kinect_obstacle_link.subscribe(kinect_obstacles)) {
+    const int kinect_obstacle_height=30; // cm: taller than the kinect's straddle_range
+    kinect_obstacles.mark_obstacles(autodriver.navigator,kinect_obstacle_height);
+  }
 
 /*
   // Check for an updated location from the vive
@@ -1092,7 +1510,7 @@ void robot_manager_t::update(void) {
   else if (robot.state==state_backend_driver)
   { // set robot power from backend UI
     robot.power=ui.power;
-    printf("Backend driver dump: %d\n",robot.power.dump);
+    ROBOT_LOG(log_debug,logsys_drive,"Backend driver dump: %d",robot.power.dump);
   }
   else if (robot.state>=state_autonomy) { // autonomous mode!
     autonomous_state();
@@ -1153,7 +1571,7 @@ void robot_manager_t::update(void) {
   speed_Mcount=robot.sensor.McountL-last_Mcount;
   float smoothing=0.3;
   smooth_Mcount=speed_Mcount*smoothing + smooth_Mcount*(1.0-smoothing);
-  robotPrintln("Mcount smoothed: %.1f, speed %d\n",
+  ROBOT_LOG(log_debug,logsys_drive,"Mcount smoothed: %.1f, speed %d",
      smooth_Mcount, speed_Mcount);
   last_Mcount=robot.sensor.McountL;
 
@@ -1174,7 +1592,7 @@ void robot_manager_t::update(void) {
   if (cur_time>last_send+0.050)
   {
     last_send=cur_time;
-    robotPrintln("Sending telemetry, waiting for command");
+    ROBOT_LOG(log_debug,logsys_network,"Sending telemetry, waiting for command");
     telemetry.count++;
     telemetry.state=robot.state; // copy current values out for send
     telemetry.status=robot.status;
@@ -1239,10 +1657,59 @@ void robot_manager_t::update(void) {
 }
 
 
-void display(void) {
-  robot_display_setup(robot_manager->robot);
+/* Control loop: runs robot_manager->update at a steady rate,
+   on its own thread, whether or not there's a GUI. */
+std::atomic<bool> control_quit(false);
+double control_hz=100.0; // --hz: control loop rate
+std::thread *control_thread=0;
+void control_loop(void) {
+  const int64_t period=(int64_t)(1.0e9/control_hz);
+  int64_t next=robot_time_ns();
+  
+  // Timing statistics, reported every few seconds
+  const int64_t report_ns=10*(int64_t)1000000000;
+  int64_t last_report=next, total_ns=0, max_ns=0;
+  long updates=0;
+  
+  while (!control_quit) {
+    int64_t start=robot_time_ns();
+    robot_manager->update();
+    int64_t end=robot_time_ns();
+    
+    updates++;
+    total_ns+=end-start;
+    if (end-start>max_ns) max_ns=end-start;
+    if (end-last_report>=report_ns) {
+      ROBOT_LOG(log_info,logsys_general,"Control loop: %.1f updates/sec, %.3f ms mean, %.3f ms max",
+        updates*1.0e9/(end-last_report), total_ns*1.0e-6/updates, max_ns*1.0e-6);
+      last_report=end; total_ns=max_ns=0; updates=0;
+    }
+    
+    next+=period;
+    if (next<end) next=end; // fell behind: don't try to catch up
+    std::this_thread::sleep_for(std::chrono::nanoseconds(next-end));
+  }
+}
 
-  robot_manager->update();
+/* Stop and join the control loop (at exit), so it can't log or
+   touch robot state while static destructors run. */
+void stop_control_loop(void) {
+  control_quit=true;
+  if (control_thread && control_thread->joinable()
+    && control_thread->get_id()!=std::this_thread::get_id())
+    control_thread->join();
+  if (robot_manager) robot_manager->autodriver.planner.stop(); // before the planner's statics go away
+}
+
+int gui_fps=30; // --fps: GUI redraw rate
+
+/* GUI: draws the latest snapshot of robot state */
+void display(void) {
+  static robot_display_snapshot snap;
+  robot_manager->set_keys(oglKeyMap);
+  robot_manager->get_snapshot(snap);
+  robot_display_setup(snap.robot);
+  robot_manager->draw(snap);
 
   if (video_texture_ID) {
     glTranslatef(field_x_GUI+350.0,100.0,0.0);
@@ -1259,13 +1726,18 @@ void display(void) {
   }
 
   glutSwapBuffers();
+}
+
+/* Redraw the GUI at gui_fps */
+void gui_timer(int value) {
   glutPostRedisplay();
+  glutTimerFunc(1000/gui_fps,gui_timer,0);
 }
 
 int main(int argc,char *argv[])
 {
   // setenv("DISPLAY", ":0",1); // never forward GUI over X
-  glutInit(&argc,argv);
+  robotTime(); // start the clock
 
   // Set screen size
   int w=1200, h=700;
@@ -1278,12 +1750,37 @@ int main(int argc,char *argv[])
     else if (0==strcmp(argv[argi],"--noplan")) {
       should_plan_paths=false;
     }
+    else if (0==strcmp(argv[argi],"--lattice")) {
+      plan_lattice=true;
+    }
+    else if (0==strcmp(argv[argi],"--plan_budget") && argi+1<argc) { // microseconds, 0 for no limit
+      plan_budget_us=atol(argv[++argi]);
+    }
+    else if (0==strcmp(argv[argi],"--nofields")) {
+      plan_fields=false;
+    }
+    else if (0==strcmp(argv[argi],"--nocache")) {
+      nav_cache_file=0;
+    }
     else if (0==strcmp(argv[argi],"--driver_test")) {
       simulate_only=true;
       driver_test=true;
     }
-    else if (0==strcmp(argv[argi],"--nogui")) { // UNTESTED!
+    else if (0==strcmp(argv[argi],"--nogui")) { // headless: no X server needed
       show_GUI=false;
+      robotPrintf_show=false;
+    }
+    else if (0==strcmp(argv[argi],"--hz") && argi+1<argc) {
+      control_hz=atof(argv[++argi]);
+    }
+    else if (0==strcmp(argv[argi],"--fps") && argi+1<argc) {
+      gui_fps=std::max(1,atoi(argv[++argi]));
+    }
+    else if (0==strcmp(argv[argi],"--loglevel") && argi+1<argc) { // 0 debug .. 3 errors only
+      robot_log::get().min_level=atoi(argv[++argi]);
+    }
+    else if (0==strcmp(argv[argi],"--verbose")) { // echo debug messages too
+      robot_log::get().console_level=log_debug;
     }
     else if (0==strcmp(argv[argi],"--nodrive")) {
       nodrive=true;
@@ -1299,21 +1796,23 @@ int main(int argc,char *argv[])
   robot_manager->locator.merged.y=100;
   if (simulate_only) robot_manager->locator.merged.x=150;
 
+  robot_manager->publish_snapshots=show_GUI;
+  robot_log::get(); // constructed before stop_control_loop is registered, so destroyed after it runs
+  control_thread=new std::thread(control_loop);
+  atexit(stop_control_loop); // glut exits from inside glutMainLoop
+
   if (show_GUI) {
+    glutInit(&argc,argv);
     glutInitDisplayMode(GLUT_RGBA + GLUT_DOUBLE);
     glutInitWindowSize(w,h);
     glutCreateWindow("Robot Backend");
     robotMainSetup();
 
     glutDisplayFunc(display);
+    glutTimerFunc(1000/gui_fps,gui_timer,0);
     glutMainLoop();
   }
-  else
-  { // no-GUI version
-    while (true) {
-      robot_manager->update();
-    }
-  }
+  control_thread->join(); // headless: control loop runs until killed
   return 0;
 }
 
@@ -9,9 +9,11 @@
 #define __AURORA_BEACON_CMD_H
 
 #include <zmq.hpp>
+#include <string.h> // for memcpy
 #include <unistd.h> // for sleep
 #include <thread>
 #include <vector>
+#include "aurora/robot_log.h"
 
 // Command letters:
 enum {
@@ -19,6 +21,8 @@ enum {
   aurora_beacon_command_point='P', // point sensor this direction
   aurora_beacon_command_home='H', // point sensor this direction
   aurora_beacon_command_off='O', // power off the beacon
+  aurora_beacon_command_panorama='S', // start a panoramic obstacle scan (replies at once)
+  aurora_beacon_command_results='R', // poll for panoramic scan results
 };
 typedef signed short aurora_beacon_command_angle_t;
 
@@ -36,16 +40,41 @@ struct aurora_detected_obstacle {
   signed short height; // height above/below neighbors
 };
 
+/* Reply to the panorama and results commands.
+   Followed by obstacle_count aurora_detected_obstacle records,
+   which are only the obstacles not already sent by an earlier reply. */
+struct aurora_panorama_status {
+  signed short sectors_done; // sectors completely scanned so far
+  signed short sectors_total; // sectors in this scan (0 if no scan was started)
+  signed short angle; // stepper angle right now (degrees)
+  signed short obstacle_count; // obstacles following this header
+};
+
+// Split a panorama reply into its status and any new obstacles.
+//   Returns false if the reply is malformed.
+inline bool parse_aurora_panorama_reply(const std::vector<unsigned char> &reply,
+  aurora_panorama_status &status,std::vector<aurora_detected_obstacle> &obstacles)
+{
+  if (reply.size()<sizeof(status)) return false;
+  memcpy(&status,&reply[0],sizeof(status));
+  size_t n=(reply.size()-sizeof(status))/sizeof(aurora_detected_obstacle);
+  if (status.obstacle_count<0 || (size_t)status.obstacle_count!=n) return false;
+  obstacles.resize(n);
+  if (n>0) memcpy(&obstacles[0],&reply[sizeof(status)],n*sizeof(aurora_detected_obstacle));
+  return true;
+}
+
 
 // Sends beacon commands to the beacon.  
-//   Blocks until any data has been returned.
+//   Blocks until any data has been returned, or for at most timeout_ms
+//   milliseconds if that's not -1.  Returns false if the reply never came.
 template <class T>
-void send_aurora_beacon_command(char letter,
+bool send_aurora_beacon_command(char letter,
   std::vector<T> &returnData,
-  aurora_beacon_command_angle_t angle=0)
+  aurora_beacon_command_angle_t angle=0,
+  int timeout_ms=-1)
 {
-  printf("Sending beacon command %c (angle %d)\n", letter,(int)angle);
-  fflush(stdout);
+  ROBOT_LOG(log_debug,logsys_beacon,"Sending beacon command %c (angle %d)",letter,(int)angle);
   zmq::context_t context(1);
   zmq::socket_t socket(context,ZMQ_REQ); // request port
   std::string server="tcp://10.10.10.100";
@@ -56,6 +85,11 @@ void send_aurora_beacon_command(char letter,
   }
 #define aurora_beacon_command_port "1111"
   server+=":" aurora_beacon_command_port;
+  if (timeout_ms>=0) { // don't wait forever on a lost reply (or at exit)
+    socket.setsockopt(ZMQ_RCVTIMEO,&timeout_ms,sizeof(timeout_ms));
+    int linger=0;
+    socket.setsockopt(ZMQ_LINGER,&linger,sizeof(linger));
+  }
   socket.connect(server.c_str());
   
   zmq::message_t cmdbuf(sizeof(aurora_beacon_command));
@@ -64,14 +98,19 @@ void send_aurora_beacon_command(char letter,
   memcpy(cmdbuf.data(),&c,sizeof(c));
   socket.send(cmdbuf);
   zmq::message_t reply;
-  socket.recv(&reply);
+  if (!socket.recv(&reply)) { // timed out: the socket goes away with us
+    ROBOT_LOG(log_warning,logsys_beacon,"No response from beacon to command %c",letter);
+    returnData.clear();
+    return false;
+  }
   
   size_t nreturn=reply.size()/sizeof(T);
   returnData.resize(nreturn);
-  memcpy(&returnData[0],reply.data(),nreturn*sizeof(T));
+  if (nreturn>0) memcpy(&returnData[0],reply.data(),nreturn*sizeof(T));
   
-  printf("Response from beacon: %d data items of size %d bytes each\n",
+  ROBOT_LOG(log_debug,logsys_beacon,"Response from beacon: %d data items of size %d bytes each",
     (int)nreturn,(int)sizeof(T));
+  return true;
 }
 
 // template<class T>
@@ -5,7 +5,11 @@
 #ifndef __AURORA_ROBOTICS__DISPLAY_H
 #define __AURORA_ROBOTICS__DISPLAY_H
 
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES 1 /* for vertex buffer objects */
+#endif
 #include <GL/glut.h> /* OpenGL Utilities Toolkit, for GUI tools */
+#include "aurora/display_gl.h" /* retained-mode vertex batches and grid textures */
 
 /* robotPrintln support code: */
 #include <stdio.h>
@@ -14,35 +18,37 @@
 #include "osl/quadric.h"
 #include "aurora/network.h"
 #include "aurora/pose.h"
+#include "aurora/robot_log.h"
 #include <string>
+#include <vector>
+#include <atomic>
 
-robot_state_t robotState_requested=state_last;
+std::atomic<robot_state_t> robotState_requested(state_last); // set by GUI clicks or UI keys, cleared once acted on
 vec2 robotMouse_pixel; // pixel position of robot mouse
 vec2 robotMouse_cm; // field-coordinates position of mouse
 bool robotMouse_down=false;
 
 double robotPrintf_x=field_x_GUI, robotPrintf_y=0.0, robotPrintf_line=-25.0;
 
-/* Return the current time, in seconds */
-double robotTime(void) {
-	return 0.001*glutGet(GLUT_ELAPSED_TIME);
-}
+#include "aurora/robot_clock.h" /* for robotTime */
+
+/* If non-null, robotPrint saves text lines here instead of drawing them.
+   Lets a thread without a GL context print, for drawing later. */
+thread_local std::vector<std::string> *robotPrint_capture=0;
 
 
-bool robotPrintf_enable=true;
+bool robotPrintf_enable=true; // log robotPrintln messages
+bool robotPrintf_show=true; // draw robotPrintln messages onscreen (needs a GL context)
+
 /* Render this string at this X,Y location */
 void robotPrint(float x,float y,const char *str)
 {
-	if (robotPrintf_enable) {
-        // Dump everything to the console, and log it too
-	fprintf(stdout,"%.3f %s\n",robotTime(),str);
-        fflush(stdout);
-
-        static FILE *flog=fopen("log.txt","w");
-	fprintf(flog,"%.3f %s\n",robotTime(),str);
-        fflush(flog);
+        if (!robotPrintf_show) return;
+        if (robotPrint_capture) {
+        	robotPrint_capture->push_back(str);
+        	return;
         }
-
+        
         // Draw it onscreen
         void *font=GLUT_BITMAP_HELVETICA_12;
         glRasterPos2f(x,y);
@@ -57,15 +63,36 @@ void robotPrint(float x,float y,const char *str)
 
 }
 
-/** Render this string onscreen, followed by a newline. */
-void robotPrintln(const char *fmt,...) {
-        va_list p; va_start(p,fmt);
-        char dest[1000];
-        vsnprintf(dest,sizeof(dest),fmt,p);
-        robotPrint(robotPrintf_x,robotPrintf_y,dest);
-        va_end(p);
+/** Log this message (asynchronously, see robot_log.h), and render it onscreen. */
+template <typename... Args>
+void robotPrintln_site(const robot_log_site &site,const char *fmt,const Args&... args) {
+        if (robotPrintf_enable && robot_log::get().enabled(site)) 
+                robot_log::get().log(site,args...);
+        if (robotPrintf_show) {
+                char dest[1000];
+                snprintf(dest,sizeof(dest),fmt,args...);
+                robotPrint(robotPrintf_x,robotPrintf_y,dest);
+        }
+}
+inline void robotPrintln_site(const robot_log_site &site,const char *fmt) {
+        if (robotPrintf_enable && robot_log::get().enabled(site)) 
+                robot_log::get().log(site);
+        if (robotPrintf_show) {
+                std::string dest; // no arguments: just undo the %% escapes
+                for (const char *c=fmt;*c!=0;c++) {
+                        if (c[0]=='%' && c[1]=='%') c++;
+                        dest+=*c;
+                }
+                robotPrint(robotPrintf_x,robotPrintf_y,dest.c_str());
+        }
 }
 
+/** Render this string onscreen, followed by a newline.  fmt must be a string literal. */
+#define robotPrintln(fmt,...) do { \
+        static robot_log_site robotPrintln_here(log_info,logsys_general,__FILE__,__LINE__,fmt); \
+        robotPrintln_site(robotPrintln_here,fmt, ##__VA_ARGS__); \
+    } while (0)
+
 void robotPrintLines(const std::string& text)
 {
 	std::string temp;
@@ -74,7 +101,7 @@ void robotPrintLines(const std::string& text)
 	{
 		if(text[ii]=='\n'||ii+1>=text.size())
 		{
-			robotPrintln(temp.c_str());
+			robotPrintln("%s",temp.c_str());
 			temp="";
 			continue;
 		}
@@ -159,28 +186,31 @@ void robot_display_setup(const robot_base &robot) {
 	glEnd();
 	*/
 
-// Delineate the start and mine bays
-	glBegin(GL_LINES);
-	glColor4f(0.3,0.3,0.5,1.0);
-	glVertex2i(0,field_y_start_zone);
-	glVertex2i(field_x_size,field_y_start_zone);
-	glVertex2i(0,field_y_mine_zone);
-	glVertex2i(field_x_size,field_y_mine_zone);
-
-// Draw the scoring trough
-	glColor4f(0.3,1.0,1.0,1.0);
-	glVertex2i(field_x_trough_edge,field_y_trough_start);
-	glVertex2i(field_x_trough_edge,field_y_trough_end);
-	glEnd();
-
-// Outline the field
-	glBegin(GL_LINE_LOOP);
-	glColor4f(0.0,0.0,0.8,1.0);
-	glVertex2i(0,0);
-	glVertex2i(field_x_size,0);
-	glVertex2i(field_x_size,field_y_size);
-	glVertex2i(0,field_y_size);
-	glEnd();
+// Draw the field itself (built once, kept on the GPU)
+	static gl_vertex_batch field;
+	if (field.empty()) {
+	// Delineate the start and mine bays
+		field.begin(GL_LINES);
+		field.color(0.3,0.3,0.5,1.0);
+		field.vertex(0,field_y_start_zone);
+		field.vertex(field_x_size,field_y_start_zone);
+		field.vertex(0,field_y_mine_zone);
+		field.vertex(field_x_size,field_y_mine_zone);
+
+	// Draw the scoring trough
+		field.color(0.3,1.0,1.0,1.0);
+		field.vertex(field_x_trough_edge,field_y_trough_start);
+		field.vertex(field_x_trough_edge,field_y_trough_end);
+
+	// Outline the field
+		field.begin(GL_LINE_LOOP);
+		field.color(0.0,0.0,0.8,1.0);
+		field.vertex(0,0);
+		field.vertex(field_x_size,0);
+		field.vertex(field_x_size,field_y_size);
+		field.vertex(0,field_y_size);
+	}
+	field.draw();
 
 // Draw current robot configuration (side view)
 	glBegin(GL_TRIANGLES);
@@ -316,7 +346,7 @@ void robot_display_setup(const robot_base &robot) {
 		if(ii==6)
 			encoder_str += " ";
 	}
-	robotPrintln(encoder_str.c_str());
+	robotPrintln("%s",encoder_str.c_str());
 
 	std::string str("Stall Raw ");
 	for(int ii=12-1;ii>=0;--ii)
@@ -328,7 +358,7 @@ void robot_display_setup(const robot_base &robot) {
 		if(ii==6)
 			str += " ";
 	}
-	robotPrintln(str.c_str());
+	robotPrintln("%s",str.c_str());
 
 	if (robot.status.arduino)
 	{ // arduino connected: print status
@@ -366,29 +396,30 @@ void robot_display(const robot_localization &loc,double alpha=1.0)
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
 
-// Draw the robot
+// Draw the robot (streamed, since it moves every frame)
+	static gl_vertex_batch batch(true);
+	batch.clear();
 	float conf=loc.confidence;
-	glColor4f(0.8,0.8*conf,0.8*conf,alpha);
-	glBegin(GL_TRIANGLE_FAN);
+	batch.begin(GL_TRIANGLE_FAN);
 	//float ang=loc.angle*M_PI/180.0;
 	vec2 C=loc.center(); // (loc.x,loc.y); // center of robot
 	vec2 F=robot_x*loc.forward(); // (+30.0*sin(ang), +30.0*cos(ang)); // robot forward direction
 	vec2 R=robot_y*loc.right(); // (+70.0*cos(ang), -70.0*sin(ang)); // robot right side
 	double d=1.0; // front wheel deploy?
 
-	glColor4f(0.0,0.8*conf,0.0,alpha); // green mining tool
-	glVertex2fv(C+robot_mine_x*loc.forward());
+	batch.color(0.0,0.8*conf,0.0,alpha); // green mining tool
+	batch.vertex(C+robot_mine_x*loc.forward());
 
-	glColor4f(0.8*conf,0.0,0.0,alpha); // red front wheels
-	glVertex2fv(C-R+d*F);
+	batch.color(0.8*conf,0.0,0.0,alpha); // red front wheels
+	batch.vertex(C-R+d*F);
 
-	glColor4f(0.0,0.0,0.0,alpha); // black back
-	glVertex2fv(C-R-F);
-	glVertex2fv(C+R-F);
+	batch.color(0.0,0.0,0.0,alpha); // black back
+	batch.vertex(C-R-F);
+	batch.vertex(C+R-F);
 
-	glColor4f(0.8*conf,0.0,0.0,alpha); // red front wheels
-	glVertex2fv(C+R+F);
-	glEnd();
+	batch.color(0.8*conf,0.0,0.0,alpha); // red front wheels
+	batch.vertex(C+R+F);
+	batch.draw();
 
 	glColor4f(1.0,1.0,1.0,1.0);
 }
@@ -442,27 +473,28 @@ void robot_display_markers(const robot_markers_all &m)
 void robot_display_autonomy(const robot_autonomy_state &a)
 {
   robot_display_markers(a.markers);
-  glBegin(GL_LINE_STRIP);
-    glColor3f(0.0,1.0,0.0); // green path to target
+  static gl_vertex_batch batch(true);
+  batch.clear();
+  batch.begin(GL_LINE_STRIP);
+    batch.color(0.0,1.0,0.0); // green path to target
     for (int i=0;i<(int)a.plan_len;i++)
-      glVertex2f(a.path_plan[i].v.x,a.path_plan[i].v.y);
+      batch.vertex(a.path_plan[i].v.x,a.path_plan[i].v.y);
     
     if (a.target.v.y!=0.0) {
-      glColor3f(0.0,1.0,1.0); // cyan target
-      glVertex2f(a.target.v.x,a.target.v.y);
+      batch.color(0.0,1.0,1.0); // cyan target
+      batch.vertex(a.target.v.x,a.target.v.y);
     }
-  glEnd();
   
   glPointSize(4.0f);
-  glBegin(GL_POINTS);
+  batch.begin(GL_POINTS);
     for (int i=0;i<(int)a.obstacle_len;i++) {
       int z=a.obstacles[i].height;
       float badness=z*(1.0/25.0);
-      if (badness>1.0) glColor3f(0.0,0.0,0.0); // black == can't even straddle
-      else glColor3f(1.0,1.0-badness,1.0-badness);
-      glVertex2f(a.obstacles[i].x,a.obstacles[i].y);
+      if (badness>1.0) batch.color(0.0,0.0,0.0); // black == can't even straddle
+      else batch.color(1.0,1.0-badness,1.0-badness);
+      batch.vertex(a.obstacles[i].x,a.obstacles[i].y);
     }
-  glEnd();
+  batch.draw();
   
   glColor3f(1.0,1.0,1.0);
 }
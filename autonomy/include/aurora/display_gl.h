@@ -0,0 +1,202 @@
+/**
+ Retained-mode OpenGL helpers for the robot displays.
+
+ gl_vertex_batch collects colored 2D vertices once, then draws them
+ all with one buffer upload: use it for static geometry (build once,
+ draw every frame) and for streamed geometry (rebuild every frame).
+
+ gl_grid_texture shows a whole 2D grid as one texture, and only
+ re-uploads the texels when the grid's version number changes.
+
+ Include this after GL/glut.h (display.h does this for you).
+*/
+#ifndef __AURORA_ROBOTICS__DISPLAY_GL_H
+#define __AURORA_ROBOTICS__DISPLAY_GL_H
+
+#include <vector>
+#include "osl/vec2.h"
+
+/* Vertex buffers are core in OpenGL 1.5; older headers (Windows)
+   fall back to plain client-side vertex arrays. */
+#if defined(GL_VERSION_1_5) && !defined(AURORA_GL_NO_VBO)
+#  define AURORA_GL_VBO 1
+#endif
+
+/** A list of colored 2D vertices, drawn as a series of primitives. */
+class gl_vertex_batch {
+public:
+  // One vertex, in the interleaved layout OpenGL reads
+  struct vertex_t {
+    float x,y;
+    unsigned char rgba[4];
+  };
+
+  gl_vertex_batch(bool streamed_=false) :streamed(streamed_) {}
+  ~gl_vertex_batch() {
+#ifdef AURORA_GL_VBO
+    if (buffer) glDeleteBuffers(1,&buffer);
+#endif
+  }
+
+  // Throw away all vertices (e.g., to rebuild streamed geometry)
+  void clear(void) {
+    vertices.clear();
+    prims.clear();
+    uploaded=false;
+  }
+  bool empty(void) const { return vertices.empty(); }
+
+  // Start a new primitive of this GL mode (GL_LINES, GL_TRIANGLE_FAN, ...)
+  void begin(GLenum mode) {
+    primitive p;
+    p.mode=mode;
+    p.first=vertices.size();
+    p.count=0;
+    prims.push_back(p);
+    uploaded=false;
+  }
+  // Set the color of subsequent vertices
+  void color(float r,float g,float b,float a=1.0f) {
+    cur.rgba[0]=to_byte(r); cur.rgba[1]=to_byte(g);
+    cur.rgba[2]=to_byte(b); cur.rgba[3]=to_byte(a);
+  }
+  // Add a vertex to the current primitive
+  void vertex(float x,float y) {
+    cur.x=x; cur.y=y;
+    vertices.push_back(cur);
+    prims.back().count++;
+  }
+  void vertex(const vec2 &v) { vertex(v.x,v.y); }
+
+  // Draw all our primitives (uploads to the GPU first if anything changed)
+  void draw(void) {
+    if (vertices.empty()) return;
+    const char *base=(const char *)&vertices[0];
+#ifdef AURORA_GL_VBO
+    if (!buffer) glGenBuffers(1,&buffer);
+    glBindBuffer(GL_ARRAY_BUFFER,buffer);
+    if (!uploaded) {
+      glBufferData(GL_ARRAY_BUFFER,vertices.size()*sizeof(vertex_t),base,
+        streamed?GL_STREAM_DRAW:GL_STATIC_DRAW);
+      uploaded=true;
+    }
+    base=0; // offsets are now relative to the buffer
+#endif
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2,GL_FLOAT,sizeof(vertex_t),base);
+    glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(vertex_t),base+2*sizeof(float));
+    for (const primitive &p : prims)
+      if (p.count>0) glDrawArrays(p.mode,p.first,p.count);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+#ifdef AURORA_GL_VBO
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+#endif
+  }
+
+private:
+  struct primitive {
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+  };
+  std::vector<vertex_t> vertices;
+  std::vector<primitive> prims;
+  vertex_t cur={0.0f,0.0f,{255,255,255,255}};
+  bool streamed; // geometry changes every frame
+  bool uploaded=false; // buffer matches vertices
+#ifdef AURORA_GL_VBO
+  GLuint buffer=0;
+#endif
+
+  static unsigned char to_byte(float f) {
+    if (f<=0.0f) return 0;
+    if (f>=1.0f) return 255;
+    return (unsigned char)(f*255.0f+0.5f);
+  }
+  // Copying would double-delete the buffer
+  gl_vertex_batch(const gl_vertex_batch &)=delete;
+  void operator=(const gl_vertex_batch &)=delete;
+};
+
+
+/** A 2D grid of values, shown as one nearest-neighbor RGBA texture. */
+class gl_grid_texture {
+public:
+  gl_grid_texture() {}
+  ~gl_grid_texture() {
+    if (texture) glDeleteTextures(1,&texture);
+  }
+
+  /* Recolor and upload this grid, but only if version has changed
+     since the last update.  colormap(value,rgba) fills in 4 bytes.
+     The grid needs an at(x,y) accessor. */
+  template <class grid_t, class colormap_t>
+  void update(const grid_t &grid,int w,int h,unsigned int version,colormap_t colormap)
+  {
+    if (texture && version==last_version && w==gridw && h==gridh) return;
+    last_version=version;
+
+    if (!texture || w>texw || h>texh) { // (re)allocate power-of-two texture
+      if (!texture) glGenTextures(1,&texture);
+      texw=texh=1;
+      while (texw<w) texw*=2;
+      while (texh<h) texh*=2;
+      glBindTexture(GL_TEXTURE_2D,texture);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP);
+      std::vector<unsigned char> blank(texw*texh*4,0);
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,texw,texh,0,
+        GL_RGBA,GL_UNSIGNED_BYTE,&blank[0]);
+    }
+    gridw=w; gridh=h;
+
+    texels.resize(w*h*4);
+    unsigned char *t=&texels[0];
+    for (int y=0;y<h;y++)
+    for (int x=0;x<w;x++,t+=4)
+      colormap(grid.at(x,y),t);
+
+    glBindTexture(GL_TEXTURE_2D,texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,w,h,GL_RGBA,GL_UNSIGNED_BYTE,&texels[0]);
+    glBindTexture(GL_TEXTURE_2D,0);
+  }
+
+  /* Draw the grid, with cell (x,y) centered at cellsize*(x,y) */
+  void draw(float cellsize) {
+    if (!texture) return;
+    float s=gridw/(float)texw, t=gridh/(float)texh;
+    vec2 lo(-0.5f*cellsize,-0.5f*cellsize);
+    vec2 hi((gridw-0.5f)*cellsize,(gridh-0.5f)*cellsize);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+    glBindTexture(GL_TEXTURE_2D,texture);
+    glEnable(GL_TEXTURE_2D);
+    glColor4f(1.0f,1.0f,1.0f,1.0f);
+    glBegin(GL_QUAD_STRIP);
+    glTexCoord2f(0.0f,0.0f); glVertex2f(lo.x,lo.y);
+    glTexCoord2f(s,0.0f); glVertex2f(hi.x,lo.y);
+    glTexCoord2f(0.0f,t); glVertex2f(lo.x,hi.y);
+    glTexCoord2f(s,t); glVertex2f(hi.x,hi.y);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D,0);
+  }
+
+private:
+  GLuint texture=0;
+  int texw=0, texh=0; // allocated texture size
+  int gridw=0, gridh=0; // grid size in texels
+  unsigned int last_version=0;
+  std::vector<unsigned char> texels; // recolored grid, before upload
+
+  gl_grid_texture(const gl_grid_texture &)=delete;
+  void operator=(const gl_grid_texture &)=delete;
+};
+
+#endif
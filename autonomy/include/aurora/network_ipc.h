@@ -0,0 +1,154 @@
+/*
+  Publishes small fixed-size POD structs (like osl::transform) across the
+  network, as a drop-in for file_ipc_link when the publisher and
+  subscriber run on different machines.
+
+  Every message is tagged with its name (used as the ZMQ subscription
+  prefix), the publisher's session ID, a sequence number, and the
+  publisher's capture timestamp.
+*/
+#ifndef __AURORA_NETWORK_IPC_H
+#define __AURORA_NETWORK_IPC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <map>
+#include <time.h>
+#include <unistd.h>
+#include <zmq.hpp>
+
+#define ZMQ_IPC_PORT "10011"
+
+/* Sent after the name and before the data */
+struct network_ipc_header {
+  uint64_t session; // picked at publisher startup, so subscribers can tell when it restarts
+  uint32_t seq; // counts up by one per publish of this name, within a session
+  uint32_t size; // byte count of the data (sanity check, prevent version mismatch)
+  int64_t time_ns; // capture time, publisher's CLOCK_MONOTONIC (see robot_clock.h)
+  int64_t wall_ns; // capture time, publisher's CLOCK_REALTIME (comparable across NTP-synced machines)
+};
+
+/* Current CLOCK_REALTIME, in nanoseconds */
+inline int64_t network_ipc_wall_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME,&ts);
+  return ts.tv_sec*(int64_t)1000000000+ts.tv_nsec;
+}
+
+/**
+  Publishes named data to every network_ipc_link subscriber.
+  Like any zmq socket, use it from only one thread.
+*/
+class network_ipc_publisher {
+public:
+  zmq::context_t context;
+  zmq::socket_t publisher;
+  uint64_t session; // identifies this run of the publisher
+  std::map<std::string,uint32_t> seq; // last sequence number for each name
+
+  network_ipc_publisher()
+    :context(1),
+     publisher(context, ZMQ_PUB),
+     session(network_ipc_wall_ns() ^ ((uint64_t)getpid()<<40))
+  {
+    int hwm=10; // subscribers want the latest data, not a backlog
+    publisher.setsockopt(ZMQ_SNDHWM,&hwm,sizeof(hwm));
+    publisher.bind("tcp://*:" ZMQ_IPC_PORT);
+  }
+
+  // Publish this data under this name, captured at time_ns (CLOCK_MONOTONIC)
+  template <class IPC_DATA>
+  void publish(const std::string &name, const IPC_DATA &data, int64_t time_ns) {
+    network_ipc_header h;
+    h.session=session;
+    h.seq=++seq[name];
+    h.size=sizeof(data);
+    h.time_ns=time_ns;
+    h.wall_ns=network_ipc_wall_ns();
+
+    // Message layout: name, 0 byte, header, data
+    size_t len=name.size()+1;
+    zmq::message_t message(len+sizeof(h)+sizeof(data));
+    char *dest=(char *)message.data();
+    memcpy(dest,name.c_str(),len);
+    memcpy(dest+len,&h,sizeof(h));
+    memcpy(dest+len+sizeof(h),&data,sizeof(data));
+    publisher.send(message,ZMQ_NOBLOCK);
+  }
+};
+
+/**
+  Receives named data from a network_ipc_publisher, with the same
+  subscribe interface as file_ipc_link.
+
+  The publisher's address comes from the VIVE_SERVER environment
+  variable (hostname or IP), or defaults to this machine.
+*/
+template <class IPC_DATA>
+class network_ipc_link {
+public:
+  zmq::context_t context;
+  zmq::socket_t subscriber;
+  std::string prefix; // name plus its 0 byte
+
+  network_ipc_header last; // header of the last data returned (seq 0 if none yet)
+  long dropped; // messages lost, from gaps in the sequence numbers
+  long restarts; // times the publisher's session changed under us
+
+  network_ipc_link(const std::string &name)
+    :context(1),
+     subscriber(context,ZMQ_SUB),
+     prefix(name.c_str(),name.size()+1),
+     dropped(0), restarts(0)
+  {
+    memset(&last,0,sizeof(last));
+    std::string server="tcp://127.0.0.1";
+    const char *server_str=getenv("VIVE_SERVER");
+    if (server_str) {
+      server="tcp://";
+      server+=server_str;
+    }
+    server+=":" ZMQ_IPC_PORT;
+    subscriber.connect(server.c_str());
+    subscriber.setsockopt(ZMQ_SUBSCRIBE,prefix.data(),prefix.size());
+  }
+
+  // Check for updated data, keeping only the newest.
+  //  Returns true if the data has been updated, false if not.
+  bool subscribe(IPC_DATA &data) {
+    bool changed=false;
+    while (true) {
+      zmq::message_t msg;
+      try {
+        if (!subscriber.recv(&msg,ZMQ_NOBLOCK)) break;
+      } catch (...) {
+        break;
+      }
+      size_t len=prefix.size();
+      if (msg.size()<len+sizeof(network_ipc_header)) continue;
+      const char *src=(const char *)msg.data();
+      network_ipc_header h;
+      memcpy(&h,src+len,sizeof(h));
+      if (h.size!=sizeof(data) || msg.size()!=len+sizeof(h)+sizeof(data)) {
+        fprintf(stderr,"ERROR> NETWORK IPC %s SIZE MISMATCH: expected %ld, got %ld\n",
+          prefix.c_str(), (long)sizeof(data), (long)h.size);
+        continue;
+      }
+      if (last.seq!=0 && h.session!=last.session) { // publisher restarted: its seq starts over
+        restarts++;
+        memset(&last,0,sizeof(last));
+      }
+      if (last.seq!=0 && h.seq>last.seq+1) dropped+=h.seq-last.seq-1;
+      if (last.seq!=0 && h.seq<=last.seq) continue; // stale or duplicate
+      memcpy((void *)&data,src+len+sizeof(h),sizeof(data));
+      last=h;
+      changed=true;
+    }
+    return changed;
+  }
+};
+
+#endif
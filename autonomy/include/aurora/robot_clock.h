@@ -0,0 +1,35 @@
+/**
+  Monotonic clock for robot code, independent of GLUT or any window.
+
+  robotTime() is seconds since the program started, with
+  nanosecond resolution, and never jumps if the wall clock is set.
+*/
+#ifndef __AURORA_ROBOT_CLOCK_H
+#define __AURORA_ROBOT_CLOCK_H
+
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#else
+#include <chrono>
+#endif
+
+/* Return the monotonic clock time, in nanoseconds (arbitrary origin) */
+inline int64_t robot_time_ns(void) {
+#if defined(__unix__) || defined(__APPLE__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*(int64_t)1000000000+ts.tv_nsec;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Return the current time, in seconds since the first call (at program startup) */
+inline double robotTime(void) {
+	static const int64_t start=robot_time_ns();
+	return (robot_time_ns()-start)*1.0e-9;
+}
+
+#endif
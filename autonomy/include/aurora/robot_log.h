@@ -0,0 +1,452 @@
+/**
+  Aurora Robotics asynchronous binary logger.
+
+  Logging a message just copies its arguments into a lock-free ring
+  buffer; a background thread writes them to a binary log file,
+  and echoes them to the console.  The control loop never waits on I/O.
+
+  Each call site's format string is only stored once: the log file
+  has one format record per call site, and message records just hold
+  the format ID and the packed argument values.  Use ipc/dump_log
+  to turn a binary log back into text.
+
+  Usage:
+     ROBOT_LOG(log_info,logsys_path,"Planned %d steps",steps);
+  The format must be a string literal (it's registered once per call site).
+
+  File layout (all little-endian, native structs):
+     robot_log_file_header
+     records: robot_log_record_header, then payload
+       format record payload: robot_log_format_info, file name, '\0', format string, '\0'
+       message record payload: packed arguments (see robot_log_pack)
+*/
+#ifndef __AURORA_ROBOT_LOG_H
+#define __AURORA_ROBOT_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+// Message importance levels
+enum robot_log_level {
+  log_debug=0,
+  log_info=1,
+  log_warning=2,
+  log_error=3,
+};
+
+// Parts of the robot code, for filtering messages
+enum robot_log_subsystem {
+  logsys_general=0, // robotPrintln and anything uncategorized
+  logsys_state, // autonomy state machine
+  logsys_path, // path planning
+  logsys_drive, // motor power and sensors
+  logsys_beacon, // beacon commands and localization
+  logsys_network, // telemetry and commands
+  logsys_last
+};
+
+inline const char *robot_log_level_name(int level) {
+  static const char *names[]={"debug","info","warning","error"};
+  if (level<0 || level>log_error) return "?";
+  return names[level];
+}
+inline const char *robot_log_subsystem_name(int sys) {
+  static const char *names[]={"general","state","path","drive","beacon","network"};
+  if (sys<0 || sys>=logsys_last) return "?";
+  return names[sys];
+}
+
+#define ROBOT_LOG_MAGIC "AULOG1"
+enum {ROBOT_LOG_VERSION=1};
+
+/** Start of the log file */
+struct robot_log_file_header {
+  char magic[8]; // ROBOT_LOG_MAGIC
+  uint32_t version; // ROBOT_LOG_VERSION
+  uint32_t header_bytes; // sizeof(robot_log_file_header)
+  int64_t start_ns; // steady clock time the log started, nanoseconds
+  int64_t start_unix; // wall clock time the log started, seconds since 1970
+};
+
+// Kinds of records
+enum {
+  robot_log_record_format=1, // defines a format ID
+  robot_log_record_message=2, // a logged message
+};
+
+/** Start of each record */
+struct robot_log_record_header {
+  uint16_t bytes; // payload bytes following this header
+  uint8_t kind; // robot_log_record_ enum
+  uint8_t pad;
+  uint32_t format_id; // which call site
+  int64_t time_ns; // steady clock time, nanoseconds
+};
+
+/** Payload of a format record (followed by file and format strings) */
+struct robot_log_format_info {
+  uint8_t level; // robot_log_level
+  uint8_t subsystem; // robot_log_subsystem
+  uint16_t line; // source line number
+};
+
+/* Return the steady (monotonic) clock time, in nanoseconds */
+inline int64_t robot_log_time_ns(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/***************** Argument packing ********************
+  Each argument is a one-byte type tag followed by its value:
+    'i' int64_t, 'u' uint64_t, 'd' double, 'p' pointer as uint64_t,
+    's' uint16_t length then that many chars (truncated to fit).
+*/
+class robot_log_packer {
+public:
+  unsigned char *buf;
+  size_t len, max;
+  robot_log_packer(unsigned char *buf_,size_t max_) :buf(buf_), len(0), max(max_) {}
+
+  void raw(char tag,const void *data,size_t n) {
+    if (len+1+n>max) { len=max; return; } // out of room: drop remaining args
+    buf[len++]=tag;
+    memcpy(buf+len,data,n);
+    len+=n;
+  }
+  void add(long long v) { int64_t i=v; raw('i',&i,sizeof(i)); }
+  void add(unsigned long long v) { uint64_t u=v; raw('u',&u,sizeof(u)); }
+  void add(double v) { raw('d',&v,sizeof(v)); }
+  void add(const char *s) {
+    if (!s) s="(null)";
+    size_t n=strlen(s);
+    if (len+1+sizeof(uint16_t)>=max) { len=max; return; }
+    size_t room=max-len-1-sizeof(uint16_t);
+    if (n>room) n=room;
+    uint16_t n16=n;
+    buf[len++]='s';
+    memcpy(buf+len,&n16,sizeof(n16)); len+=sizeof(n16);
+    memcpy(buf+len,s,n); len+=n;
+  }
+  void add(const void *p) { uint64_t u=(uintptr_t)p; raw('p',&u,sizeof(u)); }
+};
+
+// Overloads to map C++ argument types onto the packed types
+inline void robot_log_pack(robot_log_packer &p,char v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,signed char v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,unsigned char v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,short v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,unsigned short v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,int v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,unsigned int v) { p.add((unsigned long long)v); }
+inline void robot_log_pack(robot_log_packer &p,long v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,unsigned long v) { p.add((unsigned long long)v); }
+inline void robot_log_pack(robot_log_packer &p,long long v) { p.add(v); }
+inline void robot_log_pack(robot_log_packer &p,unsigned long long v) { p.add(v); }
+inline void robot_log_pack(robot_log_packer &p,bool v) { p.add((long long)v); }
+inline void robot_log_pack(robot_log_packer &p,float v) { p.add((double)v); }
+inline void robot_log_pack(robot_log_packer &p,double v) { p.add(v); }
+inline void robot_log_pack(robot_log_packer &p,const char *v) { p.add(v); }
+inline void robot_log_pack(robot_log_packer &p,char *v) { p.add((const char *)v); }
+inline void robot_log_pack(robot_log_packer &p,const std::string &v) { p.add(v.c_str()); }
+inline void robot_log_pack(robot_log_packer &p,const void *v) { p.add(v); }
+
+inline void robot_log_pack_all(robot_log_packer &p) {}
+template <typename T,typename... Rest>
+inline void robot_log_pack_all(robot_log_packer &p,const T &first,const Rest&... rest) {
+  robot_log_pack(p,first);
+  robot_log_pack_all(p,rest...);
+}
+
+
+/***************** Decoding ********************/
+
+/* Read the next packed argument.  Returns the type tag, or 0 if out of args. */
+inline char robot_log_unpack(const unsigned char *&args,const unsigned char *end,
+  int64_t &i,uint64_t &u,double &d,std::string &s)
+{
+  if (args>=end) return 0;
+  char tag=*args++;
+  size_t n=(tag=='s')?sizeof(uint16_t):8;
+  if (args+n>end) { args=end; return 0; }
+  if (tag=='i') { memcpy(&i,args,8); u=i; d=i; }
+  else if (tag=='u' || tag=='p') { memcpy(&u,args,8); i=u; d=u; }
+  else if (tag=='d') { memcpy(&d,args,8); i=(int64_t)d; u=(uint64_t)d; }
+  else if (tag=='s') {
+    uint16_t len; memcpy(&len,args,sizeof(len));
+    args+=sizeof(len);
+    if (args+len>end) len=end-args;
+    s.assign((const char *)args,len);
+    args+=len; i=u=0; d=0.0;
+    return tag;
+  }
+  else { args=end; return 0; }
+  args+=8;
+  return tag;
+}
+
+/* Format these packed arguments using this printf-style format string */
+inline std::string robot_log_format(const char *fmt,const unsigned char *args,size_t nargs)
+{
+  std::string out;
+  const unsigned char *end=args+nargs;
+  char tmp[512];
+  while (*fmt) {
+    if (*fmt!='%') { out+=*fmt++; continue; }
+    if (fmt[1]=='%') { out+='%'; fmt+=2; continue; }
+
+    // Collect the conversion spec, dropping any length modifiers
+    std::string spec="%";
+    const char *p=fmt+1;
+    int star=-1; // value of a '*' width, if any
+    while (*p && strchr("-+ #0123456789.*",*p)) {
+      if (*p=='*') {
+        int64_t i=0; uint64_t u; double d; std::string s;
+        robot_log_unpack(args,end,i,u,d,s);
+        star=(int)i;
+        spec+=std::to_string(star);
+      }
+      else spec+=*p;
+      p++;
+    }
+    while (*p && strchr("hlLqjzt",*p)) p++;
+    char conv=*p;
+    if (conv==0) { out+=fmt; break; }
+    fmt=p+1;
+
+    int64_t i=0; uint64_t u=0; double d=0.0; std::string s;
+    char tag=robot_log_unpack(args,end,i,u,d,s);
+    if (tag==0) { out+="<?>"; continue; }
+    if (strchr("di",conv)) snprintf(tmp,sizeof(tmp),(spec+"lld").c_str(),(long long)i);
+    else if (strchr("uoxX",conv)) snprintf(tmp,sizeof(tmp),(spec+"ll"+conv).c_str(),(unsigned long long)u);
+    else if (conv=='c') snprintf(tmp,sizeof(tmp),(spec+"c").c_str(),(int)i);
+    else if (strchr("feEgGaA",conv)) snprintf(tmp,sizeof(tmp),(spec+conv).c_str(),d);
+    else if (conv=='s') snprintf(tmp,sizeof(tmp),(spec+"s").c_str(),tag=='s'?s.c_str():"<?>");
+    else if (conv=='p') snprintf(tmp,sizeof(tmp),"0x%llx",(unsigned long long)u);
+    else snprintf(tmp,sizeof(tmp),"<%%%c?>",conv);
+    out+=tmp;
+  }
+  return out;
+}
+
+
+/***************** Logger ********************/
+
+/** One logging call site: registered the first time it runs. */
+class robot_log_site {
+public:
+  uint32_t id;
+  int level, subsystem;
+  robot_log_site(int level_,int subsystem_,const char *file,int line,const char *fmt);
+};
+
+/**
+  The log: a fixed-size ring of message slots, filled by any thread
+  without locking, and drained by one background writer thread.
+  If the ring fills up, new messages are dropped (and counted)
+  rather than blocking the caller.
+*/
+class robot_log {
+public:
+  enum {SLOT_BYTES=240}; // max bytes of packed arguments per message
+  enum {SLOTS=4096}; // messages buffered (must be a power of two)
+
+  // Filters, safe to change at any time:
+  std::atomic<int> min_level; // don't record messages below this level
+  std::atomic<int> console_level; // echo messages at or above this level to stdout
+  std::atomic<unsigned int> subsystems; // bitmask of subsystems to record
+
+  std::atomic<long> dropped; // messages lost because the ring was full
+
+  static robot_log &get(void) {
+    static robot_log log;
+    return log;
+  }
+
+  // Return true if this call site's messages should be recorded
+  bool enabled(const robot_log_site &site) const {
+    return site.level>=min_level && (subsystems&(1u<<site.subsystem));
+  }
+
+  // Register a new call site; returns its format ID.
+  uint32_t add_site(int level,int subsystem,const char *file,int line,const char *fmt) {
+    std::lock_guard<std::mutex> guard(formats_lock);
+    format_t f;
+    f.level=level; f.subsystem=subsystem;
+    f.file=file; f.line=line; f.fmt=fmt;
+    formats.push_back(f);
+    return formats.size()-1;
+  }
+
+  // Add a message to the ring.  Lock-free; never blocks.
+  template <typename... Args>
+  void log(const robot_log_site &site,const Args&... args) {
+    uint64_t pos=enqueue_pos.load(std::memory_order_relaxed);
+    slot_t *s;
+    while (true) {
+      s=&slots[pos&(SLOTS-1)];
+      uint64_t seq=s->seq.load(std::memory_order_acquire);
+      int64_t dif=(int64_t)seq-(int64_t)pos;
+      if (dif==0) {
+        if (enqueue_pos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) break;
+      }
+      else if (dif<0) { dropped++; return; } // ring is full
+      else pos=enqueue_pos.load(std::memory_order_relaxed);
+    }
+    s->format_id=site.id;
+    s->time_ns=robot_log_time_ns();
+    robot_log_packer p(s->data,SLOT_BYTES);
+    robot_log_pack_all(p,args...);
+    s->bytes=p.len;
+    s->seq.store(pos+1,std::memory_order_release);
+  }
+
+  // Change the log file (default is log.bin).  Call before logging starts.
+  void open(const std::string &filename) {
+    std::lock_guard<std::mutex> guard(file_lock);
+    if (f) fclose(f);
+    f=fopen(filename.c_str(),"wb");
+    if (!f) { printf("Error creating log file %s\n",filename.c_str()); return; }
+    robot_log_file_header h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,ROBOT_LOG_MAGIC,7);
+    h.version=ROBOT_LOG_VERSION;
+    h.header_bytes=sizeof(h);
+    h.start_ns=start_ns;
+    h.start_unix=time(0);
+    fwrite(&h,sizeof(h),1,f);
+    formats_written=0;
+  }
+
+  // Write everything logged so far (called periodically by the writer thread)
+  void flush(void) {
+    std::lock_guard<std::mutex> guard(file_lock);
+    write_formats();
+    slot_t *s;
+    while (true) {
+      s=&slots[dequeue_pos&(SLOTS-1)];
+      if (s->seq.load(std::memory_order_acquire)!=dequeue_pos+1) break; // empty
+      if (s->format_id>=formats_written) write_formats(); // site registered since we started
+      write_message(*s);
+      s->seq.store(dequeue_pos+SLOTS,std::memory_order_release);
+      dequeue_pos++;
+    }
+    if (f) fflush(f);
+    fflush(stdout);
+  }
+
+  ~robot_log() {
+    quit=true;
+    if (writer.joinable()) writer.join();
+    flush();
+    if (f) fclose(f);
+  }
+
+private:
+  struct slot_t {
+    std::atomic<uint64_t> seq; // ring position this slot is ready for
+    uint32_t format_id;
+    uint16_t bytes;
+    int64_t time_ns;
+    unsigned char data[SLOT_BYTES];
+  };
+  struct format_t {
+    int level, subsystem;
+    std::string file;
+    int line;
+    std::string fmt;
+  };
+
+  std::vector<slot_t> slots;
+  std::atomic<uint64_t> enqueue_pos;
+  uint64_t dequeue_pos; // only touched by the writer
+  int64_t start_ns;
+
+  std::mutex formats_lock;
+  std::deque<format_t> formats; // one per call site, indexed by ID (deque, so entries never move)
+  size_t formats_written; // formats already in the file
+
+  std::mutex file_lock;
+  FILE *f;
+  std::atomic<bool> quit;
+  std::thread writer;
+
+  robot_log()
+    :min_level(log_debug), console_level(log_info), subsystems(~0u), dropped(0),
+     slots(SLOTS), enqueue_pos(0), dequeue_pos(0), start_ns(robot_log_time_ns()),
+     formats_written(0), f(0), quit(false)
+  {
+    for (size_t i=0;i<slots.size();i++) slots[i].seq.store(i,std::memory_order_relaxed);
+    open("log.bin");
+    writer=std::thread([this]() {
+      while (!quit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        flush();
+      }
+    });
+  }
+
+  void write_record(uint8_t kind,uint32_t id,int64_t time_ns,const void *payload,size_t bytes) {
+    if (!f) return;
+    robot_log_record_header h;
+    h.bytes=bytes; h.kind=kind; h.pad=0;
+    h.format_id=id; h.time_ns=time_ns;
+    fwrite(&h,sizeof(h),1,f);
+    fwrite(payload,1,bytes,f);
+  }
+
+  // Write any new format records (writer thread only)
+  void write_formats(void) {
+    std::lock_guard<std::mutex> guard(formats_lock);
+    for (;formats_written<formats.size();formats_written++) {
+      const format_t &fm=formats[formats_written];
+      std::vector<unsigned char> payload(sizeof(robot_log_format_info));
+      robot_log_format_info info;
+      info.level=fm.level; info.subsystem=fm.subsystem; info.line=fm.line;
+      memcpy(&payload[0],&info,sizeof(info));
+      payload.insert(payload.end(),fm.file.begin(),fm.file.end());
+      payload.push_back(0);
+      payload.insert(payload.end(),fm.fmt.begin(),fm.fmt.end());
+      payload.push_back(0);
+      if (payload.size()>65535) payload.resize(65535);
+      write_record(robot_log_record_format,formats_written,start_ns,&payload[0],payload.size());
+    }
+  }
+
+  // Write this message, and echo it to the console if it's important enough
+  void write_message(const slot_t &s) {
+    write_record(robot_log_record_message,s.format_id,s.time_ns,s.data,s.bytes);
+    const format_t *fm;
+    {
+      std::lock_guard<std::mutex> guard(formats_lock);
+      fm=&formats[s.format_id];
+      if (fm->level<console_level) return;
+    }
+    std::string text=robot_log_format(fm->fmt.c_str(),s.data,s.bytes);
+    fprintf(stdout,"%.3f %s\n",(s.time_ns-start_ns)*1.0e-9,text.c_str());
+  }
+};
+
+inline robot_log_site::robot_log_site(int level_,int subsystem_,const char *file,int line,const char *fmt)
+  :level(level_), subsystem(subsystem_)
+{
+  id=robot_log::get().add_site(level,subsystem,file,line,fmt);
+}
+
+/* Log a message at this level, from this subsystem.  fmt must be a string literal. */
+#define ROBOT_LOG(level,subsystem,fmt,...) do { \
+    static robot_log_site robot_log_site_here(level,subsystem,__FILE__,__LINE__,fmt); \
+    if (robot_log::get().enabled(robot_log_site_here)) \
+      robot_log::get().log(robot_log_site_here, ##__VA_ARGS__); \
+  } while (0)
+
+#endif
@@ -0,0 +1,21 @@
+/**
+  Timestamped pose from the vive tracker, published by vive/main.cpp
+  at IMU rate on the "vive.pose" file IPC link.
+*/
+#ifndef __AURORA_VIVE_POSE_H
+#define __AURORA_VIVE_POSE_H
+
+#include <stdint.h>
+#include "osl/transform.h"
+
+struct vive_tracked_pose {
+  osl::transform robot; // same as robot.tf: robot turning center, field coordinates (cm)
+  osl::transform sensor; // same as sensor.tf: kinect sensor frame
+  
+  int64_t time_ns; // robot_time_ns() when this IMU sample arrived (CLOCK_MONOTONIC, same for every process)
+  double fix_age; // seconds since the last optical (lighthouse) fix; the rest is IMU dead reckoning
+  uint32_t imu_count; // IMU samples since startup
+  uint32_t fix_count; // optical fixes since startup
+};
+
+#endif
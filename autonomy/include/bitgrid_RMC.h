@@ -6,21 +6,34 @@
 
 
 #include "gridnav/gridnav_RMC.h"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
 
 /**
  Store a simple on/off grid.
+ 
+ Each row starts on a new 64-bit word, so whole-grid operations
+ (and, or, counts, dilation) work a word at a time; the plain loops
+ over data[] vectorize where the compiler has SIMD.
+ Bits past the end of each row are always zero.
 */
 class bitgrid {
 public:
   typedef rmc_navigator nav;
   
-  typedef unsigned char storage_t;
-  enum {STORE_BITS=8};
-  enum {NDATA=(nav::GRIDX*nav::GRIDY+STORE_BITS-1)/STORE_BITS};
-  // This is a nav::GRIDY * nav::GRIDX raster bit image.
+  typedef uint64_t storage_t;
+  enum {STORE_BITS=64};
+  enum {ROW_WORDS=(nav::GRIDX+STORE_BITS-1)/STORE_BITS};
+  enum {NDATA=ROW_WORDS*nav::GRIDY};
+  // This is a nav::GRIDY * nav::GRIDX raster bit image, ROW_WORDS per row.
   storage_t data[NDATA];
   
   bitgrid() {
+    clear();
+  }
+  
+  void clear(void) {
     for (int idx=0;idx<NDATA;idx++) data[idx]=0;
   }
   
@@ -33,22 +46,126 @@ public:
   
   // Read an in-bounds cell:
   bool read(int x,int y) const {
-    int idx=y*nav::GRIDX+x;
-    storage_t  d=data[idx/STORE_BITS];
-    storage_t bit=1<<(idx%STORE_BITS);
+    storage_t  d=data[y*ROW_WORDS+x/STORE_BITS];
+    storage_t bit=storage_t(1)<<(x%STORE_BITS);
     if (d&bit) return true;
     else return false;
   }
   
   // Write an in-bounds cell:
   void write(int x,int y,bool v) {
-    int idx=y*nav::GRIDX+x;
-    storage_t &d=data[idx/STORE_BITS];
-    storage_t bit=1<<(idx%STORE_BITS);
+    storage_t &d=data[y*ROW_WORDS+x/STORE_BITS];
+    storage_t bit=storage_t(1)<<(x%STORE_BITS);
     if (v) d |= bit; // turn on bit
     else   d &= ~bit; // turn off bit
   }
   
+  
+/************ Whole-grid operations ************/
+  // Keep only cells set in both grids
+  bitgrid &operator&=(const bitgrid &b) {
+    for (int idx=0;idx<NDATA;idx++) data[idx]&=b.data[idx];
+    return *this;
+  }
+  // Add the cells set in b
+  bitgrid &operator|=(const bitgrid &b) {
+    for (int idx=0;idx<NDATA;idx++) data[idx]|=b.data[idx];
+    return *this;
+  }
+  // Remove the cells set in b
+  bitgrid &andnot(const bitgrid &b) {
+    for (int idx=0;idx<NDATA;idx++) data[idx]&=~b.data[idx];
+    return *this;
+  }
+  // Flip every cell
+  bitgrid &invert(void) {
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int w=0;w<ROW_WORDS;w++)
+      data[y*ROW_WORDS+w]=~data[y*ROW_WORDS+w] & row_mask(w);
+    return *this;
+  }
+  
+  friend bitgrid operator&(bitgrid a,const bitgrid &b) { return a&=b; }
+  friend bitgrid operator|(bitgrid a,const bitgrid &b) { return a|=b; }
+  
+  // Count the set cells in the whole grid
+  int count(void) const {
+    int total=0;
+    for (int idx=0;idx<NDATA;idx++) total+=popcount(data[idx]);
+    return total;
+  }
+  
+  // Count the set cells with x0<=x<x1 and y0<=y<y1 (clipped to the grid)
+  int count(int x0,int y0,int x1,int y1) const {
+    x0=std::max(x0,0); x1=std::min(x1,(int)nav::GRIDX);
+    y0=std::max(y0,0); y1=std::min(y1,(int)nav::GRIDY);
+    if (x0>=x1 || y0>=y1) return 0;
+    int total=0;
+    for (int w=x0/STORE_BITS;w<=(x1-1)/STORE_BITS;w++) {
+      // Mask of this word's bits inside [x0,x1)
+      int lo=std::max(x0-w*STORE_BITS,0), hi=std::min(x1-w*STORE_BITS,(int)STORE_BITS);
+      storage_t mask=bits_below(hi) & ~bits_below(lo);
+      for (int y=y0;y<y1;y++) total+=popcount(data[y*ROW_WORDS+w]&mask);
+    }
+    return total;
+  }
+  
+  // Grow set areas by r cells in every direction (a square, like gridnav's proximity).
+  //   Cells beyond the grid edge count as empty.
+  bitgrid &dilate(int r) {
+    if (r<=0) return *this;
+    // Each pass ORs in copies shifted by step, growing the covered radius by step,
+    //   so radius r takes log2(r) passes.
+    int done=0;
+    for (int step=1;done<r;step*=2) {
+      step=std::min(step,r-done);
+      bitgrid src=*this;
+      for (int y=0;y<nav::GRIDY;y++) { // along x: shift bits
+        or_shifted_row(&data[y*ROW_WORDS],&src.data[y*ROW_WORDS],+step);
+        or_shifted_row(&data[y*ROW_WORDS],&src.data[y*ROW_WORDS],-step);
+      }
+      src=*this;
+      for (int y=0;y<nav::GRIDY;y++) // along y: whole rows
+      for (int sy=y-step;sy<=y+step;sy+=2*step) {
+        if (sy<0 || sy>=nav::GRIDY) continue;
+        for (int w=0;w<ROW_WORDS;w++) data[y*ROW_WORDS+w]|=src.data[sy*ROW_WORDS+w];
+      }
+      done+=step;
+    }
+    return *this;
+  }
+  
+  // Shrink set areas by r cells from every side (removes specks smaller than 2r+1).
+  //   Cells beyond the grid edge count as set, so areas touching the edge aren't eaten.
+  bitgrid &erode(int r) {
+    return invert().dilate(r).invert();
+  }
+  
+  
+/************ Conversion to gridnav ************/
+  typedef nav::navigator_t::obstacle_mark obstacle_mark;
+  
+  // Append an obstacle of this height for every set cell, (x,y) in centimeters
+  //   (the cell's corner, which rmc_navigator rounds back to this cell)
+  void append_obstacles(std::vector<obstacle_mark> &marks,int height) const {
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int w=0;w<ROW_WORDS;w++) {
+      storage_t d=data[y*ROW_WORDS+w];
+      while (d!=0) { // visit only the set bits
+        int bit=lowest_bit(d);
+        marks.push_back(obstacle_mark((w*STORE_BITS+bit)*nav::GRIDSIZE,y*nav::GRIDSIZE,height));
+        d&=d-1; // clear lowest set bit
+      }
+    }
+  }
+  
+  // Mark every set cell as an obstacle of this height, in one batch
+  void mark_obstacles(rmc_navigator &navigator,int height) const {
+    std::vector<obstacle_mark> marks;
+    append_obstacles(marks,height);
+    if (marks.size()>0) navigator.mark_obstacles(marks);
+  }
+  
   // Print this grid to the screen:
   void print(void) {
     for (int y=nav::GRIDY-1;y>=0;y-=2)
@@ -61,6 +178,54 @@ public:
       printf("\n");
     }
   }
+  
+private:
+  // Bits [0,n) of a word
+  static storage_t bits_below(int n) {
+    return (n>=STORE_BITS)?~storage_t(0):((storage_t(1)<<n)-1);
+  }
+  // The valid (inside the grid) bits of word w of a row
+  static storage_t row_mask(int w) {
+    return bits_below(nav::GRIDX-w*STORE_BITS);
+  }
+  
+  static int popcount(storage_t v) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    int n=0;
+    for (;v;v&=v-1) n++;
+    return n;
+#endif
+  }
+  static int lowest_bit(storage_t v) { // v must be nonzero
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n=0;
+    while (!(v&1)) { v>>=1; n++; }
+    return n;
+#endif
+  }
+  
+  // OR into row the source row shifted by dx cells (+ moves toward higher x)
+  static void or_shifted_row(storage_t *row,const storage_t *src,int dx) {
+    int words=dx/STORE_BITS, bits=dx%STORE_BITS;
+    if (dx<0) { words=(-dx)/STORE_BITS; bits=(-dx)%STORE_BITS; }
+    for (int w=0;w<ROW_WORDS;w++) {
+      storage_t v=0;
+      if (dx>0) {
+        int s=w-words; // source word
+        if (s>=0) v|=src[s]<<bits;
+        if (bits && s-1>=0) v|=src[s-1]>>(STORE_BITS-bits);
+      } else {
+        int s=w+words;
+        if (s<ROW_WORDS) v|=src[s]>>bits;
+        if (bits && s+1<ROW_WORDS) v|=src[s+1]<<(STORE_BITS-bits);
+      }
+      row[w]|=v&row_mask(w);
+    }
+  }
 };
 
 #endif
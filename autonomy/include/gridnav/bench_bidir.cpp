@@ -0,0 +1,109 @@
+/*
+  Gridnav benchmark: compare the A* planner against bidirectional A*
+  on the RMC field, for the long drives autonomy actually makes.
+
+  Obstacles are the scoring trough and beacon (as the backend marks them),
+  plus seeded random rocks in the obstacle zone.
+
+  Usage: bench_bidir [seed] [rocks]
+*/
+#include "gridnav_RMC.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef rmc_navigator::navigator_t::planner_options planner_options;
+
+// Mark the obstacles the backend starts with, plus some rocks
+void mark_field(rmc_navigator &nav,int rocks)
+{
+  for (int x=field_x_trough_start;x<=field_x_trough_end;x+=rmc_navigator::GRIDSIZE)
+  for (int y=field_y_trough_start;y<=field_y_trough_end;y+=rmc_navigator::GRIDSIZE)
+    nav.mark_obstacle(x, y, 55);
+
+  int beaconsize=15;
+  for (int dx=-beaconsize;dx<=beaconsize;dx+=rmc_navigator::GRIDSIZE/2)
+  for (int dy=-beaconsize;dy<=beaconsize;dy+=rmc_navigator::GRIDSIZE/2)
+    nav.mark_obstacle(field_x_beacon+dx, field_y_beacon+dy, 55);
+
+  for (int r=0;r<rocks;r++) {
+    int cx=20+rand()%(field_x_size-40);
+    int cy=field_y_start_zone+rand()%(field_y_mine_zone-field_y_start_zone);
+    int radius=8+rand()%8;
+    int ht=10+rand()%20; // the robot straddles the short ones
+    for (int dx=-radius;dx<=radius;dx+=rmc_navigator::GRIDSIZE/2)
+    for (int dy=-radius;dy<=radius;dy+=rmc_navigator::GRIDSIZE/2)
+      if (dx*dx+dy*dy<=radius*radius) nav.mark_obstacle(cx+dx,cy+dy,ht);
+  }
+
+  nav.navigator.compute_proximity(30/rmc_navigator::GRIDSIZE);
+}
+
+double elapsed_ms(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[])
+{
+  int seed=(argc>1)?atoi(argv[1]):1;
+  int rocks=(argc>2)?atoi(argv[2]):4;
+  srand(seed);
+
+  rmc_navigator nav;
+  mark_field(nav,rocks);
+
+  struct drive { const char *name; rmc_navigator::fposition start, target; };
+  drive drives[]={
+    {"start to mine", rmc_navigator::fposition(field_x_size-130,100,90),
+                      rmc_navigator::fposition(field_x_size/2,field_y_size-120,90)},
+    {"mine to dump",  rmc_navigator::fposition(field_x_size/2,field_y_size-120,90),
+                      rmc_navigator::fposition(field_x_size/2,field_y_trough_center,field_angle_trough)},
+    {"dump to mine",  rmc_navigator::fposition(field_x_size/2,field_y_trough_center,field_angle_trough),
+                      rmc_navigator::fposition(100,field_y_size-120,90)},
+    {"mine across",   rmc_navigator::fposition(100,field_y_mine_start+40,0),
+                      rmc_navigator::fposition(field_x_size-100,field_y_size-120,180)},
+    // The backend's own mine_target_loc and dump_target_loc, which sit in
+    //   the proximity bands of the field edge
+    {"mine_target",   rmc_navigator::fposition(field_x_size-130,100,90),
+                      rmc_navigator::fposition(field_x_size/2,field_y_size-60,90)},
+    {"dump_target",   rmc_navigator::fposition(field_x_size/2,field_y_size-60,90),
+                      rmc_navigator::fposition(field_x_size/2,field_y_trough_center-30,field_angle_trough)},
+  };
+
+  // Totals over all drives, by [lattice][bidirectional]
+  size_t total_searched[2][2]={{0,0},{0,0}};
+  double total_ms[2][2]={{0,0},{0,0}};
+
+  printf("%-14s %-8s %-14s %5s %9s %9s %9s %6s %9s %6s\n",
+    "drive","moves","planner","valid","searched","forward","backward","steps","cost","ms");
+  for (const drive &d : drives)
+  for (int lattice=0;lattice<2;lattice++) {
+    const char *moves=lattice?"lattice":"grid";
+    planner_options options(lattice);
+
+    auto start=std::chrono::steady_clock::now();
+    rmc_navigator::planner plan(nav.navigator,d.start,d.target,
+      rmc_navigator::navigator_t::drive_t(),false,options);
+    double ms=elapsed_ms(start);
+    printf("%-14s %-8s %-14s %5d %9zu %9s %9s %6zu %9.1f %6.1f\n",
+      d.name,moves,"astar",plan.valid,plan.searched,"-","-",plan.path.size(),
+      plan.path.empty()?0.0:plan.path.back().cost,ms);
+    total_searched[lattice][0]+=plan.searched; total_ms[lattice][0]+=ms;
+
+    start=std::chrono::steady_clock::now();
+    rmc_navigator::bidirectional_planner bi(nav.navigator,d.start,d.target,
+      rmc_navigator::navigator_t::drive_t(),options);
+    ms=elapsed_ms(start);
+    printf("%-14s %-8s %-14s %5d %9zu %9zu %9zu %6zu %9.1f %6.1f\n",
+      d.name,moves,"bidirectional",bi.valid,bi.searched,bi.searched_forward,bi.searched_backward,bi.path.size(),
+      bi.path.empty()?0.0:bi.path.back().cost,ms);
+    total_searched[lattice][1]+=bi.searched; total_ms[lattice][1]+=ms;
+  }
+
+  for (int lattice=0;lattice<2;lattice++)
+  for (int bidir=0;bidir<2;bidir++)
+    printf("%-14s %-8s %-14s %5s %9zu %9s %9s %6s %9s %6.1f\n",
+      "total",lattice?"lattice":"grid",bidir?"bidirectional":"astar","",
+      total_searched[lattice][bidir],"","","","",total_ms[lattice][bidir]);
+  return 0;
+}
@@ -0,0 +1,333 @@
+/*
+  Gridnav benchmark suite: run every planner on stored scenarios,
+  and report plan times, nodes expanded, memory, path cost and length.
+
+  A scenario file (see scenarios/) holds lines in the formats the robot
+  already prints, so real runs can be pasted in:
+    field                                     mark the trough and beacon, like the backend
+    Obstacle at (84,304) cm, height 10 cm     the beacon's obstacle printout
+    Planned path from 150,100@90 to target 189,678@90: 42 steps    the backend's path log
+  Obstacles are marked as one batch, like a beacon scan.  Lines starting with # are comments.
+
+  Usage: bench_gridnav [--runs N] [--csv] [--check baseline.csv] scenario.txt...
+    --csv prints machine-readable results.
+    --check compares valid, nodes, cost and steps against a saved --csv run,
+      and exits with status 1 if any differ or are missing (times are only reported).
+    p99_ms is only reported with --runs 100 or more; below that it's just the slowest run.
+*/
+#include "gridnav_RMC.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <new>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******** Memory accounting: count the bytes live during each plan ********/
+static std::atomic<long> mem_live(0), mem_peak(0);
+
+// Each block records its size in front, padded to keep malloc's alignment.
+//   (Kept out of line, so the compiler doesn't pair our malloc and free with new and delete.)
+enum {MEM_HEADER=16};
+__attribute__((noinline)) void *mem_alloc(size_t size) {
+  char *p=(char *)malloc(size+MEM_HEADER);
+  if (!p) throw std::bad_alloc();
+  *(size_t *)p=size;
+  long live=(mem_live+=size);
+  long peak=mem_peak;
+  while (live>peak && !mem_peak.compare_exchange_weak(peak,live)) {}
+  return p+MEM_HEADER;
+}
+__attribute__((noinline)) void mem_free(void *ptr) {
+  if (!ptr) return;
+  char *p=(char *)ptr-MEM_HEADER;
+  mem_live-=*(size_t *)p;
+  free(p);
+}
+void *operator new(size_t size) { return mem_alloc(size); }
+void operator delete(void *ptr) noexcept { mem_free(ptr); }
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr,size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr,size_t) noexcept { operator delete(ptr); }
+
+// Start counting the peak from what's live now
+long mem_start() { mem_peak=(long)mem_live; return mem_live; }
+
+
+/******** Scenarios ********/
+typedef rmc_navigator::fposition fposition;
+typedef rmc_navigator::navigator_t::obstacle_mark obstacle_mark;
+
+class scenario_drive {
+public:
+  std::string name;
+  fposition start, target;
+};
+
+class scenario {
+public:
+  std::string name; // file name, without directory or extension
+  bool field=false;
+  std::vector<obstacle_mark> obstacles; // in cm
+  std::vector<scenario_drive> drives;
+
+  // Read a scenario file.  Returns false if it can't be read.
+  bool read(const char *filename) {
+    FILE *f=fopen(filename,"r");
+    if (!f) return false;
+    name=filename;
+    size_t slash=name.find_last_of("/\\");
+    if (slash!=std::string::npos) name=name.substr(slash+1);
+    size_t dot=name.rfind('.');
+    if (dot!=std::string::npos) name=name.substr(0,dot);
+
+    char line[1024];
+    int lineno=0;
+    while (fgets(line,sizeof(line),f)) {
+      lineno++;
+      int x,y,h;
+      float x0,y0,a0,x1,y1,a1;
+      if (line[0]=='#' || line[0]=='\n' || line[0]=='\r') continue;
+      else if (0==strncmp(line,"field",5)) field=true;
+      else if (3==sscanf(line,"Obstacle at (%d,%d) cm, height %d cm",&x,&y,&h))
+        obstacles.push_back(obstacle_mark(x,y,h));
+      else if (6==sscanf(line,"Planned path from %f,%f@%f to target %f,%f@%f",&x0,&y0,&a0,&x1,&y1,&a1)) {
+        scenario_drive d;
+        char buf[32]; snprintf(buf,sizeof(buf),"drive%d",(int)drives.size()+1);
+        d.name=buf;
+        d.start=fposition(x0,y0,a0);
+        d.target=fposition(x1,y1,a1);
+        drives.push_back(d);
+      }
+      else printf("%s:%d: unrecognized scenario line: %s",filename,lineno,line);
+    }
+    fclose(f);
+    return true;
+  }
+
+  // Mark our obstacles on this navigator, the way the backend does
+  void mark(rmc_navigator &nav) const {
+    if (field) {
+      for (int x=field_x_trough_start;x<=field_x_trough_end;x+=rmc_navigator::GRIDSIZE)
+      for (int y=field_y_trough_start;y<=field_y_trough_end;y+=rmc_navigator::GRIDSIZE)
+        nav.mark_obstacle(x, y, 55);
+
+      int beaconsize=15;
+      for (int dx=-beaconsize;dx<=beaconsize;dx+=rmc_navigator::GRIDSIZE/2)
+      for (int dy=-beaconsize;dy<=beaconsize;dy+=rmc_navigator::GRIDSIZE/2)
+        nav.mark_obstacle(field_x_beacon+dx, field_y_beacon+dy, 55);
+    }
+    nav.navigator.compute_proximity(30/rmc_navigator::GRIDSIZE);
+    if (obstacles.size()>0) nav.mark_obstacles(obstacles);
+  }
+};
+
+
+/******** Planner variants ********/
+typedef rmc_navigator::navigator_t::planner_options planner_options;
+typedef rmc_navigator::navigator_t::drive_t drive_t;
+typedef std::deque<rmc_navigator::searchposition> path_t;
+
+// What one plan produced
+class plan_result {
+public:
+  bool valid=false;
+  size_t nodes=0;
+  path_t path;
+};
+
+class variant {
+public:
+  const char *name;
+  // Plan this drive on this map
+  plan_result (*plan)(const rmc_navigator::navigator_t::map_ptr &map,const scenario_drive &d);
+};
+
+plan_result plan_astar(const rmc_navigator::navigator_t::map_ptr &map,const scenario_drive &d,bool lattice) {
+  rmc_navigator::navigator_t::planner_target_2D target(d.target);
+  rmc_navigator::planner p(map,d.start,target,drive_t(),false,planner_options(lattice));
+  plan_result r; r.valid=p.valid; r.nodes=p.searched; r.path=p.path;
+  return r;
+}
+plan_result plan_bidir(const rmc_navigator::navigator_t::map_ptr &map,const scenario_drive &d,bool lattice) {
+  rmc_navigator::bidirectional_planner p(map,d.start,d.target,drive_t(),planner_options(lattice));
+  plan_result r; r.valid=p.valid; r.nodes=p.searched; r.path=p.path;
+  return r;
+}
+plan_result plan_anytime(const rmc_navigator::navigator_t::map_ptr &map,const scenario_drive &d,long budget_us) {
+  rmc_navigator::anytime_planner p;
+  p.plan(map,d.start,d.target,drive_t(),budget_us);
+  plan_result r; r.valid=p.valid; r.nodes=p.searched_total; r.path=p.path;
+  return r;
+}
+plan_result plan_field(const rmc_navigator::navigator_t::map_ptr &map,const scenario_drive &d) {
+  rmc_navigator::navigator_t::cost_field field(map,d.target);
+  plan_result r;
+  r.valid=field.descend(d.start,drive_t(),r.path);
+  for (float c : field.cost) if (c<std::numeric_limits<float>::infinity()) r.nodes++;
+  return r;
+}
+
+variant variants[]={
+  {"astar",         [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_astar(m,d,false); }},
+  {"astar_lattice", [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_astar(m,d,true); }},
+  {"bidir",         [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_bidir(m,d,false); }},
+  {"bidir_lattice", [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_bidir(m,d,true); }},
+  // The anytime planner gets a huge budget, so results don't depend on machine speed
+  {"anytime",       [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_anytime(m,d,1000000000L); }},
+  {"field",         [](const rmc_navigator::navigator_t::map_ptr &m,const scenario_drive &d) { return plan_field(m,d); }},
+};
+
+
+/******** Results ********/
+class bench_row {
+public:
+  std::string scenario, drive, variant;
+  int runs=0;
+  bool valid=false;
+  size_t nodes=0;
+  double cost=0.0, length=0.0; // path cost, and path length in cm
+  size_t steps=0;
+  double peak_kb=0.0;
+  double median_ms=0.0, p99_ms=0.0;
+
+  std::string key() const { return scenario+","+drive+","+variant; }
+};
+
+enum {p99_min_runs=100}; // runs needed for p99_ms to mean something
+
+const char *csv_header="scenario,drive,variant,runs,valid,nodes,cost,length_cm,steps,peak_kb,median_ms,p99_ms";
+
+void print_csv(const bench_row &r) {
+  printf("%s,%d,%d,%zu,%.2f,%.1f,%zu,%.1f,%.3f,",r.key().c_str(),r.runs,r.valid,r.nodes,
+    r.cost,r.length,r.steps,r.peak_kb,r.median_ms);
+  if (r.runs>=p99_min_runs) printf("%.3f",r.p99_ms);
+  printf("\n");
+}
+void print_table_header() {
+  printf("%-12s %-7s %-14s %5s %8s %9s %7s %6s %9s %9s %9s\n",
+    "scenario","drive","variant","valid","nodes","cost","length","steps","peak_kb","median_ms","p99_ms");
+}
+void print_table(const bench_row &r) {
+  printf("%-12s %-7s %-14s %5d %8zu %9.1f %7.0f %6zu %9.0f %9.2f ",
+    r.scenario.c_str(),r.drive.c_str(),r.variant.c_str(),r.valid,r.nodes,
+    r.cost,r.length,r.steps,r.peak_kb,r.median_ms);
+  if (r.runs>=p99_min_runs) printf("%9.2f\n",r.p99_ms);
+  else printf("%9s\n","-");
+}
+
+// Read a --csv run as a baseline, keyed by scenario,drive,variant
+bool read_baseline(const char *filename,std::map<std::string,bench_row> &rows) {
+  FILE *f=fopen(filename,"r");
+  if (!f) return false;
+  char line[1024];
+  while (fgets(line,sizeof(line),f)) {
+    char scen[256],drive[256],var[256];
+    bench_row r;
+    int valid;
+    if (11==sscanf(line,"%255[^,],%255[^,],%255[^,],%d,%d,%zu,%lf,%lf,%zu,%lf,%lf",
+        scen,drive,var,&r.runs,&valid,&r.nodes,&r.cost,&r.length,&r.steps,&r.peak_kb,&r.median_ms))
+    {
+      r.scenario=scen; r.drive=drive; r.variant=var; r.valid=valid;
+      rows[r.key()]=r;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Sum of straight-line distances along the path, in cm
+double path_length(const fposition &start,const path_t &path) {
+  double len=0.0;
+  vec2 last=start.v;
+  for (const rmc_navigator::searchposition &p : path) {
+    len+=length(p.pos.v-last);
+    last=p.pos.v;
+  }
+  return len;
+}
+
+double elapsed_ms(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[])
+{
+  int runs=5;
+  bool csv=false;
+  const char *baseline=0;
+  std::vector<scenario> scenarios;
+  for (int argi=1;argi<argc;argi++) {
+    if (0==strcmp(argv[argi],"--runs") && argi+1<argc) runs=std::max(1,atoi(argv[++argi]));
+    else if (0==strcmp(argv[argi],"--csv")) csv=true;
+    else if (0==strcmp(argv[argi],"--check") && argi+1<argc) baseline=argv[++argi];
+    else {
+      scenario s;
+      if (!s.read(argv[argi])) { printf("Can't read scenario file %s\n",argv[argi]); return 1; }
+      scenarios.push_back(s);
+    }
+  }
+  if (scenarios.empty()) {
+    printf("Usage: bench_gridnav [--runs N] [--csv] [--check baseline.csv] scenario.txt...\n");
+    return 1;
+  }
+
+  std::vector<bench_row> results;
+  if (csv) printf("%s\n",csv_header);
+  else print_table_header();
+  for (const scenario &s : scenarios) {
+    rmc_navigator nav;
+    s.mark(nav);
+    rmc_navigator::navigator_t::map_ptr map=nav.navigator.get_map();
+
+    for (const scenario_drive &d : s.drives)
+    for (const variant &v : variants) {
+      bench_row r;
+      r.scenario=s.name; r.drive=d.name; r.variant=v.name; r.runs=runs;
+      std::vector<double> times;
+      for (int run=0;run<runs;run++) {
+        long before=mem_start();
+        auto start=std::chrono::steady_clock::now();
+        plan_result p=v.plan(map,d);
+        times.push_back(elapsed_ms(start));
+        r.peak_kb=(mem_peak-before)/1024.0;
+
+        r.valid=p.valid; r.nodes=p.nodes; r.steps=p.path.size();
+        r.cost=p.path.empty()?0.0:p.path.back().cost;
+        r.length=path_length(d.start,p.path);
+      }
+      std::sort(times.begin(),times.end());
+      r.median_ms=times[times.size()/2];
+      r.p99_ms=times[std::min(times.size()-1,(size_t)ceil(0.99*times.size())-1)];
+      if (csv) print_csv(r);
+      else print_table(r);
+      fflush(stdout);
+      results.push_back(r);
+    }
+  }
+
+  if (!baseline) return 0;
+  std::map<std::string,bench_row> base;
+  if (!read_baseline(baseline,base)) { printf("Can't read baseline %s\n",baseline); return 1; }
+  int changed=0;
+  for (const bench_row &r : results) {
+    auto b=base.find(r.key());
+    if (b==base.end()) { printf("NEW %s (not in baseline)\n",r.key().c_str()); continue; }
+    const bench_row o=b->second;
+    base.erase(b); // seen
+    if (o.valid!=r.valid || o.nodes!=r.nodes || o.steps!=r.steps || fabs(o.cost-r.cost)>0.01) {
+      printf("CHANGED %s: valid %d->%d nodes %zu->%zu cost %.2f->%.2f steps %zu->%zu\n",
+        r.key().c_str(),o.valid,r.valid,o.nodes,r.nodes,o.cost,r.cost,o.steps,r.steps);
+      changed++;
+    }
+    else if (r.median_ms>2.0*o.median_ms+0.1)
+      printf("SLOWER %s: median %.2f ms -> %.2f ms\n",r.key().c_str(),o.median_ms,r.median_ms);
+  }
+  for (const auto &b : base) // baseline rows this run never produced
+    printf("MISSING %s (in baseline, not run)\n",b.first.c_str());
+  printf("%d of %zu results changed from %s, %zu missing\n",changed,results.size(),baseline,base.size());
+  return (changed || !base.empty())?1:0;
+}
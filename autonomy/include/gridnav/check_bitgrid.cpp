@@ -0,0 +1,130 @@
+/*
+  Gridnav check: the word-parallel bitgrid operations must match a
+  plain per-cell version on random grids.
+
+  Checks &, |, andnot, count (whole and region), dilate, erode, that
+  bits past the end of each row stay zero, and that mark_obstacles
+  marks the same navigator cells as mark_obstacle on each set cell.
+  Exits with status 1 if anything differs.
+
+  Usage: check_bitgrid [seed] [trials]
+*/
+#include "bitgrid_RMC.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef bitgrid::nav nav;
+
+// Per-cell reference: any set cell within r (cells past the edge are clear)
+bool ref_dilate(const bitgrid &g,int x,int y,int r) {
+  for (int dy=-r;dy<=r;dy++)
+  for (int dx=-r;dx<=r;dx++)
+    if (g.inbounds(x+dx,y+dy) && g.read(x+dx,y+dy)) return true;
+  return false;
+}
+// Per-cell reference: every cell within r set (cells past the edge count as set)
+bool ref_erode(const bitgrid &g,int x,int y,int r) {
+  for (int dy=-r;dy<=r;dy++)
+  for (int dx=-r;dx<=r;dx++)
+    if (g.inbounds(x+dx,y+dy) && !g.read(x+dx,y+dy)) return false;
+  return true;
+}
+
+// Fill a grid with this percent of cells set
+void random_grid(bitgrid &g,int percent) {
+  for (int y=0;y<nav::GRIDY;y++)
+  for (int x=0;x<nav::GRIDX;x++)
+    g.write(x,y,rand()%100<percent);
+}
+
+// Return the number of rows with bits set past the end
+int padding_errors(const bitgrid &g) {
+  int bad=0;
+  for (int y=0;y<nav::GRIDY;y++) {
+    bitgrid::storage_t last=g.data[y*bitgrid::ROW_WORDS+bitgrid::ROW_WORDS-1];
+    int used=nav::GRIDX-(bitgrid::ROW_WORDS-1)*bitgrid::STORE_BITS;
+    if (used<bitgrid::STORE_BITS && (last>>used)!=0) bad++;
+  }
+  return bad;
+}
+
+int main(int argc,char *argv[])
+{
+  int seed=(argc>1)?atoi(argv[1]):1;
+  int trials=(argc>2)?atoi(argv[2]):40;
+  srand(seed);
+
+  int logic=0, counts=0, dilates=0, erodes=0, padding=0;
+  for (int t=0;t<trials;t++) {
+    bitgrid a,b;
+    random_grid(a,1+rand()%50);
+    random_grid(b,50);
+
+    bitgrid both=a, either=a, only=a, flip=a;
+    both&=b; either|=b; only.andnot(b); flip.invert();
+    int set=0;
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int x=0;x<nav::GRIDX;x++) {
+      bool A=a.read(x,y), B=b.read(x,y);
+      if (both.read(x,y)!=(A&&B)) logic++;
+      if (either.read(x,y)!=(A||B)) logic++;
+      if (only.read(x,y)!=(A&&!B)) logic++;
+      if (flip.read(x,y)!=!A) logic++;
+      if ((a&b).read(x,y)!=(A&&B) || (a|b).read(x,y)!=(A||B)) logic++;
+      if (A) set++;
+    }
+    padding+=padding_errors(flip);
+    if (a.count()!=set) counts++;
+
+    // Region counts, including regions hanging off the grid
+    int x0=rand()%(nav::GRIDX+10)-5, y0=rand()%(nav::GRIDY+10)-5;
+    int x1=x0+rand()%40, y1=y0+rand()%40, inside=0;
+    for (int y=y0;y<y1;y++)
+    for (int x=x0;x<x1;x++)
+      if (a.inbounds(x,y) && a.read(x,y)) inside++;
+    if (a.count(x0,y0,x1,y1)!=inside) counts++;
+
+    int r=rand()%9;
+    bitgrid d=a, e=a;
+    d.dilate(r); e.erode(r);
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int x=0;x<nav::GRIDX;x++) {
+      if (d.read(x,y)!=ref_dilate(a,x,y,r)) dilates++;
+      if (e.read(x,y)!=ref_erode(a,x,y,r)) erodes++;
+    }
+    padding+=padding_errors(d)+padding_errors(e);
+  }
+
+  // Batch marking versus marking one cell at a time
+  int marks=0;
+  {
+    bitgrid a;
+    random_grid(a,3);
+    rmc_navigator batch, single;
+    batch.navigator.compute_proximity(3);
+    single.navigator.compute_proximity(3);
+    a.mark_obstacles(batch,30);
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int x=0;x<nav::GRIDX;x++)
+      if (a.read(x,y)) single.mark_obstacle(x*nav::GRIDSIZE,y*nav::GRIDSIZE,30);
+    single.navigator.compute_proximity(3);
+
+    rmc_navigator::navigator_t::map_ptr bm=batch.navigator.get_map();
+    rmc_navigator::navigator_t::map_ptr sm=single.navigator.get_map();
+    for (int ia=0;ia<nav::GRIDA;ia++)
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int x=0;x<nav::GRIDX;x++) {
+      if (bm->slice[ia].obstacle.at(x,y)!=sm->slice[ia].obstacle.at(x,y)) marks++;
+      if (bm->slice[ia].proximity.at(x,y)!=sm->slice[ia].proximity.at(x,y)) marks++;
+    }
+    for (int y=0;y<nav::GRIDY;y++)
+    for (int x=0;x<nav::GRIDX;x++)
+      if (bm->obstacles.at(x,y)!=sm->obstacles.at(x,y)) marks++;
+  }
+
+  printf("%6s %6s %6s %6s %6s %6s %6s\n","trials","logic","counts","dilate","erode","pad","marks");
+  printf("%6d %6d %6d %6d %6d %6d %6d\n",trials,logic,counts,dilates,erodes,padding,marks);
+  int bad=logic+counts+dilates+erodes+padding+marks;
+  if (bad) printf("BITGRID MISMATCH: %d differences\n",bad);
+  return bad?1:0;
+}
@@ -0,0 +1,128 @@
+/*
+  Gridnav check: the cost a planner reports for its path must match
+  the cost of driving that path, step by step.
+
+  Re-costs the A* and bidirectional paths (grid and lattice moves) on
+  the RMC field, with seeded random rocks, by finding each step among
+  the moves the planner could take and adding up their costs.
+  Exits with status 1 if any reported cost differs from the re-costing.
+
+  Usage: check_pathcost [seed] [rocks]
+*/
+#include "gridnav_RMC.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef rmc_navigator::navigator_t navigator_t;
+typedef navigator_t::fposition fposition;
+typedef navigator_t::gridposition gridposition;
+typedef navigator_t::drive_t drive_t;
+typedef navigator_t::searchposition searchposition;
+
+// Mark the obstacles the backend starts with, plus some rocks (as bench_bidir)
+void mark_field(rmc_navigator &nav,int rocks)
+{
+  for (int x=field_x_trough_start;x<=field_x_trough_end;x+=rmc_navigator::GRIDSIZE)
+  for (int y=field_y_trough_start;y<=field_y_trough_end;y+=rmc_navigator::GRIDSIZE)
+    nav.mark_obstacle(x, y, 55);
+
+  int beaconsize=15;
+  for (int dx=-beaconsize;dx<=beaconsize;dx+=rmc_navigator::GRIDSIZE/2)
+  for (int dy=-beaconsize;dy<=beaconsize;dy+=rmc_navigator::GRIDSIZE/2)
+    nav.mark_obstacle(field_x_beacon+dx, field_y_beacon+dy, 55);
+
+  for (int r=0;r<rocks;r++) {
+    int cx=20+rand()%(field_x_size-40);
+    int cy=field_y_start_zone+rand()%(field_y_mine_zone-field_y_start_zone);
+    int radius=8+rand()%8;
+    int ht=10+rand()%20;
+    for (int dx=-radius;dx<=radius;dx+=rmc_navigator::GRIDSIZE/2)
+    for (int dy=-radius;dy<=radius;dy+=rmc_navigator::GRIDSIZE/2)
+      if (dx*dx+dy*dy<=radius*radius) nav.mark_obstacle(cx+dx,cy+dy,ht);
+  }
+
+  nav.navigator.compute_proximity(30/rmc_navigator::GRIDSIZE);
+}
+
+// Cost of driving this path from origin, or -1 if some step isn't a planner move.
+//   Each step is the move (with this step's drive) that lands nearest its position,
+//   or failing that, the reverse move that starts nearest the last position.
+double recost(const navigator_t::gridmap &map,const fposition &origin,drive_t last_drive,
+  const std::deque<searchposition> &path,const navigator_t::planner_options &options)
+{
+  double cost=navigator_t::arrival_cost(map,gridposition(origin),last_drive,last_drive);
+  fposition pos=origin;
+  for (const searchposition &s : path) {
+    gridposition want(s.pos);
+    double best_step=-1.0, best_dist=1.0e30;
+    // Estimate 0: the lattice offers every move, fine ones included
+    navigator_t::for_each_move(map,pos,gridposition(pos),0.0,options,
+      [&](double step,const drive_t &drive,const fposition &next) {
+        if (!(drive==s.drive) || !(gridposition(next)==want)) return;
+        double dist=length(next.v-s.pos.v);
+        if (dist<best_dist) { best_dist=dist; best_step=step; }
+      });
+    if (best_step<0.0) // where bidirectional halves meet, the step starts elsewhere in this cell:
+      navigator_t::for_each_reverse_move(map,s.pos,0.0,options,
+        [&](double step,const drive_t &drive,const fposition &prev) {
+          if (!(drive==s.drive) || !(gridposition(prev)==gridposition(pos))) return;
+          double dist=length(prev.v-pos.v);
+          if (dist<best_dist) { best_dist=dist; best_step=step; }
+        });
+    if (best_step<0.0) return -1.0;
+    cost+=best_step+navigator_t::arrival_cost(map,want,last_drive,s.drive);
+    last_drive=s.drive;
+    pos=s.pos;
+  }
+  return cost;
+}
+
+// Compare a path's reported cost against its re-costing.  Returns 1 if they differ.
+int check(const char *name,const char *moves,const char *planner,
+  const navigator_t::gridmap &map,const fposition &origin,const std::deque<searchposition> &path,
+  const navigator_t::planner_options &options)
+{
+  double reported=path.empty()?0.0:path.back().cost;
+  double actual=recost(map,origin,drive_t(),path,options);
+  bool same=actual>=0.0 && fabs(reported-actual)<=0.01+1.0e-5*actual;
+  printf("%-12s %-8s %-14s %6zu %10.1f %10.1f %s\n",
+    name,moves,planner,path.size(),reported,actual,same?"":"MISMATCH");
+  return same?0:1;
+}
+
+int main(int argc,char *argv[])
+{
+  int seed=(argc>1)?atoi(argv[1]):1;
+  int rocks=(argc>2)?atoi(argv[2]):4;
+  srand(seed);
+
+  rmc_navigator nav;
+  mark_field(nav,rocks);
+  navigator_t::map_ptr map=nav.navigator.get_map();
+
+  struct drive { const char *name; fposition start, target; };
+  drive drives[]={
+    {"start_mine",  fposition(field_x_size-130,100,90), fposition(field_x_size/2,field_y_size-120,90)},
+    {"mine_dump",   fposition(field_x_size/2,field_y_size-120,90), fposition(field_x_size/2,field_y_trough_center,field_angle_trough)},
+    {"mine_across", fposition(100,field_y_mine_start+40,0), fposition(field_x_size-100,field_y_size-120,180)},
+    {"mine_target", fposition(field_x_size-130,100,90), fposition(field_x_size/2,field_y_size-60,90)},
+    {"dump_target", fposition(field_x_size/2,field_y_size-60,90), fposition(field_x_size/2,field_y_trough_center-30,field_angle_trough)},
+  };
+
+  printf("%-12s %-8s %-14s %6s %10s %10s\n","drive","moves","planner","steps","reported","recosted");
+  int bad=0;
+  for (const drive &d : drives)
+  for (int lattice=0;lattice<2;lattice++) {
+    const char *moves=lattice?"lattice":"grid";
+    navigator_t::planner_options options(lattice);
+
+    rmc_navigator::planner plan(map,d.start,navigator_t::planner_target_2D(d.target),drive_t(),false,options);
+    bad+=check(d.name,moves,"astar",*map,d.start,plan.path,options);
+
+    rmc_navigator::bidirectional_planner bi(map,d.start,d.target,drive_t(),options);
+    bad+=check(d.name,moves,"bidirectional",*map,d.start,bi.path,options);
+  }
+
+  if (bad) printf("PATH COST MISMATCH: %d paths\n",bad);
+  return bad?1:0;
+}
@@ -0,0 +1,152 @@
+/*
+  Gridnav check: a navigator built with footprint symmetry must mark
+  the same obstacles and plan the same paths as one without.
+
+  Compares SYMMETRY_NONE against SYMMETRY_LEFT_RIGHT for the RMC robot,
+  and against every symmetry for a plain box robot that has them all.
+  Exits with status 1 if any grid cell or planned path differs.
+
+  Usage: check_symmetry [seed] [rocks]
+*/
+#include "gridnav_RMC.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {GRIDX=rmc_navigator::GRIDX, GRIDY=rmc_navigator::GRIDY, GRIDA=rmc_navigator::GRIDA,
+      GRIDSIZE=rmc_navigator::GRIDSIZE, ROBOTSIZE=rmc_navigator::ROBOTSIZE};
+
+// A track-driven box, symmetric left/right and front/back
+class box_robot : public gridnav::robot_geometry {
+public:
+  virtual int clearance_height(float x,float y) const {
+    if (fabs(x)>50 || fabs(y)>45) return gridnav::OPEN;
+    if (fabs(y)>30) return 0; // tracks
+    return 20;
+  }
+};
+
+double elapsed_ms(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// A navigator with this symmetry, with the field obstacles marked
+template <int SYMMETRY>
+class field_setup {
+public:
+  typedef gridnav::gridnavigator<GRIDX,GRIDY,GRIDA,GRIDSIZE,ROBOTSIZE,SYMMETRY> navigator_t;
+  navigator_t nav;
+  typename navigator_t::robot_grid_geometry robot;
+  double build_ms, mark_ms;
+
+  field_setup(const gridnav::robot_geometry &geo,int seed,int rocks)
+  {
+    auto start=std::chrono::steady_clock::now();
+    robot=typename navigator_t::robot_grid_geometry(geo);
+    nav.mark_edges(robot);
+    build_ms=elapsed_ms(start);
+
+    start=std::chrono::steady_clock::now();
+    // Trough and beacon, one at a time like the backend's startup
+    for (int x=field_x_trough_start;x<=field_x_trough_end;x+=GRIDSIZE)
+    for (int y=field_y_trough_start;y<=field_y_trough_end;y+=GRIDSIZE)
+      nav.mark_obstacle(x/GRIDSIZE, y/GRIDSIZE, 55, robot);
+    nav.compute_proximity(30/GRIDSIZE);
+
+    // Rocks as one batch, like a beacon scan
+    srand(seed);
+    std::vector<typename navigator_t::obstacle_mark> marks;
+    for (int r=0;r<rocks;r++) {
+      int cx=20+rand()%(field_x_size-40);
+      int cy=field_y_start_zone+rand()%(field_y_mine_zone-field_y_start_zone);
+      int radius=8+rand()%8;
+      int ht=10+rand()%20;
+      for (int dx=-radius;dx<=radius;dx+=GRIDSIZE)
+      for (int dy=-radius;dy<=radius;dy+=GRIDSIZE)
+        if (dx*dx+dy*dy<=radius*radius)
+          marks.push_back(typename navigator_t::obstacle_mark((cx+dx)/GRIDSIZE,(cy+dy)/GRIDSIZE,ht));
+    }
+    nav.mark_obstacles(marks,robot);
+    mark_ms=elapsed_ms(start);
+  }
+
+  size_t footprint_bytes() const {
+    size_t bytes=0;
+    for (int ia=0;ia<navigator_t::FOOTPRINTS;ia++)
+      bytes+=robot.slice[ia].size()*sizeof(typename navigator_t::gridposition);
+    return bytes;
+  }
+};
+
+// Compare a symmetric setup against the full one.  Returns the number of differences.
+template <int A,int B>
+int compare(const char *robotname,const char *symname,
+  const field_setup<A> &full,const field_setup<B> &sym)
+{
+  int cells=0;
+  typename field_setup<A>::navigator_t::map_ptr fm=full.nav.get_map();
+  typename field_setup<B>::navigator_t::map_ptr sm=sym.nav.get_map();
+  for (int ia=0;ia<GRIDA;ia++)
+  for (int y=0;y<GRIDY;y++)
+  for (int x=0;x<GRIDX;x++) {
+    if (fm->slice[ia].obstacle.at(x,y)!=sm->slice[ia].obstacle.at(x,y)) cells++;
+    if (fm->slice[ia].proximity.at(x,y)!=sm->slice[ia].proximity.at(x,y)) cells++;
+  }
+
+  struct drive { float x0,y0,a0, x1,y1,a1; };
+  drive drives[]={
+    {field_x_size-130.0f,100,90, field_x_size/2.0f,field_y_size-120.0f,90},
+    {field_x_size/2.0f,field_y_size-120.0f,90, field_x_size/2.0f,field_y_trough_center,field_angle_trough},
+    {100,field_y_mine_start+40.0f,0, field_x_size-100.0f,field_y_size-120.0f,180},
+    {field_x_size/2.0f,field_y_start_zone+30.0f,270, 80,field_y_mine_start+60.0f,45},
+  };
+  int paths=0;
+  size_t searched=0;
+  for (const drive &d : drives)
+  for (int lattice=0;lattice<2;lattice++) {
+    typedef typename field_setup<A>::navigator_t FN;
+    typedef typename field_setup<B>::navigator_t SN;
+    typename FN::planner fp(full.nav,typename FN::fposition(d.x0,d.y0,d.a0),typename FN::fposition(d.x1,d.y1,d.a1),
+      typename FN::drive_t(),false,typename FN::planner_options(lattice));
+    typename SN::planner sp(sym.nav,typename SN::fposition(d.x0,d.y0,d.a0),typename SN::fposition(d.x1,d.y1,d.a1),
+      typename SN::drive_t(),false,typename SN::planner_options(lattice));
+    bool same=fp.valid==sp.valid && fp.path.size()==sp.path.size() && fp.searched==sp.searched;
+    for (size_t i=0;same && i<fp.path.size();i++)
+      same=fp.path[i].pos.v.x==sp.path[i].pos.v.x && fp.path[i].pos.v.y==sp.path[i].pos.v.y
+        && fp.path[i].pos.a==sp.path[i].pos.a && fp.path[i].cost==sp.path[i].cost;
+    if (!same) paths++;
+    searched+=fp.searched;
+  }
+
+  printf("%-6s %-17s %9zu %9zu %8.1f %8.1f %8.1f %8.1f %6d %6d %9zu\n",
+    robotname,symname,full.footprint_bytes(),sym.footprint_bytes(),
+    full.build_ms,sym.build_ms,full.mark_ms,sym.mark_ms,cells,paths,searched);
+  return cells+paths;
+}
+
+int main(int argc,char *argv[])
+{
+  int seed=(argc>1)?atoi(argv[1]):1;
+  int rocks=(argc>2)?atoi(argv[2]):6;
+
+  printf("%-6s %-17s %9s %9s %8s %8s %8s %8s %6s %6s %9s\n",
+    "robot","symmetry","bytes","sym_bytes","build","sym","mark","sym","cells","paths","searched");
+  int bad=0;
+
+  rmc_navigator rmc; // just for its geometry
+  field_setup<gridnav::SYMMETRY_NONE> rmc_full(rmc,seed,rocks);
+  field_setup<gridnav::SYMMETRY_LEFT_RIGHT> rmc_lr(rmc,seed,rocks);
+  bad+=compare("rmc","left_right",rmc_full,rmc_lr);
+
+  box_robot box;
+  field_setup<gridnav::SYMMETRY_NONE> box_full(box,seed,rocks);
+  field_setup<gridnav::SYMMETRY_LEFT_RIGHT> box_lr(box,seed,rocks);
+  field_setup<gridnav::SYMMETRY_FRONT_BACK> box_fb(box,seed,rocks);
+  field_setup<gridnav::SYMMETRY_LEFT_RIGHT|gridnav::SYMMETRY_FRONT_BACK> box_both(box,seed,rocks);
+  bad+=compare("box","left_right",box_full,box_lr);
+  bad+=compare("box","front_back",box_full,box_fb);
+  bad+=compare("box","both",box_full,box_both);
+
+  if (bad) printf("SYMMETRY MISMATCH: %d differences\n",bad);
+  return bad?1:0;
+}
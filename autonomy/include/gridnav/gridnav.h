@@ -8,6 +8,10 @@ The grid has 3 dimensions:
 The path planner walks through this grid in a lazy fashion
 using the A* algorithm to expand the next closest node to the target.
 
+The configuration-space map (obstacles, proximity) is read-only while
+planners search it; each planner keeps its own search state, so several
+planners can search at once, even while new obstacles are being marked.
+
 Aurora Robotics 2017
 */
 #ifndef AURORA_GRIDNAV_H
@@ -16,8 +20,27 @@ Aurora Robotics 2017
 #include <iostream>
 #include <deque> 
 #include <queue> // for priority_queue
+#include <vector>
+#include <string>
+#include <memory> // for shared_ptr
+#include <mutex>
+#include <thread> // for goal_fields
+#include <condition_variable>
 #include <functional> // for reference_wrapper
+#include <algorithm> // for push_heap
+#include <limits>
+#include <chrono> // for anytime planning deadlines
+#include <type_traits> // for is_trivially_copyable
 #include <math.h>
+#include <stdio.h> // for the startup cache file
+#include <stdint.h>
+#include <string.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
 #include "osl/vec2.h"
 
 namespace gridnav {
@@ -38,17 +61,28 @@ namespace gridnav {
     //    Height OPEN does not collide with anything.
     virtual int clearance_height(float x,float y) const =0;
   };
+  
+  // Symmetries of a robot's clearance_height, for gridnavigator's SYMMETRY flags.
+  //   The navigator stores only the footprints it can't rebuild by symmetry.
+  enum {
+    SYMMETRY_NONE=0,
+    SYMMETRY_LEFT_RIGHT=1, // clearance_height(x,-y)==clearance_height(x,y): angle -a mirrors angle a
+    SYMMETRY_FRONT_BACK=2, // clearance_height(-x,-y)==clearance_height(x,y): angle a+180 equals angle a
+  };
 
 /**
  Create a navigation framework for a space with:
     GRIDX by GRIDY 2D XY grid cells, of size GRIDSIZE centimeters each.
     GRIDA angular orientations representing angles from [0,360).
     The robot is approximately ROBOTGRID cells across.
+    SYMMETRY lists the robot geometry's symmetries (SYMMETRY_ flags),
+      which shrink the footprint tables and obstacle marking work.
+      Results are identical, as long as the geometry really is symmetric.
 */
-template <int GRIDX,int GRIDY,int GRIDA,int GRIDSIZE,int ROBOTGRID>
+template <int GRIDX,int GRIDY,int GRIDA,int GRIDSIZE,int ROBOTGRID,int SYMMETRY=SYMMETRY_NONE>
 class gridnavigator {
 public:
-  typedef gridnavigator<GRIDX,GRIDY,GRIDA,GRIDSIZE,ROBOTGRID> navigator_t;
+  typedef gridnavigator<GRIDX,GRIDY,GRIDA,GRIDSIZE,ROBOTGRID,SYMMETRY> navigator_t;
 
   // forward declarations
   class fposition;
@@ -134,7 +168,7 @@ public:
     }
     
     // Dump values to the screen
-    void print(std::ostream &out,int scale=1) {
+    void print(std::ostream &out,int scale=1) const {
       // for (int y=0;y<GRIDY;y++) {
       for (int y=GRIDY-1;y>=0;y-=2) {
         for (int x=0;x<GRIDX;x++) {
@@ -163,38 +197,108 @@ public:
     // Zero = totally safe driving
     // Higher values = closer to obstacles
     grid2D<int> proximity;
-    
-    // Nonzero bits here mark that we've visited this cell
-    grid2D<unsigned char> visit;
   };
   
-  // The whole grid is just a list of slices, indexed by angle.
-  gridslice slice[GRIDA];
-  
   // Return the drive direction at this grid angle ID, in radians
   static float angle_to_radians(float ia) { return ia*(2.0*M_PI/GRIDA); }
   // Return the drive direction at this grid angle ID, in degrees
   static float angle_to_degrees(float ia) { return ia*(360.0/GRIDA); }
   
-  // Set up our slices, assuming no obstacles and a point robot
-  gridnavigator() {
-    for (int ia=0;ia<GRIDA;ia++) {
-      gridslice &s=slice[ia];
-      float ang=angle_to_radians(ia);
-      s.drive=vec2(cos(ang),sin(ang));
-      s.obstacle.clear(0);
-      s.proximity.clear(0);
-      s.visit.clear(0);
+  // The configuration-space map that planners search.
+  //   Once committed, a gridmap is never modified, so planners can
+  //   keep reading their copy while obstacles get marked in the next one.
+  class gridmap {
+  public:
+    // The whole grid is just a list of slices, indexed by angle.
+    gridslice slice[GRIDA];
+  
+    // This grid records all known obstacles on the field.
+    //   zero indicates no known obstacles
+    //   They're kept here to avoid redundant obstacle updates.
+    grid2D<int> obstacles;
+  
+    // Incremented every time obstacles or proximity change,
+    //   so displays can tell when they need to redraw the grids.
+    unsigned int version=1;
+    
+    // Obstacle distance (in cells) of the last compute_proximity, or 0 if none yet.
+    int proximity_cells=0;
+    
+    // Set up our slices, assuming no obstacles and a point robot
+    gridmap() {
+      for (int ia=0;ia<GRIDA;ia++) {
+        gridslice &s=slice[ia];
+        float ang=angle_to_radians(ia);
+        s.drive=vec2(cos(ang),sin(ang));
+        s.obstacle.clear(0);
+        s.proximity.clear(0);
+      }
+      obstacles.clear(0);
     }
-    obstacles.clear(0);
-    lastpath.clear(' ');
+  };
+  typedef std::shared_ptr<const gridmap> map_ptr;
+  
+private:
+  mutable std::mutex map_lock; // guards map
+  map_ptr map; // latest committed map
+  std::shared_ptr<gridmap> draft; // uncommitted edits (obstacle-marking thread only)
+  
+  std::mutex listener_lock; // guards listeners
+  std::vector<std::pair<int,std::function<void()> > > listeners; // called after each commit
+  int last_listener=0;
+  
+public:
+  gridnavigator() :map(std::make_shared<gridmap>()) {}
+  
+  // Return the latest committed map.  Safe to call from any thread;
+  //   the map stays valid (and unchanged) as long as you hold onto it.
+  map_ptr get_map() const {
+    std::lock_guard<std::mutex> guard(map_lock);
+    return map;
   }
   
-  // After marking obstacles, call this to compute proximity.
+  // Return a private copy of the map to modify.  Changes are invisible
+  //   to planners until commit.  Only one thread should edit at a time.
+  gridmap &edit() {
+    if (!draft) draft=std::make_shared<gridmap>(*get_map());
+    return *draft;
+  }
+  
+  // Publish our edits, so newly started planners see them.
+  void commit() {
+    if (!draft) return;
+    {
+      std::lock_guard<std::mutex> guard(map_lock);
+      map=draft;
+      draft.reset();
+    }
+    std::lock_guard<std::mutex> guard(listener_lock);
+    for (auto &l : listeners) l.second();
+  }
+  
+  // Call this function (from the committing thread) after every commit.
+  //   Returns an ID for remove_commit_listener.
+  int add_commit_listener(const std::function<void()> &f) {
+    std::lock_guard<std::mutex> guard(listener_lock);
+    listeners.push_back(std::make_pair(++last_listener,f));
+    return last_listener;
+  }
+  
+  // Stop calling this listener.  Once this returns, it won't be called again.
+  void remove_commit_listener(int id) {
+    std::lock_guard<std::mutex> guard(listener_lock);
+    for (size_t i=0;i<listeners.size();i++)
+      if (listeners[i].first==id) { listeners.erase(listeners.begin()+i); break; }
+  }
+  
+  // After marking obstacles, call this to compute proximity and commit the map.
   //   This can be re-called if you mark new obstacles.
   void compute_proximity(int cells=3) {
-    for (int ia=0;ia<GRIDA;ia++) {
-      gridslice &s=slice[ia];
+    gridmap &m=edit();
+    m.version++;
+    m.proximity_cells=cells;
+    for (int ia=0;ia<FOOTPRINT_PERIOD;ia++) {
+      gridslice &s=m.slice[ia];
       s.proximity.clear(0);
       for (int y=-1;y<=GRIDY;y++)
       for (int x=-1;x<=GRIDX;x++)
@@ -215,7 +319,9 @@ public:
           }
         }
       }
+      copy_twins(m,ia);
     }
+    commit();
   }
   
 
@@ -224,17 +330,37 @@ public:
   //   x,y are relative to the robot origin.  a=clearance_height.
   typedef std::vector<gridposition> robot_grid_slice;
   
+  // Footprints repeat every FOOTPRINT_PERIOD angles (front/back symmetry),
+  //   and within a period, angle -a is the mirror image of angle a (left/right symmetry),
+  //   so only the first FOOTPRINTS angles need storing.
+  enum {FOOTPRINT_PERIOD=(SYMMETRY&SYMMETRY_FRONT_BACK)?GRIDA/2:GRIDA};
+  enum {FOOTPRINTS=(SYMMETRY&SYMMETRY_LEFT_RIGHT)?FOOTPRINT_PERIOD/2+1:FOOTPRINT_PERIOD};
+  static_assert(SYMMETRY==SYMMETRY_NONE || FOOTPRINT_PERIOD%2==0,
+    "footprint symmetry needs an even number of angles per period");
+  
   // Discretized grid version of robot geometry at each orientation.
   //   Basically a mask for placing around obstacles.
   //   Build this once, at startup.
   class robot_grid_geometry {
   public:
-    // For each angle, this gives the corresponding robot clearances
-    robot_grid_slice slice[GRIDA];
+    // For the first FOOTPRINTS angles, this gives the corresponding robot clearances
+    robot_grid_slice slice[FOOTPRINTS];
+    
+    // Return the robot clearances at any angle ia.
+    //   yflip is -1 if the cells' y coordinates must be negated (a mirror image), else +1.
+    const robot_grid_slice &footprint(int ia,int &yflip) const {
+      ia=ia%FOOTPRINT_PERIOD;
+      yflip=+1;
+      if (ia>=FOOTPRINTS) { ia=FOOTPRINT_PERIOD-ia; yflip=-1; }
+      return slice[ia];
+    }
+    
+    // Empty geometry, to be filled by load_cache
+    robot_grid_geometry() {}
     
     robot_grid_geometry(const robot_geometry &geo,bool verbose=false) {
-      // For each rotation angle:
-      for (int ia=0;ia<GRIDA;ia++) {
+      // For each stored rotation angle:
+      for (int ia=0;ia<FOOTPRINTS;ia++) {
         if (verbose) std::cout<<"Robot geometry at grid angle "<<angle_to_degrees(ia)<<"\n";
         robot_grid_slice &robotslice=slice[ia];
         float ang=angle_to_radians(ia);
@@ -280,39 +406,140 @@ public:
   };
   
   
-  // This grid records all known obstacles on the field.
-  //   zero indicates no known obstacles
-  //   They're kept here to avoid redundant obstacle updates.
-  grid2D<int> obstacles;
-  
-  // This grid stores the winning path (for display)
-  grid2D<char> lastpath;
-  
   // Mark this obstacle location, xy in grid coordinates, as impassible for this robot.
   //  This can be called at startup, or at runtime for new obstacles.
+  //  It edits the draft map: call compute_proximity (or commit) afterwards.
   void mark_obstacle(int x,int y,int height, const robot_grid_geometry &robot) {
     if (gridposition(x,y,0).valid()) {
-      int &old=obstacles.at(x,y);
-      if (old>=height) return; // redundant obstacle
-      else old=height;
+      const int &old=(draft?*draft:*map).obstacles.at(x,y);
+      if (old>=height) return; // redundant obstacle (checked before copying the map)
     }
+    gridmap &m=edit();
+    if (gridposition(x,y,0).valid()) m.obstacles.at(x,y)=height;
+    m.version++;
     
     // Mark where the robot would hit this obstacle in each orientation.
     //   The corresponding robot center points are blocked.
-    for (int ia=0;ia<GRIDA;ia++) {
-      gridslice &navslice=slice[ia];
-      const robot_grid_slice &robotslice=robot.slice[ia];
+    for (int ia=0;ia<FOOTPRINT_PERIOD;ia++) {
+      gridslice &navslice=m.slice[ia];
+      int yflip;
+      const robot_grid_slice &robotslice=robot.footprint(ia,yflip);
       for (gridposition g : robotslice) {
         if (g.a<height) { // robot would hit this obstacle
-          gridposition hit(x-g.x, y-g.y, ia);
+          gridposition hit(x-g.x, y-yflip*g.y, ia);
           int &store=navslice.obstacle.at(hit.x,hit.y);
-          if (hit.valid() && store<height)
+          if (hit.valid() && store<height) {
             store=height;
+            for (int twin=ia+FOOTPRINT_PERIOD;twin<GRIDA;twin+=FOOTPRINT_PERIOD)
+              m.slice[twin].obstacle.at(hit.x,hit.y)=height;
+          }
         }
       }
     }
   }
   
+  // Copy this slice's obstacles and proximity to the slices with the same footprint
+  void copy_twins(gridmap &m,int ia) {
+    for (int twin=ia+FOOTPRINT_PERIOD;twin<GRIDA;twin+=FOOTPRINT_PERIOD) {
+      m.slice[twin].obstacle=m.slice[ia].obstacle;
+      m.slice[twin].proximity=m.slice[ia].proximity;
+    }
+  }
+  
+  // One obstacle for mark_obstacles, xy in grid coordinates
+  class obstacle_mark {
+  public:
+    int x,y,height;
+    obstacle_mark(int x_,int y_,int height_) :x(x_), y(y_), height(height_) {}
+  };
+  
+  // Mark a whole list of obstacles, update proximity near them, and commit the map.
+  //   Same result as calling mark_obstacle on each and then compute_proximity,
+  //   but each angle slice gets one pass over the batch (angles in parallel),
+  //   and proximity is only updated around the new obstacle cells.
+  void mark_obstacles(const std::vector<obstacle_mark> &list,const robot_grid_geometry &robot) {
+    // Rasterize the batch into a height image, keeping only obstacles taller than what we know
+    const gridmap &known=draft?*draft:*map;
+    grid2D<int> raster;
+    raster.clear(0);
+    std::vector<obstacle_mark> fresh; // new obstacle heights, one per cell
+    for (const obstacle_mark &o : list) {
+      if (!gridposition(o.x,o.y,0).valid()) { fresh.push_back(o); continue; } // off-grid: no dedup
+      int &r=raster.at(o.x,o.y);
+      if (o.height>r && o.height>known.obstacles.at(o.x,o.y)) r=o.height;
+    }
+    for (int y=0;y<GRIDY;y++)
+    for (int x=0;x<GRIDX;x++)
+      if (raster.at(x,y)>0) fresh.push_back(obstacle_mark(x,y,raster.at(x,y)));
+    if (fresh.empty()) return; // nothing new
+    
+    gridmap &m=edit();
+    m.version++;
+    for (const obstacle_mark &o : fresh)
+      if (gridposition(o.x,o.y,0).valid()) m.obstacles.at(o.x,o.y)=o.height;
+    
+    // Dilate the new obstacles by the robot footprint at each angle
+    const int cells=m.proximity_cells;
+    auto dilate=[&](int ia) {
+      gridslice &navslice=m.slice[ia];
+      int yflip;
+      const robot_grid_slice &robotslice=robot.footprint(ia,yflip);
+      std::vector<gridposition> blocked; // cells that just became obstacles
+      for (const obstacle_mark &o : fresh)
+      for (const gridposition &g : robotslice) {
+        if (g.a<o.height) { // robot would hit this obstacle
+          gridposition hit(o.x-g.x, o.y-yflip*g.y, ia);
+          if (!hit.valid()) continue;
+          int &store=navslice.obstacle.at(hit.x,hit.y);
+          if (store<o.height) {
+            if (store==0) blocked.push_back(hit);
+            store=o.height;
+          }
+        }
+      }
+      
+      // Proximity can only go up, and only near newly blocked cells (see compute_proximity).
+      //   A blocked cell surrounded by blocked cells is never the closest one
+      //   to an open cell, so only its own proximity needs setting.
+      if (cells<=0) return;
+      for (const gridposition &b : blocked) {
+        // Clip the neighborhoods to the grid
+        int x0=std::max(b.x-1,0), x1=std::min(b.x+1,GRIDX-1);
+        int y0=std::max(b.y-1,0), y1=std::min(b.y+1,GRIDY-1);
+        bool edge=false;
+        for (int y=y0;y<=y1 && !edge;y++)
+        for (int x=x0;x<=x1;x++)
+          if (navslice.obstacle.at(x,y)==0) { edge=true; break; }
+        if (!edge) { navslice.proximity.at(b.x,b.y)=cells+1; continue; }
+        
+        x0=std::max(b.x-cells,0); x1=std::min(b.x+cells,GRIDX-1);
+        y0=std::max(b.y-cells,0); y1=std::min(b.y+cells,GRIDY-1);
+        for (int y=y0;y<=y1;y++)
+        for (int x=x0;x<=x1;x++)
+        {
+          int dist=cells+1 - std::max(std::abs(x-b.x),std::abs(y-b.y));
+          int &prox=navslice.proximity.at(x,y);
+          if (prox<dist) prox=dist;
+        }
+      }
+    };
+    
+    auto dilate_twins=[&](int ia) { dilate(ia); copy_twins(m,ia); };
+    
+    // Small batches aren't worth starting threads for
+    int nthreads=1;
+    if (fresh.size()>=8) nthreads=std::max(1,std::min(8,(int)std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (int t=1;t<nthreads;t++)
+      threads.emplace_back([&dilate_twins,nthreads,t]() {
+        for (int ia=t;ia<FOOTPRINT_PERIOD;ia+=nthreads) dilate_twins(ia);
+      });
+    for (int ia=0;ia<FOOTPRINT_PERIOD;ia+=nthreads) dilate_twins(ia);
+    for (std::thread &t : threads) t.join();
+    
+    commit();
+  }
+  
   // Mark the edges of the grid as impassible for this robot
   void mark_edges(const robot_grid_geometry &robot) {
     for (int y=-1;y<=GRIDY;y++)
@@ -321,6 +548,143 @@ public:
       if (!gridposition(x,y,0).valid())
         mark_obstacle(x,y,99,robot);
     }
+    commit();
+  }
+  
+
+/************ Startup Cache ************************/
+  // Building the robot footprints and the startup map is deterministic but slow,
+  //   so they can be saved to a binary file and loaded back at the next start.
+  //   The file is raw memory for this build on this machine, not a portable format.
+  
+  // Bump this when footprint or map building changes, to rebuild old cache files.
+  enum {CACHE_FORMAT=2};
+  
+  class cache_header {
+  public:
+    char magic[8]; // "gridnav"
+    uint32_t format; // CACHE_FORMAT
+    uint32_t dims[6]; // GRIDX, GRIDY, GRIDA, GRIDSIZE, ROBOTGRID, SYMMETRY
+    uint64_t map_size; // bytes of map grids, see map_bytes
+    uint64_t key; // caller's hash of everything else that went into the cache
+    uint64_t footprint[FOOTPRINTS]; // cells in each stored robot_grid_slice
+    
+    cache_header(uint64_t key_=0) {
+      memset(this,0,sizeof(*this));
+      strcpy(magic,"gridnav");
+      format=CACHE_FORMAT;
+      dims[0]=GRIDX; dims[1]=GRIDY; dims[2]=GRIDA; dims[3]=GRIDSIZE; dims[4]=ROBOTGRID; dims[5]=SYMMETRY;
+      map_size=map_bytes();
+      key=key_;
+    }
+    
+    // Bytes in the whole file, header included
+    uint64_t file_size() const {
+      uint64_t cells=0;
+      for (int ia=0;ia<FOOTPRINTS;ia++) cells+=footprint[ia];
+      return sizeof(cache_header)+cells*sizeof(gridposition)+map_size;
+    }
+  };
+  
+  // The cache stores a map's grids (the drive vectors get rebuilt):
+  //   version, proximity_cells, obstacles, then obstacle and proximity for each slice.
+  typedef grid2D<int> grid_t;
+  static_assert(std::is_trivially_copyable<grid_t>::value,"map grids must be raw memory to cache");
+  static uint64_t map_bytes() { return 2*sizeof(int)+(1+2*GRIDA)*sizeof(grid_t); }
+  
+  // Save the robot footprints and the latest committed map to this file.
+  //   Returns false (and leaves any old file alone) if it can't be written.
+  bool save_cache(const char *filename,uint64_t key,const robot_grid_geometry &robot) const {
+    cache_header header(key);
+    for (int ia=0;ia<FOOTPRINTS;ia++) header.footprint[ia]=robot.slice[ia].size();
+    map_ptr m=get_map();
+    
+    // Write a temporary file, then rename it over the old one, so a crash
+    //   mid-write never leaves a half-written cache behind.
+    std::string temp=std::string(filename)+".tmp";
+    FILE *f=fopen(temp.c_str(),"wb");
+    if (!f) return false;
+    bool ok=fwrite(&header,sizeof(header),1,f)==1;
+    for (int ia=0;ia<FOOTPRINTS && ok;ia++)
+      if (header.footprint[ia]>0)
+        ok=fwrite(&robot.slice[ia][0],sizeof(gridposition),header.footprint[ia],f)==header.footprint[ia];
+    int counts[2]={(int)m->version,m->proximity_cells};
+    if (ok) ok=fwrite(counts,sizeof(counts),1,f)==1;
+    if (ok) ok=fwrite(&m->obstacles,sizeof(grid_t),1,f)==1;
+    for (int ia=0;ia<GRIDA && ok;ia++)
+      ok=fwrite(&m->slice[ia].obstacle,sizeof(grid_t),1,f)==1
+      && fwrite(&m->slice[ia].proximity,sizeof(grid_t),1,f)==1;
+    if (fclose(f)!=0) ok=false;
+    if (ok) ok=rename(temp.c_str(),filename)==0;
+    if (!ok) remove(temp.c_str());
+    return ok;
+  }
+  
+  // Load the robot footprints and map from a save_cache file, and commit the map.
+  //   Returns false, changing nothing, if the file is missing or was built
+  //   with a different key, format, or grid.
+  bool load_cache(const char *filename,uint64_t key,robot_grid_geometry &robot) {
+    const char *bytes=0;
+    uint64_t size=0;
+#ifndef _WIN32
+    int fd=open(filename,O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    void *mem=MAP_FAILED;
+    if (fstat(fd,&st)==0 && st.st_size>=(off_t)sizeof(cache_header)) {
+      size=st.st_size;
+      mem=mmap(0,size,PROT_READ,MAP_PRIVATE,fd,0);
+    }
+    close(fd);
+    if (mem==MAP_FAILED) return false;
+    bytes=(const char *)mem;
+    bool ok=load_cache(bytes,size,key,robot);
+    munmap(mem,size);
+    return ok;
+#else
+    FILE *f=fopen(filename,"rb");
+    if (!f) return false;
+    std::vector<char> buf;
+    char block[65536];
+    size_t n;
+    while ((n=fread(block,1,sizeof(block),f))>0) buf.insert(buf.end(),block,block+n);
+    fclose(f);
+    bytes=buf.data(); size=buf.size();
+    return load_cache(bytes,size,key,robot);
+#endif
+  }
+  
+  // Load from a cache file's bytes in memory
+  bool load_cache(const char *bytes,uint64_t size,uint64_t key,robot_grid_geometry &robot) {
+    if (size<sizeof(cache_header)) return false;
+    cache_header expected(key), header;
+    memcpy(&header,bytes,sizeof(header));
+    if (memcmp(expected.magic,header.magic,sizeof(header.magic))!=0
+      || header.format!=expected.format
+      || memcmp(expected.dims,header.dims,sizeof(header.dims))!=0
+      || header.map_size!=expected.map_size
+      || header.key!=expected.key
+      || header.file_size()!=size) return false;
+    
+    const char *p=bytes+sizeof(header);
+    for (int ia=0;ia<FOOTPRINTS;ia++) {
+      const gridposition *cells=(const gridposition *)p;
+      robot.slice[ia].assign(cells,cells+header.footprint[ia]);
+      p+=header.footprint[ia]*sizeof(gridposition);
+    }
+    std::shared_ptr<gridmap> m=std::make_shared<gridmap>();
+    int counts[2];
+    memcpy(counts,p,sizeof(counts)); p+=sizeof(counts);
+    m->version=counts[0]; m->proximity_cells=counts[1];
+    memcpy(&m->obstacles,p,sizeof(grid_t)); p+=sizeof(grid_t);
+    for (int ia=0;ia<GRIDA;ia++) {
+      memcpy(&m->slice[ia].obstacle,p,sizeof(grid_t)); p+=sizeof(grid_t);
+      memcpy(&m->slice[ia].proximity,p,sizeof(grid_t)); p+=sizeof(grid_t);
+    }
+    
+    draft=m;
+    commit();
+    return true;
   }
   
 
@@ -380,6 +744,99 @@ public:
     }
   };
   
+  // A lattice motion primitive: one straight or arc segment the planner can
+  //   expand in a single step, starting from a particular grid angle.
+  class motion_primitive {
+  public:
+    vec2 delta; // robot center motion, in centimeters
+    int turn; // change in grid angle
+    drive_t drive; // command to drive this segment
+    double length; // centimeters the robot center drives
+    double turn_cost; // turning cost (in centimeter equivalents)
+    bool fine; // one-cell move, only needed to line up on the target
+    
+    // Configuration-space cells the robot passes through, relative to the
+    //  start cell (a is the angle change), in order, ending with the end cell.
+    //  The slice obstacle grids already hold the robot's footprint
+    //  (from robot_grid_geometry), so checking these cells checks the
+    //  swept footprint.
+    std::vector<gridposition> swept;
+  };
+  
+  // Per-angle table of motion primitives, built once.
+  class motion_lattice {
+  public:
+    std::vector<motion_primitive> angle[GRIDA];
+    std::vector<const motion_primitive *> ending[GRIDA]; // primitives that end at each angle
+    
+    // Shared table for this grid size
+    static const motion_lattice &get(void) {
+      static const motion_lattice lattice;
+      return lattice;
+    }
+    
+    motion_lattice() {
+      const double cell=GRIDSIZE;
+      for (int ia=0;ia<GRIDA;ia++) {
+        vec2 dir(cos(angle_to_radians(ia)),sin(angle_to_radians(ia)));
+        // Drive at least into the next grid cell:
+        double step=1.01*cell/std::max(fabs(dir.x),fabs(dir.y));
+        
+        for (int forward=-1;forward<=+1;forward+=2) {
+          add(ia,forward,step,0,true); // one cell, like the grid planner
+          add(ia,forward,4*step,0); // long straight
+          for (int turn=-1;turn<=+1;turn+=2) {
+            add(ia,forward,4*cell,3*turn); // gentle arc
+            add(ia,forward,4*cell,6*turn); // tight arc
+          }
+        }
+        for (int turn=-1;turn<=+1;turn+=2) {
+          add(ia,0,0.0,turn,true); // turn in place, like the grid planner
+          add(ia,0,0.0,3*turn); // turn in place to the arcs' angles
+        }
+      }
+      for (int ia=0;ia<GRIDA;ia++) 
+        for (const motion_primitive &m : angle[ia])
+          ending[((ia+m.turn)%GRIDA+GRIDA)%GRIDA].push_back(&m);
+    }
+    
+  private:
+    // Add a segment driving length cm in direction forward while turning turn slices.
+    void add(int ia,int forward,double length,int turn,bool fine=false) {
+      motion_primitive m;
+      m.fine=fine;
+      m.turn=turn;
+      m.length=length;
+      double turn_rad=angle_to_radians(turn);
+      double half_robot=ROBOTGRID*0.5*GRIDSIZE; // track to turning center, cm
+      if (forward==0) { // in place: same cost as the grid planner's turns
+        m.drive=drive_t(0.0f,turn);
+        m.turn_cost=std::abs(turn)*GRIDSIZE*TURN_COST_TO_GRID_COST;
+      }
+      else { // turning while driving is cheaper than stopping to turn
+        double ratio=std::min(1.0,fabs(turn_rad)*half_robot/length); // track speed from turning vs driving
+        m.drive=drive_t(forward,turn<0?-ratio:ratio);
+        m.turn_cost=0.5*std::abs(turn)*GRIDSIZE*TURN_COST_TO_GRID_COST;
+      }
+      
+      // Integrate along the segment, listing the cells it crosses
+      //   (start cell is at the origin)
+      enum {STEPS=32};
+      vec2 p(0,0);
+      gridposition last(0,0,0);
+      for (int i=1;i<=STEPS;i++) {
+        double ang=angle_to_radians(ia)+turn_rad*(i-0.5)/STEPS; // midpoint rule
+        p+=(forward*length/STEPS)*vec2(cos(ang),sin(ang));
+        gridposition g((int)floor(p.x/GRIDSIZE+0.5),(int)floor(p.y/GRIDSIZE+0.5),
+          (int)floor(turn*(double)i/STEPS+0.5));
+        if (!(g==last)) m.swept.push_back(g);
+        last=g;
+      }
+      m.delta=p;
+      angle[ia].push_back(m);
+    }
+  };
+  
   // A planner_target is basically just a cost function.
   class planner_target {
   public:
@@ -439,9 +896,153 @@ public:
   };
   
   
+  // Settings for a path search
+  class planner_options {
+  public:
+    // Expand lattice motion primitives (long straights and arcs) instead of
+    //   just one-cell moves and turns in place.  Far fewer expansions,
+    //   smoother drive commands.
+    bool lattice;
+    
+    planner_options(bool lattice_=false) :lattice(lattice_) {}
+  };
+  
+  // Extra cost for arriving at grid cell g by this drive, after lastdrive
+  static double arrival_cost(const gridmap &map,const gridposition &g,const drive_t &lastdrive,const drive_t &drive) {
+    double cost=0.0;
+    // Check for obstacles in the way:
+    const unsigned char &obs=map.slice[g.a].obstacle.at(g.x,g.y);
+    //if (obs!=0) return false; // has obstacle
+    if (obs!=0) cost += 10000.0; // hitting obstacle counts as a 10 meter cost
+    
+    if (!(lastdrive == drive)) 
+      cost+=20.0; // penalty for swapping drive directions
+    return cost;
+  }
+  
+  // Call move(cost,drive,next) for each step the planner can take from pos
+  //   (in grid cell gcur, with this estimate to the target).
+  //   cost is the cost of driving the step itself; see arrival_cost for the rest.
+  template <class MOVE>
+  static void for_each_move(const gridmap &map,const fposition &pos,const gridposition &gcur,double estimate,
+    const planner_options &options,MOVE move)
+  {
+    if (options.lattice) {
+      for_each_lattice_move(map,pos,gcur,estimate,move);
+      return;
+    }
+    
+    // Compute 'obstacle proximity cost' scaling factor
+    double turncost=1.0; // extra cost for more turning
+    double proxcost=10.0; // extra cost for driving near obstacles
+    if (gcur.valid())
+      proxcost = 1.0 + 0.5*map.slice[gcur.a].proximity.at(gcur.x,gcur.y);
+    
+    // Check all nearby cells
+    vec2 drivedir=map.slice[gcur.a].drive;
+    for (float drive=-1.0;drive<=+1.0;drive+=2.0) {
+      // Drive at least into the next grid cell:
+      double distance=1.01*GRIDSIZE/std::max(fabs(drivedir.x),fabs(drivedir.y)); 
+      
+      fposition next(pos.v+distance*drive*drivedir,pos.a);
+      move(proxcost * distance,drive_t(drive,0.0f),next);
+    }
+    for (float turn=-1.0;turn<=+1.0;turn+=2.0) {
+      fposition next(pos.v,fmodplus(pos.a+turn,GRIDA)); // angles wrap around
+      move(proxcost *turncost * GRIDSIZE*TURN_COST_TO_GRID_COST,drive_t(0.0f,turn),next);
+    }
+  }
+  
+  // Lattice version of for_each_move.
+  //   Far from the target, only the coarse moves are used: that keeps
+  //   the search on a sparse lattice of states, which is what saves work.
+  template <class MOVE>
+  static void for_each_lattice_move(const gridmap &map,const fposition &pos,const gridposition &gcur,double estimate,MOVE move)
+  {
+    const double fine_range=8.0*GRIDSIZE; // use one-cell moves within this estimated cost of the target
+    bool near=estimate<fine_range;
+    for (const motion_primitive &m : motion_lattice::get().angle[gcur.a]) {
+      if (m.fine && !near) continue;
+      lattice_move(map,pos,gcur,m,move);
+    }
+  }
+  
+  // Drive motion primitive m from pos (in grid cell gcur), if it stays on the grid.
+  template <class MOVE>
+  static void lattice_move(const gridmap &map,const fposition &pos,const gridposition &gcur,const motion_primitive &m,MOVE move)
+  {
+    fposition next(pos.v+m.delta,fmodplus(pos.a+m.turn,GRIDA)); // angles wrap around
+    gridposition gnext(next);
+    
+    // Walk the swept cells: obstacles, and the worst proximity along the way.
+    //   An obstacle in the cell we land in is arrival_cost's to charge, as for grid moves.
+    int prox=map.slice[gcur.a].proximity.at(gcur.x,gcur.y);
+    bool hit=false;
+    for (const gridposition &c : m.swept) {
+      gridposition g(gcur.x+c.x,gcur.y+c.y,(gcur.a+c.a+GRIDA)%GRIDA);
+      if (!g.valid()) return; // leaves the grid
+      const gridslice &s=map.slice[g.a];
+      if (s.obstacle.at(g.x,g.y)!=0 && !(g==gnext)) hit=true;
+      prox=std::max(prox,s.proximity.at(g.x,g.y));
+    }
+    
+    double proxcost = 1.0 + 0.5*prox;
+    double cost=proxcost * (m.length + m.turn_cost);
+    if (hit) cost += 10000.0; // same as landing on an obstacle
+    move(cost,m.drive,next);
+  }
+  
+  // Call move(cost,drive,prev) for each step that for_each_move could take
+  //   from prev to arrive at pos (for searching backward from the target).
+  //   estimate is the estimated cost back to the origin.
+  template <class MOVE>
+  static void for_each_reverse_move(const gridmap &map,const fposition &pos,double estimate,
+    const planner_options &options,MOVE move)
+  {
+    gridposition gcur(pos);
+    if (options.lattice) {
+      const double fine_range=8.0*GRIDSIZE; // see for_each_lattice_move
+      bool near=estimate<fine_range;
+      for (const motion_primitive *m : motion_lattice::get().ending[gcur.a]) {
+        if (m->fine && !near) continue;
+        fposition prev(pos.v-m->delta,fmodplus(pos.a-m->turn,GRIDA));
+        gridposition gprev(prev);
+        if (!gprev.valid()) continue;
+        lattice_move(map,prev,gprev,*m,
+          [&](double cost,const drive_t &drive,const fposition &next) { move(cost,drive,prev); });
+      }
+      return;
+    }
+    
+    double turncost=1.0; // as in for_each_move
+    vec2 drivedir=map.slice[gcur.a].drive;
+    for (float drive=-1.0;drive<=+1.0;drive+=2.0) {
+      double distance=1.01*GRIDSIZE/std::max(fabs(drivedir.x),fabs(drivedir.y)); 
+      fposition prev(pos.v-distance*drive*drivedir,pos.a);
+      gridposition gprev(prev);
+      if (!gprev.valid()) continue;
+      double proxcost = 1.0 + 0.5*map.slice[gprev.a].proximity.at(gprev.x,gprev.y);
+      move(proxcost * distance,drive_t(drive,0.0f),prev);
+    }
+    for (float turn=-1.0;turn<=+1.0;turn+=2.0) {
+      fposition prev(pos.v,fmodplus(pos.a-turn,GRIDA));
+      gridposition gprev(prev);
+      if (!gprev.valid()) continue;
+      double proxcost = 1.0 + 0.5*map.slice[gprev.a].proximity.at(gprev.x,gprev.y);
+      move(proxcost *turncost * GRIDSIZE*TURN_COST_TO_GRID_COST,drive_t(0.0f,turn),prev);
+    }
+  }
+  
   // Build the sequence of steps needed to move the robot from origin to target.
+  //   Each planner has its own search state, and searches the map that
+  //   was committed when it started, so planners are safe to run from
+  //   several threads at once.
   class planner {
-    navigator_t &nav;
+    map_ptr map; // the map we're searching (held, so it stays valid)
+    
+    // Nonzero marks that we've visited this cell, indexed by visit_index
+    std::vector<unsigned char> visit;
+    static size_t visit_index(const gridposition &g) { return ((size_t)g.a*GRIDY+g.y)*GRIDX+g.x; }
     
     // This is the active list of searched positions, sorted by distance to target.
     typedef std::priority_queue<std::reference_wrapper<searchposition>,
@@ -454,6 +1055,8 @@ public:
     typedef std::deque<searchposition> pool_t;
     pool_t pool; // safely stores our search positions
     
+    planner_options options;
+    
     // Add this search position to our priority queue.
     //   Returns true if the point was valid and could be added.
     bool add_search(double cost,const drive_t &lastdrive,const drive_t &drive,const fposition &pos,const planner_target &target,const searchposition *last) {
@@ -461,23 +1064,14 @@ public:
       gridposition g(pos);
       if (!g.valid()) return false; // out of bounds of our grid
       
-      gridslice &s=nav.slice[g.a];
-      unsigned char &visited=nav.slice[g.a].visit.at(g.x,g.y);
+      unsigned char &visited=visit[visit_index(g)];
       if (0!=visited) return false; // already visited here
       
       // create data structure to hold this point
       visited=1; // mark as visited
-        
-      // Check for obstacles in the way:
-      const unsigned char &obs=s.obstacle.at(g.x,g.y);
-      //if (obs!=0) return false; // has obstacle
-      if (obs!=0) cost += 10000.0; // hitting obstacle counts as a 10 meter cost
       
       // Seems legal, so use heuristic to estimate cost to target
-      
-      if (!(lastdrive == drive)) 
-        cost+=20.0; // penalty for swapping drive directions
-      
+      cost+=arrival_cost(*map,g,lastdrive,drive);
       double estimate=target.get_cost_from(pos);
       pool.emplace_back(cost, estimate, drive,pos,last);
       search.push(pool.back());
@@ -496,29 +1090,39 @@ public:
     // This is how many cells we expanded
     size_t searched;
     
+    // This grid stores the winning path (for display, if verbose)
+    grid2D<char> lastpath;
     
-    planner(navigator_t &nav_,const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false) 
-      :nav(nav_)
+    planner(const navigator_t &nav_,const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false,
+        const planner_options &options_=planner_options()) 
+      :map(nav_.get_map()), options(options_)
     {
       valid = plan_path(origin,target,last_drive,verbose);
     } 
     
-    planner(navigator_t &nav_,const fposition &origin,const fposition &ftarget, drive_t last_drive=drive_t(), bool verbose=false) 
-      :nav(nav_)
+    planner(const navigator_t &nav_,const fposition &origin,const fposition &ftarget, drive_t last_drive=drive_t(), bool verbose=false,
+        const planner_options &options_=planner_options()) 
+      :map(nav_.get_map()), options(options_)
     {
       planner_target_2D target(ftarget);
       valid = plan_path(origin,target,last_drive,verbose);
     }
     
+    // Search this specific map version
+    planner(const map_ptr &map_,const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false,
+        const planner_options &options_=planner_options()) 
+      :map(map_), options(options_)
+    {
+      valid = plan_path(origin,target,last_drive,verbose);
+    } 
+    
     
     bool plan_path(const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false)
     {
       // Clear all previous visit marks
       searched=0;
-      for (int ia=0;ia<GRIDA;ia++) {
-        nav.slice[ia].visit.clear(0);
-      }
-      nav.lastpath.clear(' ');
+      visit.assign((size_t)GRIDA*GRIDY*GRIDX,0);
+      lastpath.clear(' ');
       
       // Start search at specified origin
       if (!add_search(0.0,last_drive,last_drive,origin,target,0)) 
@@ -537,7 +1141,7 @@ public:
         // Find the grid location for this cell
         gridposition gcur(cur.pos);
         if (verbose && gcur.valid()) {
-          nav.lastpath.at(gcur.x,gcur.y)='.'; // checked
+          lastpath.at(gcur.x,gcur.y)='.'; // checked
         }
         if (target.reached_target(gcur)) 
         { // we're done!  Follow the chain of "last" pointers back to the origin.
@@ -548,8 +1152,8 @@ public:
             if (verbose) {
               std::cout<<p->pos<<"\n";
               gridposition gpath(p->pos);
-              if (gpath.valid()) nav.lastpath.at(gpath.x,gpath.y)='#'; // on path
-              nav.lastpath.print(std::cout,1);
+              if (gpath.valid()) lastpath.at(gpath.x,gpath.y)='#'; // on path
+              lastpath.print(std::cout,1);
             }
           }
           
@@ -560,27 +1164,10 @@ public:
           return true;
         }
         
-        // Compute 'obstacle proximity cost' scaling factor
-        double turncost=1.0; // extra cost for more turning
-        double proxcost=10.0; // extra cost for driving near obstacles
-        if (gcur.valid())
-          proxcost = 1.0 + 0.5*nav.slice[gcur.a].proximity.at(gcur.x,gcur.y);
-        
-        // Check all nearby cells
-        vec2 drivedir=nav.slice[gcur.a].drive;
-        for (float drive=-1.0;drive<=+1.0;drive+=2.0) {
-          // Drive at least into the next grid cell:
-          double distance=1.01*GRIDSIZE/std::max(fabs(drivedir.x),fabs(drivedir.y)); 
-          
-          double cost=cur.cost + proxcost * distance;
-          fposition next(cur.pos.v+distance*drive*drivedir,cur.pos.a);
-          add_search(cost,cur.drive,drive_t(drive,0.0f),next,target,&cur);
-        }
-        for (float turn=-1.0;turn<=+1.0;turn+=2.0) {
-          double cost=cur.cost + proxcost *turncost * GRIDSIZE*TURN_COST_TO_GRID_COST;
-          fposition next(cur.pos.v,fmodplus(cur.pos.a+turn,GRIDA)); // angles wrap around
-          add_search(cost,cur.drive,drive_t(0.0f,turn),next,target,&cur);
-        }
+        for_each_move(*map,cur.pos,gcur,cur.estimate,options,
+          [&](double cost,const drive_t &drive,const fposition &next) {
+            add_search(cur.cost+cost,cur.drive,drive,next,target,&cur);
+          });
       }
       
       // If we get here, we ran out of options before reaching the target.
@@ -588,6 +1175,699 @@ public:
       return false;
     }
   }; // end planner class
+  
+  
+  // Anytime path planner (ARA*): searches with an inflated heuristic first,
+  //   so it finds some path quickly, then lowers epsilon to improve the path,
+  //   reusing the search so far, until the deadline.  Keep one of these
+  //   around: calling plan again with the same map, origin cell, last drive,
+  //   and target picks up where the last call stopped.  So does moving the
+  //   origin to a cell the search already reached, arriving by the drive
+  //   the search used (like a robot following the planned path).
+  class anytime_planner {
+    // Search state for one grid cell
+    class node {
+    public:
+      double g; // best cost found to reach here
+      double h; // heuristic estimate to reach target
+      int parent; // index of preceding node, or -1 for the origin
+      unsigned stamp; // search that set up this node (else it's unvisited)
+      unsigned closed; // epsilon iteration that expanded this node
+      unsigned queued; // heap rebuild that last queued this node
+      bool incons; // improved after being closed; waits for the next iteration
+      drive_t drive; // command to drive here from the parent
+      fposition pos; // continuous robot position
+    };
+    std::vector<node> nodes; // indexed by node_index
+    static size_t node_index(const gridposition &g) { return ((size_t)g.a*GRIDY+g.y)*GRIDX+g.x; }
+    std::vector<int> visited; // nodes this search has set up, in order
+    std::vector<unsigned char> subtree; // reroot scratch: 0 unknown, 1 under the new root, 2 not
+    
+    // OPEN list entry.  Stale entries (node improved or closed since) are skipped when popped.
+    class open_entry {
+    public:
+      double key; // g + epsilon * h
+      double g; // node's g when pushed
+      int index;
+      bool operator>(const open_entry &e) const { return key>e.key; }
+    };
+    std::vector<open_entry> open; // heap, smallest key first
+    std::vector<int> incons_list; // nodes improved after being closed
+    
+    map_ptr map; // the map we're searching (held, so it stays valid)
+    
+    // What the current search is for, to decide if the next call can resume it
+    unsigned search_stamp, iteration, rebuild;
+    bool have_search;
+    gridposition origin_cell, target_cell;
+    drive_t origin_drive;
+    
+    int goal; // best node found that reached the target, or -1
+    int closest; // obstacle-free node with the smallest estimate to the target
+    double last_bound; // bound proven by the last completed iteration
+    
+    bool is_open(const open_entry &e) const {
+      const node &n=nodes[e.index];
+      return n.g==e.g && n.closed!=iteration;
+    }
+    void push_open(int index) {
+      const node &n=nodes[index];
+      open_entry e; e.key=n.g+epsilon*n.h; e.g=n.g; e.index=index;
+      open.push_back(e);
+      std::push_heap(open.begin(),open.end(),std::greater<open_entry>());
+    }
+    
+    // Drop stale entries off the top of the heap
+    void clean_open() {
+      while (!open.empty() && !is_open(open.front())) {
+        std::pop_heap(open.begin(),open.end(),std::greater<open_entry>());
+        open.pop_back();
+      }
+    }
+    
+    // Reached this node with this cost: update it if that's an improvement
+    void relax(int parent,double g,const drive_t &drive,const fposition &pos,const planner_target &target) {
+      gridposition cell(pos);
+      if (!cell.valid()) return; // out of bounds of our grid
+      int index=(int)node_index(cell);
+      node &n=nodes[index];
+      if (n.stamp!=search_stamp) { // first visit this search
+        n.stamp=search_stamp;
+        visited.push_back(index);
+        n.closed=n.queued=0;
+        n.incons=false;
+        n.h=target.get_cost_from(pos);
+        n.g=std::numeric_limits<double>::infinity();
+      }
+      g+=arrival_cost(*map,cell,parent>=0?nodes[parent].drive:drive,drive);
+      if (!(g<n.g)) return; // we already have a way here at least this good
+      
+      n.g=g; n.parent=parent; n.drive=drive; n.pos=pos;
+      if (target.reached_target(cell) && (goal<0 || g<nodes[goal].g)) goal=index;
+      if (g<10000.0 && (closest<0 || n.h<nodes[closest].h)) closest=index; // (not through obstacles)
+      
+      if (n.closed!=iteration) push_open(index);
+      else if (!n.incons) { n.incons=true; incons_list.push_back(index); }
+    }
+    
+    // Expand nodes until we can't improve the goal at this epsilon (returns true),
+    //   or we run out of time (returns false).
+    template <class CLOCK>
+    bool improve_path(const planner_target &target,const typename CLOCK::time_point &deadline) {
+      while (true) {
+        clean_open();
+        if (open.empty()) return true;
+        if (goal>=0 && nodes[goal].g<=open.front().key) return true;
+        if ((searched&63)==0 && CLOCK::now()>deadline) return false;
+        
+        int index=open.front().index;
+        std::pop_heap(open.begin(),open.end(),std::greater<open_entry>());
+        open.pop_back();
+        
+        node &n=nodes[index];
+        n.closed=iteration;
+        searched++; searched_total++;
+        
+        gridposition cell(n.pos);
+        double g=n.g;
+        fposition pos=n.pos;
+        for_each_move(*map,pos,cell,n.h,options,
+          [&](double cost,const drive_t &drive,const fposition &next) {
+            relax(index,g+cost,drive,next,target);
+          });
+      }
+    }
+    
+    // Requeue OPEN and INCONS with the keys for the new epsilon
+    void rebuild_open() {
+      iteration++; rebuild++;
+      std::vector<open_entry> old;
+      old.swap(open);
+      for (const open_entry &e : old) {
+        node &n=nodes[e.index];
+        if (n.g!=e.g || n.queued==rebuild) continue;
+        n.queued=rebuild;
+        push_open(e.index);
+      }
+      for (int index : incons_list) {
+        node &n=nodes[index];
+        n.incons=false;
+        if (n.queued==rebuild) continue;
+        n.queued=rebuild;
+        push_open(index);
+      }
+      incons_list.clear();
+    }
+    
+    // Suboptimality bound after an iteration: goal cost over the lowest
+    //   possible cost of anything still unexpanded.
+    double compute_bound() const {
+      double lowest=nodes[goal].g;
+      for (const open_entry &e : open) 
+        if (is_open(e)) lowest=std::min(lowest,e.g+nodes[e.index].h);
+      for (int index : incons_list) 
+        lowest=std::min(lowest,nodes[index].g+nodes[index].h);
+      if (lowest<=0.0) return 1.0;
+      return std::min(epsilon,nodes[goal].g/lowest);
+    }
+    
+    // Copy out the path ending at this node
+    void extract_path(int end) {
+      path.clear();
+      for (int index=end;index>=0 && nodes[index].parent>=0;index=nodes[index].parent) {
+        const node &n=nodes[index];
+        path.emplace_front(n.g,n.h,n.drive,n.pos,(const searchposition *)0);
+      }
+      for (size_t i=1;i<path.size();i++) path[i].last=&path[i-1];
+    }
+    
+    void start_search(const fposition &origin,const planner_target &target,const drive_t &last_drive) {
+      search_stamp++; 
+      if (search_stamp==0) { // wrapped around: really clear the old stamps
+        for (node &n : nodes) n.stamp=0;
+        search_stamp=1;
+      }
+      iteration=rebuild=1;
+      epsilon=epsilon_start;
+      open.clear(); incons_list.clear(); visited.clear();
+      goal=closest=-1;
+      last_bound=std::numeric_limits<double>::infinity();
+      searched_total=0;
+      done=false;
+      
+      // Seed with the origin, arriving by the last drive
+      relax(-1,0.0,last_drive,origin,target);
+    }
+    
+    // The robot moved to a cell this search already reached: make that
+    //   cell the root, keeping the part of the search tree grown out of it
+    //   (its costs shifted so the root is 0) and dropping the rest.
+    //   Returns false if the old search can't be reused.
+    bool reroot(const gridposition &ocell,const drive_t &last_drive,const planner_target &target) {
+      int root=(int)node_index(ocell);
+      const node &r=nodes[root];
+      if (r.stamp!=search_stamp || r.g>=10000.0 || !(r.drive==last_drive)) return false;
+      if (search_stamp+1==0) return false; // stamps wrap: start over instead
+      double groot=r.g;
+      
+      // Find the root's subtree, by following parents up to the root (or the old origin)
+      std::vector<int> chain;
+      subtree[root]=1;
+      for (int i : visited) {
+        int index=i;
+        chain.clear();
+        while (index>=0 && subtree[index]==0) { chain.push_back(index); index=nodes[index].parent; }
+        unsigned char mark=(index>=0 && subtree[index]==1)?1:2;
+        for (int c : chain) subtree[c]=mark;
+      }
+      
+      // Keep the subtree under a new stamp (everything else reads as unvisited).
+      //   Expanded nodes may have reached cells through the dropped part of
+      //   the tree, so every kept node gets queued to expand again.  Their
+      //   costs are real paths from the root, so the search stays correct,
+      //   and the re-expansion happens in plan, within the deadline.
+      std::vector<int> kept;
+      search_stamp++;
+      goal=closest=-1;
+      open.clear(); incons_list.clear();
+      for (int i : visited) {
+        if (subtree[i]!=1) continue;
+        subtree[i]=0;
+        node &n=nodes[i];
+        n.stamp=search_stamp;
+        n.g-=groot;
+        if (i==root) { n.parent=-1; n.g=0.0; }
+        n.closed=0; n.incons=false;
+        kept.push_back(i);
+        open_entry e; e.key=n.g+epsilon*n.h; e.g=n.g; e.index=i;
+        open.push_back(e);
+        if (target.reached_target(gridposition(n.pos)) && (goal<0 || n.g<nodes[goal].g)) goal=i;
+        if (n.g<10000.0 && (closest<0 || n.h<nodes[closest].h)) closest=i;
+      }
+      for (int i : visited) subtree[i]=0;
+      visited.swap(kept);
+      std::make_heap(open.begin(),open.end(),std::greater<open_entry>());
+      
+      last_bound=std::numeric_limits<double>::infinity();
+      done=false;
+      return true;
+    }
+    
+  public:
+    planner_options options; // takes effect when the next search starts
+    
+    // Heuristic weight schedule
+    double epsilon_start; // first iteration's heuristic weight
+    double epsilon_step; // decrease per iteration, down to 1.0
+    
+    // Results from the last call to plan:
+    bool valid; // path reaches the target
+    bool partial; // no path yet: path only leads toward the target
+    std::deque<searchposition> path; // sequence of steps from origin
+    double bound; // path cost is within this factor of the best path (infinity if unknown)
+    double epsilon; // heuristic weight of the current iteration
+    size_t searched; // cells expanded during the last call
+    size_t searched_total; // cells expanded since this search started
+    bool done; // finished at epsilon 1: further calls won't improve the path
+    
+    anytime_planner(const planner_options &options_=planner_options())
+      :search_stamp(0), iteration(0), rebuild(0), have_search(false),
+       origin_cell(-1,-1,-1), target_cell(-1,-1,-1),
+       goal(-1), closest(-1), last_bound(0.0), options(options_),
+       epsilon_start(3.0), epsilon_step(0.5),
+       valid(false), partial(false), bound(0.0), epsilon(0.0), searched(0), searched_total(0), done(false)
+    {
+      nodes.resize((size_t)GRIDA*GRIDY*GRIDX); // allocate up front, so plan stays within its deadline
+      subtree.resize(nodes.size(),0);
+      visited.reserve(nodes.size());
+    }
+    
+    // Plan a path from origin to target, taking at most deadline_us
+    //   microseconds.  Returns true if the path reaches the target.
+    //   If the target hasn't been reached yet, path leads as close as we got.
+    bool plan(const map_ptr &map_,const fposition &origin,const fposition &ftarget,drive_t last_drive,long deadline_us)
+    {
+      typedef std::chrono::steady_clock clock;
+      clock::time_point deadline=clock::now()+std::chrono::microseconds(deadline_us);
+      planner_target_2D target(ftarget);
+      
+      gridposition ocell(origin), tcell(ftarget);
+      if (!ocell.valid()) { // Start point no good: can't do this.
+        std::cout<<"Starting point is off the grid!?\n";
+        have_search=false;
+        valid=partial=false;
+        path.clear();
+        return false;
+      }
+      
+      searched=0;
+      bool same=have_search && map_==map && tcell==target_cell;
+      bool resume=same && ocell==origin_cell && last_drive==origin_drive;
+      if (!resume && same && reroot(ocell,last_drive,target)) { // moved along our search tree
+        origin_cell=ocell; origin_drive=last_drive;
+        resume=true;
+      }
+      if (!resume) {
+        map=map_;
+        origin_cell=ocell; target_cell=tcell; origin_drive=last_drive;
+        have_search=true;
+        start_search(origin,target,last_drive);
+      }
+      
+      while (!done) {
+        if (!improve_path<clock>(target,deadline)) break; // out of time
+        
+        // Finished an iteration
+        if (goal<0) break; // out of search options: can't get there from here
+        last_bound=compute_bound();
+        if (epsilon<=1.0) done=true;
+        else {
+          epsilon=std::max(1.0,epsilon-epsilon_step);
+          rebuild_open();
+        }
+      }
+      
+      valid=(goal>=0);
+      partial=!valid && closest>=0;
+      bound=valid?last_bound:std::numeric_limits<double>::infinity();
+      extract_path(valid?goal:closest);
+      return valid;
+    }
+    
+    bool plan(const navigator_t &nav,const fposition &origin,const fposition &ftarget,drive_t last_drive,long deadline_us)
+    {
+      return plan(nav.get_map(),origin,ftarget,last_drive,deadline_us);
+    }
+    
+    // True if the last search ran out of options before reaching the target
+    bool exhausted() const { return have_search && goal<0 && open.empty(); }
+  }; // end anytime_planner class
+  
+  
+  // Bidirectional A*: grows one search forward from the origin and one
+  //   backward from the target (over reversed moves), and joins them where
+  //   they meet.  Long drives across the field expand two small cones
+  //   instead of one wide one.
+  class bidirectional_planner {
+    map_ptr map; // the map we're searching (held, so it stays valid)
+    planner_options options;
+    
+    typedef std::priority_queue<std::reference_wrapper<searchposition>,
+      std::vector< std::reference_wrapper<searchposition> >,
+      std::greater<searchposition> > search_t;
+    
+    // One direction of search.
+    //   Backward, a searchposition's drive is the move out of it,
+    //   and last is the next position toward the target.
+    class side {
+    public:
+      search_t search;
+      std::deque<searchposition> pool; // safely stores our search positions
+      size_t searched;
+      
+      side() :searched(0) {}
+    };
+    side fwd, bwd;
+    
+    // Who has visited each grid cell, indexed by visit_index:
+    //   0 for nobody, n>0 for fwd.pool[n-1], n<0 for bwd.pool[-n-1], or both_sides.
+    std::vector<int> cell;
+    enum {both_sides=-0x7fffffff};
+    static size_t visit_index(const gridposition &g) { return ((size_t)g.a*GRIDY+g.y)*GRIDX+g.x; }
+    
+    // Best meeting found so far
+    double meet_cost;
+    const searchposition *meet_fwd, *meet_bwd;
+    
+    // Cost to join a forward and backward position in the same cell
+    double join_cost(const searchposition &f,const searchposition &b,const gridposition &g) const {
+      double cost=f.cost+b.cost;
+      if (map->slice[g.a].obstacle.at(g.x,g.y)!=0) cost-=10000.0; // both sides charged this cell
+      if (b.last!=NULL && !(f.drive==b.drive)) cost+=20.0; // changing drive directions here
+      return cost;
+    }
+    
+    // Add this search position to one side, and check if it meets the other.
+    //   nextdrive is the move already adjacent to it (into it, or out of it backward).
+    void add_search(bool forward,double cost,const drive_t &nextdrive,const drive_t &drive,
+      const fposition &pos,const planner_target &target,const searchposition *link) 
+    {
+      gridposition g(pos);
+      if (!g.valid()) return; // out of bounds of our grid
+      int &visited=cell[visit_index(g)];
+      if (visited==both_sides || (forward?visited>0:visited<0)) return; // already visited here
+      
+      side &us=forward?fwd:bwd;
+      cost+=arrival_cost(*map,g,nextdrive,drive);
+      double estimate=target.get_cost_from(pos);
+      us.pool.emplace_back(cost,estimate,drive,pos,link);
+      searchposition &p=us.pool.back();
+      us.search.push(p);
+      
+      if (visited==0) { visited=forward?(int)us.pool.size():-(int)us.pool.size(); return; }
+      
+      // The other side got here already: that's a way through
+      const searchposition *other=forward?&bwd.pool[-visited-1]:&fwd.pool[visited-1];
+      const searchposition &f=forward?p:*other, &b=forward?*other:p;
+      double c=join_cost(f,b,g);
+      if (meet_fwd==NULL || c<meet_cost) { meet_cost=c; meet_fwd=&f; meet_bwd=&b; }
+      visited=both_sides;
+    }
+    
+    // Return the lowest estimated total cost still waiting on this side
+    static double best_total(const side &s) {
+      return s.search.top().get().total_cost();
+    }
+    
+  public:
+    // This bool marks that we found a good path.
+    //    false == "you can't get there from here"
+    bool valid;
+    
+    // This is the sequence of steps from origin to target
+    std::deque<searchposition> path;
+    
+    // This is how many cells we expanded, total and from each end
+    size_t searched, searched_forward, searched_backward;
+    
+    bidirectional_planner(const navigator_t &nav_,const fposition &origin,const fposition &target,drive_t last_drive=drive_t(),
+        const planner_options &options_=planner_options()) 
+      :map(nav_.get_map()), options(options_)
+    {
+      valid = plan_path(origin,target,last_drive);
+    }
+    
+    // Search this specific map version
+    bidirectional_planner(const map_ptr &map_,const fposition &origin,const fposition &target,drive_t last_drive=drive_t(),
+        const planner_options &options_=planner_options()) 
+      :map(map_), options(options_)
+    {
+      valid = plan_path(origin,target,last_drive);
+    }
+    
+    bool plan_path(const fposition &origin,const fposition &target,drive_t last_drive)
+    {
+      searched=searched_forward=searched_backward=0;
+      meet_cost=0.0; meet_fwd=meet_bwd=NULL;
+      cell.assign((size_t)GRIDA*GRIDY*GRIDX,0);
+      planner_target_2D to_target(target), to_origin(origin);
+      
+      add_search(true,0.0,last_drive,last_drive,origin,to_target,0);
+      if (fwd.pool.empty()) 
+      { // Start point no good: can't do this.
+        std::cout<<"Starting point is off the grid!?\n";
+        return false;
+      }
+      add_search(false,0.0,drive_t(),drive_t(),target,to_origin,0);
+      if (bwd.pool.empty()) return false; // target is off the grid
+      
+      // Expand whichever side has the smaller frontier, until neither
+      //   side can beat the best meeting.
+      while (!fwd.search.empty() && !bwd.search.empty()) {
+        if (meet_fwd && meet_cost<=std::max(best_total(fwd),best_total(bwd))) break;
+        
+        bool forward=fwd.search.size()<=bwd.search.size();
+        side &us=forward?fwd:bwd;
+        const searchposition &cur=us.search.top(); us.search.pop();
+        us.searched++;
+        
+        if (forward) {
+          gridposition gcur(cur.pos);
+          for_each_move(*map,cur.pos,gcur,cur.estimate,options,
+            [&](double cost,const drive_t &drive,const fposition &next) {
+              add_search(true,cur.cost+cost,cur.drive,drive,next,to_target,&cur);
+            });
+        }
+        else {
+          // The target itself has no move out of it yet, so no direction change there
+          bool seed=(cur.last==NULL);
+          for_each_reverse_move(*map,cur.pos,cur.estimate,options,
+            [&](double cost,const drive_t &drive,const fposition &prev) {
+              add_search(false,cur.cost+cost,seed?drive:cur.drive,drive,prev,to_origin,&cur);
+            });
+        }
+      }
+      searched_forward=fwd.searched; searched_backward=bwd.searched;
+      searched=searched_forward+searched_backward;
+      if (!meet_fwd) return false; // ran out of options before meeting
+      
+      // Forward half: follow last pointers back to the origin
+      for (const searchposition *p=meet_fwd;p->last!=NULL;p=p->last) 
+        path.push_front(*p);
+      // Backward half: each position's drive takes us to the next one.
+      //   Backward costs charge each cell on leaving it, so re-add the
+      //   charges in driving order: step, then arriving at the next cell.
+      double cost=meet_fwd->cost;
+      drive_t lastdrive=meet_fwd->drive;
+      for (const searchposition *p=meet_bwd;p->last!=NULL;p=p->last) {
+        const searchposition *q=p->last;
+        double step=p->cost-q->cost-arrival_cost(*map,gridposition(p->pos),(q->last==NULL)?p->drive:q->drive,p->drive);
+        cost+=step+arrival_cost(*map,gridposition(q->pos),lastdrive,p->drive);
+        lastdrive=p->drive;
+        path.emplace_back(cost,meet_cost-cost,p->drive,q->pos,(const searchposition *)0);
+      }
+      for (size_t i=0;i<path.size();i++) 
+        path[i].last=(i>0)?&path[i-1]:NULL;
+      return true;
+    }
+  }; // end bidirectional_planner class
+  
+  
+  // Cost to reach one goal pose from every configuration-space cell,
+  //   computed by a backward Dijkstra search (with one-cell moves, so every
+  //   reachable cell gets a cost).  Drive direction changes aren't counted.
+  class cost_field {
+  public:
+    map_ptr map; // the map this was computed on
+    fposition goal;
+    gridposition gtarget; // goal cell
+    std::vector<float> cost; // cost to reach the goal, indexed by index(); infinity if unreachable
+    
+    static size_t index(const gridposition &g) { return ((size_t)g.a*GRIDY+g.y)*GRIDX+g.x; }
+    
+    cost_field(const map_ptr &map_,const fposition &goal_)
+      :map(map_), goal(goal_), gtarget(goal_), 
+       cost((size_t)GRIDA*GRIDY*GRIDX,std::numeric_limits<float>::infinity())
+    {
+      if (!gtarget.valid()) return;
+      typedef std::pair<float,int> entry; // cost, index
+      std::priority_queue<entry,std::vector<entry>,std::greater<entry> > search;
+      cost[index(gtarget)]=0.0f;
+      search.push(entry(0.0f,(int)index(gtarget)));
+      planner_options grid_moves;
+      while (!search.empty()) {
+        entry e=search.top(); search.pop();
+        if (e.first>cost[e.second]) continue; // already found a cheaper way
+        
+        gridposition g(e.second%GRIDX,(e.second/GRIDX)%GRIDY,e.second/(GRIDX*GRIDY));
+        fposition pos(vec2(g.x*GRIDSIZE,g.y*GRIDSIZE),g.a); // cell center
+        double arrive=e.first;
+        if (map->slice[g.a].obstacle.at(g.x,g.y)!=0) arrive+=10000.0; // as arrival_cost
+        for_each_reverse_move(*map,pos,e.first,grid_moves,
+          [&](double step,const drive_t &drive,const fposition &prev) {
+            int i=(int)index(gridposition(prev)); // (reverse moves stay on the grid)
+            float c=arrive+step;
+            if (c<cost[i]) { cost[i]=c; search.push(entry(c,i)); }
+          });
+      }
+    }
+    
+    // Cost to reach the goal from this cell
+    float at(const gridposition &g) const {
+      if (!g.valid()) return std::numeric_limits<float>::infinity();
+      return cost[index(g)];
+    }
+    
+    // Walk downhill from origin to the goal, taking the cheapest move each step.
+    //   Moves start from cell centers, like the field's.
+    //   Returns false if there's no way there, or if we get stuck.
+    bool descend(const fposition &origin,drive_t last_drive,std::deque<searchposition> &path) const
+    {
+      path.clear();
+      gridposition gcur(origin);
+      double total=0.0;
+      planner_options grid_moves;
+      while (!(gcur==gtarget)) {
+        float here=at(gcur);
+        if (!(here<std::numeric_limits<float>::infinity())) return false; // unreachable
+        
+        double best=std::numeric_limits<double>::infinity(), best_cost=0.0;
+        drive_t best_drive; fposition best_pos;
+        fposition pos(vec2(gcur.x*GRIDSIZE,gcur.y*GRIDSIZE),gcur.a); // cell center
+        for_each_move(*map,pos,gcur,here,grid_moves,
+          [&](double step,const drive_t &drive,const fposition &next) {
+            gridposition g(next);
+            if (!g.valid() || !(at(g)<here)) return; // only go downhill
+            double c=step+arrival_cost(*map,g,last_drive,drive);
+            if (c+at(g)<best) { best=c+at(g); best_cost=c; best_drive=drive; best_pos=next; }
+          });
+        if (!(best<std::numeric_limits<double>::infinity())) return false; // stuck
+        
+        total+=best_cost;
+        gcur=gridposition(best_pos); last_drive=best_drive;
+        path.emplace_back(total,at(gcur),best_drive,best_pos,path.empty()?(const searchposition *)0:&path.back());
+      }
+      return true;
+    }
+  };
+  typedef std::shared_ptr<const cost_field> field_ptr;
+  
+  // Planner target using a cost field: the estimate is the field's cost,
+  //   so the planner heads straight for the goal.
+  class planner_target_field : public planner_target {
+    field_ptr field;
+  public:
+    planner_target_field(const field_ptr &field_) :field(field_) {}
+    
+    virtual double get_cost_from(const fposition &from_pos) const
+    {
+      return field->at(gridposition(from_pos));
+    }
+    
+    virtual bool reached_target(const gridposition &grid) const 
+    {
+      return grid==field->gtarget;
+    }
+    
+    ~planner_target_field() {}
+  };
+  
+  // Keeps cost fields for a few goals we drive to over and over,
+  //   recomputing them on a background thread when the map changes.
+  class goal_fields {
+    navigator_t &nav;
+    size_t max_goals;
+    int listener; // our commit listener ID
+    
+    std::mutex lock; // protects everything below
+    std::condition_variable wake;
+    bool quit;
+    std::vector<fposition> goals; // least recently used first
+    std::vector<field_ptr> fields; // latest field for each goal, or null if not computed yet
+    std::thread worker;
+    
+    // Return our index for this goal, or -1 if it isn't registered
+    int find(const fposition &goal) const {
+      gridposition g(goal);
+      for (size_t i=0;i<goals.size();i++) 
+        if (gridposition(goals[i])==g) return (int)i;
+      return -1;
+    }
+    
+    // Background thread: recompute fields older than the current map,
+    //   most recently requested first.
+    void run() {
+      std::unique_lock<std::mutex> guard(lock);
+      while (!quit) {
+        map_ptr map=nav.get_map();
+        int todo=-1;
+        for (int i=(int)goals.size()-1;i>=0 && todo<0;i--) 
+          if (!fields[i] || fields[i]->map!=map) todo=i;
+        if (todo<0) { wake.wait(guard); continue; }
+        
+        fposition goal=goals[todo];
+        guard.unlock();
+        field_ptr field=std::make_shared<const cost_field>(map,goal);
+        guard.lock();
+        todo=find(goal); // might have moved, or been dropped
+        if (todo>=0) fields[todo]=field;
+      }
+    }
+    
+    // Add this goal (with the lock held), dropping the least recently used past max_goals
+    void add_locked(const fposition &goal) {
+      if (goals.size()>=max_goals) {
+        goals.erase(goals.begin());
+        fields.erase(fields.begin());
+      }
+      goals.push_back(goal);
+      fields.push_back(field_ptr());
+      wake.notify_one();
+    }
+    
+  public:
+    goal_fields(navigator_t &nav_,size_t max_goals_=8)
+      :nav(nav_), max_goals(max_goals_), quit(false)
+    {
+      worker=std::thread(&goal_fields::run,this);
+      listener=nav.add_commit_listener([this]() { // new map: recompute
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_one();
+      });
+    }
+    ~goal_fields() {
+      nav.remove_commit_listener(listener);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        quit=true;
+        wake.notify_one();
+      }
+      worker.join();
+    }
+    
+    // Start computing a field for this goal
+    void add_goal(const fposition &goal) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (find(goal)<0) add_locked(goal);
+    }
+    
+    // Return the newest field for this goal, which may be for an older map,
+    //   or null if it hasn't been computed yet (or isn't one of our goals:
+    //   only add_goal registers goals, so moving targets don't evict them).
+    field_ptr get(const fposition &goal) {
+      std::lock_guard<std::mutex> guard(lock);
+      int i=find(goal);
+      if (i<0) return field_ptr();
+      
+      // Mark as most recently used
+      fposition g=goals[i]; field_ptr f=fields[i];
+      goals.erase(goals.begin()+i); fields.erase(fields.begin()+i);
+      goals.push_back(g); fields.push_back(f);
+      
+      if (!f || f->map!=nav.get_map()) wake.notify_one(); // map changed: recompute
+      return f;
+    }
+  };
 
 }; // end templated class gridnavigator
 
@@ -9,6 +9,12 @@
 #include "gridnav.h"
 #include "../../firmware/field_geometry.h"
 
+// Our robot is mirror symmetric left/right (see clearance_height), so by default
+//   the navigator stores half the footprints.  Define as 0 to store them all.
+#ifndef GRIDNAV_RMC_SYMMETRY
+#  define GRIDNAV_RMC_SYMMETRY gridnav::SYMMETRY_LEFT_RIGHT
+#endif
+
 /**
   Build a gridnav navigator to plan paths for our 
   Robot Mining Competition sized robot.
@@ -25,26 +31,88 @@ public:
   enum {ROBOTSIZE=(80+GRIDSIZE-1)/GRIDSIZE}; // maximum size measured from middle
 
   // Create the navigator and planner
-  typedef gridnav::gridnavigator<GRIDX, GRIDY, GRIDA, GRIDSIZE, ROBOTSIZE> navigator_t;
+  typedef gridnav::gridnavigator<GRIDX, GRIDY, GRIDA, GRIDSIZE, ROBOTSIZE, GRIDNAV_RMC_SYMMETRY> navigator_t;
   navigator_t navigator;
   
   typedef navigator_t::planner planner;
+  typedef navigator_t::anytime_planner anytime_planner;
+  typedef navigator_t::bidirectional_planner bidirectional_planner;
+  typedef navigator_t::goal_fields goal_fields;
   typedef navigator_t::fposition fposition;
   typedef navigator_t::searchposition searchposition;
   
   // Discretized version of our geometry
   navigator_t::robot_grid_geometry robot;
   
+  // Startup cache file (empty for none), and the key its contents must match
+  std::string cache_file;
+  uint64_t cache_key=0;
+  
   // Build the navigator:
   rmc_navigator(bool verbose=false) :robot(*this,verbose)
   {
     navigator.mark_edges(robot);
   }
   
+  // True if we were loaded from the cache file, and don't need setting up.
+  bool cached=false;
+  
+  // Load the navigator from this cache file if it matches our geometry,
+  //   or build it as usual if not.  setup_key identifies whatever obstacles
+  //   the caller marks after building (bump it when those change);
+  //   call save_cache once they're marked.
+  rmc_navigator(const char *filename,uint64_t setup_key,bool verbose=false)
+    :cache_file(filename?filename:""), cache_key(geometry_key(setup_key))
+  {
+    cached=filename && navigator.load_cache(filename,cache_key,robot);
+    if (!cached) {
+      robot=navigator_t::robot_grid_geometry(*this,verbose);
+      navigator.mark_edges(robot);
+    }
+  }
+  
+  // Write our footprints and current map to the cache file, for the next start.
+  bool save_cache() const {
+    if (cache_file.empty()) return false;
+    return navigator.save_cache(cache_file.c_str(),cache_key,robot);
+  }
+  
+  // Hash of every constant that goes into the robot footprint and field edges
+  static uint64_t geometry_key(uint64_t setup_key) {
+    const long constants[]={
+      robot_x, robot_y, robot_track_y, robot_inside_clearance,
+      robot_box_y, robot_box_clearance,
+      robot_mine_x, robot_mine_y, robot_mine_radius, robot_mine_clearance,
+      field_y_size, field_y_start_zone, field_y_mine_zone, field_y_mine_start, field_x_size,
+      field_x_trough_edge, field_x_trough_stop, field_x_trough_align,
+      field_x_trough_start, field_x_trough_end, field_angle_trough,
+      field_y_trough_center, field_x_trough_center, field_y_trough_size,
+      field_y_beacon, field_x_beacon,
+      (long)setup_key
+    };
+    uint64_t hash=14695981039346656037ull; // 64-bit FNV-1a
+    const unsigned char *bytes=(const unsigned char *)constants;
+    for (size_t i=0;i<sizeof(constants);i++) {
+      hash^=bytes[i];
+      hash*=1099511628211ull;
+    }
+    return hash;
+  }
+  
   // Add an obstacle at this (x,y), in centimeters (rounds to navigation grid cell)
   void mark_obstacle(int x,int y,int height) {
      navigator.mark_obstacle((x+GRIDSIZE/2)/GRIDSIZE,(y+GRIDSIZE/2)/GRIDSIZE,height,robot);
   }
+  
+  // Add a batch of obstacles, (x,y) in centimeters, and update proximity around them.
+  //   Much faster than mark_obstacle on each, then compute_proximity.
+  void mark_obstacles(const std::vector<navigator_t::obstacle_mark> &list) {
+     std::vector<navigator_t::obstacle_mark> grid;
+     grid.reserve(list.size());
+     for (const navigator_t::obstacle_mark &o : list)
+       grid.push_back(navigator_t::obstacle_mark((o.x+GRIDSIZE/2)/GRIDSIZE,(o.y+GRIDSIZE/2)/GRIDSIZE,o.height));
+     navigator.mark_obstacles(grid,robot);
+  }
 
 
  // gridnav::robot_geometry interface:
@@ -14,6 +14,7 @@ int main()
   for (int x=0;x<150;x++) nav.mark_obstacle(x,300,40);
   // Make a straddleable obstacle in middle
   // for (int x=150;x<250;x++) nav.mark_obstacle(x,300,10);
+  nav.navigator.commit(); // make the obstacles visible to planners
   
   // Plan a path
   std::cout<<"Planning path\n";
@@ -24,7 +25,7 @@ int main()
   for (const rmc_navigator::searchposition &p : plan.path)
     std::cout<<"Plan position: "<<p.pos<<" drive "<<p.drive<<"\n";
   
-  nav.navigator.lastpath.print();
+  plan.lastpath.print(std::cout);
   
   return 0;
 }
@@ -30,6 +30,15 @@ void grid_square::addPoint(float z)
 		max=z;
 	}
 }
+void grid_square::setStats(int count_,float min_,float max_,float sum_,float sumSquares_)
+{
+	count=count_;
+	min=min_;
+	max=max_;
+	sum=sum_;
+	sumSquares=sumSquares_;
+	flags=0;
+}
 float grid_square::getMean() const
 {
 	return sum/count;
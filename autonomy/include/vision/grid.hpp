@@ -37,10 +37,15 @@ public:
 
   void setFlag(int the_flag) { flags |= the_flag; }
   bool getFlag(int the_flag) const { return the_flag & flags; }
+
+  /* Overwrite our statistics (used when reading saved grids) */
+  void setStats(int count,float min,float max,float sum,float sumSquares);
 };
 
 int compare(grid_square a, grid_square b);
 
+#include "grid_file.h"
+
 
 
 
@@ -117,27 +122,61 @@ public:
   }
 #endif
 
-  /* Write this obstacle grid to this base filename */
-  void write(std::string filename) const
+  /* Write this obstacle grid to this base filename, in grid_file format
+     (filename.grid), with this camera pose. */
+  void write(std::string filename,const grid_file_pose &pose=grid_file_pose(),bool compress=true) const
   {
 
 #ifdef OPENCV_CORE_HPP
     imwrite((filename+".png").c_str(),get_debug_2D(1));
 #endif
     
+    grid_file_write(filename+".grid",grid,GRIDX,GRIDY,GRIDSIZE,pose,compress);
+  }
+
+  /* Write this obstacle grid to filename.bin, as raw grid_squares (old format) */
+  void write_legacy(std::string filename) const
+  {
     FILE *f=fopen((filename+".bin").c_str(),"wb");
     fwrite(&grid[0],obstacle_grid::GRIDY*obstacle_grid::GRIDX,sizeof(grid[0]),f);
     fclose(f);
   }
 
-
-  /* Read this obstacle grid from this base filename */
-  void read(std::string filename)
+  /* Read this obstacle grid from this base filename.
+     Reads filename.grid if it exists, or else the old filename.bin format.
+     Returns false if neither could be read. */
+  bool read(std::string filename,grid_file_pose *pose=0)
   {
+    size_t dot=filename.rfind('.');
+    if (dot!=std::string::npos && (filename.substr(dot)==".grid" || filename.substr(dot)==".bin"))
+      filename=filename.substr(0,dot); // strip extension
+    
+    grid_file g(filename+".grid");
+    if (g.ok()) {
+      if (g.header->gridx!=GRIDX || g.header->gridy!=GRIDY || g.header->cellsize!=GRIDSIZE) {
+        printf("Error reading %s.grid: grid is %d x %d x %.0f cm, expected %d x %d x %d cm\n",
+          filename.c_str(),(int)g.header->gridx,(int)g.header->gridy,g.header->cellsize,
+          (int)GRIDX,(int)GRIDY,(int)GRIDSIZE);
+        return false;
+      }
+      if (pose) *pose=g.header->pose;
+      if (!g.unpack(&grid[0])) {
+        printf("Error reading %s.grid: corrupt cell data\n",filename.c_str());
+        return false;
+      }
+      return true;
+    }
+    
     FILE *f=fopen((filename+".bin").c_str(),"rb");
-    if (!fread(&grid[0],obstacle_grid::GRIDY*obstacle_grid::GRIDX,sizeof(grid[0]),f))
-      printf("Error doing read from %s\n",filename.c_str());
+    if (!f) {
+      printf("Error opening %s.grid or %s.bin\n",filename.c_str(),filename.c_str());
+      return false;
+    }
+    bool ok=fread(&grid[0],obstacle_grid::GRIDY*obstacle_grid::GRIDX,sizeof(grid[0]),f);
+    if (!ok) printf("Error doing read from %s\n",filename.c_str());
     fclose(f);
+    if (pose) memset(pose,0,sizeof(*pose));
+    return ok;
   }
 };
 
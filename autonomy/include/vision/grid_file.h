@@ -0,0 +1,257 @@
+/**
+  Compact on-disk format for obstacle grids.
+
+  One file holds one scan:
+     grid_file_header (grid size, cell size, camera pose, timestamp)
+     cell data: one grid_file_cell per grid cell, or if compressed,
+       runs of (grid_file_run, then run.literal grid_file_cell records)
+  Cell statistics are quantized to 16 bits, and empty cells take no
+  space when compressed, so a scan is a few tens of KB instead of ~470KB.
+
+  Uncompressed files can be memory-mapped and the cells used in place.
+
+  This is included by grid.hpp, after grid_square is declared.
+*/
+#ifndef __AURORA_GRID_FILE_H
+#define __AURORA_GRID_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define GRID_FILE_MAGIC "AUGRID1"
+enum {GRID_FILE_VERSION=1};
+enum {GRID_FILE_ZSCALE=100}; // quantized heights per cm
+
+// Header flags
+enum {
+  grid_file_compressed=1, // cell data is run-length encoded
+};
+
+/** Where the camera was when this grid was captured */
+struct grid_file_pose {
+  float camera_x, camera_y, camera_z; // camera origin, cm field coordinates
+  float angle_deg; // stepper angle, degrees
+  double timestamp; // capture time, seconds
+};
+
+/** Start of the file */
+struct grid_file_header {
+  char magic[8]; // GRID_FILE_MAGIC
+  uint32_t version; // GRID_FILE_VERSION
+  uint32_t header_bytes; // sizeof(grid_file_header), sanity check
+
+  uint32_t gridx, gridy; // grid size, in cells
+  float cellsize; // cm per grid cell
+  uint32_t flags; // grid_file_ flags
+  grid_file_pose pose;
+
+  uint32_t cell_bytes; // sizeof(grid_file_cell), sanity check
+  uint32_t data_bytes; // bytes of cell data following the header
+};
+
+/** Quantized statistics for one grid_square */
+struct grid_file_cell {
+  uint16_t count; // number of samples (saturates at 65535)
+  int16_t min, max, mean; // heights, in 1/GRID_FILE_ZSCALE cm
+  uint16_t stddev; // standard deviation, in 1/GRID_FILE_ZSCALE cm
+};
+
+/** Compressed data: skip this many empty cells, then literal cells follow */
+struct grid_file_run {
+  uint16_t skip;
+  uint16_t literal;
+};
+
+/* Quantize this height to the file format */
+inline int16_t grid_file_quantize(float z) {
+  float q=floor(z*GRID_FILE_ZSCALE+0.5f);
+  if (q>32767) q=32767;
+  if (q<-32768) q=-32768;
+  return (int16_t)q;
+}
+
+/* Convert between grid_square and the file format */
+inline grid_file_cell grid_file_pack(const grid_square &g) {
+  grid_file_cell c;
+  memset(&c,0,sizeof(c));
+  if (g.getCount()<=0) return c;
+  c.count=g.getCount()>65535?65535:g.getCount();
+  c.min=grid_file_quantize(g.getMin());
+  c.max=grid_file_quantize(g.getMax());
+  c.mean=grid_file_quantize(g.getMean());
+  float var=g.getVariance();
+  c.stddev=(uint16_t)std::min(65535.0f,floor(sqrt(var>0.0f?var:0.0f)*GRID_FILE_ZSCALE+0.5f));
+  return c;
+}
+inline grid_square grid_file_unpack(const grid_file_cell &c) {
+  grid_square g;
+  if (c.count==0) return g;
+  const float s=1.0f/GRID_FILE_ZSCALE;
+  float mean=c.mean*s, sd=c.stddev*s;
+  g.setStats(c.count,c.min*s,c.max*s,mean*c.count,c.count*(sd*sd+mean*mean));
+  return g;
+}
+
+/* Encode these cells, run-length encoding the empty ones */
+inline void grid_file_compress(const std::vector<grid_file_cell> &cells,std::vector<unsigned char> &out)
+{
+  size_t i=0, n=cells.size();
+  while (i<n) {
+    grid_file_run run;
+    run.skip=run.literal=0;
+    while (i<n && cells[i].count==0 && run.skip<65535) { run.skip++; i++; }
+    size_t first=i;
+    while (i<n && cells[i].count!=0 && run.literal<65535) { run.literal++; i++; }
+    const unsigned char *r=(const unsigned char *)&run;
+    out.insert(out.end(),r,r+sizeof(run));
+    if (run.literal>0) {
+      const unsigned char *c=(const unsigned char *)&cells[first];
+      out.insert(out.end(),c,c+run.literal*sizeof(grid_file_cell));
+    }
+  }
+}
+
+/* Write these grid cells to a new grid file.  Returns false on errors. */
+inline bool grid_file_write(const std::string &filename,
+  const std::vector<grid_square> &grid,int gridx,int gridy,float cellsize,
+  const grid_file_pose &pose,bool compress=true)
+{
+  std::vector<grid_file_cell> cells(grid.size());
+  for (size_t i=0;i<grid.size();i++) cells[i]=grid_file_pack(grid[i]);
+
+  std::vector<unsigned char> data;
+  if (compress) grid_file_compress(cells,data);
+  else {
+    const unsigned char *c=(const unsigned char *)&cells[0];
+    data.assign(c,c+cells.size()*sizeof(grid_file_cell));
+  }
+
+  grid_file_header h;
+  memset(&h,0,sizeof(h));
+  memcpy(h.magic,GRID_FILE_MAGIC,8);
+  h.version=GRID_FILE_VERSION;
+  h.header_bytes=sizeof(h);
+  h.gridx=gridx; h.gridy=gridy;
+  h.cellsize=cellsize;
+  h.flags=compress?grid_file_compressed:0;
+  h.pose=pose;
+  h.cell_bytes=sizeof(grid_file_cell);
+  h.data_bytes=data.size();
+
+  FILE *f=fopen(filename.c_str(),"wb");
+  if (!f) {
+    printf("Error creating grid file %s\n",filename.c_str());
+    return false;
+  }
+  bool ok=(1==fwrite(&h,sizeof(h),1,f));
+  if (data.size()>0) ok=ok && (1==fwrite(&data[0],data.size(),1,f));
+  fclose(f);
+  return ok;
+}
+
+
+/**
+  Read-only, memory-mapped view of a grid file.
+*/
+class grid_file {
+  const unsigned char *base; // mmap'd file data
+  uint64_t length; // bytes in file
+
+  bool fail(const char *why) {
+    printf("Error reading grid file %s: %s\n",filename.c_str(),why);
+    if (base) munmap((void *)base,length);
+    base=0; header=0;
+    return false;
+  }
+
+  bool open_file(void) {
+    int fd=open(filename.c_str(),O_RDONLY);
+    if (fd<0) return false; // no such file (not an error; caller may try legacy)
+    struct stat st;
+    if (fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(grid_file_header)) {
+      close(fd);
+      return fail("file too short");
+    }
+    length=st.st_size;
+    void *p=mmap(0,length,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); // the mapping keeps the file open
+    if (p==MAP_FAILED) return fail("can't mmap file");
+    base=(const unsigned char *)p;
+
+    header=(const grid_file_header *)base;
+    if (0!=memcmp(header->magic,GRID_FILE_MAGIC,8)) return fail("not a grid file");
+    if (header->version>GRID_FILE_VERSION) return fail("file version is too new");
+    if (header->header_bytes!=sizeof(grid_file_header)) return fail("header size mismatch");
+    if (header->cell_bytes!=sizeof(grid_file_cell)) return fail("cell size mismatch");
+    if (sizeof(grid_file_header)+(uint64_t)header->data_bytes>length) return fail("file truncated");
+    if (!(header->flags&grid_file_compressed) &&
+        header->data_bytes!=(uint64_t)header->gridx*header->gridy*sizeof(grid_file_cell))
+      return fail("cell data size mismatch");
+    return true;
+  }
+public:
+  std::string filename;
+  const grid_file_header *header; // points into the file
+
+  grid_file(const std::string &filename_)
+    :base(0), length(0), filename(filename_), header(0)
+  {
+    open_file();
+  }
+  ~grid_file() {
+    if (base) munmap((void *)base,length);
+  }
+
+  bool ok(void) const { return base!=0; }
+
+  // Return the number of cells in the grid
+  size_t size(void) const { return (size_t)header->gridx*header->gridy; }
+
+  // Return the raw cell data, for uncompressed files (no copies; points into the file).
+  //  Returns 0 for compressed files: use unpack instead.
+  const grid_file_cell *cells(void) const {
+    if (header->flags&grid_file_compressed) return 0;
+    return (const grid_file_cell *)(base+sizeof(grid_file_header));
+  }
+
+  // Decode the cells into this array of size() grid_squares.
+  //   Returns false if the data is corrupt.
+  bool unpack(grid_square *grid) const {
+    size_t n=size();
+    const grid_file_cell *c=cells();
+    if (c) {
+      for (size_t i=0;i<n;i++) grid[i]=grid_file_unpack(c[i]);
+      return true;
+    }
+    const unsigned char *p=base+sizeof(grid_file_header);
+    const unsigned char *end=p+header->data_bytes;
+    size_t i=0;
+    while (p+sizeof(grid_file_run)<=end) {
+      grid_file_run run;
+      memcpy(&run,p,sizeof(run));
+      p+=sizeof(run);
+      if (i+run.skip+run.literal>n || p+run.literal*sizeof(grid_file_cell)>end) return false;
+      for (int s=0;s<run.skip;s++) grid[i++]=grid_square();
+      for (int l=0;l<run.literal;l++) {
+        grid_file_cell cell;
+        memcpy(&cell,p,sizeof(cell));
+        p+=sizeof(cell);
+        grid[i++]=grid_file_unpack(cell);
+      }
+    }
+    while (i<n) grid[i++]=grid_square(); // trailing empty cells
+    return true;
+  }
+};
+
+#endif
+
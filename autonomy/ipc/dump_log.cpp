@@ -0,0 +1,93 @@
+/*
+  Decode a binary robot log (log.bin, written by aurora/robot_log.h)
+  back into text, one message per line:
+     seconds level subsystem: message
+*/
+#include <iostream>
+#include <map>
+#include "aurora/robot_log.h"
+
+struct format_entry {
+  robot_log_format_info info;
+  std::string file;
+  std::string fmt;
+};
+
+int main(int argc,const char *args[]) {
+  std::string filename="log.bin";
+  int min_level=log_debug;
+  unsigned int subsystems=~0u;
+  bool show_source=false;
+  for (int argi=1;argi<argc;argi++) {
+    std::string arg=args[argi];
+    if (arg=="--level" && argi+1<argc) min_level=atoi(args[++argi]);
+    else if (arg=="--subsystem" && argi+1<argc) {
+      std::string name=args[++argi];
+      if (subsystems==~0u) subsystems=0;
+      for (int s=0;s<logsys_last;s++)
+        if (name==robot_log_subsystem_name(s)) subsystems|=1u<<s;
+    }
+    else if (arg=="--source") show_source=true;
+    else if (arg[0]!='-') filename=arg;
+    else {
+      printf("Usage: dump_log [--level 0-3] [--subsystem name] [--source] [log.bin]\n");
+      return 1;
+    }
+  }
+
+  FILE *f=fopen(filename.c_str(),"rb");
+  if (!f) { printf("Can't open log file %s\n",filename.c_str()); return 1; }
+  robot_log_file_header h;
+  if (1!=fread(&h,sizeof(h),1,f) || 0!=memcmp(h.magic,ROBOT_LOG_MAGIC,7)
+    || h.header_bytes!=sizeof(h))
+  {
+    printf("%s is not a robot log file\n",filename.c_str());
+    return 1;
+  }
+  if (h.version>ROBOT_LOG_VERSION) {
+    printf("%s is a newer version (%d) of the log format\n",filename.c_str(),(int)h.version);
+    return 1;
+  }
+  time_t start=h.start_unix;
+  printf("# Log started %s",ctime(&start));
+
+  std::map<uint32_t,format_entry> formats;
+  std::vector<unsigned char> payload;
+  robot_log_record_header r;
+  long messages=0, unknown=0;
+  while (1==fread(&r,sizeof(r),1,f)) {
+    payload.resize(r.bytes);
+    if (r.bytes>0 && 1!=fread(&payload[0],r.bytes,1,f)) {
+      printf("# Log truncated\n");
+      break;
+    }
+
+    if (r.kind==robot_log_record_format && r.bytes>=sizeof(robot_log_format_info)) {
+      format_entry &e=formats[r.format_id];
+      memcpy(&e.info,&payload[0],sizeof(e.info));
+      payload.push_back(0); // make sure strings are terminated
+      const char *file=(const char *)&payload[sizeof(e.info)];
+      e.file=file;
+      e.fmt=file+e.file.size()+1;
+    }
+    else if (r.kind==robot_log_record_message) {
+      auto it=formats.find(r.format_id);
+      if (it==formats.end()) { unknown++; continue; }
+      const format_entry &e=it->second;
+      if (e.info.level<min_level || !(subsystems&(1u<<e.info.subsystem))) continue;
+
+      std::string text=robot_log_format(e.fmt.c_str(),payload.size()?&payload[0]:0,payload.size());
+      while (text.size()>0 && text[text.size()-1]=='\n') text.erase(text.size()-1);
+      printf("%.3f %-7s %-7s ",(r.time_ns-h.start_ns)*1.0e-9,
+        robot_log_level_name(e.info.level),robot_log_subsystem_name(e.info.subsystem));
+      if (show_source) printf("%s:%d: ",e.file.c_str(),(int)e.info.line);
+      printf("%s\n",text.c_str());
+      messages++;
+    }
+  }
+  fclose(f);
+  printf("# %ld messages from %d call sites",messages,(int)formats.size());
+  if (unknown>0) printf(", %ld with unknown format",unknown);
+  printf("\n");
+  return 0;
+}
@@ -45,6 +45,12 @@
 
 #include "osl/transform.h"
 #include "osl/file_ipc.h"
+#ifdef VIVE_NETWORK /* vive tracker runs on another machine (set VIVE_SERVER to its address) */
+#include "aurora/network_ipc.h"
+#define vive_ipc_link network_ipc_link
+#else
+#define vive_ipc_link file_ipc_link
+#endif
 #include "bitgrid_RMC.h"
 
 #include "libfreenect.h"
@@ -583,7 +589,7 @@ void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
 	// Grab latest vive localization
 	static osl::transform sensor_tf(vec3(2.0,1.0,0.4)); // default origin in middle of field
 	
-	static file_ipc_link<osl::transform> sensor_link("sensor.tf");
+	static vive_ipc_link<osl::transform> sensor_link("sensor.tf");
 	sensor_link.subscribe(sensor_tf);
 
 	kinect_depth_image img(depth,KINECT_w,KINECT_h);
@@ -0,0 +1,131 @@
+/**
+  Threaded pipeline plumbing for the realsense beacon:
+  bounded queues that drop stale frames, and per-stage
+  throughput counters.
+
+  The idea is each stage only ever works on the newest data,
+  so a slow stage (like writing images to disk) can't delay
+  a fast one (like publishing marker poses).
+*/
+#ifndef __AURORA_BEACON_PIPELINE_H
+#define __AURORA_BEACON_PIPELINE_H
+
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+/* Return a monotonic time, in seconds. */
+inline double pipeline_time(void) {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+  Bounded queue of work items between pipeline stages.
+  If the consumer falls behind, the oldest items are
+  dropped to make room for new ones.
+*/
+template <class T>
+class stale_queue {
+  std::mutex lock;
+  std::condition_variable ready; // signaled when an item is added
+  std::condition_variable room; // signaled when an item is removed
+  std::deque<T> items;
+  size_t max_depth;
+public:
+  std::atomic<long> pushed; // total items added
+  std::atomic<long> dropped; // items discarded before being used
+
+  stale_queue(size_t max_depth_=1)
+    :max_depth(max_depth_), pushed(0), dropped(0)
+  {}
+
+  /* Add this item to the queue, discarding stale items if full. */
+  void push(const T &item) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      while (items.size()>=max_depth) {
+        items.pop_front();
+        dropped++;
+      }
+      items.push_back(item);
+      pushed++;
+    }
+    ready.notify_one();
+  }
+
+  /* Like push, but wait for room instead of dropping stale items.
+     Used for offline replay, where every frame matters. */
+  void push_wait(const T &item) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      room.wait(guard,[this]{ return items.size()<max_depth; });
+      items.push_back(item);
+      pushed++;
+    }
+    ready.notify_one();
+  }
+
+  /* Wait up to timeout_ms for the oldest item.
+     Returns false if nothing showed up in time. */
+  bool pop(T &item,int timeout_ms=100) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!ready.wait_for(guard,std::chrono::milliseconds(timeout_ms),
+          [this]{ return !items.empty(); }))
+      return false;
+    item=items.front();
+    items.pop_front();
+    room.notify_one();
+    return true;
+  }
+
+  /* Return the number of items currently waiting. */
+  size_t depth(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    return items.size();
+  }
+};
+
+/**
+  Counts work done by one pipeline stage, for periodic reports.
+*/
+class pipeline_stage_stats {
+public:
+  const char *name;
+  std::atomic<long> count; // items finished by this stage
+  std::atomic<double> busy; // seconds spent working on items
+
+  long last_count;
+  double last_busy;
+
+  pipeline_stage_stats(const char *name_)
+    :name(name_), count(0), busy(0.0), last_count(0), last_busy(0.0) {}
+
+  /* Record that one item took this many seconds. */
+  void finished(double seconds) {
+    count++;
+    double b=busy.load();
+    while (!busy.compare_exchange_weak(b,b+seconds)) {}
+  }
+
+  /* Print our rate over the last dt seconds, plus this queue's state. */
+  template <class queue_t>
+  void print(double dt,queue_t *q) {
+    long c=count.load();
+    double b=busy.load();
+    long n=c-last_count;
+    printf("  %-8s %5.1f /sec, %6.1f ms each",
+      name, n/dt, n>0?1000.0*(b-last_busy)/n:0.0);
+    if (q) printf(", queue %d, dropped %ld",(int)q->depth(),q->dropped.load());
+    printf("\n");
+    last_count=c;
+    last_busy=b;
+  }
+  void print(double dt) { print(dt,(stale_queue<int> *)0); }
+};
+
+#endif
+
@@ -0,0 +1,162 @@
+/**
+  Depth camera geometry shared by the realsense beacon and
+  the offline analysis tools: camera pose on the beacon, 
+  per-pixel projection, and accumulating depth pixels into
+  an obstacle_grid.
+*/
+#ifndef __AURORA_DEPTH_PROJECTION_H
+#define __AURORA_DEPTH_PROJECTION_H
+
+#include <math.h>
+#include <vector>
+#include "vision/grid.hpp"
+#include "rgbd_recording.h" /* for rgbd_intrinsics */
+
+#ifdef LIBREALSENSE_RS2_HPP
+/* Convert librealsense calibration to our recording format */
+inline rgbd_intrinsics rgbd_from_rs2(const rs2_intrinsics &i) {
+  rgbd_intrinsics r;
+  r.width=i.width; r.height=i.height;
+  r.ppx=i.ppx; r.ppy=i.ppy;
+  r.fx=i.fx; r.fy=i.fy;
+  r.model=i.model;
+  for (int c=0;c<5;c++) r.coeffs[c]=i.coeffs[c];
+  return r;
+}
+#endif
+
+/// Rotate coordinates using right hand rule
+class coord_rotator {
+public:
+  const real_t angle; // rotation angle in radians
+  const real_t c,s; // cosine and sine of rotation angle
+  coord_rotator(real_t angle_degs=0.0) 
+    :angle(angle_degs*M_PI/180.0), c(cos(angle)), s(sin(angle)) 
+  { }
+  
+  inline void rotate(real_t &x,real_t &y) const {
+    real_t new_x = x*c - y*s;
+    real_t new_y = x*s + y*c;
+    x=new_x; y=new_y;
+  }
+};
+
+/// Transforms 3D points from depth camera coords to world coords,
+///  by rotating and translating
+class camera_transform {
+public:  
+  vec3 camera; // world-coordinates camera origin position (cm)
+  coord_rotator camera_tilt; // tilt down
+  coord_rotator Z_rotation; // camera panning
+  
+  camera_transform(real_t camera_Z_angle=0.0)
+    :camera(field_x_beacon,field_y_beacon,70.0),  // camera position
+     camera_tilt(-20), // X axis rotation (camera mounting tilt)
+     Z_rotation(camera_Z_angle) // Z axis rotation
+  {
+  }
+  
+  // Project this camera-relative 3D point into world coordinates
+  vec3 world_from_camera(vec3 point) const {
+    real_t x=point.z, y=-point.x, z=-point.y;
+    camera_tilt.rotate(y,z); // tilt up, so camera is level
+    Z_rotation.rotate(x,y); // rotate, to align with field
+    x+=camera.x;
+    y+=camera.y;
+    z+=camera.z; 
+    return vec3(x,y,z);
+  }
+};
+
+/* Transforms raw realsense 2D + depth pixels into 3D:
+  Camera X is along sensor's long axis, facing right from sensor point of view
+  Camera Y is facing down
+  Camera Z is positive into the frame
+*/
+class realsense_projector {
+public:
+  // Camera calibration
+  rgbd_intrinsics intrinsics;
+  
+  // Cached per-pixel direction vectors: scale by the depth to get to 3D
+  std::vector<float> xdir;
+  std::vector<float> ydir;
+  
+#ifdef LIBREALSENSE_RS2_HPP
+  realsense_projector(const rs2::depth_frame &frame)
+  {
+    auto stream_profile = frame.get_profile();
+    auto video = stream_profile.as<rs2::video_stream_profile>();
+    setup(rgbd_from_rs2(video.get_intrinsics()));
+  }
+#endif
+  realsense_projector(const rgbd_intrinsics &intrinsics_) 
+  {
+    setup(intrinsics_);
+  }
+  
+  void setup(const rgbd_intrinsics &intrinsics_) 
+  {
+    intrinsics = intrinsics_;
+    xdir.resize(intrinsics.width*intrinsics.height);
+    ydir.resize(intrinsics.width*intrinsics.height);
+    
+    // Precompute per-pixel direction vectors (with distortion)
+    for (int h = 0; h < intrinsics.height; ++h)
+    for (int w = 0; w < intrinsics.width; ++w)
+    {
+      const float pixel[] = { (float)w, (float)h };
+
+      float x = (pixel[0] - intrinsics.ppx) / intrinsics.fx;
+      float y = (pixel[1] - intrinsics.ppy) / intrinsics.fy;
+
+      if (intrinsics.model == rgbd_distortion_inverse_brown_conrady)
+      {
+          float r2 = x * x + y * y;
+          float f = 1 + intrinsics.coeffs[0] * r2 + intrinsics.coeffs[1] * r2*r2 + intrinsics.coeffs[4] * r2*r2*r2;
+          float ux = x * f + 2 * intrinsics.coeffs[2] * x*y + intrinsics.coeffs[3] * (r2 + 2 * x*x);
+          float uy = y * f + 2 * intrinsics.coeffs[3] * x*y + intrinsics.coeffs[2] * (r2 + 2 * y*y);
+          x = ux;
+          y = uy;
+      }
+
+      xdir[h*intrinsics.width + w] = x;
+      ydir[h*intrinsics.width + w] = y;
+    }
+  }
+  
+  // Project this depth at this pixel into 3D camera coordinates
+  vec3 lookup(float depth,int x,int y) 
+  {
+    int i=y*intrinsics.width + x;
+    return vec3(xdir[i]*depth, ydir[i]*depth, depth);
+  }
+};
+
+/**
+  Accumulate this raw Z16 depth image's 3D points into this obstacle grid.
+*/
+inline void grid_depth_frame(const unsigned short *depth_data,int depth_w,int depth_h,
+  double depth2cm,const camera_transform &camera_TF,
+  realsense_projector &depth_to_3D,obstacle_grid &obstacles)
+{
+  const int realsense_left_start=50; // invalid data left of here
+  for (int y = 0; y < depth_h; y++)
+  for (int x = realsense_left_start; x < depth_w; x++)
+  {
+    int i=y*depth_w + x;
+    float depth=depth_data[i]*depth2cm; // depth, in cm
+    if (depth>0) {
+      vec3 cam = depth_to_3D.lookup(depth,x,y);
+      vec3 world = camera_TF.world_from_camera(cam);
+      
+      if (world.z<150.0 && world.z>-50.0)
+      {
+        obstacles.add(world);
+      }
+    }
+  }
+}
+
+#endif
+
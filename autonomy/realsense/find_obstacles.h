@@ -12,8 +12,7 @@ public:
   point(int x_=0,int y_=0) :x(x_), y(y_) {}
 };
 
-cv::Mat hits;
-void mark_hit(const point &p,   int r,int g,int b) 
+void mark_hit(cv::Mat &hits,const point &p,   int r,int g,int b) 
 {
   hits.at<cv::Vec3b>(obstacle_grid::GRIDY-1-p.y,p.x)=cv::Vec3b(b,g,r);
 }
@@ -40,19 +39,21 @@ bool is_empty(const obstacle_grid & obstacles,const point &p,int empty_threshold
 
 /*
   Turn this grid of depth data into a discrete list of obstacle locations.
+  If debug is true, writes debug images and prints each obstacle.
+  Safe to call from several threads at once.
 */
 void find_obstacles(const obstacle_grid & obstacles,
-  std::vector<aurora_detected_obstacle> &obstacle_list)
+  std::vector<aurora_detected_obstacle> &obstacle_list,bool debug=true)
 {
   int w=obstacle_grid::GRIDX;
   int h=obstacle_grid::GRIDY;
-  hits=obstacles.get_debug_2D(1);
-  imwrite("00_topdown.png",hits);
+  cv::Mat hits=obstacles.get_debug_2D(1);
+  if (debug) imwrite("00_topdown.png",hits);
   for (int y = 0; y < h; y++)
   for (int x = 0; x < w; x++)
   {
      //const grid_square &me=obstacles.at(x,y);
-     mark_hit(point(x,y), 0,0,0); // me.getCount()/32,0);
+     mark_hit(hits,point(x,y), 0,0,0); // me.getCount()/32,0);
   }
   
   // You need this many counts to be valid
@@ -102,16 +103,16 @@ void find_obstacles(const obstacle_grid & obstacles,
       float scaleRed=200, scaleBlue=300; // standard deviations to 0-255 data numbers
       if (diff>thresh) 
       { // we have an above-average count
-        mark_hit(p, std::min(255,(int)((diff-thresh)*scaleRed)),0,0);
+        mark_hit(hits,p, std::min(255,(int)((diff-thresh)*scaleRed)),0,0);
       }
       if (diff<-thresh) 
       { // we have a below-average count
-        mark_hit(p, 0,0,std::min(255,(int)((-diff-thresh)*scaleBlue)));
+        mark_hit(hits,p, 0,0,std::min(255,(int)((-diff-thresh)*scaleBlue)));
       }
     }
   }
   
-  imwrite("01_hits.png",hits);
+  if (debug) imwrite("01_hits.png",hits);
   
   /*
   cv::Mat hits_eroded;
@@ -124,7 +125,7 @@ void find_obstacles(const obstacle_grid & obstacles,
     cv::blur(hits,hits_blurred,cv::Size(3,3));
     std::swap(hits,hits_blurred);
   }
-  imwrite("03_hits_blur.png",hits);
+  if (debug) imwrite("03_hits_blur.png",hits);
   
   int thresh=45; // brightness in each blurred channel
   int nbor_frac=nbors*nbors*2; // required extant neighboring pixels
@@ -146,12 +147,12 @@ void find_obstacles(const obstacle_grid & obstacles,
     { // a shadow-detected obstacle
       if (height>=min_height) {
 	is_obstacle=true;
-        mark_hit(point(x,y), 0,255,height);        
+        mark_hit(hits,point(x,y), 0,255,height);        
       }
     }
     if (!is_obstacle && me.getCount()>100 && height>=10 && height<=60) 
     { // a height-detected obstacle
-      mark_hit(point(x,y), 255,255,height);        
+      mark_hit(hits,point(x,y), 255,255,height);        
       is_obstacle=true;
     }
     if (is_obstacle) {
@@ -161,16 +162,16 @@ void find_obstacles(const obstacle_grid & obstacles,
         det.height=height;
         obstacle_list.push_back(det);
         
-        printf("Obstacle at (%d,%d) cm, height %d cm\n",
+        if (debug) printf("Obstacle at (%d,%d) cm, height %d cm\n",
           (int)det.x,(int)det.y,(int)height);
     }
   }
 
 
-  imwrite("04_marked.png",hits);
+  if (debug) imwrite("04_marked.png",hits);
   
   
-  printf("Wrote debug image to hits.png");
+  if (debug) printf("Wrote debug image to hits.png");
 }
 
 
@@ -0,0 +1,144 @@
+/**
+  Panoramic obstacle scan for the realsense beacon.
+
+  Sweeps the stepper through a list of sector angles, merging every
+  depth frame (including ones taken while the stepper is moving) into
+  one obstacle grid.  Once a sector has enough frames taken at its
+  angle, obstacles are found in the merged grid and the new ones are
+  queued up for the backend, which polls for them with the results
+  command while the stepper moves on to the next sector.
+
+  Threads:
+    capture stage: start(), target_angle(), poll() for the command server
+    depth stage: running(), restarted(), add_frame(), sector_done()
+*/
+#ifndef __AURORA_PANORAMA_SCAN_H
+#define __AURORA_PANORAMA_SCAN_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include "aurora/beacon_commands.h"
+#include "vision/grid.hpp"
+#include "beacon_pipeline.h" /* for pipeline_time */
+
+class panorama_scan {
+  std::mutex lock;
+  std::vector<float> angles; // stepper angle for each sector, in sweep order
+  int sector; // sector we're currently scanning (angles.size() when done)
+  bool restart; // depth stage needs to clear its grid
+  int settled_frames; // frames taken at this sector's angle
+  double start_time; // pipeline_time when scan started
+
+  std::vector<aurora_detected_obstacle> unsent; // found, but not yet polled
+  std::vector<bool> reported; // obstacle_grid cells already found this scan
+public:
+  int sectors; // sectors per scan
+  float sector_step; // degrees between sectors
+  int frames_per_sector; // frames needed at each sector's angle
+  float settle_deg; // frames within this many degrees count as at the angle
+
+  panorama_scan()
+    :sector(0), restart(false), settled_frames(0), start_time(0.0),
+     sectors(3), sector_step(35.0), frames_per_sector(8), settle_deg(1.5)
+  {}
+
+  /* Start a new scan centered on this angle.
+     Sweeps from whichever end is closest to the stepper's current angle. */
+  void start(float center_deg,float current_deg) {
+    std::lock_guard<std::mutex> guard(lock);
+    angles.clear();
+    for (int s=0;s<sectors;s++)
+      angles.push_back(center_deg+(s-0.5f*(sectors-1))*sector_step);
+    if (fabs(current_deg-angles.back())<fabs(current_deg-angles.front()))
+      std::reverse(angles.begin(),angles.end());
+    sector=0;
+    restart=true;
+    settled_frames=0;
+    start_time=pipeline_time();
+    unsent.clear();
+    reported.assign(obstacle_grid::GRIDTOTAL,false);
+  }
+
+  /* Abandon any scan in progress. */
+  void stop(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    sector=angles.size();
+  }
+
+  /* Return true if a scan is in progress. */
+  bool running(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    return sector<(int)angles.size();
+  }
+
+  /* Return true (once) after a scan starts, so the grid can be cleared. */
+  bool restarted(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    bool r=restart;
+    restart=false;
+    return r;
+  }
+
+  /* Return the angle the stepper should be heading toward,
+     or false if no scan is in progress. */
+  bool target_angle(float &deg) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (sector>=(int)angles.size()) return false;
+    deg=angles[sector];
+    return true;
+  }
+
+  /* A depth frame taken at this stepper angle was merged into the grid.
+     Returns true if the current sector now has enough frames. */
+  bool add_frame(float angle_deg) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (sector>=(int)angles.size()) return false;
+    if (fabs(angle_deg-angles[sector])<=settle_deg) settled_frames++;
+    return settled_frames>=frames_per_sector;
+  }
+
+  /* The current sector is finished, and these obstacles were found
+     in the merged grid.  Queues up the new ones and moves to the
+     next sector.  Returns true if the whole scan is finished. */
+  bool sector_done(const std::vector<aurora_detected_obstacle> &found) {
+    std::lock_guard<std::mutex> guard(lock);
+    int fresh=0;
+    for (const aurora_detected_obstacle &o : found) {
+      int cell=(o.y/obstacle_grid::GRIDSIZE)*obstacle_grid::GRIDX + o.x/obstacle_grid::GRIDSIZE;
+      if (cell<0 || cell>=obstacle_grid::GRIDTOTAL || reported[cell]) continue;
+      reported[cell]=true;
+      unsent.push_back(o);
+      fresh++;
+    }
+    printf("Panorama sector %d of %d at %.0f deg done: %d new obstacles (%.1f seconds)\n",
+      sector+1,(int)angles.size(),angles[sector],fresh,pipeline_time()-start_time);
+    sector++;
+    settled_frames=0;
+    return sector>=(int)angles.size();
+  }
+
+  /* Build a reply for the command server: status, plus obstacles
+     found since the last poll. */
+  std::vector<unsigned char> poll(float current_deg) {
+    std::lock_guard<std::mutex> guard(lock);
+    aurora_panorama_status status;
+    status.sectors_done=std::min(sector,(int)angles.size());
+    status.sectors_total=angles.size();
+    status.angle=(signed short)floor(current_deg+0.5);
+    status.obstacle_count=unsent.size();
+
+    std::vector<unsigned char> reply(sizeof(status)+unsent.size()*sizeof(aurora_detected_obstacle));
+    memcpy(&reply[0],&status,sizeof(status));
+    if (unsent.size()>0)
+      memcpy(&reply[sizeof(status)],&unsent[0],unsent.size()*sizeof(aurora_detected_obstacle));
+    unsent.clear();
+    return reply;
+  }
+};
+
+#endif
+
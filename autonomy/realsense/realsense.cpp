@@ -18,6 +18,15 @@
 
 
 #include "aruco_localize.cpp"
+#include "beacon_pipeline.h"
+#include "rgbd_recording.h"
+#include "depth_projection.h"
+#include "panorama_scan.h"
+
+#include <thread>
+#include <memory>
+#include <deque>
+#include <unistd.h> // for nice
   
 using namespace std;  
 using namespace cv;  
@@ -35,105 +44,6 @@ bool pan_stepper=true; // automatically pan stepper motor around
 
 int sys_error=0;
 
-/// Rotate coordinates using right hand rule
-class coord_rotator {
-public:
-  const real_t angle; // rotation angle in radians
-  const real_t c,s; // cosine and sine of rotation angle
-  coord_rotator(real_t angle_degs=0.0) 
-    :angle(angle_degs*M_PI/180.0), c(cos(angle)), s(sin(angle)) 
-  { }
-  
-  inline void rotate(real_t &x,real_t &y) const {
-    real_t new_x = x*c - y*s;
-    real_t new_y = x*s + y*c;
-    x=new_x; y=new_y;
-  }
-};
-
-/// Transforms 3D points from depth camera coords to world coords,
-///  by rotating and translating
-class camera_transform {
-public:  
-  vec3 camera; // world-coordinates camera origin position (cm)
-  coord_rotator camera_tilt; // tilt down
-  coord_rotator Z_rotation; // camera panning
-  
-  camera_transform(real_t camera_Z_angle=0.0)
-    :camera(field_x_beacon,field_y_beacon,70.0),  // camera position
-     camera_tilt(-20), // X axis rotation (camera mounting tilt)
-     Z_rotation(camera_Z_angle) // Z axis rotation
-  {
-  }
-  
-  // Project this camera-relative 3D point into world coordinates
-  vec3 world_from_camera(vec3 point) const {
-    real_t x=point.z, y=-point.x, z=-point.y;
-    camera_tilt.rotate(y,z); // tilt up, so camera is level
-    Z_rotation.rotate(x,y); // rotate, to align with field
-    x+=camera.x;
-    y+=camera.y;
-    z+=camera.z; 
-    return vec3(x,y,z);
-  }
-};
-
-/* Transforms raw realsense 2D + depth pixels into 3D:
-  Camera X is along sensor's long axis, facing right from sensor point of view
-  Camera Y is facing down
-  Camera Z is positive into the frame
-*/
-class realsense_projector {
-public:
-  // Camera calibration
-  rs2_intrinsics intrinsics;
-  
-  // Cached per-pixel direction vectors: scale by the depth to get to 3D
-  std::vector<float> xdir;
-  std::vector<float> ydir;
-  
-  realsense_projector(const rs2::depth_frame &frame)
-    :xdir(frame.get_width()*frame.get_height()),
-     ydir(frame.get_width()*frame.get_height())
-  {
-    auto stream_profile = frame.get_profile();
-    auto video = stream_profile.as<rs2::video_stream_profile>();
-    intrinsics = video.get_intrinsics();
-    
-    // Precompute per-pixel direction vectors (with distortion)
-    for (int h = 0; h < intrinsics.height; ++h)
-    for (int w = 0; w < intrinsics.width; ++w)
-    {
-      const float pixel[] = { (float)w, (float)h };
-
-      float x = (pixel[0] - intrinsics.ppx) / intrinsics.fx;
-      float y = (pixel[1] - intrinsics.ppy) / intrinsics.fy;
-
-      if (intrinsics.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
-      {
-          float r2 = x * x + y * y;
-          float f = 1 + intrinsics.coeffs[0] * r2 + intrinsics.coeffs[1] * r2*r2 + intrinsics.coeffs[4] * r2*r2*r2;
-          float ux = x * f + 2 * intrinsics.coeffs[2] * x*y + intrinsics.coeffs[3] * (r2 + 2 * x*x);
-          float uy = y * f + 2 * intrinsics.coeffs[3] * x*y + intrinsics.coeffs[2] * (r2 + 2 * y*y);
-          x = ux;
-          y = uy;
-      }
-
-      xdir[h*intrinsics.width + w] = x;
-      ydir[h*intrinsics.width + w] = y;
-    }
-  }
-  
-  // Project this depth at this pixel into 3D camera coordinates
-  vec3 lookup(float depth,int x,int y) 
-  {
-    int i=y*intrinsics.width + x;
-    return vec3(xdir[i]*depth, ydir[i]*depth, depth);
-  }
-};
-
-
-
 /// Keeps track of platform position
 class stepper_controller
 {
@@ -143,13 +53,34 @@ class stepper_controller
 #define stepper_angle_to_step (400.0 / 360.0)  /* scale degrees to step count */
 #define stepper_angle_zero -73 /* degrees for stepper zero */
   
+  /* Recent stepper positions, so we can tell where the camera
+     was pointing when a frame was captured, even mid-move. */
+  struct stepper_report {
+    double time; // pipeline_time of report
+    float angle; // camera_Z_angle at that time
+  };
+  std::deque<stepper_report> history;
+  double last_poll; // pipeline_time of last serial read
+  
   /* Poll on the serial port.  Return true if stuff was read. */
   bool read_serial() {
-    bool read_stuff=false;
+    std::vector<unsigned char> reports;
     while (stepper_serial.available()) {
-      read_stuff=true;
-      unsigned char pos255=stepper_serial.read();
+      reports.push_back(stepper_serial.read());
+    }
+    if (reports.size()==0) return false;
+    
+    // The nano reports once per step (or every 20ms when idle), so spread
+    //  the reports evenly over the time since our last read.
+    double now=pipeline_time();
+    double span=std::min(now-last_poll,0.020*reports.size()); // at most 20ms apart
+    for (size_t i=0;i<reports.size();i++) {
+      unsigned char pos255=reports[i];
       camera_Z_angle=(pos255 / stepper_angle_to_step)+stepper_angle_zero;
+      stepper_report r;
+      r.time=now-span*(reports.size()-1-i)/reports.size();
+      r.angle=camera_Z_angle;
+      history.push_back(r);
       
       static unsigned char last=255;
       if (pos255!=last) {
@@ -157,7 +88,9 @@ class stepper_controller
         last=pos255;
       }
     }
-    return read_stuff;
+    while (history.size()>2 && history.front().time<now-2.0) history.pop_front();
+    last_poll=now;
+    return true;
   }
 
   void seek_steps(int step) {
@@ -171,7 +104,7 @@ public:
   float angle_correction;
 
   stepper_controller() 
-    :angle_correction(0.0)
+    :last_poll(pipeline_time()), angle_correction(0.0)
   {
     last_steps=0;
     if (pan_stepper)
@@ -212,6 +145,18 @@ public:
   float get_angle_deg(void) const {
     return camera_Z_angle+angle_correction;
   }
+  
+  // Return the stepper angle at this pipeline_time, in degrees,
+  //   interpolating between stepper reports.
+  float get_angle_deg(double time) const {
+    if (history.size()==0 || time>=history.back().time) return get_angle_deg();
+    if (time<=history.front().time) return history.front().angle+angle_correction;
+    size_t i=history.size()-1;
+    while (history[i-1].time>time) i--;
+    const stepper_report &a=history[i-1], &b=history[i];
+    double f=(b.time>a.time)?(time-a.time)/(b.time-a.time):1.0;
+    return a.angle+f*(b.angle-a.angle)+angle_correction;
+  }
 };
 
 
@@ -297,15 +242,357 @@ public:
 };
 
 
+/** 
+  One captured frame, as passed between pipeline stages.
+  The pixels can come from a live realsense or a recording.
+*/
+class beacon_frame {
+public:
+  std::shared_ptr<void> keepalive; // holds the pixel data alive
+  const unsigned short *depth; // raw Z16 depth pixels
+  const unsigned char *color; // BGR8 color pixels
+  int depth_w, depth_h, color_w, color_h;
+  
+  double timestamp; // capture time, in seconds
+  unsigned long long frame_number; // camera frame counter
+  float angle_deg; // stepper angle when captured
+  vec3 camera; // world-coordinates camera origin when captured
+  
+  beacon_frame() :depth(0), color(0), depth_w(0), depth_h(0), color_w(0), color_h(0),
+    timestamp(0.0), frame_number(0), angle_deg(0.0) {}
+  
+  camera_transform get_transform(void) const {
+    camera_transform camera_TF(angle_deg);
+    camera_TF.camera=camera;
+    return camera_TF;
+  }
+  
+  // Camera pose, for storing with grids
+  grid_file_pose get_pose(void) const {
+    grid_file_pose p;
+    p.camera_x=camera.x; p.camera_y=camera.y; p.camera_z=camera.z;
+    p.angle_deg=angle_deg;
+    p.timestamp=timestamp;
+    return p;
+  }
+  
+  // Make OpenCV version of raw color pixels (no copy, so this is cheap)
+  Mat get_color(void) const {
+    return Mat(Size(color_w, color_h), CV_8UC3, (void*)color, Mat::AUTO_STEP);  
+  }
+};
+
+/** Low-priority work for the disk/GUI stage. */
+class beacon_output {
+public:
+  std::shared_ptr<void> keepalive; // keeps image pixels alive, if image points into them
+  cv::Mat image; // image to show or write
+  std::string window; // if nonempty, show image in this window
+  std::string filename; // if nonempty, write image (or grid) here
+  std::string copy_to; // if nonempty, write the same image here too
+  std::shared_ptr<obstacle_grid> grid; // if non-null, write this grid
+  grid_file_pose pose; // camera pose stored with the grid
+};
+
+/**
+  Runs the beacon's work as a set of stages connected by stale_queues:
+    capture (main thread) -> detect -> publish marker poses
+                          -> depth  -> grid obstacles, answer scans
+    detect/depth          -> output -> imshow and disk writes (low priority)
+*/
+class beacon_pipeline {
+public:
+  bool do_color, do_depth;
+  double depth2cm; // scale from realsense depth units to cm
+  rgbd_intrinsics depth_intrinsics; // depth camera calibration
+  bool lossless; // wait for room in queues instead of dropping frames (offline replay)
+  
+  // The stepper is shared between stages, so it's protected by this lock.
+  stepper_controller &stepper;
+  std::mutex stepper_lock;
+  
+  aurora_beacon_command_server &command_server;
+  
+  // If non-null, captured frames are recorded here (by the output stage)
+  rgbd_recorder *recorder;
+  bool record_jpeg; // compress recorded color frames
+  
+  stale_queue<beacon_frame> detect_queue, depth_queue, record_queue;
+  stale_queue<beacon_output> gui_queue, disk_queue;
+  pipeline_stage_stats capture_stats, detect_stats, depth_stats, output_stats;
+  
+  std::atomic<bool> quit; // set to make all stages exit
+  std::atomic<bool> dump_color, dump_depth; // request an image dump
+  std::atomic<int> scan_request; // frames for new obstacle scan (0 if none)
+  std::atomic<bool> scanning; // obstacle scan is in progress
+  std::atomic<bool> scan_reply; // send scan results to the command server
+  panorama_scan panorama; // multi-angle obstacle scan
+  
+  beacon_pipeline(stepper_controller &stepper_,aurora_beacon_command_server &command_server_)
+    :do_color(true), do_depth(false), depth2cm(0.1), lossless(false),
+     stepper(stepper_), command_server(command_server_),
+     recorder(0), record_jpeg(true), 
+     detect_queue(1), depth_queue(1), record_queue(8), gui_queue(4), disk_queue(16),
+     capture_stats("capture"), detect_stats("detect"), 
+     depth_stats("depth"), output_stats("output"),
+     quit(false), dump_color(false), dump_depth(false),
+     scan_request(0), scanning(false), scan_reply(false)
+  {}
+  
+  // Hand off this captured frame to the stages that want it.
+  void captured(const beacon_frame &f) {
+    if (lossless) {
+      if (do_color) detect_queue.push_wait(f);
+      if (do_depth || scanning) depth_queue.push_wait(f);
+    } else {
+      if (do_color) detect_queue.push(f);
+      if (do_depth || scanning) depth_queue.push(f);
+    }
+    if (recorder) record_queue.push(f);
+  }
+  
+  // Return true once all queued frames have been picked up.
+  bool drained(void) {
+    return detect_queue.depth()==0 && depth_queue.depth()==0 && 
+      record_queue.depth()==0 && disk_queue.depth()==0;
+  }
+  
+  // Look for markers, and publish the robot pose.
+  //   Pose latency is just detection time, since nothing else runs here.
+  void detect_stage(void) {
+    aruco_localizer aruco_loc;
+    pose_publisher pose_pub;
+    int framecount=0;
+    int writecount=0;
+    beacon_frame f;
+    while (!quit) {
+      if (!detect_queue.pop(f)) continue;
+      double start=pipeline_time();
+      
+      Mat color_image=f.get_color();
+      camera_transform camera_TF=f.get_transform();
+      marker_watcher_print p(camera_TF);
+#if DO_GCODE
+      if (camera_TF.camera.y!=0.0)
+#endif
+      aruco_loc.find_markers(color_image,p);
+      float beacon_angle;
+      {
+        std::lock_guard<std::mutex> guard(stepper_lock);
+        if (p.angle_correction!=0) {
+          stepper.angle_correction-=p.angle_correction;
+        }
+        beacon_angle=stepper.get_angle_deg();
+      }
+      p.markers.pose.print();
+      p.markers.beacon=beacon_angle;
+      pose_pub.publish(p.markers);
+      detect_stats.finished(pipeline_time()-start);
+      
+      // Everything below is handed off to the output stage
+      if (show_GUI) {
+        beacon_output o;
+        o.keepalive=f.keepalive; o.image=color_image; o.window="Color Image";
+        gui_queue.push(o);
+      }
+#if DO_GCODE
+      static std::string last_name="";
+      char name[100]; 
+      snprintf(name,100,"gcode_vidcap/frame_%03dcm.jpg",(int)(camera_TF.camera.y));
+      if (name!=last_name) {
+        beacon_output o;
+        o.image=color_image.clone(); o.filename=name;
+        disk_queue.push(o);
+        last_name=name;
+      }
+#endif
+      if ((++framecount>=30) || dump_color.exchange(false)) 
+      { // periodic image dump
+        framecount=0;
+        char filename[500];
+        sprintf(filename,"vidcaps/view_%04d_%03ddeg.jpg",writecount++,(int)(0.5+beacon_angle));
+        beacon_output o;
+        o.image=color_image.clone(); 
+        o.filename="vidcaps/latest.jpg";
+        o.copy_to=filename;
+        disk_queue.push(o);
+      }
+    }
+  }
+  
+  // Accumulate depth frames into the obstacle grid, and answer scan requests.
+  void depth_stage(void) {
+    obstacle_grid obstacles;
+    realsense_projector depth_to_3D(depth_intrinsics);
+    int obstacle_scan=0; // frames remaining for obstacle scan
+    int framecount=0;
+    beacon_frame f;
+    while (!quit) {
+      int scan=scan_request.exchange(0);
+      if (scan>0) { // new scan request
+        obstacles.clear();
+        obstacle_scan=scan;
+      }
+      if (panorama.restarted()) obstacles.clear();
+      if (!depth_queue.pop(f)) continue;
+      bool pano=panorama.running();
+      if (!do_depth && obstacle_scan==0 && !pano) continue; // leftover frame from a scan
+      double start=pipeline_time();
+      
+      grid_depth_frame(f.depth,f.depth_w,f.depth_h,depth2cm,
+        f.get_transform(),depth_to_3D,obstacles);
+      
+      if (pano && panorama.add_frame(f.angle_deg)) 
+      { // Sector finished: queue up any new obstacles for the backend
+        std::vector<aurora_detected_obstacle> obstacle_list;
+        find_obstacles(obstacles,obstacle_list,false);
+        if (panorama.sector_done(obstacle_list)) {
+          scanning=false;
+          beacon_output o;
+          o.grid=std::make_shared<obstacle_grid>(obstacles);
+          o.pose=f.get_pose();
+          o.filename="vidcaps/panorama";
+          disk_queue.push(o);
+        }
+      }
+      if (obstacle_scan>0) { 
+        obstacle_scan--;
+        if (obstacle_scan==0) {
+          // Done with scan--report results to backend
+          std::vector<aurora_detected_obstacle> obstacle_list;
+          find_obstacles(obstacles,obstacle_list);
+          if (scan_reply.exchange(false))
+            command_server.response(&obstacle_list[0],
+              sizeof(obstacle_list[0])*obstacle_list.size()); 
+          scanning=false;
+          
+          if (f.color) {
+            beacon_output o;
+            o.image=f.get_color().clone();
+            o.filename="raw_color.png";
+            disk_queue.push(o);
+          }
+        }
+      }
+      depth_stats.finished(pipeline_time()-start);
+      
+      if (show_GUI) {
+        beacon_output o;
+        o.image=obstacles.get_debug_2D(6); o.window="2D World";
+        gui_queue.push(o);
+      }
+      if (do_depth && obstacle_scan==0 && !pano && 
+        ((++framecount>=30) || dump_depth.exchange(false)))
+      { // periodic grid dump
+        framecount=0;
+        char filename[500];
+        sprintf(filename,"vidcaps/world_depth_%03d",(int)(0.5+f.angle_deg));
+        beacon_output o;
+        o.grid=std::make_shared<obstacle_grid>(obstacles);
+        o.pose=f.get_pose();
+        o.filename=filename;
+        disk_queue.push(o);
+        obstacles.clear();
+      }
+    }
+  }
+  
+  // Write this image or grid to disk.
+  void write_output(const beacon_output &o) {
+    if (o.grid) {
+      o.grid->write(o.filename,o.pose);
+      printf("Stored image to file %s\n",o.filename.c_str());
+      return;
+    }
+    // Encode once, then write to each filename (no shell "cp" needed)
+    std::vector<unsigned char> buf;
+    std::string ext=o.filename.substr(o.filename.rfind('.'));
+    if (!imencode(ext,o.image,buf)) return;
+    for (const std::string &name : {o.filename,o.copy_to}) {
+      if (name=="") continue;
+      FILE *f=fopen(name.c_str(),"wb");
+      if (!f) { printf("Error writing image file %s\n",name.c_str()); continue; }
+      fwrite(&buf[0],1,buf.size(),f);
+      fclose(f);
+    }
+  }
+  
+  // Append this frame to our recording.
+  void record_frame(const beacon_frame &f) {
+    std::vector<unsigned char> jpeg;
+    const void *color=f.color;
+    size_t color_bytes=f.color?f.color_w*f.color_h*3:0;
+    if (record_jpeg) {
+      imencode(".jpg",f.get_color(),jpeg);
+      color=&jpeg[0];
+      color_bytes=jpeg.size();
+    }
+    recorder->add(f.depth,color,color_bytes,f.timestamp,f.angle_deg,f.frame_number);
+  }
+  
+  // Low priority stage: show GUI windows, write to disk, print statistics.
+  //  OpenCV's highgui calls all happen in this thread.
+  void output_stage(void) {
+    if (nice(10)==-1) printf("Couldn't lower output thread priority\n"); // Linux: only affects this thread
+    double report_interval=5.0; // seconds between statistics printouts
+    double last_report=pipeline_time();
+    beacon_output o;
+    beacon_frame f;
+    while (!quit) {
+      if (show_GUI) {
+        while (gui_queue.pop(o,0)) imshow(o.window,o.image);
+        o=beacon_output(); // release frame buffers
+        int k = waitKey(10);
+        if (k == 'i') { dump_color=true; dump_depth=true; } // image dump
+        if (k == 27 || k=='q') quit=true;
+      }
+      if (recorder && record_queue.pop(f,0)) {
+        double start=pipeline_time();
+        record_frame(f);
+        output_stats.finished(pipeline_time()-start);
+        f=beacon_frame();
+      }
+      if (disk_queue.pop(o,(show_GUI||recorder)?0:50)) {
+        double start=pipeline_time();
+        write_output(o);
+        output_stats.finished(pipeline_time()-start);
+        o=beacon_output();
+      }
+      
+      double now=pipeline_time();
+      if (now-last_report>=report_interval) {
+        double dt=now-last_report;
+        last_report=now;
+        printf("Beacon pipeline over last %.1f seconds:\n",dt);
+        capture_stats.print(dt);
+        detect_stats.print(dt,&detect_queue);
+        depth_stats.print(dt,&depth_queue);
+        output_stats.print(dt,&disk_queue);
+        if (recorder) printf("  recorded %ld frames, dropped %ld\n",
+          record_queue.pushed.load()-record_queue.dropped.load(), record_queue.dropped.load());
+        fflush(stdout);
+      }
+    }
+  }
+};
+
+void beacon_detect_run(beacon_pipeline *p) { p->detect_stage(); }
+void beacon_depth_run(beacon_pipeline *p) { p->depth_stage(); }
+void beacon_output_run(beacon_pipeline *p) { p->output_stage(); }
+
 int main(int argc,const char *argv[])  
 {  
-    rs2::pipeline pipe;  
-    rs2::config cfg;  
-  
     bool bigmode=true; // high res 720p input
     bool do_depth=false; // auto-read depth frames, parse into grid
     bool do_color=true; // read color frames, look for vision markers
     int fps=6; // framerate (USB 2.0 compatible by default)
+    std::string record_name=""; // record captured frames to this file
+    bool record_jpeg=true;
+    std::string replay_name=""; // replay frames from this file instead of the camera
+    double replay_speed=1.0; // 1.0 for real time, 0.0 for as fast as possible
+    int replay_scan=0; // frames of obstacle scan to run during replay
+    double frame_latency=0.05; // seconds from exposure to frame arriving here
+    panorama_scan pano_settings;
     
     for (int argi=1;argi<argc;argi++) {
       std::string arg=argv[argi];
@@ -316,12 +603,33 @@ int main(int argc,const char *argv[])
       else if (arg=="--coarse") bigmode=false; // lowres mode
       else if (arg=="--nostep") pan_stepper=false; // pan around
       else if (arg=="--fast") fps=30; // USB-3 only
+      else if (arg=="--record" && argi+1<argc) record_name=argv[++argi];
+      else if (arg=="--record_raw") record_jpeg=false; // uncompressed color
+      else if (arg=="--replay" && argi+1<argc) replay_name=argv[++argi];
+      else if (arg=="--replay_speed" && argi+1<argc) replay_speed=atof(argv[++argi]);
+      else if (arg=="--replay_scan" && argi+1<argc) replay_scan=atoi(argv[++argi]);
+      else if (arg=="--latency" && argi+1<argc) frame_latency=atof(argv[++argi]);
+      else if (arg=="--pano_sectors" && argi+1<argc) pano_settings.sectors=atoi(argv[++argi]);
+      else if (arg=="--pano_step" && argi+1<argc) pano_settings.sector_step=atof(argv[++argi]);
+      else if (arg=="--pano_frames" && argi+1<argc) pano_settings.frames_per_sector=atoi(argv[++argi]);
       else {
         std::cerr<<"Unknown argument '"<<arg<<"'.  Exiting.\n";
         return 1;
       }
     }
     
+    rgbd_recording *replay=0;
+    if (replay_name!="") {
+      replay=new rgbd_recording(replay_name);
+      if (!replay->ok()) return 1;
+      pan_stepper=false; // angles come from the recording
+      printf("Replaying %d frames from %s\n",(int)replay->size(),replay_name.c_str());
+      if (replay->header->color_format==rgbd_color_none) {
+        if (do_color) printf("Recording has no color: running as --nocolor\n");
+        do_color=false;
+      }
+    }
+    
 #if DO_GCODE
     printf("Connecting to 3D printer over serial port...\n");
     printer_gcode gcode;
@@ -349,40 +657,85 @@ int main(int argc,const char *argv[])
       depth_w=480; depth_h=270;
       color_w=640; color_h=480; //color_w=424; color_h=240;
     }
-
-    cfg.enable_stream(RS2_STREAM_DEPTH, depth_w,depth_h, RS2_FORMAT_Z16, fps);  
-    cfg.enable_stream(RS2_STREAM_COLOR, color_w,color_h, RS2_FORMAT_BGR8, fps);  
+    
+    rs2::pipeline pipe;  
+    float scale;
+    rgbd_intrinsics depth_intrinsics;
+    if (replay) {
+      const rgbd_file_header &h=*replay->header;
+      depth_w=h.depth_w; depth_h=h.depth_h;
+      color_w=h.color_w; color_h=h.color_h;
+      scale=h.depth_scale;
+      depth_intrinsics=h.depth_intrinsics;
+    }
+    else {
+      rs2::config cfg;  
+      cfg.enable_stream(RS2_STREAM_DEPTH, depth_w,depth_h, RS2_FORMAT_Z16, fps);  
+      cfg.enable_stream(RS2_STREAM_COLOR, color_w,color_h, RS2_FORMAT_BGR8, fps);  
   
-    rs2::pipeline_profile selection = pipe.start(cfg);  
+      rs2::pipeline_profile selection = pipe.start(cfg);  
 
-    auto sensor = selection.get_device().first<rs2::depth_sensor>();
-    float scale =  sensor.get_depth_scale();
+      auto sensor = selection.get_device().first<rs2::depth_sensor>();
+      scale =  sensor.get_depth_scale();
+      depth_intrinsics = rgbd_from_rs2(selection.get_stream(RS2_STREAM_DEPTH)
+        .as<rs2::video_stream_profile>().get_intrinsics());
+    }
     printf("Depth scale: %.3f\n",scale);
-    double depth2cm = scale * 100.0; 
-    double depth2screen=255.0*scale/4.5;
     
-    pose_publisher pose_pub;
+    aurora_beacon_command_server command_server;
     
-    int framecount=0;
-    int writecount=0;
-    int nextwrite=1;
-
-    int obstacle_scan=0; // frames remaining for obstacle scan
-    int obstacle_scan_target=-999; // angle at which we want to do the scan
+    beacon_pipeline pipeline(stepper,command_server);
+    pipeline.do_color=do_color;
+    pipeline.do_depth=do_depth;
+    pipeline.depth2cm = scale * 100.0; 
+    pipeline.depth_intrinsics = depth_intrinsics;
+    pipeline.panorama.sectors = pano_settings.sectors;
+    pipeline.panorama.sector_step = pano_settings.sector_step;
+    pipeline.panorama.frames_per_sector = pano_settings.frames_per_sector;
     
-    aruco_localizer aruco_loc;
-
-    obstacle_grid obstacles;
+    if (record_name!="") {
+      rgbd_file_header h;
+      memset(&h,0,sizeof(h));
+      h.depth_w=depth_w; h.depth_h=depth_h;
+      h.color_w=color_w; h.color_h=color_h;
+      bool have_color=!replay || replay->header->color_format!=rgbd_color_none;
+      if (!have_color) record_jpeg=false;
+      h.color_format=!have_color?rgbd_color_none:(record_jpeg?rgbd_color_JPEG:rgbd_color_BGR8);
+      h.depth_scale=scale;
+      h.depth_intrinsics=depth_intrinsics;
+      pipeline.recorder=new rgbd_recorder(record_name,h);
+      pipeline.record_jpeg=record_jpeg;
+      if (!pipeline.recorder->ok()) return 1;
+    }
     
-    aurora_beacon_command_server command_server;
+    rgbd_replay *replayer=0;
+    if (replay) {
+      replayer=new rgbd_replay(*replay,replay_speed);
+      pipeline.lossless=(replay_speed<=0.0);
+      if (replay_scan>0) {
+        pipeline.scanning=true;
+        pipeline.scan_request=replay_scan;
+      }
+    }
+    
+    std::thread detect_thread(beacon_detect_run,&pipeline);
+    std::thread depth_thread(beacon_depth_run,&pipeline);
+    std::thread output_thread(beacon_output_run,&pipeline);
+    
+#if DO_GCODE
+    int framecount=0;
+#endif
+    bool pano_seek=false; // stepper has been sent to pano_last
+    float pano_last=0.0;
     
-    rs2::frameset frames;  
-    while (true)  
+    // Capture stage: handle commands, read the stepper, and grab frames.
+    while (!pipeline.quit)  
     {  
         // Check for network data
         try {
         aurora_beacon_command cmd;
         if (command_server.request(cmd)) {
+          std::lock_guard<std::mutex> guard(pipeline.stepper_lock);
           cmd.letter=toupper(cmd.letter); // uppercase request char
           if (cmd.letter=='P') { // point request
             stepper.absolute_seek(cmd.angle);
@@ -400,10 +753,22 @@ int main(int argc,const char *argv[])
             command_server.response(); 
           }
           else if (cmd.letter=='T') { // scan for obstacles
+            pipeline.panorama.stop();
             stepper.absolute_seek(cmd.angle);
-            obstacle_scan_target=cmd.angle;
-            obstacles.clear();
-            obstacle_scan=18;  // frames to scan 
+            pipeline.scanning=true;
+            pipeline.scan_reply=true; // depth stage responds
+            pipeline.scan_request=18;  // frames to scan 
+          }
+          else if (cmd.letter=='S') { // start panoramic scan, reply right away
+            pipeline.panorama.start(cmd.angle,stepper.get_angle_deg());
+            pipeline.scanning=true;
+            pano_seek=false;
+            std::vector<unsigned char> reply=pipeline.panorama.poll(stepper.get_angle_deg());
+            command_server.response(&reply[0],reply.size());
+          }
+          else if (cmd.letter=='R') { // panoramic scan results so far
+            std::vector<unsigned char> reply=pipeline.panorama.poll(stepper.get_angle_deg());
+            command_server.response(&reply[0],reply.size());
           }
           else { // unknown command
             printf("Ignoring unknown command request '%c'\n", cmd.letter);
@@ -415,17 +780,29 @@ int main(int argc,const char *argv[])
           printf("Ignoring network exception\n");
         }
 
+        // Keep the stepper moving through the panorama sectors
+        float pano_angle;
+        if (pipeline.panorama.target_angle(pano_angle)) {
+          if (!pano_seek || pano_angle!=pano_last) {
+            std::lock_guard<std::mutex> guard(pipeline.stepper_lock);
+            stepper.absolute_seek(pano_angle);
+            pano_seek=true;
+            pano_last=pano_angle;
+          }
+        }
+        else pano_seek=false;
+
         // Figure out coordinate system for this capture
-        stepper.serial_poll();
-        camera_transform camera_TF(stepper.get_angle_deg());
+        beacon_frame f;
+        f.camera=camera_transform().camera;
 
 #if DO_GCODE
-        camera_TF.camera=vec3(); // zero out camera position
+        f.camera=vec3(); // zero out camera position
         
         gcode.poll();
         int startframe=100;
         
-        if (framecount>startframe) {
+        if (framecount++>startframe) {
           float maxmove=900;
           int frames_per_mm=6;
           float moveto=(framecount-startframe)*(1.0/frames_per_mm);
@@ -434,152 +811,68 @@ int main(int argc,const char *argv[])
           gcode.send("G0 Y"); gcode.send(moveto); gcode.send("\n");
           gcode.send("M114\n"); // report position
           
-          camera_TF.camera.y=moveto*0.1; // <- mm to cm here
+          f.camera.y=moveto*0.1; // <- mm to cm here
         }
 #endif
 
-
-        // Wait for a coherent pair of frames: depth and color
-        frames = pipe.wait_for_frames();  
-        rs2::video_frame color_frame = frames.get_color_frame();  
-        rs2::depth_frame depth_frame = frames.get_depth_frame();  
-        if ((depth_w != depth_frame.get_width()) ||
-            (depth_h != depth_frame.get_height()) || 
-            (color_w != color_frame.get_width()) ||
-            (color_h != color_frame.get_height()))
-        {
-          std::cerr<<"Realsense capture size mismatch!\n";
-          exit(1);
-        }
-        
-        framecount++;
-  
-        void *color_data = (void*)color_frame.get_data();  
-          
-        // Make OpenCV version of raw pixels (no copy, so this is cheap)
-        Mat color_image(Size(color_w, color_h), CV_8UC3, color_data, Mat::AUTO_STEP);  
-        if (do_color) 
-        {
-          //imshow("RGB", color_image);
-
-          marker_watcher_print p(camera_TF);
-          
-#if DO_GCODE
-          static std::string last_name="";
-          char name[100]; 
-          snprintf(name,100,"gcode_vidcap/frame_%03dcm.jpg",(int)(camera_TF.camera.y));
-          if (name!=last_name) {
-             imwrite(name,color_image);
-             last_name=name;
-          }
-          
-          if (camera_TF.camera.y!=0.0)
-#endif
-          aruco_loc.find_markers(color_image,p);
-          if (p.angle_correction!=0) {
-             stepper.angle_correction-=p.angle_correction;
+        double start=pipeline_time();
+        if (replay) 
+        { // Grab the next recorded frame
+          rgbd_frame_view v;
+          if (!replayer->next(v)) break; // end of recording
+          f.depth=v.depth;
+          f.timestamp=v.header->timestamp;
+          f.frame_number=v.header->frame_number;
+          f.angle_deg=v.header->angle_deg;
+          if (replay->header->color_format==rgbd_color_JPEG) {
+            std::shared_ptr<Mat> color=std::make_shared<Mat>(
+              imdecode(Mat(1,v.header->color_bytes,CV_8UC1,(void*)v.color),IMREAD_COLOR));
+            f.color=color->data;
+            f.keepalive=color;
           }
-          p.markers.pose.print();
-          p.markers.beacon=stepper.get_angle_deg();
-          pose_pub.publish(p.markers);
-          
-          if (show_GUI) 
-            imshow("Color Image",color_image);
-        }
-        
-        bool do_scan=(obstacle_scan>0);
-        if (do_scan && pan_stepper && fabs(obstacle_scan_target-stepper.get_angle_deg())>4.0)
-        {
-          do_scan=false; // wait until stepper reaches target (FIXME: hangs if coords corrected during seek?)
+          else if (replay->header->color_format==rgbd_color_BGR8)
+            f.color=v.color; // raw pixels live in the mmap'd file
+          else f.color=0; // no color recorded
         }
-        
-        if (do_depth || obstacle_scan>0) 
-        {
-          typedef unsigned short depth_t;
-          depth_t *depth_data = (depth_t*)depth_frame.get_data();
-          
-          // Display raw data onscreen
-          //Mat depth_raw(Size(depth_w, depth_h), CV_16U, depth_data, Mat::AUTO_STEP);    
-          //imshow("Depth", depth_raw);
-          
-          // Set up *static* 3D so we don't need to recompute xdir and ydir every frame.
-          static realsense_projector depth_to_3D(depth_frame);
-          
-          //Mat debug_image(Size(depth_w, depth_h), CV_8UC3, cv::Scalar(0));
-          
-          // if (obstacle_scan>=16) obstacles.clear(); // clear the grid
-          
-          const int realsense_left_start=50; // invalid data left of here
-          for (int y = 0; y < depth_h; y++)
-          for (int x = realsense_left_start; x < depth_w; x++)
+        else 
+        { // Wait for a coherent pair of frames: depth and color
+          std::shared_ptr<rs2::frameset> frames=std::make_shared<rs2::frameset>(pipe.wait_for_frames());  
+          rs2::video_frame color_frame = frames->get_color_frame();  
+          rs2::depth_frame depth_frame = frames->get_depth_frame();  
+          if ((depth_w != depth_frame.get_width()) ||
+              (depth_h != depth_frame.get_height()) || 
+              (color_w != color_frame.get_width()) ||
+              (color_h != color_frame.get_height()))
           {
-            int i=y*depth_w + x;
-            float depth=depth_data[i]*depth2cm; // depth, in cm
-            
-            int depth_color=depth*(255.0/400.0);
-            cv::Vec3b debug_color;
-            if (depth_color<=255) debug_color=cv::Vec3b(depth_color,depth_color,0);
-            
-            if (depth>0) {
-              vec3 cam = depth_to_3D.lookup(depth,x,y);
-              vec3 world = camera_TF.world_from_camera(cam);
-              
-              if (world.z<150.0 && world.z>-50.0)
-              {
-                obstacles.add(world);
-              }
-              
-            }
-            //debug_image.at<cv::Vec3b>(y,x)=debug_color;
-          }   
-          //imshow("Depth image",debug_image);
-          
-          if (show_GUI) {
-            cv::Mat world_depth=obstacles.get_debug_2D(6);
-            imshow("2D World",world_depth);    
-          }
-          if (obstacle_scan>0) { 
-            obstacle_scan--;
-            if (obstacle_scan==0) {
-              // Done with scan--report results to backend
-              imwrite("raw_color.png",color_image);
-              std::vector<aurora_detected_obstacle> obstacle_list;
-              find_obstacles(obstacles,obstacle_list);
-              command_server.response(&obstacle_list[0],
-                sizeof(obstacle_list[0])*obstacle_list.size()); 
-            }
+            std::cerr<<"Realsense capture size mismatch!\n";
+            exit(1);
           }
-        }    
-        
-        int k = waitKey(10);  
-  if ((framecount>=30) || k == 'i') // image dump 
-  {
-    framecount=0;
-    char filename[500];
-    if (do_depth) {
-      sprintf(filename,"vidcaps/world_depth_%03d",(int)(0.5+stepper.get_angle_deg()));
-      obstacles.write(filename);
-      printf("Stored image to file %s\n",filename);
-      obstacles.clear();
-    }
-    if (do_color) {
-      imwrite("vidcaps/latest.jpg",color_image);
-      sprintf(filename,"cp vidcaps/latest.jpg vidcaps/view_%04d_%03ddeg.jpg",writecount,(int)(0.5+stepper.get_angle_deg()));
-      sys_error=system(filename);
-    }
-    
-    if (0 && pan_stepper) { // demo stepper seeking, in pattern
-      const int n_angles=5;
-      const static float angles[n_angles]={-45,0,+45,+60,0};
-      stepper.absolute_seek(angles[writecount%n_angles]);
-    }
-
-    writecount++;
-  }
-        if (k == 27 || k=='q')  
-            break;  
+          f.depth=(const unsigned short *)depth_frame.get_data();
+          f.color=(const unsigned char *)color_frame.get_data();
+          f.timestamp=0.001*depth_frame.get_timestamp(); // ms to seconds
+          f.frame_number=depth_frame.get_frame_number();
+          f.keepalive=frames;
+        }
+        if (!replay) 
+        { // Tag frame with where the stepper was at exposure time (it may be moving)
+          std::lock_guard<std::mutex> guard(pipeline.stepper_lock);
+          stepper.serial_poll();
+          f.angle_deg=stepper.get_angle_deg(pipeline_time()-frame_latency);
+        }
+        f.depth_w=depth_w; f.depth_h=depth_h;
+        f.color_w=color_w; f.color_h=color_h;
+        pipeline.captured(f);
+        pipeline.capture_stats.finished(pipeline_time()-start);
     }  
-  
+    
+    // Let the other stages finish up any queued work
+    while (!pipeline.quit && !pipeline.drained()) usleep(10*1000);
+    usleep(100*1000); // let in-flight frames finish
+    pipeline.quit=true;
+    detect_thread.join();
+    depth_thread.join();
+    output_thread.join();
+    if (pipeline.recorder) pipeline.recorder->finish();
   
     return 0;  
-}  
+}
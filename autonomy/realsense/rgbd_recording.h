@@ -0,0 +1,321 @@
+/**
+  Recorded RGB-D (color plus depth) datasets for the realsense beacon.
+
+  One file holds a whole run:
+     rgbd_file_header
+     frames: rgbd_frame_header, raw Z16 depth pixels, color data (BGR8 or JPEG)
+     index: one 64-bit file offset per frame
+  Every record starts on an 8-byte boundary, so the file can be
+  memory-mapped and the depth pixels used in place, with no copies.
+
+  If the recorder dies before writing the index, the reader
+  rebuilds it by walking the frame headers.
+*/
+#ifndef __AURORA_RGBD_RECORDING_H
+#define __AURORA_RGBD_RECORDING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define RGBD_FILE_MAGIC "AURGBD1"
+#define RGBD_FRAME_MAGIC 0x46444252 /* "RBDF" */
+enum {RGBD_FILE_VERSION=1};
+
+// Formats for the color data
+enum {
+  rgbd_color_none=0, // no color stored
+  rgbd_color_BGR8=1, // raw 8-bit BGR pixels
+  rgbd_color_JPEG=2, // JPEG-compressed
+};
+
+// Distortion models (same values as librealsense's rs2_distortion)
+enum {
+  rgbd_distortion_none=0,
+  rgbd_distortion_inverse_brown_conrady=2,
+};
+
+/** Depth camera calibration.  Same fields as librealsense's rs2_intrinsics. */
+struct rgbd_intrinsics {
+  int32_t width, height; // pixels
+  float ppx, ppy; // principal point, in pixels
+  float fx, fy; // focal length, in pixels
+  int32_t model; // rs2_distortion model
+  float coeffs[5]; // distortion coefficients
+};
+
+/** Start of the file */
+struct rgbd_file_header {
+  char magic[8]; // RGBD_FILE_MAGIC
+  uint32_t version; // RGBD_FILE_VERSION
+  uint32_t header_bytes; // sizeof(rgbd_file_header), sanity check
+
+  uint32_t depth_w, depth_h; // depth image size, pixels
+  uint32_t color_w, color_h; // color image size, pixels
+  uint32_t color_format; // rgbd_color_... enum
+  float depth_scale; // meters per depth unit
+  rgbd_intrinsics depth_intrinsics;
+
+  uint64_t frame_count; // frames in the index
+  uint64_t index_offset; // file offset of the index (0 if never finished)
+};
+
+/** Start of each frame */
+struct rgbd_frame_header {
+  uint32_t magic; // RGBD_FRAME_MAGIC
+  uint32_t color_bytes; // bytes of color data following the depth
+  uint64_t frame_number; // camera's frame counter
+  double timestamp; // capture time, in seconds
+  float angle_deg; // stepper angle, in degrees
+  uint32_t depth_bytes; // bytes of depth data following this header
+};
+
+/** Points to one frame's data (inside a recording, or live buffers) */
+struct rgbd_frame_view {
+  const rgbd_frame_header *header;
+  const uint16_t *depth; // depth_w * depth_h raw Z16 pixels
+  const unsigned char *color; // header->color_bytes of color data
+};
+
+/* Round this file offset up to the next 8-byte boundary */
+inline uint64_t rgbd_align(uint64_t offset) { return (offset+7)&~(uint64_t)7; }
+
+
+/**
+  Writes frames to a new recording file.
+*/
+class rgbd_recorder {
+  FILE *f;
+  rgbd_file_header header;
+  std::vector<uint64_t> index;
+
+  // Pad the file out to an 8-byte boundary
+  void pad(void) {
+    static const char zeros[8]={0};
+    uint64_t at=ftello(f);
+    fwrite(zeros,1,rgbd_align(at)-at,f);
+  }
+public:
+  // Start a recording.  header describes the image sizes and calibration.
+  rgbd_recorder(const std::string &filename,const rgbd_file_header &header_)
+    :header(header_)
+  {
+    memcpy(header.magic,RGBD_FILE_MAGIC,8);
+    header.version=RGBD_FILE_VERSION;
+    header.header_bytes=sizeof(header);
+    header.frame_count=0;
+    header.index_offset=0;
+    f=fopen(filename.c_str(),"wb");
+    if (!f) {
+      fprintf(stderr,"ERROR> Can't create RGBD recording %s\n",filename.c_str());
+      return;
+    }
+    fwrite(&header,sizeof(header),1,f);
+  }
+  ~rgbd_recorder() { finish(); }
+
+  bool ok(void) const { return f!=0; }
+
+  // Append one frame to the recording
+  void add(const uint16_t *depth,const void *color,uint32_t color_bytes,
+    double timestamp,float angle_deg,uint64_t frame_number)
+  {
+    if (!f) return;
+    pad();
+    index.push_back(ftello(f));
+    rgbd_frame_header fh;
+    memset(&fh,0,sizeof(fh));
+    fh.magic=RGBD_FRAME_MAGIC;
+    fh.depth_bytes=header.depth_w*header.depth_h*sizeof(uint16_t);
+    fh.color_bytes=color_bytes;
+    fh.frame_number=frame_number;
+    fh.timestamp=timestamp;
+    fh.angle_deg=angle_deg;
+    fwrite(&fh,sizeof(fh),1,f);
+    fwrite(depth,1,fh.depth_bytes,f);
+    if (color_bytes>0) fwrite(color,1,color_bytes,f);
+  }
+
+  // Write the index and close the file.
+  void finish(void) {
+    if (!f) return;
+    pad();
+    header.frame_count=index.size();
+    header.index_offset=ftello(f);
+    if (index.size()>0) fwrite(&index[0],sizeof(index[0]),index.size(),f);
+    fseeko(f,0,SEEK_SET);
+    fwrite(&header,sizeof(header),1,f);
+    fclose(f);
+    f=0;
+  }
+};
+
+
+/**
+  Read-only, memory-mapped view of a recording file.
+*/
+class rgbd_recording {
+  const unsigned char *base; // mmap'd file data
+  uint64_t length; // bytes in file
+  std::vector<uint64_t> index; // file offsets of frames
+  uint64_t depth_bytes; // every frame's depth data size, from the header
+  uint64_t color_bytes; // every frame's color data size, for raw color formats
+
+  bool fail(const char *why) {
+    fprintf(stderr,"ERROR> RGBD recording %s: %s\n",filename.c_str(),why);
+    return false;
+  }
+
+  // Check the frame at this file offset fits in the file and matches the header.
+  //   Returns 0 if it's good, or why not.
+  const char *check_frame(uint64_t at) const {
+    if (at<sizeof(rgbd_file_header) || at!=rgbd_align(at)) return "misaligned frame offset";
+    if (at>length || length-at<sizeof(rgbd_frame_header)) return "frame header past end of file";
+    const rgbd_frame_header *fh=(const rgbd_frame_header *)(base+at);
+    if (fh->magic!=RGBD_FRAME_MAGIC) return "bad frame magic";
+    if (fh->depth_bytes!=depth_bytes) return "frame depth size doesn't match the header";
+    if (header->color_format==rgbd_color_none && fh->color_bytes!=0) return "color data in a recording without color";
+    if (header->color_format==rgbd_color_BGR8 && fh->color_bytes!=color_bytes) return "frame color size doesn't match the header";
+    uint64_t data=(uint64_t)fh->depth_bytes+fh->color_bytes;
+    if (length-at-sizeof(rgbd_frame_header)<data) return "frame data past end of file";
+    return 0;
+  }
+
+  bool open_file(void) {
+    int fd=open(filename.c_str(),O_RDONLY);
+    if (fd<0) return fail("can't open file");
+    struct stat st;
+    if (fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(rgbd_file_header)) {
+      close(fd);
+      return fail("file too short");
+    }
+    length=st.st_size;
+    void *p=mmap(0,length,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); // the mapping keeps the file open
+    if (p==MAP_FAILED) return fail("can't mmap file");
+    base=(const unsigned char *)p;
+
+    header=(const rgbd_file_header *)base;
+    if (0!=memcmp(header->magic,RGBD_FILE_MAGIC,8)) return fail("not an RGBD recording");
+    if (header->version>RGBD_FILE_VERSION) return fail("file version is too new");
+    if (header->header_bytes!=sizeof(rgbd_file_header)) return fail("header size mismatch");
+
+    // Image sizes: frames must hold exactly this much depth (and raw color)
+    if (header->depth_w==0 || header->depth_h==0 || header->depth_w>16384 || header->depth_h>16384)
+      return fail("bad depth image size");
+    if ((int64_t)header->depth_w!=header->depth_intrinsics.width || (int64_t)header->depth_h!=header->depth_intrinsics.height)
+      return fail("depth intrinsics don't match the depth image size");
+    depth_bytes=header->depth_w*header->depth_h*sizeof(uint16_t);
+    if (header->color_format==rgbd_color_BGR8) {
+      if (header->color_w==0 || header->color_h==0 || header->color_w>16384 || header->color_h>16384)
+        return fail("bad color image size");
+      color_bytes=header->color_w*header->color_h*3;
+    }
+    else if (header->color_format!=rgbd_color_none && header->color_format!=rgbd_color_JPEG)
+      return fail("unknown color format");
+
+    if (header->index_offset!=0)
+    { // finished file: use the stored index
+      if (header->index_offset!=rgbd_align(header->index_offset) || header->index_offset>length ||
+          header->frame_count>(length-header->index_offset)/sizeof(uint64_t))
+        return fail("index past end of file");
+      const uint64_t *stored=(const uint64_t *)(base+header->index_offset);
+      index.assign(stored,stored+header->frame_count);
+      for (uint64_t at : index) {
+        const char *why=check_frame(at);
+        if (why) return fail(why);
+        if (at+sizeof(rgbd_frame_header)>header->index_offset) return fail("frame overlaps the index");
+      }
+    }
+    else
+    { // unfinished file: rebuild the index by walking the frames
+      printf("RGBD recording %s has no index; scanning frames\n",filename.c_str());
+      uint64_t at=rgbd_align(sizeof(rgbd_file_header));
+      while (at+sizeof(rgbd_frame_header)<=length) {
+        const rgbd_frame_header *fh=(const rgbd_frame_header *)(base+at);
+        uint64_t end=at+sizeof(*fh)+(uint64_t)fh->depth_bytes+fh->color_bytes;
+        if (fh->magic!=RGBD_FRAME_MAGIC || end>length) break; // recorder died here
+        const char *why=check_frame(at);
+        if (why) return fail(why);
+        index.push_back(at);
+        at=rgbd_align(end);
+      }
+    }
+    return true;
+  }
+public:
+  std::string filename;
+  const rgbd_file_header *header; // points into the file
+
+  rgbd_recording(const std::string &filename_)
+    :base(0), length(0), depth_bytes(0), color_bytes(0), filename(filename_), header(0)
+  {
+    if (!open_file()) index.clear();
+  }
+  ~rgbd_recording() {
+    if (base) munmap((void *)base,length);
+  }
+
+  bool ok(void) const { return base!=0 && index.size()>0; }
+
+  // Return the number of frames in the recording
+  size_t size(void) const { return index.size(); }
+
+  // Return the data for frame i (no copies; points into the file)
+  rgbd_frame_view frame(size_t i) const {
+    rgbd_frame_view v;
+    const unsigned char *p=base+index[i];
+    v.header=(const rgbd_frame_header *)p;
+    p+=sizeof(rgbd_frame_header);
+    v.depth=(const uint16_t *)p;
+    v.color=p+v.header->depth_bytes;
+    return v;
+  }
+};
+
+
+/**
+  Plays back a recording in timestamp order, like a live camera.
+  speed 1.0 is real time, 2.0 is twice as fast, and
+  0.0 hands out frames as fast as the caller asks for them.
+*/
+class rgbd_replay {
+  const rgbd_recording &rec;
+  size_t next_frame;
+  double speed;
+  std::chrono::steady_clock::time_point start_wall;
+  double start_stamp;
+public:
+  rgbd_replay(const rgbd_recording &rec_,double speed_=1.0)
+    :rec(rec_), next_frame(0), speed(speed_), start_stamp(0.0) {}
+
+  // Get the next frame, waiting until it's due.
+  //  Returns false at the end of the recording.
+  bool next(rgbd_frame_view &v) {
+    if (next_frame>=rec.size()) return false;
+    v=rec.frame(next_frame);
+    if (next_frame==0) {
+      start_wall=std::chrono::steady_clock::now();
+      start_stamp=v.header->timestamp;
+    }
+    else if (speed>0.0) {
+      double due=(v.header->timestamp-start_stamp)/speed;
+      std::this_thread::sleep_until(start_wall+
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(due)));
+    }
+    next_frame++;
+    return true;
+  }
+};
+
+#endif
+
@@ -1,28 +1,53 @@
-/* 
-  Do data analysis on realsense dataset. 
+/*
+  Do data analysis on realsense dataset.
+
+  Give one grid to get debug images, or several grids
+  (like vidcaps/world_depth_*.grid) to batch-analyze a whole run.
+  Reads both .grid files and the older raw .bin grids.
 */
-#include <opencv2/opencv.hpp>  
+#include <opencv2/opencv.hpp>
 #include "vision/grid.hpp"
 #include "vision/grid.cpp"
 #include "find_obstacles.h"
+#include <chrono>
 
 int main(int argc,char *argv[]) {
 
-  // Figure out which grid filename to read
-  std::string name="obstacles_debug";
-  if (argc>1) name=argv[1];
+  // Figure out which grid filenames to read
+  std::vector<std::string> names;
+  for (int argi=1;argi<argc;argi++) names.push_back(argv[argi]);
+  if (names.size()==0) names.push_back("obstacles_debug");
+  bool debug=(names.size()==1); // debug images for a single grid
+
   printf("Grid size: %d x %d = %d cells\n",
     (int)obstacle_grid::GRIDX,
     (int)obstacle_grid::GRIDY,
     (int)obstacle_grid::GRIDTOTAL);
-  
-  // Read the grid
+
   obstacle_grid obstacles;
-  obstacles.read(name);
-  
-  std::vector<aurora_detected_obstacle> list;
-  find_obstacles(obstacles,list);
-  
+  double read_ms=0.0, find_ms=0.0;
+  int grids=0;
+  for (const std::string &name : names)
+  {
+    // Read the grid
+    auto start=std::chrono::steady_clock::now();
+    grid_file_pose pose;
+    if (!obstacles.read(name,&pose)) continue;
+    auto read_done=std::chrono::steady_clock::now();
+
+    std::vector<aurora_detected_obstacle> list;
+    find_obstacles(obstacles,list,debug);
+    auto find_done=std::chrono::steady_clock::now();
+
+    read_ms+=std::chrono::duration<double,std::milli>(read_done-start).count();
+    find_ms+=std::chrono::duration<double,std::milli>(find_done-read_done).count();
+    grids++;
+    printf("%s: %d obstacles, camera angle %.1f deg, time %.3f\n",
+      name.c_str(),(int)list.size(),pose.angle_deg,pose.timestamp);
+  }
+  if (grids>1)
+    printf("%d grids: %.2f ms/grid reading, %.2f ms/grid finding obstacles\n",
+      grids, read_ms/grids, find_ms/grids);
+
   return 0;
 }
-
@@ -0,0 +1,365 @@
+/*
+  Synthetic realsense depth frames, for benchmarking obstacle detection
+  without going out to the sandbox.
+
+  Builds a random field (arena walls, scoring trough, rocks and craters),
+  ray traces RealSense-like Z16 depth frames from the beacon's camera,
+  adds range-dependent noise and dropouts, then runs the same
+  grid_depth_frame and find_obstacles code as the beacon.
+  Reports precision and recall against the true rocks and craters,
+  plus milliseconds per stage.
+
+  Every run is seeded from --seed plus its run number, so results
+  don't depend on how many threads are used.
+*/
+#include <opencv2/opencv.hpp>
+#include "vision/grid.hpp"
+#include "vision/grid.cpp"
+#include "depth_projection.h"
+#include "find_obstacles.h"
+
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+/* Benchmark settings (set from the command line) */
+struct synthetic_settings {
+  int seed=1; // random seed for run 0
+  int runs=8; // number of random fields to try
+  int threads=0; // 0 means one per core
+  int frames=18; // depth frames per scan (like the 'T' command)
+  float angle=45; // stepper angle to scan at, degrees
+
+  int rocks=8, craters=4; // objects per field
+  float rock_min=10, rock_max=30; // rock heights, cm
+  float crater_min=10, crater_max=30; // crater depths, cm
+
+  float noise=0.5; // depth noise standard deviation at 1 meter, cm (grows as distance squared)
+  float dropout=0.05; // fraction of pixels with no depth
+  bool coarse=false; // low resolution camera mode
+
+  int min_visible=20; // an object needs this many pixels to count as seen
+  std::string record=""; // write run 0's frames to this RGBD recording
+};
+
+/* One rock (height>0) or crater (height<0) */
+struct field_object {
+  float x,y; // center, cm field coordinates
+  float radius; // cm
+  float height; // cm above ground, negative for craters
+};
+
+/**
+  Height map of a random field, sampled every cm.
+*/
+class synthetic_field {
+public:
+  enum {MARGIN=50}; // cm of wall around the field
+  enum {W=field_x_size+2*MARGIN, H=field_y_size+2*MARGIN};
+  enum {WALL=80, TROUGH=55}; // heights, cm
+
+  std::vector<float> height; // W*H height map
+  std::vector<short> owner; // W*H index into objects, or -1
+  std::vector<field_object> objects;
+
+  synthetic_field(std::mt19937 &rng,const synthetic_settings &s)
+    :height(W*H,0.0f), owner(W*H,-1)
+  {
+    // Arena walls and scoring trough
+    for (int y=0;y<H;y++)
+    for (int x=0;x<W;x++) {
+      int fx=x-MARGIN, fy=y-MARGIN;
+      float &h=height[y*W+x];
+      if (fx<0 || fx>=field_x_size || fy<0 || fy>=field_y_size) h=WALL;
+      else if (fx>=field_x_trough_start && fx<field_x_trough_end &&
+               fy>=field_y_trough_start && fy<field_y_trough_end) h=TROUGH;
+    }
+
+    // Rocks and craters go in the obstacle zone
+    std::uniform_real_distribution<float> unit(0.0f,1.0f);
+    for (int i=0;i<s.rocks+s.craters;i++) {
+      field_object o;
+      bool rock=(i<s.rocks);
+      if (rock) {
+        o.height=s.rock_min+unit(rng)*(s.rock_max-s.rock_min);
+        o.radius=o.height*(1.0f+0.5f*unit(rng));
+      } else {
+        o.height=-(s.crater_min+unit(rng)*(s.crater_max-s.crater_min));
+        o.radius=-o.height*(1.5f+unit(rng));
+      }
+      o.x=o.radius+unit(rng)*(field_x_size-2*o.radius);
+      o.y=field_y_start_zone+o.radius+unit(rng)*(field_y_mine_zone-field_y_start_zone-2*o.radius);
+      objects.push_back(o);
+      stamp(o,i);
+    }
+  }
+
+  // Add this object to the height map
+  void stamp(const field_object &o,int index) {
+    float reach=o.radius*1.25f; // crater rims stick out past the radius
+    for (int y=(int)(o.y-reach);y<=(int)(o.y+reach);y++)
+    for (int x=(int)(o.x-reach);x<=(int)(o.x+reach);x++) {
+      int gx=x+MARGIN, gy=y+MARGIN;
+      if (gx<0 || gx>=W || gy<0 || gy>=H) continue;
+      float d=sqrt((x+0.5f-o.x)*(x+0.5f-o.x)+(y+0.5f-o.y)*(y+0.5f-o.y))/o.radius;
+      float dh=0.0f;
+      if (o.height>0) { // rock: ellipsoid cap
+        if (d<1.0f) dh=o.height*sqrt(1.0f-d*d);
+      } else { // crater: parabolic bowl with a low rim
+        if (d<1.0f) dh=o.height*(1.0f-d*d);
+        else if (d<1.25f) dh=-0.15f*o.height*(1.0f-fabs(d-1.125f)*8.0f);
+      }
+      if (dh!=0.0f) {
+        height[gy*W+gx]+=dh;
+        if (d<1.0f) owner[gy*W+gx]=index;
+      }
+    }
+  }
+
+  // Return the index of the height map sample at this field location, or -1 if off the map
+  int index(float x,float y) const {
+    int gx=(int)floor(x)+MARGIN, gy=(int)floor(y)+MARGIN;
+    if (gx<0 || gx>=W || gy<0 || gy>=H) return -1;
+    return gy*W+gx;
+  }
+};
+
+/**
+  Ray trace the camera's ideal (noise-free) depth image of this field.
+  Depth is along the camera's Z axis, in cm (0 for no return).
+  Counts visible pixels for each field object.
+*/
+void render_depth(const synthetic_field &field,const realsense_projector &proj,
+  const camera_transform &camera_TF,
+  std::vector<float> &depth,std::vector<int> &visible_pixels)
+{
+  const float max_range=1000.0; // cm
+  const float step_xy=2.0; // cm of horizontal travel per ray step
+  int w=proj.intrinsics.width, h=proj.intrinsics.height;
+  depth.assign(w*h,0.0f);
+  visible_pixels.assign(field.objects.size(),0);
+  vec3 C=camera_TF.camera;
+  for (int y=0;y<h;y++)
+  for (int x=0;x<w;x++)
+  {
+    int i=y*w+x;
+    vec3 D=camera_TF.world_from_camera(vec3(proj.xdir[i],proj.ydir[i],1.0))-C;
+    float dxy=sqrt(D.x*D.x+D.y*D.y);
+    float dt=step_xy/std::max(dxy,0.01f);
+    float t_last=0.0f;
+    for (float t=10.0f;t<max_range;t+=dt) {
+      vec3 P=C+D*t;
+      int idx=field.index(P.x,P.y);
+      if (idx<0) break; // left the map
+      if (P.z<=field.height[idx])
+      { // hit: refine by bisection
+        float lo=t_last, hi=t;
+        for (int rep=0;rep<6;rep++) {
+          float mid=0.5f*(lo+hi);
+          vec3 M=C+D*mid;
+          int m=field.index(M.x,M.y);
+          if (m>=0 && M.z<=field.height[m]) hi=mid; else lo=mid;
+        }
+        depth[i]=hi;
+        vec3 H=C+D*hi;
+        int hidx=field.index(H.x,H.y);
+        if (hidx>=0 && field.owner[hidx]>=0) visible_pixels[field.owner[hidx]]++;
+        break;
+      }
+      t_last=t;
+    }
+  }
+}
+
+/* RealSense-like depth camera: 87 degree field of view, no distortion */
+rgbd_intrinsics synthetic_intrinsics(const synthetic_settings &s) {
+  rgbd_intrinsics in;
+  memset(&in,0,sizeof(in));
+  in.width=s.coarse?480:1280; in.height=s.coarse?270:720;
+  in.ppx=0.5f*in.width; in.ppy=0.5f*in.height;
+  in.fx=in.fy=0.5f*in.width/tan(0.5*87.0*M_PI/180.0);
+  in.model=rgbd_distortion_none;
+  return in;
+}
+
+/* Results from one synthetic run */
+struct synthetic_result {
+  int seed;
+  int objects; // total rocks and craters
+  int visible; // objects the camera could see
+  int found; // visible objects with at least one detection
+  int detections; // obstacle cells reported by find_obstacles
+  int arena; // detections on walls or trough (not scored)
+  int true_detections; // detections that land on an object
+  double render_ms, noise_ms, grid_ms, find_ms;
+};
+
+inline double synthetic_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+/* Build a field, render and grid a scan, find obstacles, and score them. */
+synthetic_result synthetic_run(const synthetic_settings &s,int run,rgbd_recorder *recorder)
+{
+  typedef std::chrono::steady_clock clock;
+  synthetic_result r;
+  r.seed=s.seed+run;
+  std::mt19937 rng(r.seed);
+  synthetic_field field(rng,s);
+  r.objects=field.objects.size();
+
+  rgbd_intrinsics in=synthetic_intrinsics(s);
+  realsense_projector proj(in);
+  camera_transform camera_TF(s.angle);
+
+  auto start=clock::now();
+  std::vector<float> ideal;
+  std::vector<int> visible_pixels;
+  render_depth(field,proj,camera_TF,ideal,visible_pixels);
+  r.render_ms=synthetic_ms(start);
+
+  // Accumulate noisy frames, exactly like the beacon's depth stage
+  const double depth2cm=0.1; // 1mm depth units
+  std::normal_distribution<float> gauss(0.0f,1.0f);
+  std::uniform_real_distribution<float> unit(0.0f,1.0f);
+  std::vector<unsigned short> z16(ideal.size());
+  obstacle_grid obstacles;
+  r.noise_ms=r.grid_ms=0.0;
+  for (int frame=0;frame<s.frames;frame++) {
+    start=clock::now();
+    for (size_t i=0;i<ideal.size();i++) {
+      float d=ideal[i];
+      if (d<=0.0f || unit(rng)<s.dropout) { z16[i]=0; continue; }
+      float m=d*0.01f; // meters
+      d+=gauss(rng)*s.noise*m*m;
+      z16[i]=(unsigned short)std::max(0.0,std::min(65535.0,d/depth2cm+0.5));
+    }
+    r.noise_ms+=synthetic_ms(start);
+    if (recorder) recorder->add(&z16[0],0,0,frame/6.0,s.angle,frame);
+
+    start=clock::now();
+    grid_depth_frame(&z16[0],in.width,in.height,depth2cm,camera_TF,proj,obstacles);
+    r.grid_ms+=synthetic_ms(start);
+  }
+
+  start=clock::now();
+  std::vector<aurora_detected_obstacle> list;
+  find_obstacles(obstacles,list,false);
+  r.find_ms=synthetic_ms(start);
+
+  // Score detections against the true objects
+  std::vector<bool> found(field.objects.size(),false);
+  r.detections=list.size();
+  r.arena=r.true_detections=0;
+  const float tolerance=obstacle_grid::GRIDSIZE*1.5f; // cm of slop allowed
+  for (const aurora_detected_obstacle &det : list) {
+    float x=det.x+0.5f*obstacle_grid::GRIDSIZE, y=det.y+0.5f*obstacle_grid::GRIDSIZE;
+    int idx=field.index(x,y);
+    bool on_object=false;
+    for (size_t o=0;o<field.objects.size();o++) {
+      const field_object &obj=field.objects[o];
+      float d=sqrt((x-obj.x)*(x-obj.x)+(y-obj.y)*(y-obj.y));
+      if (d<=1.25f*obj.radius+tolerance) { on_object=true; found[o]=true; }
+    }
+    if (on_object) r.true_detections++;
+    else if (idx<0 || field.height[idx]>=synthetic_field::TROUGH
+      || x<tolerance || x>field_x_size-tolerance || y<tolerance || y>field_y_size-tolerance
+      || (x>field_x_trough_start-tolerance && x<field_x_trough_end+tolerance
+          && y<field_y_trough_end+tolerance))
+      r.arena++; // wall or trough: a real obstacle, but not one of ours
+  }
+  r.visible=r.found=0;
+  for (size_t o=0;o<field.objects.size();o++)
+    if (visible_pixels[o]>=s.min_visible) {
+      r.visible++;
+      if (found[o]) r.found++;
+    }
+  return r;
+}
+
+int main(int argc,char *argv[]) {
+  synthetic_settings s;
+  for (int argi=1;argi<argc;argi++) {
+    std::string arg=argv[argi];
+    bool more=(argi+1<argc);
+    if (arg=="--seed" && more) s.seed=atoi(argv[++argi]);
+    else if (arg=="--runs" && more) s.runs=atoi(argv[++argi]);
+    else if (arg=="--threads" && more) s.threads=atoi(argv[++argi]);
+    else if (arg=="--frames" && more) s.frames=atoi(argv[++argi]);
+    else if (arg=="--angle" && more) s.angle=atof(argv[++argi]);
+    else if (arg=="--rocks" && more) s.rocks=atoi(argv[++argi]);
+    else if (arg=="--craters" && more) s.craters=atoi(argv[++argi]);
+    else if (arg=="--rock_height" && argi+2<argc) { s.rock_min=atof(argv[++argi]); s.rock_max=atof(argv[++argi]); }
+    else if (arg=="--crater_depth" && argi+2<argc) { s.crater_min=atof(argv[++argi]); s.crater_max=atof(argv[++argi]); }
+    else if (arg=="--noise" && more) s.noise=atof(argv[++argi]);
+    else if (arg=="--dropout" && more) s.dropout=atof(argv[++argi]);
+    else if (arg=="--coarse") s.coarse=true;
+    else if (arg=="--record" && more) s.record=argv[++argi];
+    else {
+      printf("Unknown argument '%s'.  Options:\n"
+        "  --seed N --runs N --threads N --frames N --angle deg\n"
+        "  --rocks N --craters N --rock_height min max --crater_depth min max\n"
+        "  --noise cm_at_1m --dropout fraction --coarse --record file.rgbd\n",argv[argi]);
+      return 1;
+    }
+  }
+  if (s.threads<=0) s.threads=std::max(1u,std::thread::hardware_concurrency());
+
+  rgbd_recorder *recorder=0;
+  if (s.record!="") {
+    rgbd_file_header h;
+    memset(&h,0,sizeof(h));
+    h.depth_intrinsics=synthetic_intrinsics(s);
+    h.depth_w=h.depth_intrinsics.width; h.depth_h=h.depth_intrinsics.height;
+    h.color_format=rgbd_color_none;
+    h.depth_scale=0.001;
+    recorder=new rgbd_recorder(s.record,h);
+    if (!recorder->ok()) return 1;
+  }
+
+  // Hand out runs to worker threads
+  std::vector<synthetic_result> results(s.runs);
+  std::atomic<int> next_run(0);
+  auto start=std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t=0;t<s.threads;t++) workers.push_back(std::thread([&]() {
+    int run;
+    while ((run=next_run++)<s.runs)
+      results[run]=synthetic_run(s,run,run==0?recorder:0);
+  }));
+  for (std::thread &t : workers) t.join();
+  double wall_ms=synthetic_ms(start);
+  if (recorder) {
+    recorder->finish();
+    delete recorder;
+  }
+
+  // Report per run, then totals
+  printf("seed,objects,visible,found,detections,arena,true_detections,precision,recall,render_ms,noise_ms,grid_ms,find_ms\n");
+  synthetic_result sum;
+  memset(&sum,0,sizeof(sum));
+  for (const synthetic_result &r : results) {
+    int scored=r.detections-r.arena;
+    printf("%d,%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f\n",
+      r.seed,r.objects,r.visible,r.found,r.detections,r.arena,r.true_detections,
+      scored>0?r.true_detections/(double)scored:1.0,
+      r.visible>0?r.found/(double)r.visible:1.0,
+      r.render_ms,r.noise_ms,r.grid_ms,r.find_ms);
+    sum.visible+=r.visible; sum.found+=r.found;
+    sum.detections+=r.detections; sum.arena+=r.arena; sum.true_detections+=r.true_detections;
+    sum.render_ms+=r.render_ms; sum.noise_ms+=r.noise_ms;
+    sum.grid_ms+=r.grid_ms; sum.find_ms+=r.find_ms;
+  }
+  int n=std::max(1,s.runs);
+  int scored=sum.detections-sum.arena;
+  printf("\nTotal over %d runs (%d threads, %.0f ms wall clock):\n",s.runs,s.threads,wall_ms);
+  printf("  precision %.3f (%d of %d detections on rocks/craters, %d on walls/trough)\n",
+    scored>0?sum.true_detections/(double)scored:1.0, sum.true_detections, scored, sum.arena);
+  printf("  recall    %.3f (%d of %d visible rocks/craters found)\n",
+    sum.visible>0?sum.found/(double)sum.visible:1.0, sum.found, sum.visible);
+  printf("  per scan: render %.1f ms, noise %.1f ms, grid %.1f ms (%.2f ms/frame), find_obstacles %.1f ms\n",
+    sum.render_ms/n, sum.noise_ms/n, sum.grid_ms/n, sum.grid_ms/n/std::max(1,s.frames), sum.find_ms/n);
+  return 0;
+}
+
@@ -0,0 +1,132 @@
+/*
+  Replay a libsurvive recording through the MPFIT poser twice: once
+  evaluating measurements one at a time, and once as a batch
+  (the mpfit-batch option), and compare time and the poses found.
+  The poser also prints its per-solve time and iterations on exit.
+
+  Usage: bench_mpfit <recording> [other libsurvive options]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <survive.h>
+#include <os_generic.h>
+
+typedef struct {
+	char codename[4];
+	survive_timecode timecode;
+	SurvivePose pose;
+} bench_pose;
+
+typedef struct {
+	bench_pose *poses;
+	size_t count, alloc;
+	double wall, cpu; // seconds for the whole replay
+} bench_run;
+
+static bench_run *current_run = 0;
+
+static void bench_pose_process(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	survive_default_raw_pose_process(so, timecode, pose);
+	bench_run *r = current_run;
+	if (r->count == r->alloc) {
+		r->alloc = r->alloc ? 2 * r->alloc : 1024;
+		r->poses = realloc(r->poses, r->alloc * sizeof(bench_pose));
+	}
+	bench_pose *p = &r->poses[r->count++];
+	memcpy(p->codename, so->codename, sizeof(p->codename));
+	p->timecode = timecode;
+	p->pose = *pose;
+}
+
+// Replay the whole recording as fast as possible; returns 0 on success
+static int bench_replay(int argc, char **argv, int batch, bench_run *r) {
+	char *args[64];
+	int n = 0;
+	args[n++] = argv[0];
+	args[n++] = "--playback";
+	args[n++] = argv[1];
+	args[n++] = "--playback-factor";
+	args[n++] = "0";
+	args[n++] = "--defaultposer";
+	args[n++] = "MPFIT";
+	args[n++] = "--mpfit-batch";
+	args[n++] = batch ? "1" : "0";
+	for (int i = 2; i < argc && n < 64; i++)
+		args[n++] = argv[i];
+
+	current_run = r;
+	SurviveContext *ctx = survive_init(n, args);
+	if (!ctx) {
+		fprintf(stderr, "Can't start libsurvive playback of %s\n", argv[1]);
+		return 1;
+	}
+	survive_install_pose_fn(ctx, bench_pose_process);
+
+	double wall = OGGetAbsoluteTime();
+	clock_t cpu = clock();
+	while (survive_poll(ctx) == 0) {
+	}
+	survive_close(ctx); // poser prints its stats here
+	r->cpu = (clock() - cpu) / (double)CLOCKS_PER_SEC;
+	r->wall = OGGetAbsoluteTime() - wall;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("Usage: bench_mpfit <recording> [other libsurvive options]\n"
+			   "  Compares MPFIT with and without batched measurement evaluation.\n");
+		return 1;
+	}
+
+	bench_run runs[2];
+	memset(runs, 0, sizeof(runs));
+	for (int batch = 0; batch < 2; batch++) {
+		printf("Replaying %s with mpfit-batch %d\n", argv[1], batch);
+		if (bench_replay(argc, argv, batch, &runs[batch]))
+			return 1;
+	}
+
+	// Pose differences, for poses both runs found at the same time
+	size_t matched = 0;
+	double sum_pos = 0, max_pos = 0, sum_rot = 0;
+	for (size_t i = 0, j = 0; i < runs[0].count && j < runs[1].count;) {
+		const bench_pose *a = &runs[0].poses[i], *b = &runs[1].poses[j];
+		if (a->timecode != b->timecode) { // one run had a solve failure
+			if (a->timecode < b->timecode)
+				i++;
+			else
+				j++;
+			continue;
+		}
+		if (memcmp(a->codename, b->codename, sizeof(a->codename)) == 0) {
+			FLT d[3];
+			sub3d(d, a->pose.Pos, b->pose.Pos);
+			double pos = norm3d(d);
+			double dot = fabs(quatinnerproduct(a->pose.Rot, b->pose.Rot));
+			sum_pos += pos;
+			sum_rot += 2 * acos(dot > 1 ? 1 : dot);
+			if (pos > max_pos)
+				max_pos = pos;
+			matched++;
+		}
+		i++;
+		j++;
+	}
+
+	printf("\n%-12s %10s %10s %10s %12s\n", "mpfit-batch", "poses", "wall (s)", "cpu (s)", "cpu/pose (us)");
+	for (int batch = 0; batch < 2; batch++) {
+		const bench_run *r = &runs[batch];
+		printf("%-12d %10lu %10.3f %10.3f %12.1f\n", batch, (unsigned long)r->count, r->wall, r->cpu,
+			   r->count ? r->cpu * 1e6 / r->count : 0.0);
+	}
+	if (matched > 0)
+		printf("%lu matching poses differ by %.2f mm on average (max %.2f mm), %.4f degrees\n",
+			   (unsigned long)matched, 1000 * sum_pos / matched, 1000 * max_pos, sum_rot / matched * 180 / M_PI);
+	if (runs[0].cpu > 0)
+		printf("Batch replay speedup: %.2fx\n", runs[0].cpu / runs[1].cpu);
+	return 0;
+}
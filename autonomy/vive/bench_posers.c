@@ -0,0 +1,360 @@
+/*
+  Replay a libsurvive recording through every poser and disambiguator
+  combination, each in its own process, and write a CSV of how fast and
+  how steady each one is, so we can pick the fastest poser that's
+  accurate enough.
+
+  Usage: bench_posers [options] <recording> [other libsurvive options]
+    -posers A,B,...          posers to try (default: all but Dummy)
+    -disambiguators X,Y,...  disambiguators to try (default: all)
+    -reference POSER/DISAMB  trajectory the others are compared against
+                             (default: the first combination)
+    -j N                     combinations to run at once (default: CPU count)
+    -o file.csv              write the CSV here (default: stdout)
+    -v                       show libsurvive's output
+
+  CSV columns:
+    poses, wall_s, cpu_s       poses found, and the time the replay took
+    poses_per_s, cpu_us_per_pose
+    jitter_mm                  RMS of each pose's distance from the midpoint of its
+                               neighbors: high-frequency noise, not real motion
+    divergence_mm, max_divergence_mm, divergence_deg
+                               distance to the reference pose of the same object
+                               nearest in time (within 50ms)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <survive.h>
+#include <os_generic.h>
+#include "src/survive_internal.h"
+
+#define MAX_COMBOS 64
+#define MATCH_SECONDS 0.05 // reference poses further away than this in time don't count
+
+typedef struct {
+	char codename[4];
+	double time; // seconds of device time, unwrapped
+	SurvivePose pose;
+} bench_pose;
+
+/* One poser and disambiguator pair.  The child process fills in the
+   trajectory file; the parent fills in everything else. */
+typedef struct {
+	char poser[64], disambiguator[64];
+	FILE *trajectory; // bench_pose records, then the child's wall and cpu time
+	pid_t pid;
+	int status;
+
+	bench_pose *poses;
+	size_t count;
+	double wall, cpu;
+} bench_combo;
+
+/******************** Child: replay the recording ********************/
+static FILE *child_out = 0;
+static uint32_t last_timecode[256];
+static double timecode_base[256];
+
+static void bench_pose_process(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	survive_default_raw_pose_process(so, timecode, pose);
+
+	// Unwrap the 32 bit device timecode, per object
+	int id = (unsigned char)so->codename[0] ^ (unsigned char)so->codename[2];
+	if (timecode < last_timecode[id])
+		timecode_base[id] += 4294967296.0;
+	last_timecode[id] = timecode;
+
+	bench_pose p;
+	memcpy(p.codename, so->codename, sizeof(p.codename));
+	p.time = (timecode_base[id] + timecode) / (so->timebase_hz ? so->timebase_hz : 48000000);
+	p.pose = *pose;
+	fwrite(&p, sizeof(p), 1, child_out);
+}
+
+static void bench_quiet(SurviveContext *ctx, const char *fault) {}
+
+static int bench_child(bench_combo *c, int argc, char **argv, int verbose) {
+	char *args[64];
+	int n = 0;
+	args[n++] = argv[0];
+	args[n++] = "--playback";
+	args[n++] = argv[1];
+	args[n++] = "--playback-factor";
+	args[n++] = "0";
+	args[n++] = "--defaultposer";
+	args[n++] = c->poser;
+	args[n++] = "--disambiguator";
+	args[n++] = c->disambiguator;
+	for (int i = 2; i < argc && n < 64; i++)
+		args[n++] = argv[i];
+
+	if (!verbose) {
+		freopen("/dev/null", "w", stdout);
+		freopen("/dev/null", "w", stderr);
+	}
+	child_out = c->trajectory;
+
+	double wall = OGGetAbsoluteTime();
+	clock_t cpu = clock();
+	SurviveContext *ctx = survive_init(n, args);
+	if (!ctx)
+		return 1;
+	if (!verbose)
+		survive_install_info_fn(ctx, bench_quiet);
+	survive_install_pose_fn(ctx, bench_pose_process);
+	while (survive_poll(ctx) == 0) {
+	}
+	survive_close(ctx);
+
+	// The times go last, so the parent can find them
+	double times[2] = {OGGetAbsoluteTime() - wall, (clock() - cpu) / (double)CLOCKS_PER_SEC};
+	fwrite(times, sizeof(times), 1, child_out);
+	fclose(child_out);
+	return 0;
+}
+
+/******************** Parent: gather and score ********************/
+// By object, then by time
+static int bench_pose_order(const void *va, const void *vb) {
+	const bench_pose *a = va, *b = vb;
+	int c = memcmp(a->codename, b->codename, sizeof(a->codename));
+	if (c)
+		return c;
+	return a->time < b->time ? -1 : a->time > b->time;
+}
+
+static int bench_read_trajectory(bench_combo *c) {
+	rewind(c->trajectory);
+	fseek(c->trajectory, 0, SEEK_END);
+	long bytes = ftell(c->trajectory) - 2 * sizeof(double);
+	if (bytes < 0 || bytes % sizeof(bench_pose) != 0)
+		return 1;
+	c->count = bytes / sizeof(bench_pose);
+	c->poses = malloc(bytes + 1);
+	double times[2];
+	fseek(c->trajectory, 0, SEEK_SET);
+	if (fread(c->poses, sizeof(bench_pose), c->count, c->trajectory) != c->count ||
+		fread(times, sizeof(times), 1, c->trajectory) != 1)
+		return 1;
+	c->wall = times[0];
+	c->cpu = times[1];
+	// Poses for different objects arrive interleaved; give each object its own run of the trajectory
+	qsort(c->poses, c->count, sizeof(bench_pose), bench_pose_order);
+	return 0;
+}
+
+// RMS distance of each pose from the midpoint of the poses before and after it
+static double bench_jitter(const bench_combo *c) {
+	double sum = 0;
+	size_t n = 0;
+	for (size_t i = 1; i + 1 < c->count; i++) {
+		const bench_pose *a = &c->poses[i - 1], *b = &c->poses[i], *d = &c->poses[i + 1];
+		if (memcmp(a->codename, b->codename, 4) || memcmp(b->codename, d->codename, 4))
+			continue; // first or last pose of its object
+		FLT mid[3], off[3];
+		add3d(mid, a->pose.Pos, d->pose.Pos);
+		scale3d(mid, mid, 0.5);
+		sub3d(off, b->pose.Pos, mid);
+		sum += dot3d(off, off);
+		n++;
+	}
+	return n ? sqrt(sum / n) : 0;
+}
+
+// Mean and max distance (meters), and mean angle (radians), to the nearest reference pose
+static size_t bench_divergence(const bench_combo *c, const bench_combo *ref, double *mean, double *max,
+							   double *angle) {
+	size_t matched = 0;
+	*mean = *max = *angle = 0;
+	for (size_t i = 0; i < c->count; i++) {
+		const bench_pose *p = &c->poses[i];
+		// First reference pose at or after p, in the same order bench_read_trajectory sorted them
+		size_t lo = 0, hi = ref->count;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (bench_pose_order(&ref->poses[mid], p) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		// The nearest in time is that one or the one before, if they're the same object
+		const bench_pose *best = 0;
+		for (size_t k = lo > 0 ? lo - 1 : 0; k < ref->count && k <= lo; k++) {
+			const bench_pose *r = &ref->poses[k];
+			if (memcmp(r->codename, p->codename, 4) == 0 &&
+				(!best || fabs(r->time - p->time) < fabs(best->time - p->time)))
+				best = r;
+		}
+		if (!best || fabs(best->time - p->time) > MATCH_SECONDS)
+			continue;
+
+		FLT d[3];
+		sub3d(d, p->pose.Pos, best->pose.Pos);
+		double dist = norm3d(d);
+		double dot = fabs(quatinnerproduct(p->pose.Rot, best->pose.Rot));
+		*mean += dist;
+		*angle += 2 * acos(dot > 1 ? 1 : dot);
+		if (dist > *max)
+			*max = dist;
+		matched++;
+	}
+	if (matched) {
+		*mean /= matched;
+		*angle /= matched;
+	}
+	return matched;
+}
+
+// Split a comma separated list into names; returns the count
+static int bench_split(char *list, char **names, int max) {
+	int n = 0;
+	for (char *s = strtok(list, ","); s && n < max; s = strtok(0, ","))
+		names[n++] = s;
+	return n;
+}
+
+// All registered drivers with this prefix (minus the prefix)
+static int bench_drivers(const char *prefix, char **names, int max) {
+	int n = 0;
+	const char *name;
+	for (int i = 0; n < max && (name = GetDriverNameMatching(prefix, i)); i++) {
+		name += strlen(prefix);
+		if (strcmp(name, "Dummy") != 0)
+			names[n++] = strdup(name);
+	}
+	return n;
+}
+
+int main(int argc, char **argv) {
+	char *posers[MAX_COMBOS], *disambiguators[MAX_COMBOS];
+	int nposer = 0, ndisambiguator = 0;
+	const char *reference = 0, *csv_name = 0;
+	int jobs = sysconf(_SC_NPROCESSORS_ONLN), verbose = 0;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char *arg = argv[argi];
+		if (strcmp(arg, "-v") == 0)
+			verbose = 1;
+		else if (argi + 1 >= argc)
+			break;
+		else if (strcmp(arg, "-posers") == 0)
+			nposer = bench_split(argv[++argi], posers, MAX_COMBOS);
+		else if (strcmp(arg, "-disambiguators") == 0)
+			ndisambiguator = bench_split(argv[++argi], disambiguators, MAX_COMBOS);
+		else if (strcmp(arg, "-reference") == 0)
+			reference = argv[++argi];
+		else if (strcmp(arg, "-j") == 0)
+			jobs = atoi(argv[++argi]);
+		else if (strcmp(arg, "-o") == 0)
+			csv_name = argv[++argi];
+		else
+			break;
+	}
+	if (argi >= argc) {
+		printf("Usage: bench_posers [-posers A,B] [-disambiguators X,Y] [-reference POSER/DISAMB]\n"
+			   "                    [-j N] [-o file.csv] [-v] <recording> [other libsurvive options]\n");
+		return 1;
+	}
+	if (jobs < 1)
+		jobs = 1;
+	// The child gets argv[0], the recording, and the libsurvive options
+	char **child_argv = &argv[argi - 1];
+	int child_argc = argc - argi + 1;
+	child_argv[0] = argv[0];
+
+	if (nposer == 0)
+		nposer = bench_drivers("Poser", posers, MAX_COMBOS);
+	if (ndisambiguator == 0)
+		ndisambiguator = bench_drivers("Disambiguator", disambiguators, MAX_COMBOS);
+
+	bench_combo combos[MAX_COMBOS];
+	int ncombo = 0;
+	for (int p = 0; p < nposer; p++)
+		for (int d = 0; d < ndisambiguator && ncombo < MAX_COMBOS; d++) {
+			bench_combo *c = &combos[ncombo++];
+			memset(c, 0, sizeof(*c));
+			snprintf(c->poser, sizeof(c->poser), "%s", posers[p]);
+			snprintf(c->disambiguator, sizeof(c->disambiguator), "%s", disambiguators[d]);
+		}
+	if (ncombo == 0) {
+		fprintf(stderr, "No posers or disambiguators to try\n");
+		return 1;
+	}
+
+	// Run up to jobs combinations at once
+	int started = 0, running = 0;
+	while (started < ncombo || running > 0) {
+		if (started < ncombo && running < jobs) {
+			bench_combo *c = &combos[started++];
+			c->trajectory = tmpfile();
+			fflush(stdout);
+			fflush(stderr);
+			c->pid = fork();
+			if (c->pid == 0)
+				exit(bench_child(c, child_argc, child_argv, verbose));
+			if (c->pid < 0) {
+				perror("fork");
+				c->status = -1;
+				continue;
+			}
+			running++;
+			fprintf(stderr, "Started %s/%s\n", c->poser, c->disambiguator);
+			continue;
+		}
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0)
+			break;
+		for (int i = 0; i < started; i++)
+			if (combos[i].pid == pid) {
+				combos[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+				if (combos[i].status == 0)
+					combos[i].status = bench_read_trajectory(&combos[i]);
+				fprintf(stderr, "Finished %s/%s (%lu poses)\n", combos[i].poser, combos[i].disambiguator,
+						(unsigned long)combos[i].count);
+				running--;
+			}
+	}
+
+	const bench_combo *ref = &combos[0];
+	for (int i = 0; reference && i < ncombo; i++) {
+		char name[160];
+		snprintf(name, sizeof(name), "%s/%s", combos[i].poser, combos[i].disambiguator);
+		if (strcmp(name, reference) == 0)
+			ref = &combos[i];
+	}
+
+	FILE *csv = csv_name ? fopen(csv_name, "w") : stdout;
+	if (!csv) {
+		fprintf(stderr, "Can't write %s\n", csv_name);
+		return 1;
+	}
+	fprintf(csv, "poser,disambiguator,status,poses,wall_s,cpu_s,poses_per_s,cpu_us_per_pose,jitter_mm,"
+				 "divergence_mm,max_divergence_mm,divergence_deg,reference\n");
+	for (int i = 0; i < ncombo; i++) {
+		const bench_combo *c = &combos[i];
+		if (c->status != 0) {
+			fprintf(csv, "%s,%s,failed,,,,,,,,,,%s/%s\n", c->poser, c->disambiguator, ref->poser, ref->disambiguator);
+			continue;
+		}
+		double mean = 0, max = 0, angle = 0;
+		size_t matched = bench_divergence(c, ref, &mean, &max, &angle);
+		fprintf(csv, "%s,%s,ok,%lu,%.3f,%.3f,%.1f,%.1f,%.3f,", c->poser, c->disambiguator, (unsigned long)c->count,
+				c->wall, c->cpu, c->wall > 0 ? c->count / c->wall : 0.0, c->count ? c->cpu * 1e6 / c->count : 0.0,
+				1000 * bench_jitter(c));
+		if (matched)
+			fprintf(csv, "%.3f,%.3f,%.4f,", 1000 * mean, 1000 * max, angle * 180 / M_PI);
+		else
+			fprintf(csv, ",,,");
+		fprintf(csv, "%s/%s\n", ref->poser, ref->disambiguator);
+	}
+	if (csv != stdout)
+		fclose(csv);
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+  Convert libsurvive recordings between the text format and the
+  compact binary format (survive_binary_recording.h).
+
+  Usage: convert_recording <input> <output>
+    A text input is written as binary, and a binary input as text.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "survive_binary_recording.h"
+
+// Return a pointer to the text after the first n spaces of line
+static const char *skip_words(const char *line, int n) {
+	for (int i = 0; i < n && line; i++) {
+		line = strchr(line, ' ');
+		if (line)
+			line++;
+	}
+	return line ? line : "";
+}
+
+static int parse_pose(const char *rest, svb_pose *p) {
+	return 7 == sscanf(rest, "%lf %lf %lf %lf %lf %lf %lf", &p->pos[0], &p->pos[1], &p->pos[2], &p->rot[0],
+					   &p->rot[1], &p->rot[2], &p->rot[3]);
+}
+
+/* Convert one text line (minus the trailing newline).  Returns 0 if not understood. */
+static int text_to_binary_line(svb_writer *w, const char *line) {
+	double time;
+	char dev[128], op[128];
+	if (sscanf(line, "%lf %127s %127s", &time, dev, op) != 3)
+		return 0;
+	const char *rest = skip_words(line, 3);
+
+	if (strcmp(op, "CONFIG") == 0) {
+		svb_write(w, time, SVB_CONFIG, dev, rest, strlen(rest));
+	} else if (strcmp(dev, "INFO") == 0 && strcmp(op, "LOG") == 0) {
+		svb_write(w, time, SVB_INFO, 0, rest, strlen(rest));
+	} else if (strcmp(op, "LH_POSE") == 0) {
+		svb_pose p;
+		if (!parse_pose(rest, &p))
+			return 0;
+		svb_write_obj(w, time, SVB_LH_POSE, atoi(dev), &p, sizeof(p));
+	} else if (strcmp(op, "POSE") == 0 || strcmp(op, "VELOCITY") == 0 || strcmp(op, "EXTERNAL_POSE") == 0 ||
+			   strcmp(op, "EXTERNAL_VELOCITY") == 0) {
+		svb_pose p;
+		if (!parse_pose(rest, &p))
+			return 0;
+		int type = SVB_POSE;
+		if (strcmp(op, "VELOCITY") == 0)
+			type = SVB_VELOCITY;
+		if (strcmp(op, "EXTERNAL_POSE") == 0)
+			type = SVB_EXTERNAL_POSE;
+		if (strcmp(op, "EXTERNAL_VELOCITY") == 0)
+			type = SVB_EXTERNAL_VELOCITY;
+		svb_write(w, time, type, dev, &p, sizeof(p));
+	} else if (strcmp(op, "A") == 0) {
+		int sensor_id, acode;
+		unsigned timecode, lh;
+		float length, angle;
+		if (sscanf(rest, "%d %d %u %f %f %u", &sensor_id, &acode, &timecode, &length, &angle, &lh) != 6)
+			return 0;
+		svb_angle a = {sensor_id, acode, timecode, length, angle, lh};
+		svb_write(w, time, SVB_ANGLE, dev, &a, sizeof(a));
+	} else if (strcmp(op, "C") == 0) {
+		unsigned sensor_id, timestamp, length;
+		if (sscanf(rest, "%u %u %u", &sensor_id, &timestamp, &length) != 3)
+			return 0;
+		svb_rawlight c = {sensor_id, 0, length, timestamp};
+		svb_write(w, time, SVB_RAWLIGHT, dev, &c, sizeof(c));
+	} else if (strcmp(op, "S") == 0 || strcmp(op, "L") == 0 || strcmp(op, "R") == 0) {
+		if (op[0] != 'S')
+			rest = skip_words(rest, 1); // skip the X or Y axis
+		int sensor_id, acode, timeinsweep;
+		unsigned timecode, length, lh;
+		if (sscanf(rest, "%d %d %d %u %u %u", &sensor_id, &acode, &timeinsweep, &timecode, &length, &lh) != 6)
+			return 0;
+		svb_light l = {sensor_id, acode, timeinsweep, timecode, length, lh};
+		svb_write(w, time, SVB_LIGHT, dev, &l, sizeof(l));
+	} else if (strcmp(op, "I") == 0) {
+		svb_imu m;
+		memset(&m, 0, sizeof(m));
+		float *ag = m.accelgyro;
+		int rr = sscanf(rest, "%d %u %f %f %f %f %f %f %f %f %f %d", &m.mask, &m.timecode, &ag[0], &ag[1], &ag[2],
+						&ag[3], &ag[4], &ag[5], &ag[6], &ag[7], &ag[8], &m.id);
+		if (rr == 9) { // older format, without magnetometer data
+			m.id = (int)ag[6];
+			ag[6] = 0;
+		} else if (rr != 12)
+			return 0;
+		svb_write(w, time, SVB_IMU, dev, &m, sizeof(m));
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+static int text_to_binary(FILE *in, FILE *out) {
+	svb_writer *w = svb_writer_open(out);
+	char *line = 0;
+	size_t n = 0;
+	long lineno = 0, skipped = 0;
+	while (getline(&line, &n, in) > 0) {
+		lineno++;
+		size_t len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = 0;
+		if (!text_to_binary_line(w, line)) {
+			if (skipped++ < 10)
+				fprintf(stderr, "Skipping line %ld: '%.60s'\n", lineno, line);
+		}
+	}
+	free(line);
+	svb_writer_close(w);
+	printf("Converted %ld lines to binary (%ld skipped)\n", lineno - skipped, skipped);
+	return 0;
+}
+
+/* Same layout as survive_playback.c's text recording */
+static int binary_to_text(FILE *in, FILE *out) {
+	svb_reader *r = svb_reader_open(in);
+	if (!r)
+		return 1;
+	svb_event ev;
+	long events = 0;
+	while (svb_reader_next(r, &ev) > 0) {
+		const char *name = ev.name ? ev.name : "";
+		const char *text = (const char *)ev.payload;
+		events++;
+		fprintf(out, "%0.6f ", ev.time);
+		switch (ev.type) {
+		case SVB_CONFIG:
+			fprintf(out, "%s CONFIG %.*s\n", name, (int)ev.bytes, text);
+			break;
+		case SVB_INFO:
+			fprintf(out, "INFO LOG %.*s\n", (int)ev.bytes, text);
+			break;
+		case SVB_LIGHT: {
+			svb_light l;
+			memcpy(&l, ev.payload, sizeof(l));
+			if (l.acode < 0) {
+				fprintf(out, "%s S %d %d %d %u %u %u\n", name, l.sensor_id, l.acode, l.timeinsweep, l.timecode,
+						l.length, l.lh);
+				break;
+			}
+			int lh = l.acode / 4, axis = l.acode % 2; // acode 0-3 is L, 4-7 is R; odd is Y
+			fprintf(out, "%s %s %s %d %d %d %u %u %u\n", name, lh ? "R" : "L", axis ? "Y" : "X", l.sensor_id,
+					l.acode, l.timeinsweep, l.timecode, l.length, l.lh);
+			break;
+		}
+		case SVB_RAWLIGHT: {
+			svb_rawlight c;
+			memcpy(&c, ev.payload, sizeof(c));
+			fprintf(out, "%s C %d %u %u\n", name, c.sensor_id, c.timestamp, c.length);
+			break;
+		}
+		case SVB_ANGLE: {
+			svb_angle a;
+			memcpy(&a, ev.payload, sizeof(a));
+			fprintf(out, "%s A %d %d %u %0.6f %0.6f %u\n", name, a.sensor_id, a.acode, a.timecode, a.length, a.angle,
+					a.lh);
+			break;
+		}
+		case SVB_IMU: {
+			svb_imu m;
+			memcpy(&m, ev.payload, sizeof(m));
+			const float *ag = m.accelgyro;
+			fprintf(out, "%s I %d %u %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f  %0.6f %0.6f %0.6f %d\n", name, m.mask,
+					m.timecode, ag[0], ag[1], ag[2], ag[3], ag[4], ag[5], ag[6], ag[7], ag[8], m.id);
+			break;
+		}
+		default: {
+			if (svb_record_size(ev.type) != sizeof(svb_pose)) {
+				fprintf(out, "INFO LOG unknown binary record type %d\n", ev.type);
+				break;
+			}
+			svb_pose p;
+			memcpy(&p, ev.payload, sizeof(p));
+			const char *op = "POSE";
+			if (ev.type == SVB_VELOCITY)
+				op = "VELOCITY";
+			if (ev.type == SVB_EXTERNAL_POSE)
+				op = "EXTERNAL_POSE";
+			if (ev.type == SVB_EXTERNAL_VELOCITY)
+				op = "EXTERNAL_VELOCITY";
+			if (ev.type == SVB_LH_POSE)
+				fprintf(out, "%d LH_POSE", ev.obj);
+			else
+				fprintf(out, "%s %s", name, op);
+			fprintf(out, " %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", p.pos[0], p.pos[1], p.pos[2], p.rot[0],
+					p.rot[1], p.rot[2], p.rot[3]);
+		}
+		}
+	}
+	svb_reader_close(r);
+	fclose(out);
+	printf("Converted %ld binary events to text\n", events);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		printf("Usage: convert_recording <input> <output>\n"
+			   "  Converts text recordings to binary, and binary recordings to text.\n");
+		return 1;
+	}
+	FILE *in = fopen(argv[1], "rb");
+	if (!in) {
+		printf("Can't open input recording %s\n", argv[1]);
+		return 1;
+	}
+	FILE *out = fopen(argv[2], "wb");
+	if (!out) {
+		printf("Can't create output recording %s\n", argv[2]);
+		return 1;
+	}
+	if (svb_is_binary(in))
+		return binary_to_text(in, out);
+	else
+		return text_to_binary(in, out);
+}
@@ -31,6 +31,9 @@ typedef struct {
 	int cameraLength;
 	int fcalLength;
 	int ptsLength;
+
+	// Evaluate all measurements together each iteration (see survive_optimizer_run)
+	bool use_batch;
 } survive_optimizer;
 
 #define SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(ctx)                                                                     \
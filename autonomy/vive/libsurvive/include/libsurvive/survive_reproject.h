@@ -40,6 +40,26 @@ SURVIVE_EXPORT void survive_reproject_full_y_jac_obj_pose(SurviveAngleReading ou
 										   const LinmathVec3d ptInObj, const SurvivePose *world2lh,
 										   const BaseStationCal *bcal);
 
+// Batched versions for n sensors seen by the same lighthouse. ptsInObj holds n points of
+// 3 FLTs each. The axis versions handle one sweep (0 for x, 1 for y); the others do both,
+// with out holding n x angles and then n y angles.
+SURVIVE_EXPORT void survive_reproject_axis_batch(const BaseStationCal *bcal, int axis, const SurvivePose *obj2lh,
+												 const FLT *ptsInObj, size_t n, FLT *out);
+SURVIVE_EXPORT void survive_reproject_xy_batch(const BaseStationCal *bcal, const SurvivePose *obj2lh,
+											   const FLT *ptsInObj, size_t n, FLT *out);
+
+// These also fill in the jacobian by obj2world, whose rotation must be normalized: jac gets
+// 7 rows of n per axis, and jac[j * n + i] is the derivative of sensor i's x angle by pose
+// parameter j (y angles follow in rows 7 to 13)
+SURVIVE_EXPORT void survive_reproject_axis_jac_obj_pose_batch(FLT *out, FLT *jac, int axis,
+															  const SurvivePose *obj2world, const FLT *ptsInObj,
+															  size_t n, const SurvivePose *world2lh,
+															  const BaseStationCal *bcal);
+SURVIVE_EXPORT void survive_reproject_jac_obj_pose_batch(FLT *out, FLT *jac, const SurvivePose *obj2world,
+														 const FLT *ptsInObj, size_t n,
+														 const SurvivePose *world2lh,
+														 const BaseStationCal *bcal);
+
 SURVIVE_EXPORT void survive_reproject_full(const BaseStationCal *bcal, const SurvivePose *world2lh, const SurvivePose *obj2world,
 							const LinmathVec3d ptInObj, SurviveAngleReading out);
 
@@ -5,6 +5,7 @@
 #include <malloc.h>
 
 #include "mpfit/mpfit.h"
+#include "os_generic.h"
 #include "poser.h"
 #include "survive_imu.h"
 #include <survive.h>
@@ -31,6 +32,7 @@ STATIC_CONFIG_ITEM(SENSOR_VARIANCE_PER_SEC, "sensor-variance-per-sec", 'f',
 				   "Variance per second to add to the sensor input -- discounts older data", 0.0);
 STATIC_CONFIG_ITEM(SENSOR_VARIANCE, "sensor-variance", 'f', "Base variance for each sensor input", 1.0);
 STATIC_CONFIG_ITEM(DISABLE_LIGHTHOUSE, "disable-lighthouse", 'i', "Disable given lighthouse from tracking", -1);
+STATIC_CONFIG_ITEM(MPFIT_BATCH, "mpfit-batch", 'i', "Evaluate all measurements as one batch on each MPFIT iteration", 1);
 
 typedef struct MPFITData {
 	GeneralOptimizerData opt;
@@ -50,9 +52,13 @@ typedef struct MPFITData {
 	SurviveIMUTracker tracker;
 	bool useIMU;
 	bool useKalman;
+	bool useBatch;
 
 	struct {
 		int meas_failures;
+		int solves;
+		int iterations;
+		double solve_time; // seconds spent in the optimizer
 	} stats;
 } MPFITData;
 
@@ -133,6 +139,7 @@ static double run_mpfit_find_3d_structure(MPFITData *d, PoserDataLight *pdl, Sur
 		//.current_bias = 0.001,
 		.poseLength = 1,
 		.cameraLength = so->ctx->activeLighthouses,
+		.use_batch = d->useBatch,
 	};
 
 	SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(mpfitctx);
@@ -163,7 +170,11 @@ static double run_mpfit_find_3d_structure(MPFITData *d, PoserDataLight *pdl, Sur
 	mp_result result = {0};
 	mpfitctx.initialPose = *soLocation;
 
+	double start = OGGetAbsoluteTime();
 	int res = survive_optimizer_run(&mpfitctx, &result);
+	d->stats.solve_time += OGGetAbsoluteTime() - start;
+	d->stats.solves++;
+	d->stats.iterations += result.niter;
 
 	double rtn = -1;
 	bool status_failure = res <= 0;
@@ -197,6 +208,7 @@ static double run_mpfit_find_cameras(MPFITData *d, PoserDataFullScene *pdfs) {
 		.so = so,
 		.poseLength = 1,
 		.cameraLength = so->ctx->activeLighthouses,
+		.use_batch = d->useBatch,
 	};
 
 	SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(mpfitctx);
@@ -285,6 +297,7 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 
 		d->sensor_time_window = survive_configi(ctx, "time-window", SC_GET, SurviveSensorActivations_default_tolerance);
 		d->use_jacobian_function = survive_configi(ctx, "use-jacobian-function", SC_GET, 1);
+		d->useBatch = (bool)survive_configi(ctx, "mpfit-batch", SC_GET, 1);
 		survive_attach_configi(ctx, "disable-lighthouse", &d->disable_lighthouse);
 		survive_attach_configf(ctx, "sensor-variance-per-sec", &d->sensor_variance_per_second);
 		survive_attach_configf(ctx, "sensor-variance", &d->sensor_variance);
@@ -301,6 +314,7 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 		SV_INFO("\tuse-imu: %d", d->useIMU);
 		SV_INFO("\tuse-kalman: %d", d->useKalman);
 		SV_INFO("\tuse-jacobian-function: %d", d->use_jacobian_function);
+		SV_INFO("\tmpfit-batch: %d", d->useBatch);
 	}
 	MPFITData *d = so->PoserData;
 	switch (pd->pt) {
@@ -347,6 +361,10 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 	case POSERDATA_DISASSOCIATE: {
 		SV_INFO("MPFIT stats:");
 		SV_INFO("\tmeas failures %d", d->stats.meas_failures);
+		if (d->stats.solves > 0) {
+			SV_INFO("\tsolves %d, %.2f iterations and %.1f us per solve", d->stats.solves,
+					d->stats.iterations / (double)d->stats.solves, d->stats.solve_time * 1e6 / d->stats.solves);
+		}
 		general_optimizer_data_dtor(&d->opt);
 		free(d);
 		so->PoserData = 0;
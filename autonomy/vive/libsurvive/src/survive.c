@@ -665,6 +665,7 @@ void survive_close(SurviveContext *ctx) {
 	free(ctx->temporary_config_values);
 	free(ctx->lh_config);
 	free(ctx->calptr);
+	survive_recording_close(ctx);
 	free(ctx->recptr);
 
 	free(ctx);
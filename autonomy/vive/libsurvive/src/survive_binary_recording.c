@@ -0,0 +1,346 @@
+// All MIT/x11 Licensed Code in this file may be relicensed freely under the GPL
+// or LGPL licenses.
+
+#include "survive_binary_recording.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVB_MAX_NAMES 255 // SVB_NO_OBJ can't be a name
+
+size_t svb_record_size(int type) {
+	switch (type) {
+	case SVB_LIGHT:
+		return sizeof(svb_light);
+	case SVB_RAWLIGHT:
+		return sizeof(svb_rawlight);
+	case SVB_ANGLE:
+		return sizeof(svb_angle);
+	case SVB_IMU:
+		return sizeof(svb_imu);
+	case SVB_POSE:
+	case SVB_VELOCITY:
+	case SVB_LH_POSE:
+	case SVB_EXTERNAL_POSE:
+	case SVB_EXTERNAL_VELOCITY:
+		return sizeof(svb_pose);
+	default:
+		return 0;
+	}
+}
+
+/************************* Writing ***************************/
+struct svb_writer {
+	FILE *f;
+	uint64_t offset; // file offset of the next block
+
+	char *names[SVB_MAX_NAMES];
+	int name_count;
+	bool announced[SVB_MAX_NAMES]; // name was written in the current block
+
+	svb_block_header header; // current block
+	bool block_open;
+	uint8_t *block;
+	size_t block_alloc;
+
+	svb_index_entry *index;
+	size_t index_count, index_alloc;
+};
+
+svb_writer *svb_writer_open(FILE *f) {
+	svb_file_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SVB_FILE_MAGIC, sizeof(h.magic));
+	h.version = SVB_VERSION;
+	h.header_bytes = sizeof(h);
+	if (fwrite(&h, sizeof(h), 1, f) != 1)
+		return 0;
+
+	svb_writer *w = calloc(1, sizeof(svb_writer));
+	w->f = f;
+	w->offset = sizeof(h);
+	return w;
+}
+
+static void svb_flush_block(svb_writer *w) {
+	if (!w->block_open)
+		return;
+	w->block_open = false;
+
+	if (w->index_count == w->index_alloc) {
+		w->index_alloc = w->index_alloc ? 2 * w->index_alloc : 256;
+		w->index = realloc(w->index, w->index_alloc * sizeof(svb_index_entry));
+	}
+	svb_index_entry *e = &w->index[w->index_count++];
+	e->offset = w->offset;
+	e->start_time = w->header.start_time;
+
+	fwrite(&w->header, sizeof(w->header), 1, w->f);
+	fwrite(w->block, w->header.bytes, 1, w->f);
+	fflush(w->f); // at most one flush per block
+	w->offset += sizeof(w->header) + w->header.bytes;
+}
+
+static void svb_append(svb_writer *w, double time, int type, uint8_t obj, const void *payload, size_t bytes) {
+	if (bytes > 0xffff) {
+		fprintf(stderr, "Binary recording: truncating %d byte record (type %d)\n", (int)bytes, type);
+		bytes = 0xffff;
+	}
+	size_t need = sizeof(svb_record_header) + bytes;
+	if (w->header.bytes + need > w->block_alloc) {
+		w->block_alloc = w->header.bytes + need + SVB_BLOCK_BYTES;
+		w->block = realloc(w->block, w->block_alloc);
+	}
+
+	svb_record_header r;
+	r.type = type;
+	r.obj = obj;
+	r.bytes = bytes;
+	double dt = (time - w->header.start_time) * 1.0e6;
+	r.dt_us = dt > 0 ? (uint32_t)(dt + 0.5) : 0;
+
+	uint8_t *dest = w->block + w->header.bytes;
+	memcpy(dest, &r, sizeof(r));
+	memcpy(dest + sizeof(r), payload, bytes);
+	w->header.bytes += need;
+	w->header.events++;
+	if (type == SVB_CONFIG)
+		w->header.flags |= SVB_BLOCK_CONFIG;
+}
+
+void svb_write_obj(svb_writer *w, double time, int type, uint8_t obj, const void *payload, size_t bytes) {
+	if (!w)
+		return;
+	if (w->block_open && (w->header.bytes + bytes >= SVB_BLOCK_BYTES || time - w->header.start_time >= SVB_BLOCK_SECONDS))
+		svb_flush_block(w);
+
+	if (!w->block_open) { // start a new block
+		memset(&w->header, 0, sizeof(w->header));
+		memcpy(w->header.magic, SVB_BLOCK_MAGIC, sizeof(w->header.magic));
+		w->header.start_time = time;
+		memset(w->announced, 0, sizeof(w->announced));
+		w->block_open = true;
+	}
+
+	if (obj < w->name_count && type != SVB_LH_POSE && !w->announced[obj]) {
+		svb_append(w, time, SVB_NAME, obj, w->names[obj], strlen(w->names[obj]));
+		w->announced[obj] = true;
+	}
+	svb_append(w, time, type, obj, payload, bytes);
+}
+
+void svb_write(svb_writer *w, double time, int type, const char *name, const void *payload, size_t bytes) {
+	if (!w)
+		return;
+	int obj = SVB_NO_OBJ;
+	if (name) {
+		for (int i = 0; i < w->name_count; i++) {
+			if (strcmp(w->names[i], name) == 0) {
+				obj = i;
+				break;
+			}
+		}
+		if (obj == SVB_NO_OBJ && w->name_count < SVB_MAX_NAMES) { // new name
+			obj = w->name_count++;
+			w->names[obj] = strdup(name);
+		}
+	}
+	svb_write_obj(w, time, type, obj, payload, bytes);
+}
+
+void svb_writer_close(svb_writer *w) {
+	if (!w)
+		return;
+	svb_flush_block(w);
+
+	svb_index_trailer t;
+	memset(&t, 0, sizeof(t));
+	t.index_offset = w->offset;
+	t.blocks = w->index_count;
+	memcpy(t.magic, SVB_INDEX_MAGIC, sizeof(t.magic));
+	if (w->index_count > 0)
+		fwrite(w->index, sizeof(svb_index_entry), w->index_count, w->f);
+	fwrite(&t, sizeof(t), 1, w->f);
+	fclose(w->f);
+
+	for (int i = 0; i < w->name_count; i++)
+		free(w->names[i]);
+	free(w->block);
+	free(w->index);
+	free(w);
+}
+
+/************************* Reading ***************************/
+struct svb_reader {
+	FILE *f;
+	uint64_t data_start, data_end; // file offsets of the blocks
+	uint32_t filter;
+
+	svb_block_header header; // current block
+	uint8_t *block;
+	size_t block_alloc;
+	size_t pos; // read offset in block
+
+	char *names[SVB_MAX_NAMES];
+
+	svb_index_entry *index; // NULL if the recording was never closed
+	uint32_t index_count;
+};
+
+int svb_is_binary(FILE *f) {
+	svb_file_header h;
+	int ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, SVB_FILE_MAGIC, sizeof(h.magic)) == 0;
+	fseek(f, 0, SEEK_SET);
+	return ok;
+}
+
+svb_reader *svb_reader_open(FILE *f) {
+	svb_file_header h;
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, SVB_FILE_MAGIC, sizeof(h.magic)) != 0) {
+		fprintf(stderr, "Not a binary survive recording\n");
+		return 0;
+	}
+	if (h.version > SVB_VERSION) {
+		fprintf(stderr, "Binary survive recording is a newer version (%d)\n", (int)h.version);
+		return 0;
+	}
+
+	svb_reader *r = calloc(1, sizeof(svb_reader));
+	r->f = f;
+	r->data_start = h.header_bytes;
+	fseek(f, 0, SEEK_END);
+	r->data_end = ftell(f);
+
+	// Look for the index at the end of the file
+	svb_index_trailer t;
+	if (r->data_end >= r->data_start + sizeof(t)) {
+		fseek(f, r->data_end - sizeof(t), SEEK_SET);
+		if (fread(&t, sizeof(t), 1, f) == 1 && memcmp(t.magic, SVB_INDEX_MAGIC, sizeof(t.magic)) == 0 &&
+			t.index_offset + t.blocks * sizeof(svb_index_entry) + sizeof(t) == r->data_end) {
+			r->index = malloc(t.blocks * sizeof(svb_index_entry) + 1);
+			fseek(f, t.index_offset, SEEK_SET);
+			if (t.blocks == 0 || fread(r->index, sizeof(svb_index_entry), t.blocks, f) == t.blocks) {
+				r->index_count = t.blocks;
+				r->data_end = t.index_offset;
+			} else {
+				free(r->index);
+				r->index = 0;
+			}
+		}
+	}
+
+	fseek(f, r->data_start, SEEK_SET);
+	return r;
+}
+
+void svb_reader_filter(svb_reader *r, uint32_t flags) { r->filter = flags; }
+
+// Read the next block header (and its records, unless filtered out).  Returns 0 at the end.
+static int svb_read_block(svb_reader *r) {
+	while (1) {
+		r->pos = 0;
+		r->header.bytes = 0;
+		if ((uint64_t)ftell(r->f) + sizeof(svb_block_header) > r->data_end)
+			return 0;
+		if (fread(&r->header, sizeof(r->header), 1, r->f) != 1)
+			return 0;
+		if (memcmp(r->header.magic, SVB_BLOCK_MAGIC, sizeof(r->header.magic)) != 0) {
+			fprintf(stderr, "Binary survive recording: bad block at offset %ld\n", ftell(r->f));
+			r->header.bytes = 0;
+			return -1;
+		}
+		if (r->filter && !(r->header.flags & r->filter)) { // skip this block
+			fseek(r->f, r->header.bytes, SEEK_CUR);
+			continue;
+		}
+
+		if (r->header.bytes > r->block_alloc) {
+			r->block_alloc = r->header.bytes;
+			r->block = realloc(r->block, r->block_alloc);
+		}
+		if (fread(r->block, 1, r->header.bytes, r->f) != r->header.bytes) {
+			r->header.bytes = 0;
+			return 0; // truncated recording
+		}
+		return 1;
+	}
+}
+
+int svb_reader_next(svb_reader *r, svb_event *ev) {
+	while (1) {
+		if (r->pos + sizeof(svb_record_header) > r->header.bytes) {
+			int status = svb_read_block(r);
+			if (status <= 0)
+				return status;
+			continue;
+		}
+
+		svb_record_header h;
+		memcpy(&h, r->block + r->pos, sizeof(h));
+		const uint8_t *payload = r->block + r->pos + sizeof(h);
+		r->pos += sizeof(h) + h.bytes;
+		if (r->pos > r->header.bytes)
+			return -1; // record runs off the end of the block
+		if (h.bytes < svb_record_size(h.type))
+			continue; // too short to use
+
+		if (h.type == SVB_NAME) {
+			if (h.obj < SVB_MAX_NAMES) {
+				free(r->names[h.obj]);
+				r->names[h.obj] = malloc(h.bytes + 1);
+				memcpy(r->names[h.obj], payload, h.bytes);
+				r->names[h.obj][h.bytes] = 0;
+			}
+			continue;
+		}
+
+		ev->time = r->header.start_time + h.dt_us * 1.0e-6;
+		ev->type = h.type;
+		ev->obj = h.obj;
+		ev->name = (h.obj < SVB_MAX_NAMES && h.type != SVB_LH_POSE) ? r->names[h.obj] : 0;
+		ev->bytes = h.bytes;
+		ev->payload = payload;
+		return 1;
+	}
+}
+
+int svb_reader_seek(svb_reader *r, double time) {
+	uint64_t offset = r->data_start;
+	if (r->index) { // binary search the index for the last block starting before time
+		uint32_t lo = 0, hi = r->index_count;
+		while (hi - lo > 1) {
+			uint32_t mid = (lo + hi) / 2;
+			if (r->index[mid].start_time <= time)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		if (r->index_count > 0)
+			offset = r->index[lo].offset;
+	} else { // no index: hop along the block headers
+		svb_block_header h;
+		uint64_t at = r->data_start;
+		fseek(r->f, at, SEEK_SET);
+		while (at + sizeof(h) <= r->data_end && fread(&h, sizeof(h), 1, r->f) == 1 &&
+			   memcmp(h.magic, SVB_BLOCK_MAGIC, sizeof(h.magic)) == 0 && h.start_time <= time) {
+			offset = at;
+			at += sizeof(h) + h.bytes;
+			fseek(r->f, at, SEEK_SET);
+		}
+	}
+	r->pos = 0;
+	r->header.bytes = 0;
+	return fseek(r->f, offset, SEEK_SET);
+}
+
+void svb_reader_close(svb_reader *r) {
+	if (!r)
+		return;
+	fclose(r->f);
+	for (int i = 0; i < SVB_MAX_NAMES; i++)
+		free(r->names[i]);
+	free(r->block);
+	free(r->index);
+	free(r);
+}
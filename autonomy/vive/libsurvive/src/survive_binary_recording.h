@@ -0,0 +1,171 @@
+#ifndef _SURVIVE_BINARY_RECORDING_H
+#define _SURVIVE_BINARY_RECORDING_H
+
+/*
+ * Compact binary event log, an alternative to the text recording format.
+ *
+ * File layout:
+ *   svb_file_header
+ *   blocks: svb_block_header, then 'bytes' of records
+ *   index (optional, written on close): svb_index_entry per block, then svb_index_trailer
+ *
+ * Each record is an svb_record_header followed by a payload whose size is fixed by
+ * the record type (except names, configs and info strings).  Record times are
+ * microseconds after the block's start time, so a reader can seek to any block.
+ * Every block re-announces the object names it uses, so blocks can be read alone.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SVB_FILE_MAGIC "SURVBIN1"
+#define SVB_BLOCK_MAGIC "SVBK"
+#define SVB_INDEX_MAGIC "SVBINDEX"
+#define SVB_VERSION 1
+
+// Blocks get written once they reach this size, or cover this many seconds
+#define SVB_BLOCK_BYTES (64 * 1024)
+#define SVB_BLOCK_SECONDS 1.0
+
+typedef struct svb_file_header {
+	char magic[8]; // SVB_FILE_MAGIC
+	uint32_t version;
+	uint32_t header_bytes; // sizeof(svb_file_header)
+} svb_file_header;
+
+enum svb_block_flags {
+	SVB_BLOCK_CONFIG = 1 << 0, // block contains SVB_CONFIG records
+};
+
+typedef struct svb_block_header {
+	char magic[4]; // SVB_BLOCK_MAGIC
+	uint32_t bytes; // of records following this header
+	uint32_t events; // number of records
+	uint32_t flags; // svb_block_flags
+	double start_time; // seconds since the recording started
+} svb_block_header;
+
+typedef struct svb_index_entry {
+	uint64_t offset; // file offset of the block header
+	double start_time;
+} svb_index_entry;
+
+typedef struct svb_index_trailer {
+	uint64_t index_offset; // file offset of the first svb_index_entry
+	uint32_t blocks;
+	uint32_t reserved;
+	char magic[8]; // SVB_INDEX_MAGIC
+} svb_index_trailer;
+
+typedef enum svb_record_type {
+	SVB_NAME = 1,			 // obj gets this name (payload: the name)
+	SVB_CONFIG,				 // obj's JSON config (payload: the text)
+	SVB_INFO,				 // log message (payload: the text)
+	SVB_LIGHT,				 // svb_light
+	SVB_RAWLIGHT,			 // svb_rawlight
+	SVB_ANGLE,				 // svb_angle
+	SVB_IMU,				 // svb_imu
+	SVB_POSE,				 // svb_pose
+	SVB_VELOCITY,			 // svb_pose
+	SVB_LH_POSE,			 // svb_pose, obj is the lighthouse number
+	SVB_EXTERNAL_POSE,		 // svb_pose
+	SVB_EXTERNAL_VELOCITY,	 // svb_pose
+	SVB_RECORD_TYPES
+} svb_record_type;
+
+#define SVB_NO_OBJ 0xff // record has no object
+
+typedef struct svb_record_header {
+	uint8_t type; // svb_record_type
+	uint8_t obj;  // object index (from an SVB_NAME record), or SVB_NO_OBJ
+	uint16_t bytes; // of payload after this header
+	uint32_t dt_us; // microseconds since the block's start_time
+} svb_record_header;
+
+typedef struct svb_light {
+	int16_t sensor_id, acode;
+	int32_t timeinsweep;
+	uint32_t timecode, length, lh;
+} svb_light;
+
+typedef struct svb_rawlight {
+	uint8_t sensor_id, reserved;
+	uint16_t length;
+	uint32_t timestamp;
+} svb_rawlight;
+
+typedef struct svb_angle {
+	int16_t sensor_id, acode;
+	uint32_t timecode;
+	float length, angle;
+	uint32_t lh;
+} svb_angle;
+
+typedef struct svb_imu {
+	int32_t mask;
+	uint32_t timecode;
+	int32_t id;
+	float accelgyro[9];
+} svb_imu;
+
+typedef struct svb_pose {
+	double pos[3];
+	double rot[4];
+} svb_pose;
+
+// Return the expected payload size for this record type, or 0 if variable
+size_t svb_record_size(int type);
+
+/* Writing */
+typedef struct svb_writer svb_writer;
+
+// Start writing a binary recording to this file (which the writer then owns)
+svb_writer *svb_writer_open(FILE *f);
+
+// Add one record at this time.  name is the object's name, or NULL for SVB_NO_OBJ.
+void svb_write(svb_writer *w, double time, int type, const char *name, const void *payload, size_t bytes);
+
+// Like svb_write, but for records whose obj is a plain number (SVB_LH_POSE)
+void svb_write_obj(svb_writer *w, double time, int type, uint8_t obj, const void *payload, size_t bytes);
+
+// Write out any pending block and the index, and close the file
+void svb_writer_close(svb_writer *w);
+
+/* Reading */
+typedef struct svb_event {
+	double time; // seconds since the recording started
+	int type;
+	int obj;
+	const char *name; // object name, or NULL (for SVB_NO_OBJ or SVB_LH_POSE)
+	size_t bytes;
+	const void *payload; // valid until the next svb_reader_next; may be unaligned, so memcpy it out
+} svb_event;
+
+typedef struct svb_reader svb_reader;
+
+// Return 1 if this file starts like a binary recording (leaves the file rewound)
+int svb_is_binary(FILE *f);
+
+// Start reading a binary recording from this file (which the reader then owns)
+svb_reader *svb_reader_open(FILE *f);
+
+// Only read blocks with these svb_block_flags, skipping the rest (0 reads all blocks)
+void svb_reader_filter(svb_reader *r, uint32_t flags);
+
+// Read the next event.  Returns 1 if ev was filled, 0 at the end of the file, -1 on error.
+int svb_reader_next(svb_reader *r, svb_event *ev);
+
+// Move to the start of the block containing this time (0 for the start of the file)
+int svb_reader_seek(svb_reader *r, double time);
+
+void svb_reader_close(svb_reader *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
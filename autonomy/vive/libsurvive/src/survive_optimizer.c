@@ -1,5 +1,7 @@
 #include <assert.h>
+#include <malloc.h>
 #include <math.h>
+#include <string.h>
 #include <survive_optimizer.h>
 #include <survive_reproject.h>
 
@@ -107,11 +109,7 @@ typedef void (*reproject_axis_jacob_fn_t)(SurviveAngleReading, const SurvivePose
 static const reproject_axis_jacob_fn_t reproject_axis_jacob_fns[] = {survive_reproject_full_x_jac_obj_pose,
 																	 survive_reproject_full_y_jac_obj_pose};
 
-static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, void *private) {
-	survive_optimizer *mpfunc_ctx = private;
-
-	mpfunc_ctx->parameters = p;
-
+static void normalize_cameras(survive_optimizer *mpfunc_ctx) {
 	SurvivePose *cameras = survive_optimizer_get_camera(mpfunc_ctx);
 
 	int start = survive_optimizer_get_camera_index(mpfunc_ctx);
@@ -120,12 +118,10 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 			quatnormalize(cameras[i].Rot, cameras[i].Rot);
 		}
 	}
-	const double *sensor_points = survive_optimizer_get_sensors(mpfunc_ctx);
-
-	int pose_idx = -1;
-	SurvivePose *pose = 0;
-	SurvivePose obj2lh[NUM_LIGHTHOUSES] = { 0 };
+}
 
+// Fill in the deviates that pull toward the initial pose; returns the count of real measurements
+static int apply_bias(survive_optimizer *mpfunc_ctx, int m, double *p, double *deviates, double **derivs) {
 	int meas_count = m;
 	if (mpfunc_ctx->current_bias > 0) {
 		meas_count -= 7;
@@ -137,6 +133,23 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 			}
 		}
 	}
+	return meas_count;
+}
+
+static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, void *private) {
+	survive_optimizer *mpfunc_ctx = private;
+
+	mpfunc_ctx->parameters = p;
+
+	SurvivePose *cameras = survive_optimizer_get_camera(mpfunc_ctx);
+	normalize_cameras(mpfunc_ctx);
+	const double *sensor_points = survive_optimizer_get_sensors(mpfunc_ctx);
+
+	int pose_idx = -1;
+	SurvivePose *pose = 0;
+	SurvivePose obj2lh[NUM_LIGHTHOUSES] = { 0 };
+
+	int meas_count = apply_bias(mpfunc_ctx, m, p, deviates, derivs);
 
 	for (int i = 0; i < meas_count; i++) {
 		const survive_optimizer_measurement *meas = &mpfunc_ctx->measurements[i];
@@ -161,8 +174,8 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 
 		// If the next two measurements are joined; handle the full pair. This lets us just calculate
 		// sensorPtInLH once
-		const bool nextIsPair =
-			i + 1 < m && meas[0].axis == 0 && meas[1].axis == 1 && meas[0].sensor_idx == meas[1].sensor_idx;
+		const bool nextIsPair = i + 1 < meas_count && meas[0].axis == 0 && meas[1].axis == 1 &&
+								meas[0].sensor_idx == meas[1].sensor_idx && meas[0].lh == meas[1].lh;
 
 		LinmathPoint3d sensorPtInLH;
 		ApplyPoseToPoint(sensorPtInLH, &obj2lh[lh], pt);
@@ -212,9 +225,150 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 	return 0;
 }
 
+/* The measurements sorted into contiguous runs that share a lighthouse and a sweep: x and y
+ * pairs from the same sensor, then lone x, then lone y readings. Each run is evaluated in one
+ * loop. The sort happens once per solve; mpfit then evaluates the batch on every iteration. */
+enum { BATCH_PAIR, BATCH_X, BATCH_Y, BATCH_KINDS };
+#define BATCH_RUNS (NUM_LIGHTHOUSES * BATCH_KINDS)
+
+typedef struct {
+	survive_optimizer *optimizer;
+	int count; // measurements, not counting the bias terms
+
+	// Run g = BATCH_KINDS * lh + kind is entries [run_start[g], run_start[g + 1])
+	int run_start[BATCH_RUNS + 1];
+
+	// Per entry:
+	int *meas_idx; // index into optimizer->measurements and deviates (a pair's y follows its x)
+	FLT *pts;	   // sensor position in object coordinates (3 per entry)
+	FLT *reproj;   // reprojected angles (2 per entry)
+	FLT *jac;	   // derivatives by each pose parameter (14 per entry)
+} survive_optimizer_batch;
+
+static int mpfunc_batch(int m, int n, double *p, double *deviates, double **derivs, void *private) {
+	survive_optimizer_batch *batch = private;
+	survive_optimizer *mpfunc_ctx = batch->optimizer;
+
+	mpfunc_ctx->parameters = p;
+
+	SurvivePose *cameras = survive_optimizer_get_camera(mpfunc_ctx);
+	normalize_cameras(mpfunc_ctx);
+	const double *sensor_points = survive_optimizer_get_sensors(mpfunc_ctx);
+
+	apply_bias(mpfunc_ctx, m, p, deviates, derivs);
+
+	SurvivePose *pose = survive_optimizer_get_pose(mpfunc_ctx);
+	quatnormalize(pose->Rot, pose->Rot);
+
+	for (int g = 0; g < BATCH_RUNS; g++) {
+		const int start = batch->run_start[g], count = batch->run_start[g + 1] - start;
+		if (count == 0)
+			continue;
+		const int lh = g / BATCH_KINDS, kind = g % BATCH_KINDS;
+		const int axes = kind == BATCH_PAIR ? 2 : 1;
+		const struct BaseStationCal *cal = survive_optimizer_get_calibration(mpfunc_ctx, lh);
+		const int *meas_idx = &batch->meas_idx[start];
+		FLT *pts = &batch->pts[3 * start];
+
+		// Sensor points can be parameters, so gather them on every call
+		for (int i = 0; i < count; i++) {
+			const FLT *pt = &sensor_points[mpfunc_ctx->measurements[meas_idx[i]].sensor_idx * 3];
+			pts[3 * i + 0] = pt[0];
+			pts[3 * i + 1] = pt[1];
+			pts[3 * i + 2] = pt[2];
+		}
+
+		if (derivs) {
+			if (kind == BATCH_PAIR)
+				survive_reproject_jac_obj_pose_batch(batch->reproj, batch->jac, pose, pts, count, &cameras[lh], cal);
+			else
+				survive_reproject_axis_jac_obj_pose_batch(batch->reproj, batch->jac, kind == BATCH_Y, pose, pts, count,
+														  &cameras[lh], cal);
+		} else {
+			SurvivePose obj2lh;
+			ApplyPoseToPose(&obj2lh, &cameras[lh], pose);
+			if (kind == BATCH_PAIR)
+				survive_reproject_xy_batch(cal, &obj2lh, pts, count, batch->reproj);
+			else
+				survive_reproject_axis_batch(cal, kind == BATCH_Y, &obj2lh, pts, count, batch->reproj);
+		}
+
+		// Row a of the results is for the measurement at meas_idx + a
+		for (int a = 0; a < axes; a++) {
+			const FLT *row = &batch->reproj[a * count];
+			for (int i = 0; i < count; i++) {
+				const int idx = meas_idx[i] + a;
+				const survive_optimizer_measurement *meas = &mpfunc_ctx->measurements[idx];
+				deviates[idx] = (row[i] - meas->value) / meas->variance;
+			}
+
+			for (int j = 0; derivs && j < 7; j++) {
+				if (!derivs[j])
+					continue;
+				const FLT *jac_row = &batch->jac[(a * 7 + j) * count];
+				for (int i = 0; i < count; i++) {
+					assert(!isnan(jac_row[i]));
+					derivs[j][meas_idx[i] + a] = jac_row[i];
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// The batch only handles a single object; returns false if this problem needs mpfunc
+static bool survive_optimizer_batch_init(survive_optimizer_batch *batch, survive_optimizer *optimizer) {
+	if (optimizer->poseLength != 1 || optimizer->cameraLength == 0)
+		return false;
+
+	batch->optimizer = optimizer;
+	batch->count = optimizer->measurementsCnt - (optimizer->current_bias > 0 ? 7 : 0);
+	const survive_optimizer_measurement *meas = optimizer->measurements;
+
+	// Counting sort into runs; a pair is an x reading followed by the y from the same sensor and lighthouse
+	int run_count[BATCH_RUNS] = {0};
+	for (int i = 0; i < batch->count; i++) {
+		if (meas[i].object != 0 || meas[i].lh >= NUM_LIGHTHOUSES)
+			return false;
+		const bool pair = i + 1 < batch->count && meas[i].axis == 0 && meas[i + 1].axis == 1 &&
+						  meas[i].sensor_idx == meas[i + 1].sensor_idx && meas[i].lh == meas[i + 1].lh;
+		run_count[BATCH_KINDS * meas[i].lh + (pair ? BATCH_PAIR : meas[i].axis ? BATCH_Y : BATCH_X)]++;
+		if (pair)
+			i++;
+	}
+	batch->run_start[0] = 0;
+	for (int g = 0; g < BATCH_RUNS; g++)
+		batch->run_start[g + 1] = batch->run_start[g] + run_count[g];
+
+	int next[BATCH_RUNS];
+	memcpy(next, batch->run_start, sizeof(next));
+	for (int i = 0; i < batch->count; i++) {
+		const bool pair = i + 1 < batch->count && meas[i].axis == 0 && meas[i + 1].axis == 1 &&
+						  meas[i].sensor_idx == meas[i + 1].sensor_idx && meas[i].lh == meas[i + 1].lh;
+		batch->meas_idx[next[BATCH_KINDS * meas[i].lh + (pair ? BATCH_PAIR : meas[i].axis ? BATCH_Y : BATCH_X)]++] = i;
+		if (pair)
+			i++;
+	}
+	return true;
+}
+
 int survive_optimizer_run(survive_optimizer *optimizer, struct mp_result_struct *result) {
 	SurviveContext *ctx = optimizer->so->ctx;
 	// SV_INFO("Run start");
+	if (optimizer->use_batch) {
+		size_t count = optimizer->measurementsCnt;
+		survive_optimizer_batch batch = {
+			.meas_idx = alloca(sizeof(int) * count),
+			.pts = alloca(sizeof(FLT) * 3 * count),
+			.reproj = alloca(sizeof(FLT) * 2 * count),
+			.jac = alloca(sizeof(FLT) * 14 * count),
+		};
+		if (survive_optimizer_batch_init(&batch, optimizer)) {
+			return mpfit(mpfunc_batch, optimizer->measurementsCnt, survive_optimizer_get_parameters_count(optimizer),
+						 optimizer->parameters, optimizer->parameters_info, 0, &batch, result);
+		}
+	}
 	return mpfit(mpfunc, optimizer->measurementsCnt, survive_optimizer_get_parameters_count(optimizer),
 				 optimizer->parameters, optimizer->parameters_info, 0, optimizer, result);
 }
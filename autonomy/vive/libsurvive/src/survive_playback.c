@@ -7,6 +7,7 @@
 
 #include <string.h>
 
+#include "survive_binary_recording.h"
 #include "survive_config.h"
 #include "survive_default_devices.h"
 
@@ -23,14 +24,17 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream);
 
 STATIC_CONFIG_ITEM( RECORD, "record", 's', "File to record to if you wish to make a recording.", "" );
 STATIC_CONFIG_ITEM(RECORD_STDOUT, "record-stdout", 'i', "Whether or not to dump recording data to stdout", 0);
+STATIC_CONFIG_ITEM(RECORD_BINARY, "record-binary", 'i', "Write the recording file in the compact binary format", 0);
 STATIC_CONFIG_ITEM( PLAYBACK, "playback", 's', "File to be used for playback if playing a recording.", "" );
 STATIC_CONFIG_ITEM( PLAYBACK_FACTOR, "playback-factor", 'f', "Time factor of playback -- 1 is run at the same timing as original, 0 is run as fast as possible.", 1.0f );
+STATIC_CONFIG_ITEM(PLAYBACK_START, "playback-start", 'f', "Seconds into a binary recording to start playback.", 0.0f);
 
 
 typedef struct SurviveRecordingData {
 	bool alwaysWriteStdOut;
 	bool writeRawLight;
 	FILE *output_file;
+	svb_writer *binary; // if non-null, write binary records here instead of output_file
 } SurviveRecordingData;
 
 static double timestamp_in_us() {
@@ -40,7 +44,24 @@ static double timestamp_in_us() {
 	return OGGetAbsoluteTime() - start_time_us;
 }
 
+static void svb_pose_from(svb_pose *out, const SurvivePose *pose) {
+	for (int i = 0; i < 3; i++)
+		out->pos[i] = pose->Pos[i];
+	for (int i = 0; i < 4; i++)
+		out->rot[i] = pose->Rot[i];
+}
+
+static void write_pose_binary(SurviveRecordingData *recordingData, int type, const char *name, const SurvivePose *pose) {
+	if (!recordingData->binary)
+		return;
+	svb_pose p;
+	svb_pose_from(&p, pose);
+	svb_write(recordingData->binary, timestamp_in_us(), type, name, &p, sizeof(p));
+}
+
 static void write_to_output(SurviveRecordingData *recordingData, const char *format, ...) {
+	if (!recordingData->output_file && !recordingData->alwaysWriteStdOut)
+		return; // binary recording only: skip formatting
 	double ts = timestamp_in_us();
 
 	if (recordingData->output_file) {
@@ -70,6 +91,7 @@ void survive_recording_config_process(SurviveObject *so, char *ct0conf, int len)
 		if (buffer[i] == '\n')
 			buffer[i] = ' ';
 
+	svb_write(recordingData->binary, timestamp_in_us(), SVB_CONFIG, so->codename, buffer, len);
 	write_to_output(recordingData, "%s CONFIG %.*s\n", so->codename, len, buffer);
 	free(buffer);
 }
@@ -80,6 +102,11 @@ void survive_recording_lighthouse_process(SurviveContext *ctx, uint8_t lighthous
 	if (recordingData == 0)
 		return;
 
+	if (recordingData->binary) {
+		svb_pose p;
+		svb_pose_from(&p, lh_pose);
+		svb_write_obj(recordingData->binary, timestamp_in_us(), SVB_LH_POSE, lighthouse, &p, sizeof(p));
+	}
 	write_to_output(recordingData, "%d LH_POSE %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", lighthouse,
 					lh_pose->Pos[0], lh_pose->Pos[1], lh_pose->Pos[2], lh_pose->Rot[0], lh_pose->Rot[1],
 					lh_pose->Rot[2], lh_pose->Rot[3]);
@@ -89,6 +116,7 @@ void survive_recording_velocity_process(SurviveObject *so, uint8_t lighthouse, c
 	if (recordingData == 0)
 		return;
 
+	write_pose_binary(recordingData, SVB_VELOCITY, so->codename, pose);
 	write_to_output(recordingData, "%s VELOCITY %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", so->codename,
 					pose->Pos[0], pose->Pos[1], pose->Pos[2], pose->Rot[0], pose->Rot[1], pose->Rot[2], pose->Rot[3]);
 }
@@ -97,6 +125,7 @@ void survive_recording_raw_pose_process(SurviveObject *so, uint8_t lighthouse, S
 	if (recordingData == 0)
 		return;
 
+	write_pose_binary(recordingData, SVB_POSE, so->codename, pose);
 	write_to_output(recordingData, "%s POSE %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", so->codename, pose->Pos[0],
 					pose->Pos[1], pose->Pos[2], pose->Rot[0], pose->Rot[1], pose->Rot[2], pose->Rot[3]);
 }
@@ -106,6 +135,7 @@ void survive_recording_external_velocity_process(SurviveContext *ctx, const char
 	if (recordingData == 0)
 		return;
 
+	write_pose_binary(recordingData, SVB_EXTERNAL_VELOCITY, name, pose);
 	write_to_output(recordingData, "%s EXTERNAL_VELOCITY %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", name,
 					pose->Pos[0], pose->Pos[1], pose->Pos[2], pose->Rot[0], pose->Rot[1], pose->Rot[2], pose->Rot[3]);
 }
@@ -115,6 +145,7 @@ void survive_recording_external_pose_process(SurviveContext *ctx, const char *na
 	if (recordingData == 0)
 		return;
 
+	write_pose_binary(recordingData, SVB_EXTERNAL_POSE, name, pose);
 	write_to_output(recordingData, "%s EXTERNAL_POSE %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", name, pose->Pos[0],
 					pose->Pos[1], pose->Pos[2], pose->Rot[0], pose->Rot[1], pose->Rot[2], pose->Rot[3]);
 }
@@ -124,6 +155,7 @@ void survive_recording_info_process(SurviveContext *ctx, const char *fault) {
 	if (recordingData == 0)
 		return;
 
+	svb_write(recordingData->binary, timestamp_in_us(), SVB_INFO, 0, fault, strlen(fault));
 	write_to_output(recordingData, "INFO LOG %s\n", fault);
 }
 
@@ -133,6 +165,10 @@ void survive_recording_angle_process(struct SurviveObject *so, int sensor_id, in
 	if (recordingData == 0)
 		return;
 
+	if (recordingData->binary) {
+		svb_angle a = {sensor_id, acode, timecode, length, angle, lh};
+		svb_write(recordingData->binary, timestamp_in_us(), SVB_ANGLE, so->codename, &a, sizeof(a));
+	}
 	write_to_output(recordingData, "%s A %d %d %u %0.6f %0.6f %u\n", so->codename, sensor_id, acode, timecode, length,
 					angle, lh);
 }
@@ -143,6 +179,10 @@ void survive_recording_lightcap(SurviveObject *so, LightcapElement *le) {
 		return;
 
 	if (recordingData->writeRawLight) {
+		if (recordingData->binary) {
+			svb_rawlight c = {le->sensor_id, 0, le->length, le->timestamp};
+			svb_write(recordingData->binary, timestamp_in_us(), SVB_RAWLIGHT, so->codename, &c, sizeof(c));
+		}
 		write_to_output(recordingData, "%s C %d %u %u\n", so->codename, le->sensor_id, le->timestamp, le->length);
 	}
 }
@@ -153,6 +193,11 @@ void survive_recording_light_process(struct SurviveObject *so, int sensor_id, in
 	if (recordingData == 0)
 		return;
 
+	if (recordingData->binary) {
+		svb_light l = {sensor_id, acode, timeinsweep, timecode, length, lh};
+		svb_write(recordingData->binary, timestamp_in_us(), SVB_LIGHT, so->codename, &l, sizeof(l));
+	}
+
 	if (acode == -1) {
 		write_to_output(recordingData, "%s S %d %d %d %u %u %u\n", so->codename, sensor_id, acode, timeinsweep,
 						timecode, length, lh);
@@ -194,6 +239,12 @@ void survive_recording_imu_process(struct SurviveObject *so, int mask, FLT *acce
 	if (recordingData == 0)
 		return;
 
+	if (recordingData->binary) {
+		svb_imu m = {mask, timecode, id};
+		for (int i = 0; i < 9; i++)
+			m.accelgyro[i] = accelgyro[i];
+		svb_write(recordingData->binary, timestamp_in_us(), SVB_IMU, so->codename, &m, sizeof(m));
+	}
 	write_to_output(recordingData, "%s I %d %u %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f  %0.6f %0.6f %0.6f %d\n",
 					so->codename, mask, timecode, accelgyro[0], accelgyro[1], accelgyro[2], accelgyro[3], accelgyro[4],
 					accelgyro[5], accelgyro[6], accelgyro[7], accelgyro[8], id);
@@ -208,6 +259,11 @@ struct SurvivePlaybackData {
 	double next_time_us;
 	FLT playback_factor;
 	bool hasRawLight;
+
+	svb_reader *binary; // non-null when playing back a binary recording
+	svb_event next_event;
+	bool has_next_event;
+	FLT playback_start; // seconds skipped at the start of a binary recording
 };
 typedef struct SurvivePlaybackData SurvivePlaybackData;
 
@@ -318,8 +374,99 @@ static int parse_and_run_lightcode(const char *line, SurvivePlaybackData *driver
 	return 0;
 }
 
+static SurviveObject *binary_event_object(SurvivePlaybackData *driver, const svb_event *ev) {
+	SurviveObject *so = ev->name ? survive_get_so_by_name(driver->ctx, ev->name) : 0;
+	if (!so) {
+		static bool display_once = false;
+		SurviveContext *ctx = driver->ctx;
+		if (display_once == false) {
+			SV_ERROR("Could not find device named %s at time %f\n", ev->name ? ev->name : "(none)", ev->time);
+		}
+		display_once = true;
+	}
+	return so;
+}
+
+static void run_binary_event(SurvivePlaybackData *driver, const svb_event *ev) {
+	SurviveContext *ctx = driver->ctx;
+	switch (ev->type) {
+	case SVB_RAWLIGHT: {
+		driver->hasRawLight = 1;
+		svb_rawlight c;
+		memcpy(&c, ev->payload, sizeof(c));
+		SurviveObject *so = binary_event_object(driver, ev);
+		if (so) {
+			LightcapElement le;
+			le.sensor_id = c.sensor_id;
+			le.length = c.length;
+			le.timestamp = c.timestamp;
+			handle_lightcap(so, &le);
+		}
+		break;
+	}
+	case SVB_LIGHT: {
+		svb_light l;
+		memcpy(&l, ev->payload, sizeof(l));
+		if (driver->hasRawLight || l.acode < 0) // same as text playback
+			break;
+		SurviveObject *so = binary_event_object(driver, ev);
+		if (so)
+			ctx->lightproc(so, l.sensor_id, l.acode, l.timeinsweep, l.timecode, l.length, l.lh);
+		break;
+	}
+	case SVB_IMU: {
+		svb_imu m;
+		memcpy(&m, ev->payload, sizeof(m));
+		FLT accelgyro[9];
+		for (int i = 0; i < 9; i++)
+			accelgyro[i] = m.accelgyro[i];
+		SurviveObject *so = binary_event_object(driver, ev);
+		if (so)
+			ctx->imuproc(so, m.mask, accelgyro, m.timecode, m.id);
+		break;
+	}
+	case SVB_EXTERNAL_POSE: {
+		svb_pose p;
+		memcpy(&p, ev->payload, sizeof(p));
+		SurvivePose pose;
+		for (int i = 0; i < 3; i++)
+			pose.Pos[i] = p.pos[i];
+		for (int i = 0; i < 4; i++)
+			pose.Rot[i] = p.rot[i];
+		ctx->externalposeproc(ctx, ev->name ? ev->name : "", &pose);
+		break;
+	}
+	default: // angles, poses, configs and logs are outputs: not replayed
+		break;
+	}
+}
+
+/* Binary playback: run every event that is due, reading whole blocks at a time */
+static int playback_poll_binary(struct SurviveContext *ctx, SurvivePlaybackData *driver) {
+	for (int count = 0; count < 1000; count++) { // let other drivers poll sometimes
+		if (!driver->has_next_event) {
+			if (svb_reader_next(driver->binary, &driver->next_event) <= 0) {
+				svb_reader_close(driver->binary);
+				driver->binary = 0;
+				driver->playback_file = 0;
+				return -1;
+			}
+			driver->has_next_event = true;
+		}
+
+		double t = driver->next_event.time - driver->playback_start;
+		if (t * driver->playback_factor > timestamp_in_us())
+			return 0;
+		driver->has_next_event = false;
+		run_binary_event(driver, &driver->next_event);
+	}
+	return 0;
+}
+
 static int playback_poll(struct SurviveContext *ctx, void *_driver) {
 	SurvivePlaybackData *driver = _driver;
+	if (driver->binary)
+		return playback_poll_binary(ctx, driver);
 	FILE *f = driver->playback_file;
 
 	if (f && !feof(f) && !ferror(f)) {
@@ -398,8 +545,11 @@ static int playback_poll(struct SurviveContext *ctx, void *_driver) {
 
 static int playback_close(struct SurviveContext *ctx, void *_driver) {
 	SurvivePlaybackData *driver = _driver;
-	if (driver->playback_file)
+	if (driver->binary)
+		svb_reader_close(driver->binary); // also closes playback_file
+	else if (driver->playback_file)
 		fclose(driver->playback_file);
+	driver->binary = 0;
 	driver->playback_file = 0;
 
 	return 0;
@@ -412,14 +562,19 @@ void survive_install_recording(SurviveContext *ctx) {
 	if (strlen(dataout_file) > 0 || record_to_stdout) {
 		ctx->recptr = calloc(1, sizeof(struct SurviveRecordingData));
 
-		ctx->recptr->output_file = fopen(dataout_file, "w");
-		if (ctx->recptr->output_file == 0 && !record_to_stdout) {
+		bool binary = survive_configi(ctx, "record-binary", SC_GET, 0);
+		ctx->recptr->output_file = fopen(dataout_file, binary ? "wb" : "w");
+		if (ctx->recptr->output_file && binary) {
+			ctx->recptr->binary = svb_writer_open(ctx->recptr->output_file); // takes over the file
+			ctx->recptr->output_file = 0;
+		}
+		if (ctx->recptr->output_file == 0 && ctx->recptr->binary == 0 && !record_to_stdout) {
 			SV_INFO("Could not open %s for writing", dataout_file);
 			free(ctx->recptr);
 			ctx->recptr = 0;
 			return;
 		}
-		SV_INFO("Recording to '%s'", dataout_file);
+		SV_INFO("Recording to '%s'%s", dataout_file, ctx->recptr->binary ? " (binary)" : "");
 		ctx->recptr->alwaysWriteStdOut = record_to_stdout;
 		if (record_to_stdout) {
 			SV_INFO("Recording to stdout");
@@ -429,6 +584,41 @@ void survive_install_recording(SurviveContext *ctx) {
 	}
 }
 
+void survive_recording_close(SurviveContext *ctx) {
+	SurviveRecordingData *recordingData = ctx->recptr;
+	if (recordingData == 0)
+		return;
+	svb_writer_close(recordingData->binary); // writes the seek index
+	recordingData->binary = 0;
+	if (recordingData->output_file)
+		fclose(recordingData->output_file);
+	recordingData->output_file = 0;
+}
+
+/* Add the objects whose CONFIG records are in this binary recording */
+static void binary_playback_configs(SurviveContext *ctx, SurvivePlaybackData *sp, SurviveObject **objs, int nobjs) {
+	svb_reader_filter(sp->binary, SVB_BLOCK_CONFIG); // skips straight past the data blocks
+	svb_event ev;
+	while (svb_reader_next(sp->binary, &ev) > 0) {
+		if (ev.type != SVB_CONFIG || !ev.name)
+			continue;
+		char *config = malloc(ev.bytes + 1);
+		memcpy(config, ev.payload, ev.bytes);
+		config[ev.bytes] = 0;
+		for (int i = 0; i < nobjs; i++) {
+			SurviveObject **obj = &objs[i];
+			if (*obj && strcmp(ev.name, (*obj)->codename) == 0 && ctx->configfunction(*obj, config, ev.bytes) == 0) {
+				SV_INFO("Found %s in playback file...", ev.name);
+				survive_add_object(ctx, *obj);
+				*obj = 0;
+			}
+		}
+		free(config);
+	}
+	svb_reader_filter(sp->binary, 0);
+	svb_reader_seek(sp->binary, sp->playback_start);
+}
+
 int DriverRegPlayback(SurviveContext *ctx) {
 	const char *playback_file = survive_configs(ctx, "playback", SC_GET, "");
 
@@ -440,7 +630,7 @@ int DriverRegPlayback(SurviveContext *ctx) {
 	sp->ctx = ctx;
 	sp->playback_dir = playback_file;
 
-	sp->playback_file = fopen(playback_file, "r");
+	sp->playback_file = fopen(playback_file, "rb");
 	if (sp->playback_file == 0) {
 		SV_WARN("Could not open playback events file %s", playback_file);
 		return -1;
@@ -457,8 +647,17 @@ int DriverRegPlayback(SurviveContext *ctx) {
 
 	SurviveObject *objs[] = {hmd, wm0, wm1, tr0, ww0};
 
+	if (svb_is_binary(sp->playback_file)) {
+		sp->binary = svb_reader_open(sp->playback_file);
+		if (sp->binary == 0)
+			return -1;
+		sp->playback_start = survive_configf(ctx, "playback-start", SC_GET, 0);
+		SV_INFO("Binary playback file, starting at %f seconds", sp->playback_start);
+		binary_playback_configs(ctx, sp, objs, sizeof(objs) / sizeof(objs[0]));
+	}
+
 	FLT time;
-	while (!feof(sp->playback_file) && !ferror(sp->playback_file)) {
+	while (!sp->binary && !feof(sp->playback_file) && !ferror(sp->playback_file)) {
 		char *line = 0;
 		size_t n;
 		int r = getline(&line, &n, sp->playback_file);
@@ -505,7 +704,8 @@ int DriverRegPlayback(SurviveContext *ctx) {
 			free(obj);
 		}
 	}
-	fseek(sp->playback_file, 0, SEEK_SET); // same as rewind(f);
+	if (!sp->binary)
+		fseek(sp->playback_file, 0, SEEK_SET); // same as rewind(f);
 
 	survive_add_driver(ctx, sp, playback_poll, playback_close, 0);
 	return 0;
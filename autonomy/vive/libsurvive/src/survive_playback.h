@@ -1,6 +1,7 @@
 #include <survive.h>
 
 void survive_install_recording(SurviveContext *ctx);
+void survive_recording_close(SurviveContext *ctx);
 void survive_recording_config_process(SurviveObject *so, char *ct0conf, int len);
 
 void survive_recording_lighthouse_process(SurviveContext *ctx, uint8_t lighthouse, SurvivePose *lh_pose,
@@ -101,6 +101,141 @@ void survive_reproject_full_jac_obj_pose(SurviveAngleReading out, const SurviveP
 							curve_1, gibPhase_0, gibPhase_1, gibMag_0, gibMag_1);
 }
 
+/* Batched reprojection. This is the same model as survive_reproject_axis, but points are
+ * rotated with matrices and the jacobian comes from the chain rule, so every point is the
+ * same short run of arithmetic, with the per-lighthouse and per-pose work done once. */
+
+// Angle of a point in lighthouse coordinates for this sweep (as survive_reproject_axis_x / _y),
+// and when grad isn't NULL, the gradient of that angle by the point
+static inline FLT survive_reproject_sweep(const BaseStationCal *bcal, int axis, FLT tan_tilt, const FLT *pt,
+										  FLT *grad) {
+	// survive_reproject_axis arguments
+	const FLT X = axis == 0 ? pt[0] : -pt[1];
+	const FLT O = axis == 0 ? pt[1] : pt[0];
+	const FLT Z = -pt[2];
+	const BaseStationCal *cal = &bcal[axis];
+
+	const FLT mag2 = X * X + Z * Z, mag = sqrt(mag2);
+	FLT s = tan_tilt * O / mag;
+	const bool clamped = s > 1. || s < -1.;
+	s = s > 1. ? 1. : (s < -1. ? -1. : s);
+	const FLT ang1 = atan2(Z, X) - cal->phase - asin(s);
+	const FLT b = atan2(O, Z);
+	const FLT ang = ang1 - cos(cal->gibpha + ang1) * cal->gibmag + cal->curve * b * b;
+
+	if (grad) {
+		const FLT dasin = clamped ? 0. : 1. / sqrt(1. - s * s);
+		const FLT gib = 1. + sin(cal->gibpha + ang1) * cal->gibmag;
+		const FLT curve = 2. * cal->curve * b / (O * O + Z * Z);
+		const FLT dX = gib * (-Z + dasin * s * X) / mag2;
+		const FLT dO = -gib * dasin * tan_tilt / mag + curve * Z;
+		const FLT dZ = gib * (X + dasin * s * Z) / mag2 - curve * O;
+		grad[0] = axis == 0 ? dX : dO;
+		grad[1] = axis == 0 ? dO : -dX;
+		grad[2] = -dZ;
+	}
+	return ang - M_PI / 2.;
+}
+
+static inline void transform_point(FLT *out, const FLT *m, const FLT *t, const FLT *p) {
+	out[0] = m[0] * p[0] + m[3] * p[1] + m[6] * p[2] + t[0];
+	out[1] = m[1] * p[0] + m[4] * p[1] + m[7] * p[2] + t[1];
+	out[2] = m[2] * p[0] + m[5] * p[1] + m[8] * p[2] + t[2];
+}
+
+// Angles for axes first_axis .. first_axis + axes - 1, into rows of n
+static void survive_reproject_batch(const BaseStationCal *bcal, int first_axis, int axes, const SurvivePose *obj2lh,
+									const FLT *ptsInObj, size_t n, FLT *out) {
+	FLT m[9];
+	quattomatrix33(m, obj2lh->Rot);
+	FLT tan_tilt[2] = {tan(bcal[0].tilt), tan(bcal[1].tilt)};
+
+	for (size_t i = 0; i < n; i++) {
+		FLT pt[3];
+		transform_point(pt, m, obj2lh->Pos, &ptsInObj[3 * i]);
+		for (int a = 0; a < axes; a++) {
+			const int axis = first_axis + a;
+			out[a * n + i] = survive_reproject_sweep(bcal, axis, tan_tilt[axis], pt, 0);
+		}
+	}
+}
+
+// Angles and jacobians by obj_pose, which must have a normalized rotation
+static void survive_reproject_jac_batch(const BaseStationCal *bcal, int first_axis, int axes,
+										const SurvivePose *obj_pose, const FLT *ptsInObj, size_t n,
+										const SurvivePose *world2lh, FLT *out, FLT *jac) {
+	FLT obj_m[9], lh_m[9];
+	quattomatrix33(obj_m, obj_pose->Rot);
+	quattomatrix33(lh_m, world2lh->Rot);
+	const FLT *u = obj_pose->Rot;
+	FLT tan_tilt[2] = {tan(bcal[0].tilt), tan(bcal[1].tilt)};
+
+	for (size_t i = 0; i < n; i++) {
+		const FLT *p = &ptsInObj[3 * i];
+		FLT world[3], pt[3];
+		transform_point(world, obj_m, obj_pose->Pos, p);
+		transform_point(pt, lh_m, world2lh->Pos, world);
+
+		/* Derivatives of the rotated point by the quaternion, as quatrotatevector computes it:
+		 *   rotated = p + 2 v x (v x p + w p)
+		 * so d/dw = 2 v x p, and d/dv_j = 2 (e_j x (v x p + w p) + v x (e_j x p)) */
+		const FLT *v = &u[1];
+		FLT vxp[3], t[3], d_rot[4][3];
+		cross3d(vxp, v, p);
+		for (int k = 0; k < 3; k++) {
+			t[k] = vxp[k] + u[0] * p[k];
+			d_rot[0][k] = 2 * vxp[k];
+		}
+		for (int j = 0; j < 3; j++) {
+			FLT e[3] = {0}, ext[3], exp_[3], vxexp[3];
+			e[j] = 1;
+			cross3d(ext, e, t);
+			cross3d(exp_, e, p);
+			cross3d(vxexp, v, exp_);
+			for (int k = 0; k < 3; k++)
+				d_rot[j + 1][k] = 2 * (ext[k] + vxexp[k]);
+		}
+
+		for (int a = 0; a < axes; a++) {
+			const int axis = first_axis + a;
+			FLT grad[3], grad_world[3];
+			out[a * n + i] = survive_reproject_sweep(bcal, axis, tan_tilt[axis], pt, grad);
+
+			// grad_world = lh_m^T grad
+			for (int k = 0; k < 3; k++)
+				grad_world[k] = lh_m[3 * k] * grad[0] + lh_m[3 * k + 1] * grad[1] + lh_m[3 * k + 2] * grad[2];
+
+			FLT *row = &jac[a * 7 * n + i];
+			row[0] = grad_world[0];
+			row[n] = grad_world[1];
+			row[2 * n] = grad_world[2];
+			for (int q = 0; q < 4; q++)
+				row[(3 + q) * n] = dot3d(grad_world, d_rot[q]);
+		}
+	}
+}
+
+void survive_reproject_axis_batch(const BaseStationCal *bcal, int axis, const SurvivePose *obj2lh, const FLT *ptsInObj,
+								  size_t n, FLT *out) {
+	survive_reproject_batch(bcal, axis, 1, obj2lh, ptsInObj, n, out);
+}
+
+void survive_reproject_xy_batch(const BaseStationCal *bcal, const SurvivePose *obj2lh, const FLT *ptsInObj, size_t n,
+								FLT *out) {
+	survive_reproject_batch(bcal, 0, 2, obj2lh, ptsInObj, n, out);
+}
+
+void survive_reproject_axis_jac_obj_pose_batch(FLT *out, FLT *jac, int axis, const SurvivePose *obj_pose,
+											   const FLT *ptsInObj, size_t n, const SurvivePose *world2lh,
+											   const BaseStationCal *bcal) {
+	survive_reproject_jac_batch(bcal, axis, 1, obj_pose, ptsInObj, n, world2lh, out, jac);
+}
+
+void survive_reproject_jac_obj_pose_batch(FLT *out, FLT *jac, const SurvivePose *obj_pose, const FLT *ptsInObj,
+										  size_t n, const SurvivePose *world2lh, const BaseStationCal *bcal) {
+	survive_reproject_jac_batch(bcal, 0, 2, obj_pose, ptsInObj, n, world2lh, out, jac);
+}
+
 void survive_reproject_from_pose_with_bcal(const BaseStationCal *bcal, const SurvivePose *world2lh,
 										   LinmathVec3d const ptInWorld, SurviveAngleReading out) {
 	LinmathPoint3d ptInLh;
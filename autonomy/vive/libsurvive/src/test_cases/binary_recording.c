@@ -0,0 +1,77 @@
+#include "../survive_binary_recording.h"
+#include "test_case.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_RECORDING "binary_recording_test.svb"
+
+#define ASSERT_INT_EQ(val1, val2)                                                                                      \
+	if ((val1) != (val2)) {                                                                                            \
+		fprintf(stderr, "Assert failed: %s != %s: %d != %d\n", #val1, #val2, (int)(val1), (int)(val2));             \
+		return survive_test_assert();                                                                                  \
+	}
+
+// Write IMU events for two objects every millisecond, for this many seconds
+static int write_test_recording(double seconds) {
+	FILE *f = fopen(TEST_RECORDING, "wb");
+	if (!f)
+		return survive_test_assert();
+	svb_writer *w = svb_writer_open(f);
+	const char *config = "{\"config\": 1}";
+	svb_write(w, 0.0, SVB_CONFIG, "WW0", config, strlen(config));
+	for (int i = 0; i < seconds * 1000; i++) {
+		svb_imu m = {1, (uint32_t)i, 0};
+		m.accelgyro[0] = i * 0.5f;
+		svb_write(w, i * 0.001, SVB_IMU, (i % 2) ? "TR0" : "WW0", &m, sizeof(m));
+	}
+	svb_writer_close(w);
+	return 0;
+}
+
+TEST(BinaryRecording, RoundTrip) {
+	ASSERT_SUCCESS(write_test_recording(5.0));
+
+	svb_reader *r = svb_reader_open(fopen(TEST_RECORDING, "rb"));
+	if (!r)
+		return survive_test_assert();
+
+	svb_event ev;
+	ASSERT_INT_EQ(svb_reader_next(r, &ev), 1);
+	ASSERT_INT_EQ(ev.type, SVB_CONFIG);
+	ASSERT_INT_EQ(strcmp(ev.name, "WW0"), 0);
+
+	int count = 0;
+	while (svb_reader_next(r, &ev) > 0) {
+		svb_imu m;
+		memcpy(&m, ev.payload, sizeof(m));
+		ASSERT_INT_EQ(ev.type, SVB_IMU);
+		ASSERT_INT_EQ(m.timecode, count);
+		ASSERT_INT_EQ(strcmp(ev.name, (count % 2) ? "TR0" : "WW0"), 0);
+		ASSERT_DOUBLE_EQ(ev.time, count * 0.001);
+		ASSERT_DOUBLE_EQ(m.accelgyro[0], count * 0.5);
+		count++;
+	}
+	ASSERT_INT_EQ(count, 5000);
+
+	// Seek into the middle: names must still be known
+	ASSERT_INT_EQ(svb_reader_seek(r, 3.5), 0);
+	ASSERT_INT_EQ(svb_reader_next(r, &ev), 1);
+	ASSERT_GE(ev.time, 2.5);
+	ASSERT_GE(3.5, ev.time);
+	if (!ev.name)
+		return survive_test_assert();
+
+	// Only the first block holds the config, so the filter skips the rest
+	svb_reader_filter(r, SVB_BLOCK_CONFIG);
+	svb_reader_seek(r, 0);
+	count = 0;
+	while (svb_reader_next(r, &ev) > 0)
+		count++;
+	ASSERT_GT((double)count, 0.0);
+	ASSERT_GT(2000.0, (double)count);
+
+	svb_reader_close(r);
+	remove(TEST_RECORDING);
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include "../../redist/mpfit/mpfit.h"
+#include "survive_optimizer.h"
+#include "survive_reproject.h"
+#include "test_case.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SENSOR_COUNT 16
+
+static SurvivePose true_pose = {.Pos = {0.1, -0.2, 0.05}, .Rot = {0.9659258, 0, 0.258819, 0}};
+
+static void setup_scene(SurviveContext *ctx, SurviveObject *so, FLT *sensors) {
+	memset(ctx, 0, sizeof(*ctx));
+	memset(so, 0, sizeof(*so));
+	ctx->activeLighthouses = 2;
+	for (int lh = 0; lh < 2; lh++) {
+		ctx->bsd[lh].PositionSet = 1;
+		ctx->bsd[lh].Pose = (SurvivePose){.Pos = {lh * 1.5 - 0.75, 0.3, 2.5}, .Rot = {1, 0, 0, 0}};
+		for (int axis = 0; axis < 2; axis++) {
+			ctx->bsd[lh].fcal[axis] =
+				(BaseStationCal){.phase = 0.01 * (axis + 1), .tilt = 0.005 * (lh + 1), .curve = 0.002};
+		}
+	}
+
+	// Sensors scattered over a 10cm ball
+	srand(5);
+	for (int i = 0; i < 3 * SENSOR_COUNT; i++)
+		sensors[i] = (rand() / (FLT)RAND_MAX - 0.5) * 0.1;
+	so->ctx = ctx;
+	so->sensor_ct = SENSOR_COUNT;
+	so->sensor_locations = sensors;
+}
+
+// Solve for the pose from a perturbed start, with or without the batch evaluation
+static int solve(SurviveObject *so, bool use_batch, SurvivePose *out, mp_result *result) {
+	survive_optimizer mpfitctx = {
+		.so = so,
+		.poseLength = 1,
+		.cameraLength = 2,
+		.use_batch = use_batch,
+	};
+	SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(mpfitctx);
+	survive_optimizer_setup_cameras(&mpfitctx, so->ctx, true);
+
+	SurvivePose start = true_pose;
+	start.Pos[0] += 0.05;
+	start.Pos[2] -= 0.1;
+	start.Rot[1] += 0.05;
+	quatnormalize(start.Rot, start.Rot);
+	survive_optimizer_setup_pose(&mpfitctx, &start, false, 1);
+
+	// Measurements in the same sensor, lighthouse, axis order poser_mpfit uses
+	SurvivePose *cameras = survive_optimizer_get_camera(&mpfitctx);
+	survive_optimizer_measurement *meas = mpfitctx.measurements;
+	for (int sensor = 0; sensor < SENSOR_COUNT; sensor++) {
+		for (int lh = 0; lh < 2; lh++) {
+			SurviveAngleReading ang;
+			survive_reproject_full(so->ctx->bsd[lh].fcal, &cameras[lh], &true_pose, &so->sensor_locations[3 * sensor],
+								   ang);
+			for (int axis = 0; axis < 2; axis++) {
+				if ((sensor + lh + axis) % 5 == 0)
+					continue; // leave some axes unpaired
+				*meas++ = (survive_optimizer_measurement){
+					.value = ang[axis], .variance = 1, .lh = lh, .sensor_idx = sensor, .axis = axis};
+			}
+		}
+	}
+	mpfitctx.measurementsCnt = meas - mpfitctx.measurements;
+
+	memset(result, 0, sizeof(*result));
+	int res = survive_optimizer_run(&mpfitctx, result);
+	*out = *survive_optimizer_get_pose(&mpfitctx);
+	quatnormalize(out->Rot, out->Rot);
+	return res;
+}
+
+TEST(Optimizer, BatchMatchesSingle) {
+	SurviveContext ctx;
+	SurviveObject so;
+	FLT sensors[3 * SENSOR_COUNT];
+	setup_scene(&ctx, &so, sensors);
+
+	SurvivePose single, batch;
+	mp_result single_result, batch_result;
+	ASSERT_GT((double)solve(&so, false, &single, &single_result), 0.);
+	ASSERT_GT((double)solve(&so, true, &batch, &batch_result), 0.);
+
+	ASSERT_DOUBLE_ARRAY_EQ(3, batch.Pos, single.Pos);
+	ASSERT_QUAT_EQ(batch.Rot, single.Rot);
+	ASSERT_DOUBLE_ARRAY_EQ(3, batch.Pos, true_pose.Pos);
+	ASSERT_QUAT_EQ(batch.Rot, true_pose.Rot);
+	// The batch jacobian is exact for the rotation, so it shouldn't need more iterations
+	ASSERT_GE((double)single_result.niter, (double)batch_result.niter);
+	return 0;
+}
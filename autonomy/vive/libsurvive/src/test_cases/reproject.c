@@ -58,3 +58,46 @@ TEST(Reproject, Extents) {
 
 	return 0;
 }
+
+TEST(Reproject, BatchJacobian) {
+	BaseStationCal cal[2] = {{.phase = 0.01, .tilt = 0.05, .curve = 0.02, .gibpha = 0.3, .gibmag = 0.01},
+							 {.phase = 0.02, .tilt = -0.04, .curve = 0.01, .gibpha = -0.2, .gibmag = 0.02}};
+	SurvivePose world2lh = {.Pos = {0.75, -0.3, -2.5}, .Rot = {0.98, 0.1, -0.1, 0.05}};
+	SurvivePose obj2world = {.Pos = {0.1, -0.2, 0.05}, .Rot = {0.96, 0.1, 0.26, -0.2}};
+	quatnormalize(world2lh.Rot, world2lh.Rot);
+	quatnormalize(obj2world.Rot, obj2world.Rot);
+	const FLT pts[] = {0.03, -0.02, 0.04, -0.05, 0.01, 0.02, 0.0, 0.06, -0.03};
+	const int n = 3;
+
+	FLT out[2 * 3], jac[14 * 3];
+	survive_reproject_jac_obj_pose_batch(out, jac, &obj2world, pts, n, &world2lh, cal);
+
+	FLT xy[2 * 3];
+	SurvivePose obj2lh;
+	ApplyPoseToPose(&obj2lh, &world2lh, &obj2world);
+	survive_reproject_xy_batch(cal, &obj2lh, pts, n, xy);
+
+	for (int i = 0; i < n; i++) {
+		SurviveAngleReading ang;
+		survive_reproject_full(cal, &world2lh, &obj2world, &pts[3 * i], ang);
+		ASSERT_DOUBLE_EQ(out[i], ang[0]);
+		ASSERT_DOUBLE_EQ(out[n + i], ang[1]);
+		ASSERT_DOUBLE_EQ(xy[i], ang[0]);
+		ASSERT_DOUBLE_EQ(xy[n + i], ang[1]);
+
+		// Central differences of the same model
+		for (int j = 0; j < 7; j++) {
+			const FLT h = 1e-6;
+			SurvivePose plus = obj2world, minus = obj2world;
+			((FLT *)plus.Pos)[j] += h; // Pos and Rot are contiguous
+			((FLT *)minus.Pos)[j] -= h;
+			SurviveAngleReading ang_plus, ang_minus;
+			survive_reproject_full(cal, &world2lh, &plus, &pts[3 * i], ang_plus);
+			survive_reproject_full(cal, &world2lh, &minus, &pts[3 * i], ang_minus);
+			ASSERT_DOUBLE_EQ(jac[j * n + i], (ang_plus[0] - ang_minus[0]) / (2 * h));
+			ASSERT_DOUBLE_EQ(jac[(7 + j) * n + i], (ang_plus[1] - ang_minus[1]) / (2 * h));
+		}
+	}
+
+	return 0;
+}
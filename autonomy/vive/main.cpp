@@ -14,7 +14,16 @@
 
 #include "osl/file_ipc.h"
 #include "osl/transform.h"
+#include "aurora/robot_clock.h"
+#include "aurora/vive_pose.h"
+#include "aurora/network_ipc.h"
 #include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "src/survive_cal.h"
 #include <CNFGFunctions.h>
@@ -169,6 +178,13 @@ typedef struct SurviveObjectSimulation {
   
   // Down vector, measured in local orient frame
   vec3 down;
+  
+  // IMU dead reckoning since the last optical fix (global coordinates)
+  vec3 imu_offset; // meters moved since the fix
+  vec3 imu_velocity; // m/s
+  
+  // time_in_seconds of the last optical fix
+  double last_fix_time;
 
   // Number of sensors actually present in these arrays:
   int nsensor;
@@ -203,6 +219,9 @@ SurviveObjectSimulation *survive_sim_init(const char *type) {
   o->last_imu_time=now;
   o->down=vec3(0,0,0);
   
+  o->imu_offset=o->imu_velocity=vec3(0,0,0);
+  o->last_fix_time=now;
+  
   const static SurviveSensorHardware hardware[]={
 #include "survive_models/controller_cal.h"
   };
@@ -217,33 +236,151 @@ SurviveObjectSimulation *survive_sim_init(const char *type) {
   return o;
 }
 
-// Return the global coordinates normal of the plane swept by
-//   lighthouse L's axis A at angle ang radians.
-vec3 survive_lighthouse_normal(SurviveObjectSimulation *o,int L,int A,FLT ang)
+/* Struct-of-arrays batch of the sweep readings for one integration step.
+   Readings are grouped by lighthouse and axis, so each group shares
+   one lighthouse position and orientation. */
+enum {SURVIVE_BATCH_MAX=NUM_LIGHTHOUSES*2*SENSORS_PER_OBJECT};
+typedef struct SurviveSensorBatch {
+  // Readings [group_start[L][A],group_start[L][A+1]) came from lighthouse L's axis A
+  int group_start[NUM_LIGHTHOUSES*2+1];
+  int n; // total readings
+  
+  // Per reading:
+  alignas(32) float angle[SURVIVE_BATCH_MAX]; // sensed sweep angle (radians)
+  alignas(32) float lx[SURVIVE_BATCH_MAX], ly[SURVIVE_BATCH_MAX], lz[SURVIVE_BATCH_MAX]; // sensor position (local coords)
+  alignas(32) float nx[SURVIVE_BATCH_MAX], ny[SURVIVE_BATCH_MAX], nz[SURVIVE_BATCH_MAX]; // sweep plane normal (global)
+  alignas(32) float ox[SURVIVE_BATCH_MAX], oy[SURVIVE_BATCH_MAX], oz[SURVIVE_BATCH_MAX]; // sensor offset (global), per pass
+  alignas(32) float predicted[SURVIVE_BATCH_MAX]; // geometric angle estimate, per pass
+  alignas(32) float inlier[SURVIVE_BATCH_MAX]; // 1 if used this pass, 0 if an outlier
+  
+  // Per group: normal of the sweep plane at angle 0
+  vec3 normal0[NUM_LIGHTHOUSES*2];
+} SurviveSensorBatch;
+
+// Collect the sensed angles into the batch, and compute their sweep plane normals.
+//   The normals only depend on the angle, so they're fixed for all passes.
+void survive_batch_gather(SurviveObjectSimulation *o,SurviveSensorBatch *b)
 {
-  vec3 N;
-  FLT s=sin(ang), c=cos(ang);
-  if (A==0) { // Sweeping across X axis
-    N=vec3(-c,-s,0.0);
-  } else { // Y axis sweep
-    N=vec3(0.0,-s,c);
+  int n=0;
+  for (int L=0;L<NUM_LIGHTHOUSES;L++)
+    for (int A=0;A<2;A++)
+    {
+      int g=L*2+A;
+      b->group_start[g]=n;
+      for (int S=0;S<SENSORS_PER_OBJECT;S++)
+      {
+        FLT a=o->sensor[S].angle[L][A];
+        if (a==0.0) continue;  // no data
+        if (a<-1.5 || a>1.5) throw "Invalid angle";
+        b->angle[n]=a;
+        vec3 p=o->hardware[S].position;
+        b->lx[n]=p.x; b->ly[n]=p.y; b->lz[n]=p.z;
+        n++;
+      }
+      
+      // Normals kernel: local plane normal is (-c,-s,0) sweeping X, (0,-s,c) sweeping Y
+      const SurviveObjectOrientation &R=o->lighthouse_orient[L];
+      float cx=(A==0)?-1.0f:0.0f, cz=(A==0)?0.0f:1.0f;
+      for (int i=b->group_start[g];i<n;i++) {
+        float s=sinf(b->angle[i]), c=cosf(b->angle[i]);
+        float Nx=cx*c, Ny=-s, Nz=cz*c;
+        b->nx[i]=Nx*R.x.x+Ny*R.y.x+Nz*R.z.x;
+        b->ny[i]=Nx*R.x.y+Ny*R.y.y+Nz*R.z.y;
+        b->nz[i]=Nx*R.x.z+Ny*R.y.z+Nz*R.z.z;
+      }
+      b->normal0[g]=survive_orient_global_from_local(&o->lighthouse_orient[L],vec3(cx,0.0,cz));
+    }
+  b->group_start[NUM_LIGHTHOUSES*2]=n;
+  b->n=n;
+}
+
+// Transform every sensor offset into global coordinates at once
+void survive_batch_transform(const SurviveObjectOrientation *orient,SurviveSensorBatch *b)
+{
+  const vec3 X=orient->x, Y=orient->y, Z=orient->z;
+  for (int i=0;i<b->n;i++) {
+    b->ox[i]=b->lx[i]*X.x+b->ly[i]*Y.x+b->lz[i]*Z.x;
+    b->oy[i]=b->lx[i]*X.y+b->ly[i]*Y.y+b->lz[i]*Z.y;
+    b->oz[i]=b->lx[i]*X.z+b->ly[i]*Y.z+b->lz[i]*Z.z;
   }
-  return survive_orient_global_from_local(&o->lighthouse_orient[L],N);
 }
 
-// Integrate the collected sensor sweep data
-void survive_sim_integrate(SurviveObjectSimulation *o) {
+/* Residual sums for one group of readings */
+struct SurviveBatchSums {
+  vec3 motion; // linear residual, global coordinates
+  vec3 torque; // rotational residual, global coordinates
+  float n_inlier;
+  float tot_err;
+};
+
+// Residuals kernel: compare readings [start,end) against the sweep plane
+//   of a lighthouse at LP, with the object's center at P.
+SurviveBatchSums survive_batch_residuals(SurviveSensorBatch *b,int start,int end,
+  vec3 P,vec3 LP,vec3 N0,float outlier_err)
+{
+  const float Dx=P.x-LP.x, Dy=P.y-LP.y, Dz=P.z-LP.z;
+  float mx=0,my=0,mz=0, tx=0,ty=0,tz=0, n_inlier=0, tot_err=0;
+#pragma omp simd reduction(+:mx,my,mz,tx,ty,tz,n_inlier,tot_err)
+  for (int i=start;i<end;i++) {
+    // Expected global sensed location E is at our origin plus the sensor offset.
+    //   Detected location is on the (LP,N) plane, so err=dot(E-LP,N)
+    float ex=Dx+b->ox[i], ey=Dy+b->oy[i], ez=Dz+b->oz[i];
+    float err=ex*b->nx[i]+ey*b->ny[i]+ez*b->nz[i];
+    float ferr=fabsf(err);
+    tot_err+=ferr;
+    float w=(ferr<outlier_err)?1.0f:0.0f; // include this point in the average?
+    n_inlier+=w;
+    b->inlier[i]=w;
+    
+    // Angular velocity estimate: radians
+    //    numerator is projection of sensor into LN plane
+    //    denominator is distance to sensor
+    b->predicted[i]=(ex*N0.x+ey*N0.y+ez*N0.z)/sqrtf(ex*ex+ey*ey+ez*ez);
+    
+    float c=-w*err; // correction=-err*N
+    float cx=c*b->nx[i], cy=c*b->ny[i], cz=c*b->nz[i];
+    mx+=cx; my+=cy; mz+=cz;
+    
+    // magnitude of torque cross product: |s||c|sin(angle)
+    //  Rotation required for correction: |c|/|s| radians
+    //  so divide by |s|^2
+    float sx=b->ox[i], sy=b->oy[i], sz=b->oz[i];
+    float scale=1.0f/(0.01f*0.01f+sx*sx+sy*sy+sz*sz);
+    tx+=(sy*cz-sz*cy)*scale;
+    ty+=(sz*cx-sx*cz)*scale;
+    tz+=(sx*cy-sy*cx)*scale;
+  }
+  SurviveBatchSums r;
+  r.motion=vec3(mx,my,mz);
+  r.torque=vec3(tx,ty,tz);
+  r.n_inlier=n_inlier;
+  r.tot_err=tot_err;
+  return r;
+}
+
+// Number of solver passes per integration step (VIVE_PASSES overrides)
+int survive_sim_passes(void) {
+  static int passes=getenv("VIVE_PASSES")?atoi(getenv("VIVE_PASSES")):10;
+  return passes>1?passes:1;
+}
+
+// Integrate the collected sensor sweep data.
+//   Returns true if the sweeps gave an optical position fix.
+bool survive_sim_integrate(SurviveObjectSimulation *o) {
   double now=time_in_seconds();
   double dt=now-o->last_integrate_time;
   o->last_integrate_time=now;
   
+  static SurviveSensorBatch batch;
+  survive_batch_gather(o,&batch);
   
   // Update predicted global position based on velocity
   vec3 nextP=o->position; // +dt*o->velocity;    //  (velocity is worse than useless)
   
   // Iteratively update position and orientation based on sensed angles
-  enum {NPASS=5};
+  const int NPASS=survive_sim_passes();
   float last_avg_err=10.0;
+  bool fix=false;
   for (int pass=0;pass<NPASS;pass++) {
     vec3 sum_motion=vec3(0.0); // linear residual, global coordinates
     float n_motion=0.0;
@@ -254,84 +391,44 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
     int n_lighthouse[NUM_LIGHTHOUSES]={0};
     
     float tot_err=0.0; int n_err=0; int n_outlier=0;
-    //if (pass==NPASS-1) printf("Per-sensor error (m): ");
+    
+    // Orientation may change between passes, so transform offsets here
+    survive_batch_transform(&o->orient,&batch);
+    
     for (int L=0;L<NUM_LIGHTHOUSES;L++)
       for (int A=0;A<2;A++)
       {
-#define ANGULAR_CHECK 1
-#if ANGULAR_CHECK
-      // Angular sweep speed check:
-      //   predicted = geometric predicted angles
-      //   sensed = observed angles
-        float all_predicted[SENSORS_PER_OBJECT];
-        float all_sensed[SENSORS_PER_OBJECT];
-        int n_sensed=0;
-#endif
-
-      // float sensor_err=0.0; int n_sensor=0;
-        for (int S=0;S<SENSORS_PER_OBJECT;S++)
-        {
-          FLT a=o->sensor[S].angle[L][A];
-          if (a==0.0) continue;  // no data
-          if (a<-1.5 || a>1.5) throw "Invalid angle";
-          
-          // Origin of sweep plane is at point where sweep axes cross:
-          vec3 LP=o->lighthouse_position[L];
-          // Normal of sweep plane
-          vec3 LN=survive_lighthouse_normal(o,L,A,a);
-           
-          // Expected global sensed location is at our origin plus the sensor position offset
-          vec3 sensor_offset=survive_orient_global_from_local(&o->orient,o->hardware[S].position);
-          vec3 E=nextP+sensor_offset;
-          
-          // Detected location is the projection D of E onto the (P,N) plane:
-          //  We want dot(D-LP,LN)=0
-          FLT err=dot(E-LP,LN);  
-          
-          float ferr=fabs(err);
-          tot_err+=ferr; n_err++; // sensor_err+=ferr; n_sensor++;
-          if (ferr<3.0*last_avg_err) 
-          { // Include this point in the average:
-            n_lighthouse[L]++;
-            
-            
-#if ANGULAR_CHECK
-            // Angular velocity estimate: radians
-            //    numerator is projection of sensor into LN plane
-            //    denominator is distance to sensor
-            float predicted=dot(E-LP,survive_lighthouse_normal(o,L,A,0.0))/length(E-LP);
-            all_predicted[n_sensed]=predicted;
-            all_sensed[n_sensed]=a;
-            // printf(" %2d sweep velocity: pred %.4f  sensed %.4f\n",S,predicted,a);
-            n_sensed++;
-#endif
-          
-            vec3 correction=-err*LN;
-            // vec3 D=E+correction; // actual location on sweep plane
-            
-            sum_motion+=correction;
-            n_motion+=1.0;
-            
-            vec3 torque=cross(sensor_offset,correction);
-            // magnitude of cross product: |s||c|sin(angle)
-            //  Rotation required for correction: |c|/|s| radians
-            //  so divide by |s|^2
-            torque*=1.0/(0.01*0.01+dot(sensor_offset,sensor_offset));
-            sum_torque+=torque;
-            n_torque+=1.0;
-            
-            // FLT speed=0.5; // m/s of position correction per sensor
-            // tracking+=speed*dt*correction; // move toward detected value
-            
-            // FLT sanity_check=dot(D-LP,LN); printf("Sanity check: D is off by %.5f meters\n",sanity_check);
-          }
-          else n_outlier++;
-        }
-      //if (pass==NPASS-1) if (sensor_err>0) printf("%.4f(%d)\t",sensor_err/n_sensor,n_sensor);
+        int start=batch.group_start[L*2+A], end=batch.group_start[L*2+A+1];
+        if (start==end) continue;
+        
+        SurviveBatchSums sums=survive_batch_residuals(&batch,start,end,
+          nextP,o->lighthouse_position[L],batch.normal0[L*2+A],3.0*last_avg_err);
+        
+        int n_inlier=(int)sums.n_inlier;
+        tot_err+=sums.tot_err; n_err+=end-start;
+        n_outlier+=end-start-n_inlier;
+        n_lighthouse[L]+=n_inlier;
+        sum_motion+=sums.motion;
+        n_motion+=n_inlier;
+        sum_torque+=sums.torque;
+        n_torque+=n_inlier;
 
+#define ANGULAR_CHECK 1
 #if ANGULAR_CHECK
-        if (n_sensed>=2 && pass>2) 
+        if (n_inlier>=2 && pass>2) 
         { // use angular ratio as distance estimate:
+          // Angular sweep speed check:
+          //   predicted = geometric predicted angles
+          //   sensed = observed angles
+          float all_predicted[SENSORS_PER_OBJECT];
+          float all_sensed[SENSORS_PER_OBJECT];
+          int n_sensed=0;
+          for (int i=start;i<end;i++)
+            if (batch.inlier[i]!=0.0f) {
+              all_predicted[n_sensed]=batch.predicted[i];
+              all_sensed[n_sensed]=batch.angle[i];
+              n_sensed++;
+            }
           
           // Find mean slope: radio of expected and actual angles
           float sum_slopes=0.0;
@@ -394,16 +491,17 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
         }
 #endif
     }
-    //if (pass==NPASS-1) printf("\n");
     vec3 motion=sum_motion*(1.0/n_motion);
     vec3 torque=sum_torque*(1.0/n_torque);
     
     float avg_err=tot_err/n_err;
     
-    printf("Pass %d: %d points, error %.4f meters, %d/%d visible, %d outliers removed\n",
-        pass,(int)n_motion,avg_err,n_lighthouse[0],n_lighthouse[1],n_outlier);
-    survive_vec3_print("    motion: ",motion);
-    survive_vec3_print("                     torque: ",torque);
+    if (pass==0 || pass==NPASS-1) { // first and last pass show convergence
+      printf("Pass %d: %d points, error %.4f meters, %d/%d visible, %d outliers removed\n",
+          pass,(int)n_motion,avg_err,n_lighthouse[0],n_lighthouse[1],n_outlier);
+      survive_vec3_print("    motion: ",motion);
+      survive_vec3_print("                     torque: ",torque);
+    }
     
     if (pass>0 && n_motion>0 && (n_lighthouse[0]>1 || n_lighthouse[1]>1) ) {
       // Apply position offset:
@@ -418,6 +516,7 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
       }
       
       nextP+=strength*motion;
+      fix=true;
     }
     
     // Wait until position is correct to apply torque:
@@ -436,6 +535,11 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
   FLT velfilter=10.0*dt;
   o->velocity=velfilter*nextV+(1.0-velfilter)*o->velocity;
   o->position=nextP;
+  if (fix) { // restart IMU dead reckoning from here
+    o->last_fix_time=now;
+    o->imu_offset=vec3(0,0,0);
+    o->imu_velocity=o->velocity;
+  }
   
   // Coarse distance updater:
   double tot_length=0; int n_lengths=0;
@@ -487,12 +591,15 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
         o->sensor[S].angle[L][A]=0.0;
         o->sensor[S].length[L][A]=0.0;
       }
-  
-  
-  // Create robot and sensor transforms, and publish them.
-  
-  SurviveObjectOrientation &basis=o->orient;
-  vec3 vive=o->position; // meters, relative to lighthouse 0
+  return fix;
+}
+
+// Create robot and sensor transforms for the current (IMU propagated) pose, and publish them.
+//   time_ns is the robot_time_ns() of the newest data.
+void survive_sim_publish(const SurviveObjectSimulation *o, int64_t time_ns, uint32_t imu_count, uint32_t fix_count)
+{
+  const SurviveObjectOrientation &basis=o->orient;
+  vec3 vive=o->position+o->imu_offset; // meters, relative to lighthouse 0
   vive*=100; // to cm
   vive.x-=75; // x==0 on centerline between the sensors
   vive.x+=378/2; // set X=0 to left edge of arena (driving coords, not centered)
@@ -532,6 +639,22 @@ void survive_sim_integrate(SurviveObjectSimulation *o) {
   
   static file_ipc_link<osl::transform> sensor_link("sensor.tf");
   sensor_link.publish(tf_sensor);
+  
+  vive_tracked_pose pose;
+  pose.robot=tf_robot;
+  pose.sensor=tf_sensor;
+  pose.time_ns=time_ns;
+  pose.fix_age=time_in_seconds()-o->last_fix_time;
+  pose.imu_count=imu_count;
+  pose.fix_count=fix_count;
+  static file_ipc_link<vive_tracked_pose> pose_link("vive.pose");
+  pose_link.publish(pose);
+  
+  // Same data over the network, for consumers on other machines
+  static network_ipc_publisher net;
+  net.publish("robot.tf",tf_robot,time_ns);
+  net.publish("sensor.tf",tf_sensor,time_ns);
+  net.publish("vive.pose",pose,time_ns);
 }
 // Dump important stuff to the screen:
 void survive_sim_print(SurviveObjectSimulation *o)
@@ -542,12 +665,10 @@ void survive_sim_print(SurviveObjectSimulation *o)
   survive_vec3_print("down",o->down);
 }
 
-// Update simulation for these IMU readings
-void survive_sim_imu(SurviveObjectSimulation *o, FLT * accelgyro)
+// Update simulation for these IMU readings, taken dt seconds after the last ones
+void survive_sim_imu(SurviveObjectSimulation *o, const FLT * accelgyro, double dt)
 {
-  double now=time_in_seconds();
-  double dt=now-o->last_imu_time;
-  o->last_imu_time=now;
+  o->last_imu_time=time_in_seconds();
   vec3 accel=vec3(accelgyro[0], accelgyro[2], accelgyro[1]);
   accel*=1.0/4140.0; // emperical scale factor to 1.0g 
   o->down=accel;
@@ -560,6 +681,18 @@ void survive_sim_imu(SurviveObjectSimulation *o, FLT * accelgyro)
   // Keep gravity's down vector pointing to global down
   survive_orient_nudge(&o->orient,
     o->down,vec3(0,0,-1.0), dt*2.0);
+  
+  // Dead reckon position until the next optical fix.
+  //   Accelerometer drift grows fast, so damp the velocity,
+  //   and hold still if the fixes stop coming.
+  const double max_reckon=0.25; // seconds after a fix to keep integrating
+  if (o->last_imu_time-o->last_fix_time<max_reckon) {
+    // accel reads gravity's direction at rest, so acceleration is gravity minus the reading
+    vec3 linear=9.81*(vec3(0,0,-1.0)-survive_orient_global_from_local(&o->orient,accel)); // m/s^2
+    const double damping=2.0; // 1/seconds
+    o->imu_velocity=(1.0-damping*dt)*o->imu_velocity+dt*linear;
+    o->imu_offset+=dt*o->imu_velocity;
+  }
 }
 
 
@@ -569,9 +702,63 @@ void survive_sim_imu(SurviveObjectSimulation *o, FLT * accelgyro)
 
 
 SurviveObjectSimulation *ww0=0;
+const char *ww0_codename="WW0"; // the libsurvive object ww0 tracks
 struct SurviveContext * ctx;
 const char *caldesc="Initializing...";
-int  quit = 0;
+std::atomic<int> quit(0); // set by the GUI or at exit, read by every thread
+
+// Guards ww0, which libsurvive's poll thread, the tracking thread, and the GUI all use
+std::mutex sim_lock;
+
+/* IMU readings, queued by libsurvive's poll thread for the tracking thread */
+struct SurviveImuSample {
+  FLT accelgyro[6];
+  double dt; // seconds since the previous sample (from the device timecode)
+  int64_t time_ns; // robot_time_ns() when it arrived
+};
+std::mutex imu_lock;
+std::condition_variable imu_ready;
+std::deque<SurviveImuSample> imu_queue;
+
+// Tracking thread: propagates the pose at IMU rate, runs the optical
+//   solver every fix_interval, and publishes after each step.
+void TrackingThread(void)
+{
+  const double fix_interval=0.01; // seconds between optical solves
+  double last_fix_attempt=time_in_seconds();
+  uint32_t imu_count=0, fix_count=0;
+  
+  while (!quit) {
+    SurviveImuSample sample;
+    bool have_sample=false;
+    {
+      std::unique_lock<std::mutex> guard(imu_lock);
+      if (imu_queue.empty()) // IMU-less trackers still get optical fixes
+        imu_ready.wait_for(guard,std::chrono::microseconds((int)(fix_interval*1.0e6)));
+      if (!imu_queue.empty()) {
+        sample=imu_queue.front();
+        imu_queue.pop_front();
+        have_sample=true;
+      }
+    }
+    
+    std::lock_guard<std::mutex> guard(sim_lock);
+    int64_t time_ns=robot_time_ns();
+    if (have_sample) {
+      survive_sim_imu(ww0,sample.accelgyro,sample.dt);
+      time_ns=sample.time_ns;
+      imu_count++;
+    }
+    double now=time_in_seconds();
+    if (now-last_fix_attempt>=fix_interval) {
+      last_fix_attempt=now;
+      if (survive_sim_integrate(ww0)) fix_count++;
+    }
+    else if (!have_sample) continue; // nothing new to publish
+    
+    survive_sim_publish(ww0,time_ns,imu_count,fix_count);
+  }
+}
 
 void HandleKey( int keycode, int bDown )
 {
@@ -658,7 +845,23 @@ void my_imu_process( struct SurviveObject * so, int mask, FLT * accelgyro_new, u
 {
 	survive_default_imu_process( so, mask, accelgyro, timecode, id );
 	
-	if (ww0) survive_sim_imu(ww0,accelgyro_new);
+	if (0==strcmp(so->codename,ww0_codename))
+	{ // hand off to the tracking thread (other devices' IMUs would corrupt ww0's dead reckoning)
+		static std::map<const struct SurviveObject *,uint32_t> last_timecodes; // device clocks aren't synchronized
+		std::map<const struct SurviveObject *,uint32_t>::iterator last=last_timecodes.find(so);
+		SurviveImuSample sample;
+		memcpy(sample.accelgyro,accelgyro_new,6*sizeof(FLT));
+		if (last==last_timecodes.end()) sample.dt=0.0; // first sample from this device
+		else sample.dt=(uint32_t)(timecode-last->second)/(double)(so->timebase_hz?so->timebase_hz:48000000);
+		if (sample.dt>0.05) sample.dt=0.05; // dropped samples
+		last_timecodes[so]=timecode;
+		sample.time_ns=robot_time_ns();
+		
+		std::lock_guard<std::mutex> guard(imu_lock);
+		if (imu_queue.size()>1000) imu_queue.pop_front(); // tracking thread is stalled
+		imu_queue.push_back(sample);
+		imu_ready.notify_one();
+	}
 	imu_updates++;
 	memcpy(accelgyro,accelgyro_new,6*sizeof(FLT));
 
@@ -693,12 +896,14 @@ void my_angle_process( struct SurviveObject * so, int sensor_id, int acode, uint
   else {
 	  if (angle==0) angle=0.00000001; //  <- 0 is sentinal value
 	  if (ww0) {
+	    std::lock_guard<std::mutex> guard(sim_lock);
 	    ww0->sensor[sensor_id].angle[lh][acode%2]=angle;
 	    ww0->sensor[sensor_id].length[lh][acode%2]=length;
 	  }
   }	
 	
-	if (1)
+	static bool print_rawangles=getenv("VIVE_RAWANGLES")!=0; // debug: log every angle
+	if (print_rawangles)
 	printf("RAWANGLES:  %d  %d  %d  %.5f %.3g\n",
 	  sensor_id, acode, lh, angle, length);
 
@@ -734,8 +939,13 @@ usleep(10*1000); // limit to 100fps
 		printf("\033[2J"); // seek to (0,0) and clear screen
 		
 	  if (ww0) {
-	    survive_sim_integrate(ww0);
-	    survive_sim_print(ww0);
+	    static SurviveObjectSimulation sim; // snapshot, so we don't hold up tracking while drawing
+	    {
+	      std::lock_guard<std::mutex> guard(sim_lock);
+	      sim=*ww0;
+	    }
+	    survive_sim_print(&sim);
+	    printf("optical fix age: %.3f s\n",time_in_seconds()-sim.last_fix_time);
 
 		  float scaleX=-screenx/5.0, scaleY=screeny/5.0;
 		  float offX=screenx+2.0*scaleX, offY=0;
@@ -743,10 +953,10 @@ usleep(10*1000); // limit to 100fps
 		  // Segments for tracked controller position
 		  for (int axis=0;axis<3;axis++) {
 		    CNFGColor(0x0000ff<<(8*axis));
-		    vec3 del=0.2*ww0->orient.x;
-		    if (axis==1) del=0.2*ww0->orient.y;
-		    if (axis==2) del=0.4*ww0->orient.z;
-		    vec3 S=ww0->position, E=ww0->position + del;
+		    vec3 del=0.2*sim.orient.x;
+		    if (axis==1) del=0.2*sim.orient.y;
+		    if (axis==2) del=0.4*sim.orient.z;
+		    vec3 S=sim.position+sim.imu_offset, E=S + del;
 		    
 		    CNFGTackSegment( S.x*scaleX+offX, S.y*scaleY+offY,
 		                     E.x*scaleX+offX, E.y*scaleY+offY);
@@ -845,7 +1055,7 @@ int main(int argc,char * const *argv)
 	  return 1;
 	}
 	
-	ww0=survive_sim_init("WW0");
+	ww0=survive_sim_init(ww0_codename);
 
 	uint8_t i =0;
 	for (i=0;i<MAX_SENSOR_NAME;++i) {
@@ -859,6 +1069,7 @@ int main(int argc,char * const *argv)
 
 	// survive_cal_install( ctx );
 
+	std::thread tracking_thread(TrackingThread);
 	OGCreateThread( GuiThread, 0 );
 	
 
@@ -873,6 +1084,8 @@ int main(int argc,char * const *argv)
 		//Do stuff.
 	}
 
+	quit = 1;
+	tracking_thread.join();
 	survive_close( ctx );
 
 	printf( "Returned\n" );